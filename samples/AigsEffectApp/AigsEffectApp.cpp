@@ -20,6 +20,7 @@
 # CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #
 ###############################################################################*/
+#include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
@@ -30,6 +31,7 @@
 #include <iostream>
 #include <vector>
 
+#include "FrameScheduler.h"
 #include "nvCVOpenCV.h"
 #include "nvVideoEffects.h"
 #include "opencv2/opencv.hpp"
@@ -67,9 +69,14 @@ bool        FLAG_show     = false;
 bool        FLAG_verbose  = false;
 bool        FLAG_webcam   = false;
 bool        FLAG_cudaGraph = false;
+bool        FLAG_segMotion = false;
+bool        FLAG_segReport = false;
 int         FLAG_compMode = 3 /*compWhite*/;
 int         FLAG_mode     = 0;
+int         FLAG_segInterval = 1;
 float       FLAG_blurStrength = 0.5;
+float       FLAG_latencyBudget = 0.f;
+float       FLAG_segThreshold = 3.f;
 std::string FLAG_camRes;
 std::string FLAG_codec    = DEFAULT_CODEC;
 std::string FLAG_inFile;
@@ -140,6 +147,8 @@ static void Usage() {
       "  --bg_file=<path>           background file for composition\n"
       "  --webcam                   use a webcam as input\n"
       "  --cam_res=[WWWx]HHH        specify resolution as height or width x height\n"
+      "  --latency_budget=<ms>      webcam frames that would exceed this glass-to-glass latency are dropped\n"
+      "                             (default 0: only drop frames that are superseded by newer ones)\n"
       "  --model_dir=<path>         the path to the directory that contains the models\n"
       "  --codec=<fourcc>           the FOURCC code for the desired codec (default " DEFAULT_CODEC ")\n"
       "  --show                     display the results in a window\n"
@@ -157,6 +166,13 @@ static void Usage() {
       "                               6 (blur the background of the image - compBlur) }\n"
       "  --blur_strength=[0-1]      strength of the background blur, when applicable\n"
       "  --cuda_graph               Enable cuda graph.\n"
+      "  --seg_interval=<k>         run the segmentation at least every k frames, holding the matte in between\n"
+      "                             (default 1: segment every frame)\n"
+      "  --seg_threshold=<diff>     rerun the segmentation early when the mean luma difference from the last\n"
+      "                             segmented frame exceeds this, in 8-bit code values (default 3)\n"
+      "  --seg_motion               compensate the held matte for global camera motion\n"
+      "  --seg_report               also segment every frame as a reference, and report the matte error of the\n"
+      "                             held frames against it\n"
   );
 }
 
@@ -176,7 +192,12 @@ static int ParseMyArgs(int argc, char **argv) {
                 GetFlagArgVal("cam_res", arg, &FLAG_camRes) || GetFlagArgVal("mode", arg, &FLAG_mode) ||
                 GetFlagArgVal("progress", arg, &FLAG_progress) || GetFlagArgVal("show", arg, &FLAG_show) ||
                 GetFlagArgVal("comp_mode", arg, &FLAG_compMode) || GetFlagArgVal("blur_strength", arg, &FLAG_blurStrength) ||
-                GetFlagArgVal("cuda_graph", arg, &FLAG_cudaGraph) )) {
+                GetFlagArgVal("cuda_graph", arg, &FLAG_cudaGraph) ||
+                GetFlagArgVal("latency_budget", arg, &FLAG_latencyBudget) ||
+                GetFlagArgVal("seg_interval", arg, &FLAG_segInterval) ||
+                GetFlagArgVal("seg_threshold", arg, &FLAG_segThreshold) ||
+                GetFlagArgVal("seg_motion", arg, &FLAG_segMotion) ||
+                GetFlagArgVal("seg_report", arg, &FLAG_segReport) )) {
       continue;
     } else if (GetFlagArgVal("help", arg, &help)) {
       return NVCV_ERR_HELP;
@@ -279,6 +300,82 @@ static int StringToFourcc(const std::string &str) {
   return x.i;
 }
 
+// Decides, frame by frame, whether the segmentation network needs to be run, or whether the matte from the last
+// segmented (key) frame can be held over. The decision is based on a cheap downsampled luma difference between the
+// current frame and the key frame; with motion compensation, the global translation between the two is estimated
+// first, so that a panning camera does not force a rerun, and the held matte is shifted to follow it.
+class MatteCadence {
+public:
+  MatteCadence() : runs(0), holds(0), _interval(1), _threshold(0.f), _motion(false), _sinceKey(0), _thumbScale(1.) {}
+
+  void init(int interval, float threshold, bool motion) {
+    _interval  = interval;
+    _threshold = threshold;
+    _motion    = motion;
+    _keyThumb.release();
+  }
+
+  // Returns true if the segmentation must be run on this frame.
+  bool needsRun(const cv::Mat &frame) {
+    makeThumb(frame, _curThumb);
+    _shift = cv::Point2d(0., 0.);
+    if (_keyThumb.empty() || ++_sinceKey >= _interval)
+      return true;
+    const cv::Mat *ref = &_keyThumb;
+    if (_motion) {
+      cv::Point2d s = cv::phaseCorrelate(_keyThumb, _curThumb);
+      _shift = s * _thumbScale;
+      cv::Mat M = (cv::Mat_<double>(2, 3) << 1., 0., s.x, 0., 1., s.y);
+      cv::warpAffine(_keyThumb, _warpedThumb, M, _keyThumb.size(), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+      ref = &_warpedThumb;
+    }
+    cv::absdiff(*ref, _curThumb, _diff);
+    return cv::mean(_diff)[0] > _threshold;
+  }
+
+  // Record that the segmentation was run on the frame last given to needsRun(), and produced this matte.
+  void keyed(const cv::Mat &matte) {
+    cv::swap(_keyThumb, _curThumb);
+    matte.copyTo(_keyMatte);
+    _sinceKey = 0;
+    ++runs;
+  }
+
+  // Produce the held matte for the frame last given to needsRun(). dst must already be allocated, and is reused.
+  void hold(cv::Mat &dst) {
+    if (_motion && (fabs(_shift.x) >= 0.5 || fabs(_shift.y) >= 0.5)) {
+      cv::Mat M = (cv::Mat_<double>(2, 3) << 1., 0., _shift.x, 0., 1., _shift.y);
+      cv::warpAffine(_keyMatte, dst, M, dst.size(), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+    } else {
+      _keyMatte.copyTo(dst);
+    }
+    ++holds;
+  }
+
+  unsigned long long runs, holds;
+
+private:
+  static const int kThumbWidth = 160;
+
+  void makeThumb(const cv::Mat &frame, cv::Mat &thumb) {
+    int tw = frame.cols < kThumbWidth ? frame.cols : kThumbWidth;
+    int th = (frame.rows * tw + frame.cols / 2) / frame.cols;
+    _thumbScale = (double)frame.cols / tw;
+    cv::resize(frame, _small, cv::Size(tw, th), 0, 0, cv::INTER_AREA);
+    cv::cvtColor(_small, _gray, cv::COLOR_BGR2GRAY);
+    _gray.convertTo(thumb, CV_32F);   // phaseCorrelate() requires floating point
+  }
+
+  int         _interval;
+  float       _threshold;
+  bool        _motion;
+  int         _sinceKey;
+  double      _thumbScale;
+  cv::Point2d _shift;       // Translation from the key frame to the current frame, in full resolution pixels
+  cv::Mat     _keyThumb, _curThumb, _warpedThumb, _diff, _small, _gray;
+  cv::Mat     _keyMatte;
+};
+
 struct FXApp {
   enum Err {
     errQuit = +1,                              // Application errors
@@ -718,9 +815,17 @@ FXApp::Err FXApp::processMovie(const char *inFile, const char *outFile) {
   unsigned frameNum;
   VideoInfo info;
   unsigned int modelBatch = 1;
+  RealtimeFrameScheduler scheduler;
+  bool live, runSeg;
+  MatteCadence cadence;
+  NvCVImage refNvVFXImage;   // Reference matte for --seg_report
+  cv::Mat refImg, errImg;
+  double sumAbsErr = 0., sumIoU = 0., minIoU = 1.;
+  unsigned long long numReported = 0;
 
   if (inFile && !inFile[0]) inFile = nullptr;  // Set file paths to NULL if zero length
   if (outFile && !outFile[0]) outFile = nullptr;
+  live = (inFile == nullptr);
 
   if (inFile) {
     reader.open(inFile);
@@ -813,35 +918,84 @@ FXApp::Err FXApp::processMovie(const char *inFile, const char *outFile) {
     BAIL_IF_ERR(vfxErr =
                     NvCVImage_Alloc(&_blurNvVFXImage, width, height, NVCV_BGR, NVCV_U8, NVCV_CHUNKY, NVCV_GPU, 1));
 
-  for (frameNum = 0; reader.read(_srcImg); ++frameNum) {
+  if (FLAG_segReport) {
+    if (_stateArray.size() < 2) {   // The reference needs its own temporal state, so as not to perturb the held run
+      printf("Error: --seg_report requires a second state object\n");
+      vfxErr = NVCV_ERR_GENERAL;
+      goto bail;
+    }
+    BAIL_IF_ERR(vfxErr =
+                    NvCVImage_Alloc(&refNvVFXImage, width, height, NVCV_A, NVCV_U8, NVCV_CHUNKY, NVCV_GPU, 1));
+    refImg.create(height, width, CV_8UC1);
+  }
+  cadence.init(FLAG_segInterval, FLAG_segThreshold, FLAG_segMotion);
+
+  // With a webcam, always process the newest frame rather than the oldest one buffered by the driver
+  if (live && !scheduler.start(&reader, FLAG_latencyBudget)) {
+    vfxErr = NVCV_ERR_READ;
+    goto bail;
+  }
+
+  for (frameNum = 0; live ? scheduler.acquire(_srcImg) : reader.read(_srcImg); ++frameNum) {
     if (_srcImg.empty()) printf("Frame %u is empty\n", frameNum);
 
-    _dstImg = cv::Mat::zeros(_srcImg.size(), CV_8UC1);  // TODO: Allocate and clear outside of the loop?
+    if (_dstImg.size() != _srcImg.size() || _dstImg.type() != CV_8UC1)  // The matte persists between frames
+      _dstImg = cv::Mat::zeros(_srcImg.size(), CV_8UC1);
     BAIL_IF_NULL(_dstImg.data, vfxErr, NVCV_ERR_MEMORY);
 
-    (void)NVWrapperForCVMat(&_srcImg, &_srcVFX);  // Ditto
+    (void)NVWrapperForCVMat(&_srcImg, &_srcVFX);  // The source may have been swapped by the scheduler
     (void)NVWrapperForCVMat(&_dstImg, &_dstVFX);
 
-    BAIL_IF_ERR(vfxErr = NvVFX_SetImage(_eff, NVVFX_INPUT_IMAGE, &_srcNvVFXImage));
-    BAIL_IF_ERR(vfxErr = NvVFX_SetImage(_eff, NVVFX_OUTPUT_IMAGE, &_dstNvVFXImage));
-    BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_srcVFX, &_srcNvVFXImage, 1.0f, _stream, NULL));
-
-    // Assign states from stateArray in batchOfStates
-    // There is only one stream in this app
-    _batchOfStates[0] = _stateArray[0];
-    BAIL_IF_ERR(vfxErr = NvVFX_SetStateObjectHandleArray(_eff, NVVFX_STATE, _batchOfStates));
-
-    auto startTime = std::chrono::high_resolution_clock::now();
-    BAIL_IF_ERR(vfxErr = NvVFX_Run(_eff, 0));
-    auto endTime = std::chrono::high_resolution_clock::now();
-    ms = std::chrono::duration<float, std::milli>(endTime - startTime).count();
-    _count += 1;
-    if (_count > 0) {
-      // skipping first frame
-      _total += ms;
+    runSeg = (FLAG_segInterval <= 1) || cadence.needsRun(_srcImg);
+    if (runSeg || _compMode == compBlur || FLAG_segReport)
+      BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_srcVFX, &_srcNvVFXImage, 1.0f, _stream, NULL));
+
+    if (runSeg) {
+      BAIL_IF_ERR(vfxErr = NvVFX_SetImage(_eff, NVVFX_INPUT_IMAGE, &_srcNvVFXImage));
+      BAIL_IF_ERR(vfxErr = NvVFX_SetImage(_eff, NVVFX_OUTPUT_IMAGE, &_dstNvVFXImage));
+
+      // Assign states from stateArray in batchOfStates
+      // There is only one stream in this app
+      _batchOfStates[0] = _stateArray[0];
+      BAIL_IF_ERR(vfxErr = NvVFX_SetStateObjectHandleArray(_eff, NVVFX_STATE, _batchOfStates));
+
+      auto startTime = std::chrono::high_resolution_clock::now();
+      BAIL_IF_ERR(vfxErr = NvVFX_Run(_eff, 0));
+      auto endTime = std::chrono::high_resolution_clock::now();
+      ms = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+      _count += 1;
+      if (_count > 0) {
+        // skipping first frame
+        _total += ms;
+      }
+
+      BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_dstNvVFXImage, &_dstVFX, 1.0f, _stream, NULL));
+      if (FLAG_segInterval > 1)
+        cadence.keyed(_dstImg);
+    } else {
+      cadence.hold(_dstImg);
+      if (_compMode == compBlur)  // The blur effect takes its matte from the GPU
+        BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_dstVFX, &_dstNvVFXImage, 1.0f, _stream, NULL));
     }
 
-    BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_dstNvVFXImage, &_dstVFX, 1.0f, _stream, NULL));
+    if (FLAG_segReport) {  // Segment every frame with a separate state, and compare it to the matte we are using
+      BAIL_IF_ERR(vfxErr = NvVFX_SetImage(_eff, NVVFX_INPUT_IMAGE, &_srcNvVFXImage));
+      BAIL_IF_ERR(vfxErr = NvVFX_SetImage(_eff, NVVFX_OUTPUT_IMAGE, &refNvVFXImage));
+      _batchOfStates[0] = _stateArray[1];
+      BAIL_IF_ERR(vfxErr = NvVFX_SetStateObjectHandleArray(_eff, NVVFX_STATE, _batchOfStates));
+      BAIL_IF_ERR(vfxErr = NvVFX_Run(_eff, 0));
+      NvCVImage refVFX;
+      (void)NVWrapperForCVMat(&refImg, &refVFX);
+      BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&refNvVFXImage, &refVFX, 1.0f, _stream, NULL));
+      cv::absdiff(_dstImg, refImg, errImg);
+      sumAbsErr += cv::mean(errImg)[0] * (1. / 255.);
+      int isect = cv::countNonZero((_dstImg > 127) & (refImg > 127));
+      int uni   = cv::countNonZero((_dstImg > 127) | (refImg > 127));
+      double iou = uni ? (double)isect / uni : 1.;
+      sumIoU += iou;
+      if (iou < minIoU) minIoU = iou;
+      ++numReported;
+    }
 
     result.create(_srcImg.rows, _srcImg.cols,
                   CV_8UC3);  // Make sure the result is allocated. TODO: allocate outsifde of the loop?
@@ -916,9 +1070,13 @@ FXApp::Err FXApp::processMovie(const char *inFile, const char *outFile) {
       writer.write(_dstImg);
 #endif  // WRITE_MATTE
     }
+    if (live && !_show)
+      scheduler.present();
     if (_show) {
       drawFrameRate(result);
       cv::imshow("Output", result);
+      if (live)
+        scheduler.present();
       int key = cv::waitKey(1);
       if (key > 0) {
         appErr = processKey(key);
@@ -933,10 +1091,21 @@ FXApp::Err FXApp::processMovie(const char *inFile, const char *outFile) {
   }
 
   if (_progress) fprintf(stderr, "\n");
+  if (live) {
+    scheduler.stop();
+    scheduler.printStats(stdout);
+  }
+  if (FLAG_segInterval > 1)
+    printf("Segmentation ran on %llu of %llu frames (%.1f%% held)\n", cadence.runs, cadence.runs + cadence.holds,
+           (cadence.runs + cadence.holds) ? 100. * cadence.holds / (cadence.runs + cadence.holds) : 0.);
+  if (numReported)
+    printf("Matte vs per-frame segmentation over %llu frames: mean abs error %.4f, mean IoU %.4f, min IoU %.4f\n",
+           numReported, sumAbsErr / numReported, sumIoU / numReported, minIoU);
   reader.release();
   if (outFile) writer.release();
 bail:
   // Dealloc
+  NvCVImage_Dealloc(&refNvVFXImage);
   NvCVImage_Dealloc(&(_srcNvVFXImage));  // This is also called in the destructor, ...
   NvCVImage_Dealloc(&(_dstNvVFXImage));  // ... so is not necessary except in C code.
   NvCVImage_Dealloc(&(_blurNvVFXImage));
@@ -1014,6 +1183,8 @@ int main(int argc, char **argv) {
     Usage();
     fxErr = FXApp::errFlag;
   } else {
+    if (FLAG_segReport)
+      app._maxNumberStreams = 2u;  // One more state for the per-frame reference segmentation
     fxErr = app.appErrFromVfxStatus(app.createAigsEffect());
     if (FXApp::errNone == fxErr) {
       if (IsImageFile(FLAG_inFile.c_str()))
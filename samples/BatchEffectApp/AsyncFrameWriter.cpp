@@ -0,0 +1,169 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include "AsyncFrameWriter.h"
+#include "nvCVOpenCV.h"
+
+
+void AsyncFrameWriter::start(std::vector<cv::VideoWriter>& writers, unsigned numBuffers) {
+  close();
+  _streams.clear();
+  _buffers.clear();
+  _free.clear();
+  _written = _stalls = 0;
+  for (unsigned i = 0; i < (numBuffers ? numBuffers : 1); ++i) {
+    _buffers.push_back(std::unique_ptr<NvCVImage>(new NvCVImage));
+    _free.push_back(_buffers.back().get());
+  }
+  for (cv::VideoWriter& writer : writers) {
+    _streams.push_back(std::unique_ptr<Stream>(new Stream));
+    _streams.back()->writer   = &writer;
+    _streams.back()->next.path.clear();
+    _streams.back()->finished = false;
+    _streams.back()->failed   = false;
+  }
+  for (auto& s : _streams)
+    s->thread = std::thread(&AsyncFrameWriter::encodeLoop, this, s.get());
+}
+
+NvCV_Status AsyncFrameWriter::acquire(unsigned width, unsigned height, NvCVImage_PixelFormat format, NvCVImage **buf) {
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_free.empty()) {
+      ++_stalls;
+      _freeCond.wait(lock, [this] { return !_free.empty(); });
+    }
+    *buf = _free.back();
+    _free.pop_back();
+  }
+  NvCV_Status err = NvCVImage_Realloc(*buf, width, height, format, NVCV_U8, NVCV_CHUNKY, NVCV_CPU_PINNED, 0);
+  if (NVCV_SUCCESS != err) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _free.push_back(*buf);
+    *buf = nullptr;
+  }
+  return err;
+}
+
+void AsyncFrameWriter::submit(unsigned stream, NvCVImage *buf, const cv::Rect& roi) {
+  Job job;
+  job.buf = buf;
+  job.roi = roi;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _streams[stream]->queue.push_back(job);
+  }
+  _streams[stream]->cond.notify_one();
+}
+
+void AsyncFrameWriter::split(unsigned stream, const std::string& path, int fourcc, double fps, const cv::Size& size,
+                             const std::function<void()>& done) {
+  Job job;
+  job.buf    = nullptr;
+  job.path   = path;
+  job.fourcc = fourcc;
+  job.fps    = fps;
+  job.size   = size;
+  job.done   = done;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_streams[stream]->finished)
+      return;
+    _streams[stream]->queue.push_back(job);
+  }
+  _streams[stream]->cond.notify_one();
+}
+
+void AsyncFrameWriter::finish(unsigned stream, const std::function<void()>& done) {
+  Job job;
+  job.buf  = nullptr;
+  job.done = done;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_streams[stream]->finished)
+      return;
+    _streams[stream]->finished = true;
+    _streams[stream]->queue.push_back(job);
+  }
+  _streams[stream]->cond.notify_one();
+}
+
+bool AsyncFrameWriter::failed(unsigned stream) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return stream < _streams.size() && _streams[stream]->failed;  // Not started is not failed
+}
+
+void AsyncFrameWriter::close() {
+  for (unsigned i = 0; i < _streams.size(); ++i)
+    finish(i);
+  for (auto& s : _streams)
+    if (s->thread.joinable())
+      s->thread.join();
+}
+
+void AsyncFrameWriter::encodeLoop(Stream *s) {
+  cv::Mat frame;
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      s->cond.wait(lock, [s] { return !s->queue.empty(); });
+      job = s->queue.front();
+      s->queue.pop_front();
+    }
+    if (!job.buf) {
+      s->writer->release();
+      if (job.done && !s->failed)   // Nothing past a failure may be recorded as written, e.g. by a checkpoint
+        job.done();
+      if (job.path.empty())
+        break;
+      if (!s->failed)
+        s->next = job;
+      continue;
+    }
+    if (!s->next.path.empty()) {
+      if (!s->writer->open(s->next.path, s->next.fourcc, s->next.fps, s->next.size)) {
+        printf("Cannot open \"%s\"\n", s->next.path.c_str());
+        std::lock_guard<std::mutex> lock(_mutex);
+        s->failed = true;
+      }
+      s->next.path.clear();
+    }
+    if (!s->failed) {
+      CVWrapperForNvCVImage(job.buf, &frame);
+      *s->writer << frame(job.roi);
+    }
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _free.push_back(job.buf);
+      ++_written;
+    }
+    _freeCond.notify_one();
+  }
+}
+
+void AsyncFrameWriter::printStats(FILE *fp) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  fprintf(fp, "Encoded %llu frames on %zu threads with %zu buffers; waited for a buffer %llu times\n",
+    _written, _streams.size(), _buffers.size(), _stalls);
+}
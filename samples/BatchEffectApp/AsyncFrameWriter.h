@@ -0,0 +1,130 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __ASYNC_FRAME_WRITER_H__
+#define __ASYNC_FRAME_WRITER_H__
+
+#include <stdio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nvCVImage.h"
+#include "opencv2/opencv.hpp"
+
+//! Encode the outputs of a batch app on one thread per output video, so that encoding overlaps the next batch.
+//! Results are downloaded into host buffers from a recycled pool of pinned buffers, which are queued to the encoder
+//! of their stream and returned to the pool once written. Each stream's frames are written in the order submitted.
+class AsyncFrameWriter {
+public:
+  AsyncFrameWriter() : _written(0), _stalls(0) {}
+  ~AsyncFrameWriter() { close(); }
+
+  //! Start an encoder thread for each writer.
+  //! Until close() returns, the writers must only be used through this object.
+  //! \param[in]  writers     the opened writers, one per stream.
+  //! \param[in]  numBuffers  the number of host buffers in the pool; more allows the encoders to fall further behind.
+  void start(std::vector<cv::VideoWriter>& writers, unsigned numBuffers);
+
+  //! Get a free host buffer, waiting for an encoder to return one if necessary.
+  //! Buffers are reallocated only if they are too small.
+  //! \param[in]  width   the width of the buffer.
+  //! \param[in]  height  the height of the buffer.
+  //! \param[in]  format  the pixel format of the buffer, of U8 chunky components.
+  //! \param[out] buf     the buffer, which must be passed to submit().
+  //! \return     NVCV_SUCCESS, or NVCV_ERR_MEMORY if the buffer could not be allocated.
+  NvCV_Status acquire(unsigned width, unsigned height, NvCVImage_PixelFormat format, NvCVImage **buf);
+
+  //! Queue a buffer for encoding. Any asynchronous transfer into it must have completed.
+  //! \param[in]  stream  the index of the writer.
+  //! \param[in]  buf     the buffer from acquire().
+  //! \param[in]  roi     the region of the buffer to write.
+  void submit(unsigned stream, NvCVImage *buf, const cv::Rect& roi);
+
+  //! Finalize the file of a stream once its queued frames have been written, and continue the stream in a new file,
+  //! which is opened when its first frame is written, so that a stream that ends here leaves no empty file.
+  //! \param[in]  stream  the index of the writer.
+  //! \param[in]  path    the path of the new file.
+  //! \param[in]  fourcc  the codec of the new file.
+  //! \param[in]  fps     the frame rate of the new file.
+  //! \param[in]  size    the frame size of the new file.
+  //! \param[in]  done    if not empty, called on the encoder thread once the previous file has been finalized,
+  //!                     unless a file of the stream has failed to open.
+  void split(unsigned stream, const std::string& path, int fourcc, double fps, const cv::Size& size,
+             const std::function<void()>& done);
+
+  //! Release the writer of a stream once its queued frames have been written, finalizing the file.
+  //! \param[in]  stream  the index of the writer.
+  //! \param[in]  done    if not empty, called on the encoder thread once the file has been finalized,
+  //!                     unless a file of the stream has failed to open.
+  void finish(unsigned stream, const std::function<void()>& done = std::function<void()>());
+
+  //! Whether a file of a stream failed to open when split. The frames from then on are dropped, and no more files
+  //! are opened nor done callbacks called for the stream, so that nothing records those frames as written.
+  //! \param[in]  stream  the index of the writer.
+  //! \return     true if the stream has failed.
+  bool failed(unsigned stream);
+
+  //! Finish all streams, wait for the encoders and join their threads. This is called by the destructor.
+  void close();
+
+  //! Print the number of frames written, and the number of times that acquire() had to wait for an encoder.
+  void printStats(FILE *fp);
+
+private:
+  struct Job {
+    NvCVImage             *buf;   // NULL to split the stream if path is set, or to finish it
+    cv::Rect              roi;
+    std::string           path;   // The next file of the stream
+    int                   fourcc;
+    double                fps;
+    cv::Size              size;
+    std::function<void()> done;
+  };
+  struct Stream {
+    cv::VideoWriter         *writer;
+    std::deque<Job>         queue;
+    Job                     next;       // The file to open for the next frame, if its path is set
+    bool                    finished;
+    bool                    failed;     // A file failed to open
+    std::condition_variable cond;
+    std::thread             thread;
+  };
+
+  void encodeLoop(Stream *s);
+
+  std::vector<std::unique_ptr<Stream> >     _streams;
+  std::vector<std::unique_ptr<NvCVImage> >  _buffers;
+  std::vector<NvCVImage*>                   _free;
+  unsigned long long                        _written, _stalls;
+  std::mutex                                _mutex;
+  std::condition_variable                   _freeCond;
+};
+
+#endif // __ASYNC_FRAME_WRITER_H__
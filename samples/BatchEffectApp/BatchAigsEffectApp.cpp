@@ -21,11 +21,19 @@
 #
 ###############################################################################*/
 
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <cuda_runtime_api.h>
+#include "AsyncFrameWriter.h"
 #include "BatchUtilities.h"
+#include "FramePrefetcher.h"
+#include "ShardManager.h"
+#include "StatefulBatcher.h"
 #include "nvCVOpenCV.h"
 #include "nvVideoEffects.h"
 #include "opencv2/opencv.hpp"
@@ -46,8 +54,16 @@
 #endif // _WIN32
 
 bool                      FLAG_verbose        = false;
-int                       FLAG_mode           = 0;
+int                       FLAG_mode           = 0,
+                          FLAG_batch          = 8,
+                          FLAG_maxStreams     = 0,
+                          FLAG_prefetch       = 4;
+float                     FLAG_maxWait        = 10.f,
+                          FLAG_aging          = 100.f;
 std::string               FLAG_outFile,
+                          FLAG_gpus,
+                          FLAG_priority,
+                          FLAG_deadline,
                           FLAG_modelDir,
                           FLAG_codec          = DEFAULT_CODEC;
 std::vector<const char*>  FLAG_inFiles;
@@ -114,6 +130,43 @@ static bool GetFlagArgVal(const char *flag, const char *arg, int *val) {
   return success;
 }
 
+static bool GetFlagArgVal(const char *flag, const char *arg, float *val) {
+  const char *valStr;
+  bool success = GetFlagArgVal(flag, arg, &valStr);
+  if (success)
+    *val = strtof(valStr, NULL);
+  return success;
+}
+
+// Get the i-th of a comma-separated list of numbers; the last one applies to the rest. An empty list gives defVal.
+static float ListVal(const std::string &list, unsigned i, float defVal) {
+  const char *s = list.c_str();
+  float val = defVal;
+  while (*s) {
+    char *end;
+    val = strtof(s, &end);
+    if (!i-- || *end != ',')
+      break;
+    s = end + 1;
+  }
+  return val;
+}
+
+// Parse a comma-separated list of integers.
+static std::vector<int> IntList(const std::string &list) {
+  std::vector<int> vals;
+  const char *s = list.c_str();
+  while (*s) {
+    char *end;
+    long val = strtol(s, &end, 10);
+    if (end == s)
+      break;
+    vals.push_back((int)val);
+    s = (*end == ',') ? end + 1 : end;
+  }
+  return vals;
+}
+
 static int StringToFourcc(const std::string &str) {
   union chint {
     int i;
@@ -131,6 +184,19 @@ static void Usage() {
     "  --out_file=<path>     output video files to be written (a pattern with one %%u or %%d), default \"BatchOut_%%02u.mp4\"\n"
     "  --model_dir=<path>    the path to the directory that contains the models\n"
     "  --mode=<value>        which model to pick for processing (default: 0)\n"
+    "  --batch=<n>           the largest number of frames to run together (default: 8)\n"
+    "  --max_wait=<ms>       the longest time that a frame waits for a batch to fill up (default: 10)\n"
+    "  --prefetch=<n>        the number of frames of each video to decode ahead, into pinned memory (default: 4)\n"
+    "  --max_streams=<n>     the number of videos processed concurrently; the others join as these finish\n"
+    "                        (default: all of them)\n"
+    "  --priority=<p,...>    the priority class of each video, 0 being the most urgent; the last value applies to\n"
+    "                        the rest (default: 0)\n"
+    "  --deadline=<ms,...>   the latency within which each frame of each video should be completed, e.g. for live\n"
+    "                        streams; 0 for none. The last value applies to the rest (default: 0)\n"
+    "  --gpus=<i,...>        the GPUs to shard the videos across, each with its own instance of the effect; videos are\n"
+    "                        placed on the least loaded GPU, and moved off a saturated one (default: the current GPU)\n"
+    "  --aging=<ms>          promote a waiting frame one priority class every this many ms, so that no class\n"
+    "                        starves (default: 100; 0 disables)\n"
     "  --verbose             verbose output\n"
     "  --codec=<fourcc>      the fourcc code for the desired codec (default " DEFAULT_CODEC ")\n"
     "  and inFile1 ... are identically sized video files\n"
@@ -146,6 +212,14 @@ static int ParseMyArgs(int argc, char **argv) {
       if (arg[1] == '-') {                                      // double-dash
         if (GetFlagArgVal("verbose",    arg, &FLAG_verbose)   ||
             GetFlagArgVal("mode",       arg, &FLAG_mode)      ||
+            GetFlagArgVal("batch",      arg, &FLAG_batch)     ||
+            GetFlagArgVal("max_wait",   arg, &FLAG_maxWait)   ||
+            GetFlagArgVal("prefetch",   arg, &FLAG_prefetch)  ||
+            GetFlagArgVal("max_streams", arg, &FLAG_maxStreams) ||
+            GetFlagArgVal("priority",   arg, &FLAG_priority)  ||
+            GetFlagArgVal("deadline",   arg, &FLAG_deadline)  ||
+            GetFlagArgVal("aging",      arg, &FLAG_aging)     ||
+            GetFlagArgVal("gpus",       arg, &FLAG_gpus)      ||
             GetFlagArgVal("model_dir",  arg, &FLAG_modelDir)  ||
             GetFlagArgVal("out_file",   arg, &FLAG_outFile)   ||
             GetFlagArgVal("codec",      arg, &FLAG_codec)
@@ -188,11 +262,16 @@ public:
     NvVFX_DestroyEffect(_eff); if (_stream) NvVFX_CudaStreamDestroy(_stream);
   }
 
-  NvCV_Status init(const char* effectName, unsigned batchSize, unsigned int mode, const NvCVImage *srcImg) {
+  // If a gpu is given, the effect and its buffers are placed on it; otherwise they are placed on the current device.
+  NvCV_Status init(const char* effectName, unsigned batchSize, unsigned int mode, const NvCVImage *srcImg, int gpu = -1) {
     NvCV_Status err = NVCV_ERR_UNIMPLEMENTED;
  
     _batchSize = batchSize;
+    if (gpu >= 0)
+      BAIL_IF_FALSE(cudaSuccess == cudaSetDevice(gpu), err, NVCV_ERR_CUDA);  // For the buffers and the stream
     BAIL_IF_ERR(err = NvVFX_CreateEffect(effectName, &_eff));
+    if (gpu >= 0)
+      BAIL_IF_ERR(err = NvVFX_SetU32(_eff, NVVFX_GPU, (unsigned)gpu));
 
     BAIL_IF_ERR(err = AllocateBatchBuffer(&_src, _batchSize, srcImg->width, srcImg->height, NVCV_BGR, NVCV_U8, NVCV_CHUNKY, NVCV_GPU, 1));
     BAIL_IF_ERR(err = AllocateBatchBuffer(&_dst, _batchSize, srcImg->width, srcImg->height, NVCV_A, NVCV_U8, NVCV_CHUNKY, NVCV_GPU, 1));
@@ -214,26 +293,197 @@ public:
 };
 
 
+// One instance of the effect per GPU, with its own CUDA stream, state pool and batcher, driven by its own thread.
+struct Shard {
+  unsigned          index;
+  int               gpu;        // -1 for the current device
+  App               app;
+  StateObjectPool   statePool;  // Declared before the batcher, which releases its states into it
+  StatefulBatcher   batcher;
+  std::thread       thread;
+  NvCV_Status       err;
+};
+
+// What the readers and the shards share.
+struct Pipeline {
+  std::vector<std::unique_ptr<Shard> >            shards;
+  ShardManager                                    manager;
+  std::vector<std::unique_ptr<PinnedFrameRing> >  rings;        // One per video
+  AsyncFrameWriter                                *frameWriter;
+  std::atomic<unsigned>                           numReaders;
+  unsigned                                        dstHeight;
+
+  void close(bool abort) {    // Stop accepting streams; if aborting, also unblock the readers and drop their frames
+    for (auto& shard : shards)
+      shard->batcher.close(abort);
+    if (abort) {
+      manager.close();
+      for (auto& ring : rings)
+        ring->abort();
+    }
+  }
+};
+
+
+// Read one video, joining the batcher of the shard that the manager places it on, and leaving at the end of the video.
+// If the manager moves the video to another shard, it leaves and rejoins once the first shard has run all of its frames,
+// so that its frames stay in order; the effect state starts afresh on the new shard.
+// The stream is scheduled by the --priority and --deadline of the video.
+// A video that cannot be batched with the others is abandoned without affecting them.
+// Frames are decoded directly into the pinned ring of the video, and the batcher carries a view of each;
+// the consumer takes and releases the ring slots in the same order.
+// The last reader to finish closes the batchers.
+static void ReadStream(Pipeline *pipe, cv::VideoCapture *cap, unsigned videoIdx, const char *fileName,
+                       int width, int height, float weight) {
+  PinnedFrameRing *ring     = pipe->rings[videoIdx].get();
+  unsigned        priority  = (unsigned)ListVal(FLAG_priority, videoIdx, 0.f), to;
+  float           deadline  = ListVal(FLAG_deadline, videoIdx, 0.f);
+  StatefulBatcher *batcher  = nullptr;
+  int             stream    = -1, device;
+  cv::Mat         frame;
+
+  if ((device = pipe->manager.place(videoIdx, weight)) >= 0) {
+    batcher = &pipe->shards[device]->batcher;
+    stream  = batcher->join(videoIdx, priority, deadline);
+  }
+  while (stream >= 0) {
+    if (pipe->manager.moving(videoIdx, &to)) {    // Hand the video over to a less loaded shard
+      batcher->leave((unsigned)stream);
+      stream = -1;
+      if (!pipe->manager.waitDrained(videoIdx))
+        break;
+      batcher = &pipe->shards[to]->batcher;
+      if ((stream = batcher->join(videoIdx, priority, deadline)) < 0)
+        break;
+    }
+    NvCVImage *slot = ring->beginWrite();
+    if (!slot)
+      break;
+    CVWrapperForNvCVImage(slot, &frame);
+    if (!cap->read(frame) || frame.empty()) {
+      ring->cancelWrite();
+      break;
+    }
+    if (frame.data != slot->pixels) {   // OpenCV reallocated, because the size differs
+      printf("Input video file \"%s\" %dx%d does not match %dx%d\n"
+             "Batching requires all video frames to be of the same size\n", fileName, frame.cols, frame.rows, width, height);
+      ring->cancelWrite();
+      break;
+    }
+    ring->endWrite();
+    if (!batcher->submit((unsigned)stream, frame))
+      break;
+  }
+  if (stream >= 0)
+    batcher->leave((unsigned)stream);
+  pipe->manager.remove(videoIdx);
+  if (0 == --pipe->numReaders)
+    pipe->close(false);
+}
+
+
+// Run the batches of one shard until its batcher is closed and drained, reporting the load of each to the manager.
+static void RunShard(Pipeline *pipe, Shard *shard) {
+  typedef std::chrono::high_resolution_clock Clock;
+  NvCV_Status                         err   = NVCV_SUCCESS;
+  App&                                app   = shard->app;
+  std::vector<StatefulBatcher::Entry> batch;
+  std::vector<unsigned>               finished;
+  std::vector<NvCVImage*>             outFrames(app._batchSize);
+  Clock::time_point                   t0, t1;
+  float                               work;
+
+  if (shard->gpu >= 0)
+    BAIL_IF_FALSE(cudaSuccess == cudaSetDevice(shard->gpu), err, NVCV_ERR_CUDA);
+  for (;;) {
+    t0 = Clock::now();
+    BAIL_IF_ERR(err = shard->batcher.gather(&batch, &finished));
+    for (unsigned idx : finished) {
+      if (pipe->manager.isMoving(idx))
+        pipe->manager.drained(idx);                 // The video continues on another shard
+      else
+        pipe->frameWriter->finish(idx);             // Finalize each output as soon as its stream has finished
+    }
+    if (batch.empty()) {
+      if (finished.empty())
+        break;
+      continue;
+    }
+    t1 = Clock::now();
+
+    for (unsigned int i = 0; i < batch.size(); i++) {
+      NvCVImage *src = pipe->rings[batch[i].tag]->take();   // The pinned frame that batch[i].frame views
+      BAIL_IF_ERR(err = TransferToNthImage(i, src, &app._src, 1.f, app._stream, NULL));
+    }
+
+    // Run batch
+    BAIL_IF_ERR(err = NvVFX_SetU32(app._eff, NVVFX_BATCH_SIZE, (unsigned)batch.size()));  // The batchSize can change every Run
+    BAIL_IF_ERR(err = NvVFX_SetStateObjectHandleArray(app._eff, NVVFX_STATE, shard->batcher.states()));  // The batch of states can change every Run
+    BAIL_IF_ERR(err = NvVFX_Run(app._eff, 0));
+
+    // Download all of the mattes asynchronously into pinned buffers, then hand them to the encoders
+    for (unsigned int i = 0; i < batch.size(); ++i) {
+      BAIL_IF_ERR(err = pipe->frameWriter->acquire(app._dst.width, pipe->dstHeight, NVCV_A, &outFrames[i]));
+      BAIL_IF_ERR(err = TransferFromNthImage(i, &app._dst, outFrames[i], 1.0f, app._stream, NULL));
+    }
+    BAIL_IF_FALSE(cudaSuccess == cudaStreamSynchronize((cudaStream_t)app._stream), err, NVCV_ERR_CUDA);
+    for (unsigned int i = 0; i < batch.size(); ++i) {
+      pipe->frameWriter->submit(batch[i].tag, outFrames[i], cv::Rect(0, 0, app._dst.width, pipe->dstHeight));
+      pipe->rings[batch[i].tag]->release();   // The upload has completed too
+    }
+    shard->batcher.complete(batch);           // Account the latency of each frame against its deadline
+    work = (float)batch.size() * batch[0].frame.cols * batch[0].frame.rows;
+    pipe->manager.report(shard->index, work, std::chrono::duration<float, std::milli>(Clock::now() - t1).count(),
+                         std::chrono::duration<float, std::milli>(t1 - t0).count());
+    // NvCVImage_Dealloc() is called in the destructors
+  }
+bail:
+  shard->err = err;
+  if (NVCV_SUCCESS != err)
+    pipe->close(true);    // Stop everything, as a single instance would
+}
+
+
 NvCV_Status BatchProcess(const char* effectName, unsigned int mode,
   const std::vector<const char*>& srcVideos, const char *outfilePattern, std::string codec) {
   NvCV_Status err       = NVCV_SUCCESS;
-  App         app;
-  cv::Mat     ocv1, ocv2;
-  NvCVImage   nvx1, nvx2;
-  unsigned    srcWidth, srcHeight, dstHeight;
-
-  std::vector<NvVFX_StateObjectHandle> arrayOfStates;
-  NvVFX_StateObjectHandle* batchOfStates = nullptr;
+  cv::Mat     ocv1;
+  NvCVImage   nvx1;
+  unsigned    srcWidth, srcHeight, batchSize, modelBatch, maxStreams, shardStreams, numShards;
+  int         numDevices = 0;
+  Pipeline                              pipe;
+  std::vector<int>                      gpus = IntList(FLAG_gpus);
+  std::vector<float>                    weights;
+  std::vector<std::thread>              readers;
 
   unsigned int numOfVideoStreams = static_cast<unsigned int>(srcVideos.size());
 
-  // If valid states are passed for inference, then -
-  // 1. Effect can only process a batch which is equal to maximum number of video streams
-  // 2. Multiple frames from the same video stream should not be present in the same batch
-  unsigned batchSize = numOfVideoStreams;
+  // Frames are gathered from whichever videos have one ready, at most one per video in each batch,
+  // since each batch entry is paired with the state of its stream.
+  // The concurrent videos are divided among the shards, one per GPU.
+  if (gpus.empty())
+    gpus.push_back(-1);   // The current device
+  numShards  = (unsigned)gpus.size();
+  batchSize  = (FLAG_batch > 0) ? (unsigned)FLAG_batch : 1;
+  maxStreams = (FLAG_maxStreams > 0 && (unsigned)FLAG_maxStreams < numOfVideoStreams) ? (unsigned)FLAG_maxStreams
+                                                                                      : numOfVideoStreams;
+  shardStreams = (maxStreams + numShards - 1) / numShards;
+  if (batchSize > shardStreams)
+    batchSize = shardStreams;   // Larger batches could never be filled
 
   std::vector<cv::VideoCapture> srcCaptures(numOfVideoStreams);
   std::vector<cv::VideoWriter> dstWriters(numOfVideoStreams);
+  AsyncFrameWriter frameWriter;   // Declared after the writers that it encodes to
+  pipe.frameWriter = &frameWriter;
+  if (numShards > 1 || gpus[0] >= 0) {
+    BAIL_IF_FALSE(cudaSuccess == cudaGetDeviceCount(&numDevices), err, NVCV_ERR_CUDA);
+    for (int gpu : gpus) {
+      if (gpu < 0 || gpu >= numDevices) {
+        printf("There is no GPU %d; there are %d\n", gpu, numDevices);
+        BAIL(err, NVCV_ERR_PARAMETER);
+      }
+    }
+  }
   for (unsigned int i = 0; i < numOfVideoStreams; i++) {
     srcCaptures[i].open(srcVideos[i]);
     if (srcCaptures[i].isOpened()==false)  BAIL(err, NVCV_ERR_READ);
@@ -243,6 +493,7 @@ NvCV_Status BatchProcess(const char* effectName, unsigned int mode,
     width = (int)srcCaptures[i].get(cv::CAP_PROP_FRAME_WIDTH);
     height = (int)srcCaptures[i].get(cv::CAP_PROP_FRAME_HEIGHT);
     fps = srcCaptures[i].get(cv::CAP_PROP_FPS);
+    weights.push_back((float)width * height * (float)(fps > 0. ? fps : 30.) * 1e-3f);  // Pixels per ms
 
     const int fourcc = StringToFourcc(codec);
     char fileName[1024];
@@ -263,71 +514,72 @@ NvCV_Status BatchProcess(const char* effectName, unsigned int mode,
   srcWidth  = nvx1.width;
   srcHeight = nvx1.height;
 
-  BAIL_IF_ERR(err = app.init(effectName, batchSize, mode, &nvx1)); // Init effect and buffers
-  BAIL_IF_ERR(err = NvVFX_SetU32(app._eff, NVVFX_MAX_NUMBER_STREAMS, numOfVideoStreams));
-  BAIL_IF_ERR(err = NvVFX_SetU32(app._eff, NVVFX_MODEL_BATCH, numOfVideoStreams>1?8:1));
-  BAIL_IF_ERR(err = NvVFX_Load(app._eff));
-
-  // Creating state objects, one per stream.
+  for (unsigned int i = 0; i < numShards; i++) {
+    pipe.shards.push_back(std::unique_ptr<Shard>(new Shard));
+    Shard& shard = *pipe.shards[i];
+    shard.index = i;
+    shard.gpu   = gpus[i];
+    shard.err   = NVCV_SUCCESS;
+    BAIL_IF_ERR(err = shard.app.init(effectName, batchSize, mode, &nvx1, shard.gpu)); // Init effect and buffers
+    BAIL_IF_ERR(err = NvVFX_SetU32(shard.app._eff, NVVFX_MAX_NUMBER_STREAMS, shardStreams));
+    BAIL_IF_ERR(err = NvVFX_SetU32(shard.app._eff, NVVFX_MODEL_BATCH, (batchSize > 1 ? 8 : 1)));  // Only batch 1 and 8 models ship
+    err = NvVFX_Load(shard.app._eff);
+    if (!(NVCV_SUCCESS == err || NVCV_ERR_MODELSUBSTITUTION == err)) goto bail;
+    BAIL_IF_ERR(err = NvVFX_GetU32(shard.app._eff, NVVFX_MODEL_BATCH, &modelBatch));  // The batch size of the chosen model
+    if (batchSize > modelBatch)
+      batchSize = modelBatch;   // Runs may be smaller than the model batch, but not larger
+    BAIL_IF_ERR(err = shard.statePool.initHandles(shard.app._eff, shardStreams));  // Videos that join later reuse the states of those that left
+    BAIL_IF_ERR(err = shard.batcher.init(shard.app._eff, batchSize, shardStreams, FLAG_maxWait, &shard.statePool,
+                                         (FLAG_prefetch > 0 ? FLAG_prefetch : 1)));
+    shard.batcher.setAging(FLAG_aging);
+  }
+  pipe.manager.init(numShards, shardStreams);
   for (unsigned int i = 0; i < numOfVideoStreams; i++) {
-    NvVFX_StateObjectHandle state;
-    BAIL_IF_ERR(err = NvVFX_AllocateState(app._eff, &state));
-    arrayOfStates.push_back(state);
+    pipe.rings.push_back(std::unique_ptr<PinnedFrameRing>(new PinnedFrameRing));
+    BAIL_IF_ERR(err = pipe.rings[i]->alloc((FLAG_prefetch > 0 ? FLAG_prefetch : 1), srcWidth, srcHeight));
   }
 
-  //Creating batch array to hold states
-  batchOfStates = (NvVFX_StateObjectHandle*)malloc(sizeof(NvVFX_StateObjectHandle) * batchSize);
-  if (batchOfStates == nullptr) {
-    err = NVCV_ERR_MEMORY;
-    goto bail;
-  }
+  pipe.dstHeight = pipe.shards[0]->app._dst.height / pipe.shards[0]->app._batchSize;
+  frameWriter.start(dstWriters, 3 * batchSize * numShards);  // Enough for the encoders to lag a couple of batches
 
-  dstHeight = app._dst.height / batchSize;
-  BAIL_IF_ERR(err = NvCVImage_Alloc(&nvx2, app._dst.width, dstHeight, NVCV_A, NVCV_U8, NVCV_CHUNKY, NVCV_CPU, 0));
-  CVWrapperForNvCVImage(&nvx2, &ocv2);
-  for(int j=0;;j++)
-  {
-    for (unsigned int i = 0; i < batchSize; i++) {
-      int capIdx = i%numOfVideoStreams; // interlacing frames from different video stream, but can in any order
-      srcCaptures[capIdx] >> ocv1;
-      if (ocv1.empty())  goto bail;
-      batchOfStates[i] = arrayOfStates[capIdx];
-
-      NVWrapperForCVMat(&ocv1, &nvx1);
-      if (!(nvx1.width == srcWidth && nvx1.height == srcHeight)) {
-        printf("Input video file \"%s\" %ux%u does not match %ux%u\n"
-               "Batching requires all video frames to be of the same size\n", srcVideos[i], nvx1.width, nvx1.height, srcWidth, srcHeight);
-        BAIL(err, NVCV_ERR_MISMATCH);
-      }
-      BAIL_IF_ERR(err = TransferToNthImage(i, &nvx1, &app._src, 1.f, app._stream, NULL));
-      ocv1.release();
-    }
-
-    // Run batch
-    BAIL_IF_ERR(err = NvVFX_SetU32(app._eff, NVVFX_BATCH_SIZE, (unsigned)batchSize));  // The batchSize can change every Run
-    BAIL_IF_ERR(err = NvVFX_SetStateObjectHandleArray(app._eff, NVVFX_STATE, batchOfStates));  // The batch of states can change every Run
-    BAIL_IF_ERR(err = NvVFX_Run(app._eff, 0));
+  // Every video gets its own reader; those beyond maxStreams wait to be placed until a running stream finishes.
+  for (auto& shard : pipe.shards)
+    shard->thread = std::thread(RunShard, &pipe, shard.get());
+  pipe.numReaders = numOfVideoStreams;
+  for (unsigned int i = 0; i < numOfVideoStreams; i++)
+    readers.push_back(std::thread(ReadStream, &pipe, &srcCaptures[i], i, srcVideos[i], (int)srcWidth, (int)srcHeight,
+                                  weights[i]));
 
+bail:
+  if (NVCV_SUCCESS != err)
+    pipe.close(true);     // Unblock the readers and the shards, if we stopped early
+  for (auto& reader : readers)
+    reader.join();
+  for (auto& shard : pipe.shards) {
+    if (shard->thread.joinable())
+      shard->thread.join();
+    if (NVCV_SUCCESS == err)
+      err = shard->err;
+  }
 
-    for (unsigned int i = 0; i < batchSize; ++i) {
-      int writerIdx = i % numOfVideoStreams;
-      BAIL_IF_ERR(err = TransferFromNthImage(i, &app._dst, &nvx2, 1.0f, app._stream, NULL));
-      dstWriters[writerIdx] << ocv2;
+  frameWriter.close();
+  if (FLAG_verbose) {
+    for (auto& shard : pipe.shards) {
+      if (numShards > 1)
+        printf("Shard %u, GPU %d:\n", shard->index, shard->gpu);
+      shard->batcher.printStats(stdout);
+      shard->statePool.printStats(stdout);
     }
-    // NvCVImage_Dealloc() is called in the destructors
-  } 
-bail:
-  // If DeallocateState fails, all memory allocated in the SDK returns to the heap when the effect handle is destroyed.
-  for (unsigned int i = 0; i < arrayOfStates.size(); i++) {
-    NvVFX_DeallocateState(app._eff, arrayOfStates[i]);
+    if (numShards > 1)
+      pipe.manager.printStats(stdout);
+    frameWriter.printStats(stdout);
   }
-  arrayOfStates.clear();
 
-  if (batchOfStates) {
-    free(batchOfStates);
-    batchOfStates = nullptr;
+  for (auto& shard : pipe.shards) {
+    shard->batcher.release();
+    shard->statePool.destroy();
   }
-  
+
   for (auto& cap : srcCaptures) {
     if (cap.isOpened())  cap.release();
   }
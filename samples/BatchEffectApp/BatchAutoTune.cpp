@@ -0,0 +1,112 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <algorithm>
+
+#include "BatchAutoTune.h"
+
+
+std::vector<BatchTuneResult> BatchParetoFront(const std::vector<BatchTuneResult>& results) {
+  std::vector<BatchTuneResult> sorted(results), front;
+
+  // Sweep in order of increasing latency, breaking ties by decreasing throughput,
+  // keeping each result that is faster than every one before it.
+  std::sort(sorted.begin(), sorted.end(), [](const BatchTuneResult& a, const BatchTuneResult& b) {
+    return (a.p99Ms != b.p99Ms) ? (a.p99Ms < b.p99Ms) : (a.imagesPerSec > b.imagesPerSec);
+  });
+  for (const BatchTuneResult& r : sorted)
+    if (front.empty() || r.imagesPerSec > front.back().imagesPerSec)
+      front.push_back(r);
+  return front;
+}
+
+
+const BatchTuneResult* ChooseBatchConfig(const std::vector<BatchTuneResult>& front, float latencyBudgetMs) {
+  const BatchTuneResult *best = nullptr;
+  if (front.empty())
+    return nullptr;
+  for (const BatchTuneResult& r : front)   // Throughput increases along the front
+    if (latencyBudgetMs <= 0.f || r.p99Ms <= latencyBudgetMs)
+      best = &r;
+  return best ? best : &front[0];
+}
+
+
+float Percentile(std::vector<float>& samples, float pct) {
+  if (samples.empty())
+    return 0.f;
+  std::sort(samples.begin(), samples.end());
+  size_t i = (size_t)(pct * 0.01f * (samples.size() - 1) + 0.5f);
+  return samples[std::min(i, samples.size() - 1)];
+}
+
+
+/********************************************************************************
+ * BatchTuneCache
+ ********************************************************************************/
+
+std::string BatchTuneCache::makeKey(const char *effectName, unsigned width, unsigned height, unsigned sdkVersion) {
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%s %ux%u %u.%u.%u.%u", effectName, width, height,
+    (sdkVersion >> 24) & 0xFF, (sdkVersion >> 16) & 0xFF, (sdkVersion >> 8) & 0xFF, sdkVersion & 0xFF);
+  return buf;
+}
+
+bool BatchTuneCache::load(const char *path) {
+  char line[512], effect[128], size[32], version[32];
+  BatchTuneResult r;
+  FILE *fp;
+
+  _fronts.clear();
+  if (nullptr == (fp = fopen(path, "r")))
+    return false;
+  while (fgets(line, sizeof(line), fp)) {
+    if (line[0] == '#')
+      continue;
+    if (8 != sscanf(line, "%127s %31s %31s %u %u %f %f %f", effect, size, version,
+                    &r.modelBatch, &r.runBatch, &r.imagesPerSec, &r.p99Ms, &r.meanMs))
+      continue;   // Ignore malformed lines, rather than failing the run
+    _fronts[std::string(effect) + ' ' + size + ' ' + version].push_back(r);
+  }
+  fclose(fp);
+  for (auto& kv : _fronts)
+    kv.second = BatchParetoFront(kv.second);  // Sort, in case the file was edited by hand
+  return true;
+}
+
+bool BatchTuneCache::save(const char *path) const {
+  FILE *fp = fopen(path, "w");
+  if (!fp)
+    return false;
+  fprintf(fp, "# effect WxH sdkVersion modelBatch runBatch imagesPerSec p99Ms meanMs\n");
+  for (const auto& kv : _fronts)
+    for (const BatchTuneResult& r : kv.second)
+      fprintf(fp, "%s %u %u %.1f %.3f %.3f\n", kv.first.c_str(), r.modelBatch, r.runBatch, r.imagesPerSec, r.p99Ms,
+              r.meanMs);
+  return 0 == fclose(fp);
+}
+
+const std::vector<BatchTuneResult>* BatchTuneCache::find(const std::string& key) const {
+  auto it = _fronts.find(key);
+  return (it != _fronts.end()) ? &it->second : nullptr;
+}
@@ -0,0 +1,87 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __BATCH_AUTO_TUNE_H__
+#define __BATCH_AUTO_TUNE_H__
+
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+//! The measured performance of one batch configuration.
+struct BatchTuneResult {
+  unsigned  modelBatch;     //!< The batch size of the model chosen by Load().
+  unsigned  runBatch;       //!< The number of images submitted to each Run().
+  float     imagesPerSec;   //!< Throughput.
+  float     p99Ms;          //!< The 99th percentile of the time for one Run(), i.e. the latency of its images.
+  float     meanMs;         //!< The mean time for one Run().
+};
+
+//! Keep only the results that are not dominated by another, i.e. that no other result beats in throughput without
+//! also being worse in latency. The front is sorted by increasing latency (and so throughput).
+std::vector<BatchTuneResult> BatchParetoFront(const std::vector<BatchTuneResult>& results);
+
+//! Choose from a Pareto front the configuration with the highest throughput whose p99 latency meets the budget,
+//! or the one with the lowest latency if none do.
+//! \param[in]  front           the Pareto front, sorted as by BatchParetoFront().
+//! \param[in]  latencyBudgetMs the p99 latency budget in milliseconds; 0 for none.
+//! \return     the chosen configuration, or NULL if the front is empty.
+const BatchTuneResult* ChooseBatchConfig(const std::vector<BatchTuneResult>& front, float latencyBudgetMs);
+
+//! The pct percentile of a set of samples, which are sorted in place.
+float Percentile(std::vector<float>& samples, float pct);
+
+//! A text file of Pareto fronts from previous tuning runs, one per (effect, resolution, SDK version).
+//! Each line holds: effect WxH version modelBatch runBatch imagesPerSec p99Ms meanMs; lines starting with '#' are
+//! ignored. The file is small, so it is read and rewritten in its entirety.
+class BatchTuneCache {
+public:
+  //! Make the key under which results are stored.
+  //! \param[in]  effectName  the name of the effect.
+  //! \param[in]  width       the width of the source images.
+  //! \param[in]  height      the height of the source images.
+  //! \param[in]  sdkVersion  the version from NvVFX_GetVersion(), so that results are re-tuned after an upgrade.
+  static std::string makeKey(const char *effectName, unsigned width, unsigned height, unsigned sdkVersion);
+
+  //! Read a cache file, replacing the current contents.
+  //! \return     false if the file could not be opened; the cache is then empty.
+  bool load(const char *path);
+
+  //! Write the cache file.
+  //! \return     false if the file could not be written.
+  bool save(const char *path) const;
+
+  //! Replace the front stored under a key.
+  void store(const std::string& key, const std::vector<BatchTuneResult>& front) { _fronts[key] = front; }
+
+  //! Get the front stored under a key.
+  //! \return     the front, or NULL if this configuration has not been tuned.
+  const std::vector<BatchTuneResult>* find(const std::string& key) const;
+
+private:
+  std::map<std::string, std::vector<BatchTuneResult> > _fronts;
+};
+
+#endif // __BATCH_AUTO_TUNE_H__
@@ -21,12 +21,21 @@
 #
 ###############################################################################*/
 
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 
+#include <memory>
 #include <string>
+#include <vector>
 #include <cuda_runtime_api.h>
+#include "AsyncFrameWriter.h"
 #include "BatchUtilities.h"
+#include "FramePrefetcher.h"
+#include "PathUtilities.h"
+#include "ResolutionBuckets.h"
+#include "StateCheckpoint.h"
+#include "StateObjectPool.h"
 #include "nvCVOpenCV.h"
 #include "nvVideoEffects.h"
 #include "opencv2/opencv.hpp"
@@ -41,12 +50,18 @@
 #define BAIL(err, code)             do {                            err = code; goto bail;   } while(0)
 
 
-bool                      FLAG_verbose        = false;
+bool                      FLAG_verbose        = false,
+                          FLAG_resume         = false;
 float                     FLAG_strength       = 0.f,
                           FLAG_scale          = 1.0;
 int                       FLAG_mode           = 0,
                           FLAG_resolution     = 0,
-                          FLAG_batchSize      = 8;
+                          FLAG_batchSize      = 8,
+                          FLAG_padTo          = 0,
+                          FLAG_prefetch       = 4,
+                          FLAG_checkpoint     = 0,
+                          FLAG_segments       = 0,
+                          FLAG_preroll        = 30;
 std::string               FLAG_outFile,
                           FLAG_modelDir;
 std::vector<const char*>  FLAG_inFiles;
@@ -128,9 +143,22 @@ static void Usage() {
     "  --out_file=<path>     output video files to be written (a pattern with one %%u or %%d), default \"BatchOut_%%02u.mp4\"\n"
     "  --strength=<value>    strength of denoising [0-1]\n"
     "  --model_dir=<path>    the path to the directory that contains the models\n"
-    "  --batchsize=<value>   size of the batch (default: 8)\n"
+    "  --batch_size=<value>  the largest number of videos to run at once (default: 8)\n"
+    "  --pad_to=<n>          batch videos whose sizes round up to the same multiple of n together, padding them\n"
+    "                        (default 0: only identically sized videos are batched together)\n"
+    "  --prefetch=<n>        the number of frames of each video to decode ahead, into pinned memory (default: 4)\n"
+    "  --checkpoint=<n>      save the denoising state of each video every n frames, to <output file>.state,\n"
+    "                        which is deleted when the video is complete (default: 0, no checkpoints);\n"
+    "                        the output is written in pieces of n frames, each after the first to <output file>_from<frame>,\n"
+    "                        and each checkpoint is saved only once the piece before it has been finalized\n"
+    "  --resume              resume each video that has a checkpoint from where it left off, with its state restored;\n"
+    "                        the rest of the video is written to <output file>_from<frame>, replacing any partial piece\n"
+    "  --segments=<k>        split a single long video into k segments that are denoised concurrently, as entries of\n"
+    "                        the same batch, then stitched together in order (default: 0, not split)\n"
+    "  --preroll=<n>         the number of frames before each segment that are run only to warm up its temporal state,\n"
+    "                        and whose output is discarded (default: 30)\n"
     "  --verbose             verbose output\n"
-    "  and inFile1 ... are identically sized video files\n"
+    "  and inFile1 ... are video files\n"
   );
 }
 
@@ -147,7 +175,13 @@ static int ParseMyArgs(int argc, char **argv) {
             GetFlagArgVal("mode",       arg, &FLAG_mode)      ||
             GetFlagArgVal("model_dir",  arg, &FLAG_modelDir)  ||
             GetFlagArgVal("out_file",   arg, &FLAG_outFile)   ||
-            GetFlagArgVal("batch_size", arg, &FLAG_batchSize)
+            GetFlagArgVal("batch_size", arg, &FLAG_batchSize) ||
+            GetFlagArgVal("pad_to",     arg, &FLAG_padTo)     ||
+            GetFlagArgVal("prefetch",   arg, &FLAG_prefetch)  ||
+            GetFlagArgVal("checkpoint", arg, &FLAG_checkpoint) ||
+            GetFlagArgVal("resume",     arg, &FLAG_resume)    ||
+            GetFlagArgVal("segments",   arg, &FLAG_segments)  ||
+            GetFlagArgVal("preroll",    arg, &FLAG_preroll)
         ) {
           continue;
         } else if (GetFlagArgVal("help", arg, &help)) {         // --help
@@ -212,104 +246,279 @@ public:
 };
 
 
-NvCV_Status BatchProcess(const char* effectName, const std::vector<const char*>& srcVideos, unsigned batchSize, const char *outfilePattern) {
-  NvCV_Status err       = NVCV_SUCCESS;
-  App         app;
-  cv::Mat     ocv1, ocv2;
-  NvCVImage   nvx1, nvx2;
-  unsigned    srcWidth, srcHeight, dstHeight;
+// A stream to be denoised: a video, or a range of the frames of one.
+struct VideoJob {
+  std::string         src;          // The input video
+  std::string         dst;          // The output video
+  std::string         checkpoint;   // The checkpoint file, or empty if the stream is not checkpointed
+  int                 fourcc;       // The codec of the output
+  unsigned long long  first;        // The first frame to read
+  unsigned long long  count;        // The number of frames to read, or 0 to read to the end
+  unsigned long long  preroll;      // The number of frames, from the first, that only warm up the state
+};
+
+static std::string OutputPath(const char *outfilePattern, unsigned video) {
+  char buf[1024];
+  snprintf(buf, sizeof(buf), outfilePattern, video);
+  return buf;
+}
+
+// A video resumed from a checkpoint is written as a new segment, named by its first frame.
+static std::string ResumedPath(const std::string& path, unsigned long long firstFrame) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "_from%06llu", firstFrame);
+  return InsertSuffix(path, buf);
+}
+
+
+// Seek a capture to a frame.
+// Setting CAP_PROP_POS_FRAMES is only exact for intra-coded or indexed streams; otherwise some backends land on a nearby
+// keyframe. If the position that the backend then reports is not the one asked for, the video is reopened and decoded
+// up to the frame, which is exact but slow. A backend that reports the requested position after an inexact seek cannot
+// be detected, so resuming such a stream may be off by a few frames.
+static bool SeekToFrame(cv::VideoCapture& cap, const std::string& path, unsigned long long frame) {
+  unsigned long long i;
+  if (cap.set(cv::CAP_PROP_POS_FRAMES, (double)frame) &&
+      frame == (unsigned long long)llround(cap.get(cv::CAP_PROP_POS_FRAMES)))
+    return true;
+  if (!cap.open(path))
+    return false;
+  for (i = 0; i < frame; ++i)
+    if (!cap.grab())
+      return false;
+  return true;
+}
 
-  void** arrayOfStates = nullptr;
-  void** batchOfStates = nullptr;
-  unsigned int stateSizeInBytes;
 
-  unsigned int numOfVideoStreams = static_cast<unsigned int>(srcVideos.size()); 
+// Videos of differing sizes are grouped into resolution buckets, each with its own effect instance, batch buffers and
+// states. Each Run takes one frame from each of up to batchSize videos of a bucket, since each batch entry is paired
+// with the state of its video. A video that ends simply drops out of its bucket's batches.
+// Each video is decoded on its own thread into a ring of pinned buffers, and only the frames that are ready are run,
+// so that decoding overlaps the effect rather than adding to it with each stream.
+// Likewise, each output is encoded on its own thread.
+// With --checkpoint, the state of each video is periodically copied out with its frame count, so that --resume can
+// seek to that frame and restore the state, rather than starting over or re-warming the temporal state.
+// A video file cannot be appended to, and is unreadable until finalized, so the output is split into a new file at each
+// checkpoint, and the encoder saves the checkpoint only after it has finalized the file of the frames that precede it.
+// The frames of a job's preroll are run only to warm up its state, and their output is not downloaded.
+NvCV_Status BatchProcess(const char* effectName, const std::vector<VideoJob>& jobs, unsigned batchSize) {
+  NvCV_Status err       = NVCV_SUCCESS;
+  cv::Mat     ocv1, padded;
+  NvCVImage   nvx1, dims;
+  unsigned    numLive, i, j, n, sdkVersion;
+  bool        ran;
+  unsigned long long seen;
+
+  ResolutionBuckets                               buckets;
+  std::vector<std::unique_ptr<App> >              apps;         // One per bucket
+  std::vector<std::unique_ptr<StateObjectPool> >  statePools;   // One per bucket, declared after the apps that use them
+  std::vector<void*>                              arrayOfStates;
+  std::vector<void*>                              batchOfStates;
+  std::vector<unsigned>                           readyVideos;
+  std::vector<NvCVImage*>                         readyFrames, outFrames;
+  std::vector<cv::Size>                           srcSizes;
+  std::vector<double>                             frameRates;
+  std::vector<bool>                               live;
+  std::vector<unsigned long long>                 framesRun;    // Per video, including those before a resume
+  std::vector<unsigned long long>                 keepFrom;     // Per video, the first frame whose output is kept
+  std::vector<unsigned long long>                 limits;       // Per video, the number of frames to read
+  std::vector<bool>                               resumed;      // Per video, whether its state is restored
+  std::vector<bool>                               keep;         // Per batch entry, whether its output is kept
+  std::vector<StateCheckpoint>                    checkpoints;  // Per video, restored from or to be saved
+  std::vector<unsigned>                           toSave;
+
+  unsigned int numOfVideoStreams = static_cast<unsigned int>(jobs.size());
   std::vector<cv::VideoCapture> srcCaptures(numOfVideoStreams);
   std::vector<cv::VideoWriter> dstWriters(numOfVideoStreams);
-  for (unsigned int i = 0; i < numOfVideoStreams; i++) {
-    srcCaptures[i].open(srcVideos[i]);
+  FramePrefetcher prefetcher;   // Declared after the captures that it reads ...
+  AsyncFrameWriter frameWriter; // ... and the writers that it encodes to
+  BAIL_IF_FALSE(jobs.size() > 0, err, NVCV_ERR_MISSINGINPUT);
+  BAIL_IF_ERR(err = NvVFX_GetVersion(&sdkVersion));
+  if (batchSize < 1)
+    batchSize = 1;
+  buckets.init(FLAG_padTo, batchSize);
+  framesRun.resize(numOfVideoStreams);
+  keepFrom.resize(numOfVideoStreams);
+  limits.resize(numOfVideoStreams);
+  resumed.assign(numOfVideoStreams, false);
+  checkpoints.resize(numOfVideoStreams);
+  for (i = 0; i < numOfVideoStreams; i++) {
+    const VideoJob& job = jobs[i];
+    std::string dstPath = job.dst;
+    srcCaptures[i].open(job.src);
     if (srcCaptures[i].isOpened()==false)  BAIL(err, NVCV_ERR_READ);
+    framesRun[i] = job.first;
+    keepFrom[i]  = job.first + job.preroll;
+    limits[i]    = job.count;
+    if (job.first && !SeekToFrame(srcCaptures[i], job.src, job.first))
+      BAIL(err, NVCV_ERR_READ);
+    if (FLAG_resume && !job.checkpoint.empty() &&
+        NVCV_SUCCESS == ReadStateCheckpoint(job.checkpoint.c_str(), &checkpoints[i])) {
+      if (!SeekToFrame(srcCaptures[i], job.src, checkpoints[i].frames))
+        BAIL(err, NVCV_ERR_READ);
+      framesRun[i] = keepFrom[i] = checkpoints[i].frames;
+      limits[i]    = 0;
+      resumed[i]   = true;
+      dstPath      = ResumedPath(job.dst, framesRun[i]);
+      if (FLAG_verbose)
+        printf("Resuming \"%s\" at frame %llu\n", job.src.c_str(), framesRun[i]);
+    }
 
     int width, height;
     double fps;
     width = (int)srcCaptures[i].get(cv::CAP_PROP_FRAME_WIDTH);
     height = (int)srcCaptures[i].get(cv::CAP_PROP_FRAME_HEIGHT);
     fps = srcCaptures[i].get(cv::CAP_PROP_FPS);
+    srcSizes.push_back(cv::Size(width, height));
+    frameRates.push_back(fps);
+    buckets.add(width, height);
 
-    const int fourcc_h264 = cv::VideoWriter::fourcc('H','2','6','4');
-    char fileName[1024];
-    snprintf(fileName, sizeof(fileName), outfilePattern, i);
-    dstWriters[i].open(fileName, fourcc_h264, fps, cv::Size2i(width,height));
+    dstWriters[i].open(dstPath, job.fourcc, fps, cv::Size2i(width,height));
     if (dstWriters[i].isOpened() == false)  BAIL(err, NVCV_ERR_WRITE);
+    if (cv::VideoWriter::fourcc('M','J','P','G') == job.fourcc)
+      dstWriters[i].set(cv::VIDEOWRITER_PROP_QUALITY, 100);  // Intermediate files should not lose much
   }
-
-  // Read in the first image, to determine the resolution for init()
-  BAIL_IF_FALSE(srcVideos.size() > 0, err, NVCV_ERR_MISSINGINPUT);
-  srcCaptures[0] >> ocv1;
-  srcCaptures[0].set(cv::CAP_PROP_POS_FRAMES, 0);  //resetting to first frame
-  if (!ocv1.data) {
-    printf("Cannot read video file \"%s\"\n", srcVideos[0]);
-    BAIL(err, NVCV_ERR_READ);
-  }
-  NVWrapperForCVMat(&ocv1, &nvx1);
-  srcWidth  = nvx1.width;
-  srcHeight = nvx1.height;
-
-  BAIL_IF_ERR(err = app.init(effectName, batchSize, &nvx1)); // Init effect and buffers
-
-  // Creating state objects, one per stream.
-  BAIL_IF_ERR(err = NvVFX_GetU32(app._eff, NVVFX_STATE_SIZE, &stateSizeInBytes));
-  arrayOfStates = (void**)calloc(numOfVideoStreams, sizeof(void*)); // allocating void* array of numOfVideoStreams elements
-  for (unsigned int i = 0; i < numOfVideoStreams; i++) {
-    cudaMalloc(&arrayOfStates[i], stateSizeInBytes);
-    cudaMemsetAsync(arrayOfStates[i], 0, stateSizeInBytes,app._stream);
+  buckets.build();
+  if (FLAG_verbose)
+    buckets.print(stdout);
+
+  // Init an effect and buffers for each bucket, and create its state objects, one per video,
+  // as NVVFX_STATE_SIZE byte slabs of a single cleared GPU arena.
+  arrayOfStates.resize(numOfVideoStreams);
+  for (j = 0; j < buckets.buckets().size(); ++j) {
+    const ResolutionBuckets::Bucket& bucket = buckets.buckets()[j];
+    n = ((unsigned)bucket.items.size() < batchSize) ? (unsigned)bucket.items.size() : batchSize;
+    dims.width  = bucket.width;
+    dims.height = bucket.height;
+    apps.push_back(std::unique_ptr<App>(new App));
+    BAIL_IF_ERR(err = apps[j]->init(effectName, n, &dims));
+    statePools.push_back(std::unique_ptr<StateObjectPool>(new StateObjectPool));
+    BAIL_IF_ERR(err = statePools[j]->initSlabs(apps[j]->_eff, (unsigned)bucket.items.size(), apps[j]->_stream));
+    for (unsigned v : bucket.items) {
+      BAIL_IF_ERR(err = statePools[j]->acquire(&arrayOfStates[v]));
+      if (!resumed[v])
+        continue;
+      const StateCheckpoint& ckpt = checkpoints[v];   // Remains valid until the restore, queued on the stream, is done
+      if (ckpt.sdkVersion != sdkVersion || ckpt.width != bucket.width || ckpt.height != bucket.height ||
+          ckpt.state.size() != statePools[j]->stateBytes())
+        printf("The checkpoint of \"%s\" does not match this configuration; its state will be re-warmed\n", jobs[v].src.c_str());
+      else
+        BAIL_IF_ERR(err = statePools[j]->restore(ckpt.state.data(), ckpt.state.size(), arrayOfStates[v]));
+    }
   }
-  //Creating batch array to hold states
-  batchOfStates = (void**)calloc(batchSize, sizeof(void*));
-
-  
-  dstHeight = app._dst.height / batchSize;
-  BAIL_IF_ERR(err = NvCVImage_Alloc(&nvx2, app._dst.width, dstHeight, ((app._dst.numComponents == 1) ? NVCV_Y : NVCV_BGR), NVCV_U8, NVCV_CHUNKY, NVCV_CPU, 0));
-  CVWrapperForNvCVImage(&nvx2, &ocv2);
-  for(int j=0;;j++)
-  {
-    for (unsigned int i = 0; i < batchSize; i++) {
-      int capIdx = i%numOfVideoStreams; // interlacing frames from different video stream, but can in any order
-      srcCaptures[capIdx] >> ocv1;
-      if (ocv1.empty())  goto bail;
-      batchOfStates[i] = arrayOfStates[capIdx];
-
-      NVWrapperForCVMat(&ocv1, &nvx1);
-      if (!(nvx1.width == srcWidth && nvx1.height == srcHeight)) {
-        printf("Input video file \"%s\" %ux%u does not match %ux%u\n"
-               "Batching requires all video frames to be of the same size\n", srcVideos[i], nvx1.width, nvx1.height, srcWidth, srcHeight);
-        BAIL(err, NVCV_ERR_MISMATCH);
+  batchOfStates.resize(batchSize);
+  live.assign(numOfVideoStreams, true);
+  readyFrames.assign(numOfVideoStreams, nullptr);
+  BAIL_IF_ERR(err = prefetcher.start(srcCaptures, srcSizes, FLAG_prefetch, &limits));
+  frameWriter.start(dstWriters, 3 * batchSize);  // Enough for the encoders to lag a couple of batches
+  outFrames.resize(batchSize);
+  keep.resize(batchSize);
+
+  for (numLive = numOfVideoStreams; numLive;) {
+    seen = prefetcher.events();
+    ran  = false;
+    for (j = 0; j < buckets.buckets().size(); ++j) {
+      App& app = *apps[j];
+      const ResolutionBuckets::Bucket& bucket = buckets.buckets()[j];
+      readyVideos.clear();
+      for (unsigned v : bucket.items) {
+        if (!live[v])
+          continue;
+        if (prefetcher.ended(v)) {
+          live[v] = false;
+          --numLive;
+          if (FLAG_checkpoint > 0 && !jobs[v].checkpoint.empty()) {  // Finalize each output as soon as its video has ended
+            std::string ckptPath = jobs[v].checkpoint;
+            frameWriter.finish(v, [ckptPath] { remove(ckptPath.c_str()); });  // Then there is nothing left to resume
+          } else {
+            frameWriter.finish(v);
+          }
+        } else if (nullptr != (readyFrames[v] = prefetcher.take(v))) {
+          readyVideos.push_back(v);
+        }
       }
-      BAIL_IF_ERR(err = TransferToNthImage(i, &nvx1, &app._src, 1.f / 255.f, app._stream, &app._stg));
-      ocv1.release();
-    }
 
-    // Run batch
-    BAIL_IF_ERR(err = NvVFX_SetU32(app._eff, NVVFX_BATCH_SIZE, (unsigned)batchSize));  // The batchSize can change every Run
-    BAIL_IF_ERR(err = NvVFX_SetObject(app._eff, NVVFX_STATE, (void*)batchOfStates));  // The batch of states can change every Run
-    BAIL_IF_ERR(err = NvVFX_Run(app._eff, 0));
+      for (const std::vector<unsigned>& batch : buckets.split(readyVideos)) {
+        for (i = 0; i < batch.size(); ++i) {
+          unsigned v = batch[i];
+          CVWrapperForNvCVImage(readyFrames[v], &ocv1);
+          if (ocv1.cols != (int)bucket.width || ocv1.rows != (int)bucket.height) {
+            cv::copyMakeBorder(ocv1, padded, 0, bucket.height - ocv1.rows, 0, bucket.width - ocv1.cols, cv::BORDER_REPLICATE);
+            NVWrapperForCVMat(&padded, &nvx1);
+            BAIL_IF_ERR(err = TransferToNthImage(i, &nvx1, &app._src, 1.f / 255.f, app._stream, &app._stg));
+          } else {
+            BAIL_IF_ERR(err = TransferToNthImage(i, readyFrames[v], &app._src, 1.f / 255.f, app._stream, &app._stg));
+          }
+          batchOfStates[i] = arrayOfStates[v];
+        }
 
+        // Run batch
+        BAIL_IF_ERR(err = NvVFX_SetU32(app._eff, NVVFX_BATCH_SIZE, (unsigned)batch.size()));  // The batchSize can change every Run
+        BAIL_IF_ERR(err = NvVFX_SetObject(app._eff, NVVFX_STATE, (void*)batchOfStates.data()));  // The batch of states can change every Run
+        BAIL_IF_ERR(err = NvVFX_Run(app._eff, 0));
+        ran = true;
+
+        // Queue the copies of any states that are due to be checkpointed, after the Run that updated them
+        toSave.clear();
+        for (i = 0; i < batch.size(); ++i) {
+          unsigned v = batch[i];
+          keep[i] = framesRun[v] >= keepFrom[v];
+          ++framesRun[v];
+          if (FLAG_checkpoint > 0 && !jobs[v].checkpoint.empty() && 0 == framesRun[v] % FLAG_checkpoint) {
+            checkpoints[v].state.resize(statePools[j]->stateBytes());
+            BAIL_IF_ERR(err = statePools[j]->snapshot(arrayOfStates[v], checkpoints[v].state.data()));
+            toSave.push_back(v);
+          }
+        }
 
-    for (unsigned int i = 0; i < batchSize; ++i) {
-      int writerIdx = i % numOfVideoStreams;
-      BAIL_IF_ERR(err = TransferFromNthImage(i, &app._dst, &nvx2, 255.f, app._stream, &app._stg));
-      dstWriters[writerIdx] << ocv2;
+        // Download all of the results asynchronously into pinned buffers, then hand them to the encoders
+        for (i = 0; i < batch.size(); ++i) {
+          outFrames[i] = nullptr;
+          if (!keep[i])
+            continue;                           // A preroll frame
+          BAIL_IF_ERR(err = frameWriter.acquire(app._dst.width, app._dst.height / app._batchSize,
+              ((app._dst.numComponents == 1) ? NVCV_Y : NVCV_BGR), &outFrames[i]));
+          BAIL_IF_ERR(err = TransferFromNthImage(i, &app._dst, outFrames[i], 255.f, app._stream, &app._stg));
+        }
+        BAIL_IF_FALSE(cudaSuccess == cudaStreamSynchronize((cudaStream_t)app._stream), err, NVCV_ERR_CUDA);
+        for (i = 0; i < batch.size(); ++i) {
+          unsigned v = batch[i];
+          if (outFrames[i])
+            frameWriter.submit(v, outFrames[i], cv::Rect(0, 0, srcSizes[v].width, srcSizes[v].height));
+          prefetcher.release(v);                // The upload has completed too
+        }
+        for (unsigned v : toSave) {             // The state copies have completed too
+          checkpoints[v].sdkVersion = sdkVersion;
+          checkpoints[v].width      = bucket.width;
+          checkpoints[v].height     = bucket.height;
+          checkpoints[v].frames     = framesRun[v];
+          StateCheckpoint ckpt     = checkpoints[v];  // Saved by the encoder, once the frames before it are in a file
+          std::string     ckptPath = jobs[v].checkpoint, src = jobs[v].src;
+          frameWriter.split(v, ResumedPath(jobs[v].dst, framesRun[v]), jobs[v].fourcc, frameRates[v], srcSizes[v],
+            [ckpt, ckptPath, src] {
+              if (NVCV_SUCCESS != WriteStateCheckpoint(ckptPath.c_str(), ckpt))
+                printf("Cannot write the checkpoint of \"%s\"\n", src.c_str());
+            });
+        }
+        // NvCVImage_Dealloc() is called in the destructors
+      }
     }
-    // NvCVImage_Dealloc() is called in the destructors
-  } 
+    if (!ran && numLive)
+      prefetcher.waitForEvent(seen);            // Nothing was ready
+  }
 bail:
-  if (arrayOfStates) {
-    for (unsigned int i = 0; i < numOfVideoStreams; i++) {
-      if (arrayOfStates[i])  cudaFree(arrayOfStates[i]);
-    }
-    free(arrayOfStates);
+  if (FLAG_verbose) {
+    for (auto& pool : statePools)
+      pool->printStats(stdout);
   }
-  if (batchOfStates)  free(batchOfStates);
+  statePools.clear();
+  prefetcher.stop();
+  frameWriter.close();
+  for (i = 0; i < numOfVideoStreams; ++i)
+    if (NVCV_SUCCESS == err && frameWriter.failed(i))
+      err = NVCV_ERR_WRITE;             // Its checkpoint stops before the frames that were dropped
+  if (FLAG_verbose)
+    frameWriter.printStats(stdout);
   
   for (auto& cap : srcCaptures) {
     if (cap.isOpened())  cap.release();
@@ -321,6 +530,77 @@ bail:
 }
 
 
+// Append the segments, in order, to the output video, deleting each one once it has been copied.
+static NvCV_Status StitchSegments(const std::vector<VideoJob>& segments, const char *outFile) {
+  NvCV_Status       err = NVCV_SUCCESS;
+  cv::VideoCapture  cap;
+  cv::VideoWriter   writer;
+  cv::Mat           frame;
+  unsigned long long numFrames = 0;
+
+  for (const VideoJob& seg : segments) {
+    BAIL_IF_FALSE(cap.open(seg.dst), err, NVCV_ERR_READ);
+    if (!writer.isOpened()) {
+      writer.open(outFile, cv::VideoWriter::fourcc('H','2','6','4'), cap.get(cv::CAP_PROP_FPS),
+                  cv::Size((int)cap.get(cv::CAP_PROP_FRAME_WIDTH), (int)cap.get(cv::CAP_PROP_FRAME_HEIGHT)));
+      BAIL_IF_FALSE(writer.isOpened(), err, NVCV_ERR_WRITE);
+    }
+    for (; cap.read(frame); ++numFrames)
+      writer.write(frame);
+    cap.release();
+    remove(seg.dst.c_str());
+  }
+  if (FLAG_verbose)
+    printf("Stitched %u segments, %llu frames, into \"%s\"\n", (unsigned)segments.size(), numFrames, outFile);
+bail:
+  return err;
+}
+
+
+// A single long video is split into segments that are denoised concurrently, as the entries of a batch, to make use
+// of batching when there is only one video. The temporal state of each segment is warmed up by running the preroll
+// frames that precede it, whose output is discarded, so that the seams are not visible. Each segment is written to an
+// intermediate Motion JPEG file, which is always available in OpenCV, and these are then stitched together in order.
+NvCV_Status SegmentProcess(const char* effectName, const char *srcVideo, unsigned numSegments, unsigned preroll,
+                           unsigned batchSize, const char *outFile) {
+  NvCV_Status           err = NVCV_SUCCESS;
+  cv::VideoCapture      cap;
+  std::vector<VideoJob> segments;
+  unsigned long long    numFrames, segFrames, start;
+  unsigned              k;
+  char                  suffix[32];
+
+  BAIL_IF_FALSE(cap.open(srcVideo), err, NVCV_ERR_READ);
+  numFrames = (unsigned long long)cap.get(cv::CAP_PROP_FRAME_COUNT);
+  cap.release();
+  if (!numFrames) {
+    printf("The number of frames in \"%s\" is unknown, so it cannot be split into segments\n", srcVideo);
+    BAIL(err, NVCV_ERR_READ);
+  }
+  if (numSegments > numFrames)
+    numSegments = (unsigned)numFrames;
+  segFrames = (numFrames + numSegments - 1) / numSegments;
+  for (k = 0, start = 0; k < numSegments && start < numFrames; ++k, start += segFrames) {
+    VideoJob seg;
+    snprintf(suffix, sizeof(suffix), "_seg%02u", k);
+    seg.src        = srcVideo;
+    seg.dst        = ReplaceExtension(InsertSuffix(outFile, suffix), ".avi");
+    seg.fourcc     = cv::VideoWriter::fourcc('M','J','P','G');
+    seg.preroll    = (start < preroll) ? start : preroll;
+    seg.first      = start - seg.preroll;
+    seg.count      = (start + segFrames < numFrames) ? seg.preroll + segFrames : 0;  // The last one reads to the end
+    segments.push_back(seg);
+    if (FLAG_verbose)
+      printf("Segment %u: frames %llu-%llu, with %llu preroll frames, to \"%s\"\n", k, start,
+             (seg.count ? start + segFrames : numFrames) - 1, seg.preroll, seg.dst.c_str());
+  }
+  BAIL_IF_ERR(err = BatchProcess(effectName, segments, batchSize));
+  BAIL_IF_ERR(err = StitchSegments(segments, outFile));
+bail:
+  return err;
+}
+
+
 int main(int argc, char** argv) {
   int         nErrs;
   NvCV_Status vfxErr;
@@ -334,7 +614,26 @@ int main(int argc, char** argv) {
   else if (std::string::npos == FLAG_outFile.find_first_of('%'))
     FLAG_outFile.insert(FLAG_outFile.size() - 4, "_%02u"); 
 
-  vfxErr = BatchProcess(NVVFX_FX_DENOISING, FLAG_inFiles, FLAG_batchSize, FLAG_outFile.c_str());
+  if (FLAG_segments > 1) {
+    if (FLAG_inFiles.size() != 1 || FLAG_checkpoint || FLAG_resume) {
+      printf("--segments takes a single input video, and cannot be combined with --checkpoint or --resume\n");
+      return 1;
+    }
+    vfxErr = SegmentProcess(NVVFX_FX_DENOISING, FLAG_inFiles[0], FLAG_segments, (FLAG_preroll > 0) ? FLAG_preroll : 0,
+                            FLAG_batchSize, OutputPath(FLAG_outFile.c_str(), 0).c_str());
+  } else {
+    std::vector<VideoJob> jobs(FLAG_inFiles.size());
+    for (unsigned v = 0; v < jobs.size(); ++v) {
+      jobs[v].src        = FLAG_inFiles[v];
+      jobs[v].dst        = OutputPath(FLAG_outFile.c_str(), v);
+      jobs[v].checkpoint = jobs[v].dst + ".state";
+      jobs[v].fourcc     = cv::VideoWriter::fourcc('H','2','6','4');
+      jobs[v].first      = 0;
+      jobs[v].count      = 0;
+      jobs[v].preroll    = 0;
+    }
+    vfxErr = BatchProcess(NVVFX_FX_DENOISING, jobs, FLAG_batchSize);
+  }
   if (NVCV_SUCCESS != vfxErr) {
     Usage();
     printf("Error: %s\n", NvCV_GetErrorStringFromCode(vfxErr));
@@ -25,12 +25,23 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
+#include "BatchAutoTune.h"
 #include "BatchUtilities.h"
+#include "EffectLimits.h"
+#include "MosaicPacker.h"
+#include "ResolutionBuckets.h"
 #include "nvCVOpenCV.h"
 #include "nvVideoEffects.h"
 #include "opencv2/opencv.hpp"
+#include <cuda_runtime_api.h>
 
 #ifdef _MSC_VER
   #define strcasecmp _stricmp
@@ -42,12 +53,23 @@
 #define BAIL(err, code)             do {                            err = code; goto bail;   } while(0)
 
 
-bool                      FLAG_verbose        = false;
+bool                      FLAG_verbose        = false,
+                          FLAG_mosaic         = false,
+                          FLAG_autoTune       = false;
 float                     FLAG_strength       = 0.f,
-                          FLAG_scale          = 1.0;
+                          FLAG_scale          = 1.0,
+                          FLAG_latencyBudget  = 0.f;
 int                       FLAG_mode           = 0,
-                          FLAG_resolution     = 0;
+                          FLAG_resolution     = 0,
+                          FLAG_mosaicGuard    = 8,
+                          FLAG_benchmark      = 0,
+                          FLAG_padTo          = 0,
+                          FLAG_maxBatch       = 0,
+                          FLAG_tuneIters      = 100;
 std::string               FLAG_outFile,
+                          FLAG_inDir,
+                          FLAG_tuneFile       = "BatchTune.txt",
+                          FLAG_tuneSize,
                           FLAG_modelDir,
                           FLAG_effect;
 std::vector<const char*>  FLAG_inFiles;
@@ -130,11 +152,28 @@ static void Usage() {
     "  --effect=<effect>     the effect to apply\n"
     "  --strength=<value>    strength of the upscaling effect, [0.0, 1.0]\n"
     "  --scale=<scale>       scale factor to be applied: 1.5, 2, 3, maybe 1.3333333\n"
-    "  --resolution=<height> the desired height (either --scale or --resolution may be used)\n"
+    "  --resolution=<height> the desired height (either --scale or --resolution may be used; not with --pad_to)\n"
     "  --mode=<mode>         mode 0 or 1\n"
     "  --model_dir=<path>    the path to the directory that contains the models\n"
+    "  --pad_to=<n>          batch images whose sizes round up to the same multiple of n together, padding them\n"
+    "                        (default 0: only identically sized images are batched together)\n"
+    "  --max_batch=<n>       the largest number of images to run at once (default 0: all of the same size;\n"
+    "                        8 with --in_dir)\n"
+    "  --in_dir=<path>       process every image in this directory, or matching this glob pattern, e.g. \"frames/*.png\",\n"
+    "                        in chunks of the model batch size, instead of the images listed on the command line\n"
+    "  --mosaic              pack the images side by side into as few atlas images as the effect accepts,\n"
+    "                        rather than running them as separate batch entries\n"
+    "  --mosaic_guard=<n>    the width of the replicated border around each image in the atlas (default 8)\n"
+    "  --benchmark=<iters>   compare the throughput of batching and mosaic packing over this many passes\n"
+    "  --autotune            measure the throughput and p99 latency of each model and run batch size, up to --max_batch\n"
+    "                        (default 32), on synthetic frames, and record the Pareto-optimal ones in the tune file\n"
+    "  --tune_size=<W>x<H>   the resolution to tune for (default: that of the first input image)\n"
+    "  --tune_iters=<n>      the number of timed runs of each configuration (default 100)\n"
+    "  --tune_file=<path>    the file of tuned batch sizes, which is read on every run (default \"BatchTune.txt\");\n"
+    "                        when --max_batch is not given, the tuned batch sizes for the effect and resolution are used\n"
+    "  --latency_budget=<ms> choose the fastest tuned configuration whose p99 latency is within this (default 0: none)\n"
     "  --verbose             verbose output\n"
-    "  and inFile1 ... are identically sized image files, e.g. png, jpg\n"
+    "  and inFile1 ... are image files, e.g. png, jpg; they must be identically sized for --mosaic\n"
   );
 
   const char* cStr;
@@ -157,6 +196,17 @@ static int ParseMyArgs(int argc, char **argv) {
             GetFlagArgVal("scale",      arg, &FLAG_scale)     ||
             GetFlagArgVal("mode",       arg, &FLAG_mode)      ||
             GetFlagArgVal("model_dir",  arg, &FLAG_modelDir)  ||
+            GetFlagArgVal("mosaic",     arg, &FLAG_mosaic)    ||
+            GetFlagArgVal("mosaic_guard", arg, &FLAG_mosaicGuard) ||
+            GetFlagArgVal("benchmark",  arg, &FLAG_benchmark) ||
+            GetFlagArgVal("pad_to",     arg, &FLAG_padTo)     ||
+            GetFlagArgVal("max_batch",  arg, &FLAG_maxBatch)  ||
+            GetFlagArgVal("in_dir",     arg, &FLAG_inDir)     ||
+            GetFlagArgVal("autotune",   arg, &FLAG_autoTune)  ||
+            GetFlagArgVal("tune_size",  arg, &FLAG_tuneSize)  ||
+            GetFlagArgVal("tune_iters", arg, &FLAG_tuneIters) ||
+            GetFlagArgVal("tune_file",  arg, &FLAG_tuneFile)  ||
+            GetFlagArgVal("latency_budget", arg, &FLAG_latencyBudget) ||
             GetFlagArgVal("out_file",   arg, &FLAG_outFile)
         ) {
           continue;
@@ -210,21 +260,50 @@ static bool IsLossyImageFile(const char *str) {
   return HasOneOfTheseSuffixes(str, ".jpg", ".jpeg", nullptr);
 }
 
+static BatchTuneCache gTuneCache;
+
+// Get the tuned batch configuration for an effect at a resolution, if it has been tuned with this version of the SDK.
+static const BatchTuneResult* TunedConfig(const char* effectName, unsigned width, unsigned height) {
+  const std::vector<BatchTuneResult> *front;
+  unsigned version;
+  if (NVCV_SUCCESS != NvVFX_GetVersion(&version))
+    return nullptr;
+  front = gTuneCache.find(BatchTuneCache::makeKey(effectName, width, height, version));
+  return front ? ChooseBatchConfig(*front, FLAG_latencyBudget) : nullptr;
+}
+
+
 class App {
 public:
   NvVFX_Handle  _eff;
   NvCVImage     _src, _dst, _stg;
   CUstream      _stream;
   unsigned      _batchSize;
+  unsigned      _modelBatch;  // The batch size of the model chosen by Load()
 
-  App() : _eff(nullptr), _stream(0), _batchSize(0) {}
+  App() : _eff(nullptr), _stream(0), _batchSize(0), _modelBatch(0) {}
   ~App() { NvVFX_DestroyEffect(_eff); if (_stream) NvVFX_CudaStreamDestroy(_stream); }
 
-  NvCV_Status init(const char* effectName, unsigned batchSize, const NvCVImage *src) {
+  // The destination size is determined from the flags, unless it is specified explicitly.
+  // The batch size of the model requested from Load() is modelBatch if specified, otherwise the tuned one for this
+  // effect and resolution, otherwise batchSize, the number of images in the buffers.
+  NvCV_Status init(const char* effectName, unsigned batchSize, const NvCVImage *src,
+                   unsigned dstWidth = 0, unsigned dstHeight = 0, unsigned modelBatch = 0) {
     NvCV_Status err = NVCV_ERR_UNIMPLEMENTED;
     unsigned    dw, dh;
 
-    if (FLAG_resolution) {
+    if (!modelBatch) {
+      const BatchTuneResult *tuned = TunedConfig(effectName, src->width, src->height);
+      modelBatch = tuned ? tuned->modelBatch : batchSize;
+      if (tuned && FLAG_verbose)
+        printf("Using the tuned model batch size %u for %ux%u\n", modelBatch, src->width, src->height);
+    }
+
+    if (dstWidth && dstHeight) {
+      dw = dstWidth;
+      dh = dstHeight;
+    }
+    else if (FLAG_resolution) {
       dw = FLAG_resolution * src->width / src->height,  // No rounding
       dh = FLAG_resolution;
     }
@@ -293,13 +372,14 @@ public:
       // the batch size is changing constantly as some videos complete and other are added, so setting the batchSize
       // before every Run() call would be typical.
       unsigned gotBatch;
-      BAIL_IF_ERR(err = NvVFX_SetU32(_eff, NVVFX_MODEL_BATCH, _batchSize)); // Try to choose a model tuned to this batch size
+      BAIL_IF_ERR(err = NvVFX_SetU32(_eff, NVVFX_MODEL_BATCH, modelBatch)); // Try to choose a model tuned to this batch size
       err = NvVFX_Load(_eff);                                               // This will load a new batched model -- a weighty process
       if (!(NVCV_SUCCESS == err || NVCV_ERR_MODELSUBSTITUTION == err)) goto bail;
       BAIL_IF_ERR(err = NvVFX_GetU32(_eff, NVVFX_MODEL_BATCH, &gotBatch));  // This tells us the batch size of the chosen model
-      if (FLAG_verbose && gotBatch != _batchSize) {
+      _modelBatch = gotBatch;
+      if (FLAG_verbose && gotBatch != modelBatch) {
         printf("Effect %s has no batch=%u model; processing in multiple batches of size %u%s instead\n",
-            effectName, _batchSize, gotBatch, (gotBatch > 1 ? " or less" : ""));
+            effectName, modelBatch, gotBatch, (gotBatch > 1 ? " or less" : ""));
         BAIL_IF_ERR(err = NvVFX_SetU32(_eff, NVVFX_BATCH_SIZE, _batchSize));  // This is lightweight, and usually done each Run
       }
     }
@@ -310,67 +390,499 @@ public:
 };
 
 
-NvCV_Status BatchProcessImages(const char* effectName, const std::vector<const char*>& srcImages, const char *outfilePattern) {
-  NvCV_Status err       = NVCV_SUCCESS;
-  unsigned    batchSize = (unsigned)srcImages.size();
-  App         app;
-  cv::Mat     ocv;
-  NvCVImage   nvx;
-  unsigned    srcWidth, srcHeight, dstHeight, i;
-
-  // Read in the first image, to determine the resolution for init()
+// Read a set of identically sized images.
+static NvCV_Status ReadImages(const std::vector<const char*>& srcImages, std::vector<cv::Mat> *frames) {
+  NvCV_Status err = NVCV_SUCCESS;
   BAIL_IF_FALSE(srcImages.size() > 0, err, NVCV_ERR_MISSINGINPUT);
-  ocv = cv::imread(srcImages[0]);
-  if (!ocv.data) {
-    printf("Cannot read image file \"%s\"\n", srcImages[0]);
-    BAIL(err, NVCV_ERR_READ);
+  frames->resize(srcImages.size());
+  for (size_t i = 0; i < srcImages.size(); ++i) {
+    (*frames)[i] = cv::imread(srcImages[i]);
+    if (!(*frames)[i].data) {
+      printf("Cannot read image file \"%s\"\n", srcImages[i]);
+      BAIL(err, NVCV_ERR_READ);
+    }
+    if ((*frames)[i].size() != (*frames)[0].size()) {
+      printf("Input image file \"%s\" %dx%d does not match %dx%d\n", srcImages[i],
+        (*frames)[i].cols, (*frames)[i].rows, (*frames)[0].cols, (*frames)[0].rows);
+      BAIL(err, NVCV_ERR_MISMATCH);
+    }
+  }
+bail:
+  return err;
+}
+
+// Compute the size of the output of the effect for one input frame, as App::init() does.
+static void GetDstSize(const char* effectName, unsigned width, unsigned height, unsigned *dstWidth, unsigned *dstHeight) {
+  if (!strcmp(effectName, NVVFX_FX_TRANSFER) || !strcmp(effectName, NVVFX_FX_ARTIFACT_REDUCTION)) {
+    *dstWidth  = width;
+    *dstHeight = height;
+  } else if (FLAG_resolution) {
+    *dstWidth  = FLAG_resolution * width / height;
+    *dstHeight = FLAG_resolution;
+  } else {
+    *dstWidth  = lroundf(width  * FLAG_scale);
+    *dstHeight = lroundf(height * FLAG_scale);
   }
-  NVWrapperForCVMat(&ocv, &nvx);
-  srcWidth  = nvx.width;
-  srcHeight = nvx.height;
-  BAIL_IF_ERR(err = app.init(effectName, batchSize, &nvx)); // Init effect and buffers
+}
 
-  // Transfer the first image to the batch src.
+// Run a batch of images no larger than width x height through an App of that size. The images are padded by
+// replicating their right and bottom edges, and the results cropped and written, named by their indices.
+// The whole bucket is scaled uniformly, so each result is cropped to its own size at the scale of the bucket.
+static NvCV_Status RunImageBatch(const char* effectName, App& app, unsigned width, unsigned height,
+                                 const std::vector<const cv::Mat*>& images, const std::vector<unsigned>& indices,
+                                 const char *outfilePattern) {
+  NvCV_Status err = NVCV_SUCCESS;
+  cv::Mat     ocv, padded;
+  NvCVImage   nvx;
+  unsigned    k, dstWidth, dstHeight, bucketDstWidth, bucketDstHeight;
+
+  // Transfer the images to the batch src, padding as needed.
   // Note, in all transfers, the scale factor only applies to floating-point pixels.
-  BAIL_IF_ERR(err = TransferToNthImage(0, &nvx, &app._src, 1.f/255.f, app._stream, &app._stg));
-  ocv.release();
+  for (k = 0; k < images.size(); ++k) {
+    const cv::Mat& im = *images[k];
+    if (im.cols != (int)width || im.rows != (int)height)
+      cv::copyMakeBorder(im, padded, 0, height - im.rows, 0, width - im.cols, cv::BORDER_REPLICATE);
+    else
+      padded = im;
+    NVWrapperForCVMat(&padded, &nvx);
+    BAIL_IF_ERR(err = TransferToNthImage(k, &nvx, &app._src, 1.f / 255.f, app._stream, &app._stg));
+  }
 
-  // Read the remaining images and transfer to the batch src
-  for (i = 1; i < batchSize; ++i) {
-    ocv = cv::imread(srcImages[i]);
-    if (!ocv.data) {
+  // Run batch
+  BAIL_IF_ERR(err = NvVFX_SetU32(app._eff, NVVFX_BATCH_SIZE, (unsigned)images.size()));  // The batchSize can change every Run
+  BAIL_IF_ERR(err = NvVFX_Run(app._eff, 0));
+
+  // Retrieve, crop and write images
+  BAIL_IF_ERR(err = NvCVImage_Realloc(&nvx, app._dst.width, app._dst.height / app._batchSize,
+                                      ((app._dst.numComponents == 1) ? NVCV_Y : NVCV_BGR), NVCV_U8, NVCV_CHUNKY, NVCV_CPU, 0));
+  CVWrapperForNvCVImage(&nvx, &ocv);
+  bucketDstWidth  = app._dst.width;
+  bucketDstHeight = app._dst.height / app._batchSize;
+  for (k = 0; k < images.size(); ++k) {
+    char fileName[1024];
+    snprintf(fileName, sizeof(fileName), outfilePattern, indices[k]);
+    BAIL_IF_ERR(err = TransferFromNthImage(k, &app._dst, &nvx, 255.f, app._stream, &app._stg));
+    dstWidth  = std::min((unsigned)lround((double)images[k]->cols * bucketDstWidth  / width),  bucketDstWidth);
+    dstHeight = std::min((unsigned)lround((double)images[k]->rows * bucketDstHeight / height), bucketDstHeight);
+    if (!cv::imwrite(fileName, ocv(cv::Rect(0, 0, dstWidth, dstHeight)))) {
+      printf("Cannot write image file \"%s\"\n", fileName);
+      BAIL(err, NVCV_ERR_WRITE);
+    }
+  }
+  // NvCVImage_Dealloc() is called in the destructors
+
+bail:
+  return err;
+}
+
+
+// Run a set of images through the effect. Images of differing sizes are grouped into resolution buckets,
+// each with its own effect instance and batch buffers.
+NvCV_Status BatchProcessImages(const char* effectName, const std::vector<const char*>& srcImages, const char *outfilePattern) {
+  NvCV_Status                         err = NVCV_SUCCESS;
+  ResolutionBuckets                   buckets;
+  std::vector<ResolutionBuckets::Batch> batches;
+  std::vector<std::unique_ptr<App> >  apps;   // One per bucket
+  std::vector<cv::Mat>                images;
+  std::vector<const cv::Mat*>         batchImages;
+  NvCVImage                           dims;
+  const BatchTuneResult               *tuned;
+  unsigned                            i, j, maxBatch;
+
+  BAIL_IF_FALSE(srcImages.size() > 0, err, NVCV_ERR_MISSINGINPUT);
+  images.resize(srcImages.size());
+  for (i = 0; i < images.size(); ++i) {
+    images[i] = cv::imread(srcImages[i]);
+    if (!images[i].data) {
       printf("Cannot read image file \"%s\"\n", srcImages[i]);
       BAIL(err, NVCV_ERR_READ);
     }
-    NVWrapperForCVMat(&ocv, &nvx);
-    if (!(nvx.width == srcWidth && nvx.height == srcHeight)) {
-      printf("Input image file \"%s\" %ux%u does not match %ux%u\n", srcImages[i], nvx.width, nvx.height, srcWidth, srcHeight);
-      BAIL(err, NVCV_ERR_MISMATCH);
+  }
+  maxBatch = FLAG_maxBatch;
+  if (!maxBatch && nullptr != (tuned = TunedConfig(effectName, images[0].cols, images[0].rows)))
+    maxBatch = tuned->runBatch;   // Tuned for the size of the first image
+  buckets.init(FLAG_padTo, maxBatch, (FLAG_resolution ? 0.f : 0.5f));  // --resolution is per image, so never pad
+  for (i = 0; i < images.size(); ++i)
+    buckets.add(images[i].cols, images[i].rows);
+  buckets.build();
+  if (FLAG_verbose)
+    buckets.print(stdout);
+
+  // Init an effect and buffers for each bucket; only the dimensions of the source are needed for this.
+  for (j = 0; j < buckets.buckets().size(); ++j) {
+    dims.width  = buckets.buckets()[j].width;
+    dims.height = buckets.buckets()[j].height;
+    apps.push_back(std::unique_ptr<App>(new App));
+    BAIL_IF_ERR(err = apps[j]->init(effectName, buckets.maxBatchOf(j), &dims));
+  }
+
+  if(IsLossyImageFile(outfilePattern))
+    fprintf(stderr, "WARNING: JPEG output file format will reduce image quality\n");
+  batches = buckets.schedule();
+  for (const ResolutionBuckets::Batch& batch : batches) {
+    const ResolutionBuckets::Bucket& bucket = buckets.buckets()[batch.bucket];
+    batchImages.clear();
+    for (unsigned item : batch.items)
+      batchImages.push_back(&images[item]);
+    BAIL_IF_ERR(err = RunImageBatch(effectName, *apps[batch.bucket], bucket.width, bucket.height, batchImages,
+                                    batch.items, outfilePattern));
+  }
+
+bail:
+  return err;
+}
+
+
+// Read a chunk of images for StreamProcessImages(), skipping any that cannot be read.
+struct ImageChunk {
+  unsigned              first, count; // The range of files that was read
+  std::vector<cv::Mat>  images;
+  std::vector<unsigned> indices;
+};
+static ImageChunk ReadImageChunk(const std::vector<cv::String> *files, unsigned first, unsigned count) {
+  ImageChunk chunk;
+  chunk.first = first;
+  chunk.count = count;
+  for (unsigned i = first; i < first + count && i < files->size(); ++i) {
+    cv::Mat im = cv::imread((*files)[i]);
+    if (!im.data) {
+      printf("Cannot read image file \"%s\"; skipping it\n", (*files)[i].c_str());
+      continue;
+    }
+    chunk.images.push_back(im);
+    chunk.indices.push_back(i);
+  }
+  return chunk;
+}
+
+static unsigned RoundUpTo(unsigned x, int n) { return (n > 1) ? (x + n - 1) / n * n : x; }
+
+
+// Process every image in a directory, or matching a glob pattern, in chunks of the batch size of the loaded model,
+// so that memory use does not depend on the number of images. The next chunk is decoded while the current one runs.
+// Images are grouped by their size, rounded up to --pad_to, each group with its own effect instance,
+// which is created on first use and recycled for every subsequent chunk.
+NvCV_Status StreamProcessImages(const char* effectName, const char *inPattern, const char *outfilePattern) {
+  NvCV_Status                 err = NVCV_SUCCESS;
+  std::vector<cv::String>     files, imageFiles;
+  std::map<std::pair<unsigned, unsigned>, std::unique_ptr<App> > apps;
+  std::future<ImageChunk>     decoding;
+  ImageChunk                  chunk;
+  std::vector<const cv::Mat*> groupImages;
+  std::vector<unsigned>       groupIndices;
+  std::vector<bool>           done;
+  NvCVImage                   dims;
+  const BatchTuneResult       *tuned = nullptr;
+  unsigned                    first, chunkSize, allocSize, k, n;
+
+  cv::glob(inPattern, files, false);  // A directory yields all of its files
+  for (const cv::String& file : files)
+    if (HasOneOfTheseSuffixes(file.c_str(), ".png", ".jpg", ".jpeg", ".bmp", ".tif", ".tiff", ".webp", ".ppm", nullptr))
+      imageFiles.push_back(file);
+  if (imageFiles.empty()) {
+    printf("No image files found in \"%s\"\n", inPattern);
+    BAIL(err, NVCV_ERR_MISSINGINPUT);
+  }
+  if(IsLossyImageFile(outfilePattern))
+    fprintf(stderr, "WARNING: JPEG output file format will reduce image quality\n");
+
+  if (FLAG_maxBatch > 0) {
+    chunkSize = FLAG_maxBatch;
+  } else {  // Use the run batch size tuned for the size of the first image, if any
+    cv::Mat im = cv::imread(imageFiles[0]);
+    if (im.data)
+      tuned = TunedConfig(effectName, RoundUpTo(im.cols, FLAG_padTo), RoundUpTo(im.rows, FLAG_padTo));
+    chunkSize = tuned ? tuned->runBatch : 8;
+  }
+  allocSize = chunkSize;  // Chunks never grow, so neither do the buffers
+  decoding  = std::async(std::launch::async, ReadImageChunk, &imageFiles, 0u, chunkSize);
+  for (first = 0; first < imageFiles.size(); first = n) {
+    chunk = decoding.get();
+    n = chunk.first + chunk.count;  // The chunk may have been decoded before chunkSize shrank
+    if (n < imageFiles.size())
+      decoding = std::async(std::launch::async, ReadImageChunk, &imageFiles, n, chunkSize);
+
+    // Run each group of same-sized images in the chunk together
+    done.assign(chunk.images.size(), false);
+    for (unsigned i = 0; i < chunk.images.size(); ++i) {
+      if (done[i])
+        continue;
+      std::pair<unsigned, unsigned> key(RoundUpTo(chunk.images[i].cols, FLAG_padTo), RoundUpTo(chunk.images[i].rows, FLAG_padTo));
+      groupImages.clear();
+      groupIndices.clear();
+      for (k = i; k < chunk.images.size(); ++k) {
+        if (!done[k] && RoundUpTo(chunk.images[k].cols, FLAG_padTo) == key.first &&
+                        RoundUpTo(chunk.images[k].rows, FLAG_padTo) == key.second) {
+          groupImages.push_back(&chunk.images[k]);
+          groupIndices.push_back(chunk.indices[k]);
+          done[k] = true;
+        }
+      }
+      std::unique_ptr<App>& app = apps[key];
+      if (!app) {
+        dims.width  = key.first;
+        dims.height = key.second;
+        app.reset(new App);
+        BAIL_IF_ERR(err = app->init(effectName, allocSize, &dims));
+        if (!tuned && app->_modelBatch < chunkSize) {
+          if (FLAG_verbose)
+            printf("Processing in chunks of %u, the batch size of the loaded model\n", app->_modelBatch);
+          chunkSize = app->_modelBatch;  // Takes effect from the next chunk to be launched; the one in flight is kept
+        }
+      }
+      BAIL_IF_ERR(err = RunImageBatch(effectName, *app, key.first, key.second, groupImages, groupIndices,
+                                      outfilePattern));
     }
+    if (FLAG_verbose)
+      printf("%u of %zu images\n", (n < imageFiles.size() ? n : (unsigned)imageFiles.size()), imageFiles.size());
+  }
+
+bail:
+  return err;
+}
+
+
+// Choose the mosaic layout for a set of frames, from the maximum input size of the effect.
+static NvCV_Status InitMosaic(const char* effectName, unsigned numFrames, unsigned width, unsigned height,
+                              MosaicPacker *packer) {
+  NvCV_Status  err;
+  NvVFX_Handle eff = nullptr;
+  unsigned     dw, dh, num, den, maxWidth, maxHeight;
+
+  GetDstSize(effectName, width, height, &dw, &dh);
+  if (NVCV_SUCCESS != ReduceScale(width, height, dw, dh, &num, &den)) {
+    printf("%ux%u --> %ux%u: different scale for width and height is not supported\n", width, height, dw, dh);
+    return NVCV_ERR_RESOLUTION;
+  }
+  BAIL_IF_ERR(err = NvVFX_CreateEffect(effectName, &eff));   // Only to query its capabilities
+  GetEffectMaxInputSize(eff, effectName, (float)dh / height, &maxWidth, &maxHeight);
+  err = packer->init(width, height, numFrames, maxWidth, maxHeight, FLAG_mosaicGuard, num, den);
+  if (NVCV_SUCCESS != err) {
+    printf("Cannot pack %ux%u images with a guard of %d into the %ux%u maximum input\n",
+      width, height, FLAG_mosaicGuard, maxWidth, maxHeight);
+    goto bail;
+  }
+  if (FLAG_verbose)
+    printf("Packing %u images into %u atlases of %ux%u, %u images each\n", numFrames, packer->numAtlases(),
+      packer->atlasWidth(), packer->atlasHeight(), packer->framesPerAtlas());
+bail:
+  NvVFX_DestroyEffect(eff);
+  return err;
+}
+
+// Run the frames through the effect as separate batch entries.
+static NvCV_Status RunBatch(App& app, std::vector<cv::Mat>& frames, std::vector<cv::Mat>& outputs) {
+  NvCV_Status err = NVCV_SUCCESS;
+  NvCVImage   nvx;
+  unsigned    i;
+  for (i = 0; i < frames.size(); ++i) {
+    NVWrapperForCVMat(&frames[i], &nvx);
     BAIL_IF_ERR(err = TransferToNthImage(i, &nvx, &app._src, 1.f / 255.f, app._stream, &app._stg));
-    ocv.release();
   }
+  BAIL_IF_ERR(err = NvVFX_SetU32(app._eff, NVVFX_BATCH_SIZE, (unsigned)frames.size()));
+  BAIL_IF_ERR(err = NvVFX_Run(app._eff, 0));
+  for (i = 0; i < frames.size(); ++i) {
+    NVWrapperForCVMat(&outputs[i], &nvx);
+    BAIL_IF_ERR(err = TransferFromNthImage(i, &app._dst, &nvx, 255.f, app._stream, &app._stg));
+  }
+bail:
+  return err;
+}
 
-  // Run batch
-  BAIL_IF_ERR(err = NvVFX_SetU32(app._eff, NVVFX_BATCH_SIZE, (unsigned)srcImages.size()));  // The batchSize can change every Run
+// Run the frames through the effect packed into atlases, which are themselves batched.
+// The atlas buffers are in pageable memory, so that they can be reused as soon as each transfer returns.
+static NvCV_Status RunMosaic(App& app, const MosaicPacker& packer, std::vector<cv::Mat>& frames,
+                             std::vector<cv::Mat>& outputs, NvCVImage *atlas, NvCVImage *dstAtlas) {
+  NvCV_Status err = NVCV_SUCCESS;
+  NvCVImage   nvx;
+  unsigned    a, i;
+  for (a = 0, i = 0; a < packer.numAtlases(); ++a) {
+    for (; i < frames.size() && packer.atlasOf(i) == a; ++i) {
+      NVWrapperForCVMat(&frames[i], &nvx);
+      BAIL_IF_ERR(err = packer.pack(i, &nvx, atlas));
+    }
+    BAIL_IF_ERR(err = TransferToNthImage(a, atlas, &app._src, 1.f / 255.f, app._stream, &app._stg));
+  }
+  BAIL_IF_ERR(err = NvVFX_SetU32(app._eff, NVVFX_BATCH_SIZE, packer.numAtlases()));
   BAIL_IF_ERR(err = NvVFX_Run(app._eff, 0));
+  for (a = 0, i = 0; a < packer.numAtlases(); ++a) {
+    BAIL_IF_ERR(err = TransferFromNthImage(a, &app._dst, dstAtlas, 255.f, app._stream, &app._stg));
+    for (; i < frames.size() && packer.atlasOf(i) == a; ++i) {
+      NVWrapperForCVMat(&outputs[i], &nvx);
+      BAIL_IF_ERR(err = packer.unpack(i, dstAtlas, &nvx, 1.f, app._stream, nullptr));
+    }
+  }
+bail:
+  return err;
+}
 
-  // Retrieve and write images
-  dstHeight = app._dst.height / batchSize;
-  BAIL_IF_ERR(err = NvCVImage_Alloc(&nvx, app._dst.width, dstHeight, ((app._dst.numComponents == 1) ? NVCV_Y : NVCV_BGR), NVCV_U8, NVCV_CHUNKY, NVCV_CPU, 0));
-  CVWrapperForNvCVImage(&nvx, &ocv);
-  if(IsLossyImageFile(outfilePattern))
+// Set up an App to process the frames in mosaic form, along with the CPU atlas buffers.
+static NvCV_Status InitMosaicApp(const char* effectName, std::vector<cv::Mat>& frames, MosaicPacker *packer, App *app,
+                                 NvCVImage *atlas, NvCVImage *dstAtlas) {
+  NvCV_Status err;
+  BAIL_IF_ERR(err = InitMosaic(effectName, (unsigned)frames.size(), frames[0].cols, frames[0].rows, packer));
+  BAIL_IF_ERR(err = NvCVImage_Alloc(atlas, packer->atlasWidth(), packer->atlasHeight(), NVCV_BGR, NVCV_U8,
+                                    NVCV_CHUNKY, NVCV_CPU, 0));
+  BAIL_IF_ERR(err = NvCVImage_Alloc(dstAtlas, packer->dstAtlasWidth(), packer->dstAtlasHeight(), NVCV_BGR, NVCV_U8,
+                                    NVCV_CHUNKY, NVCV_CPU, 0));
+  memset(atlas->pixels, 0, (size_t)atlas->pitch * atlas->height);  // Unused cells in the last atlas
+  BAIL_IF_ERR(err = app->init(effectName, packer->numAtlases(), atlas, packer->dstAtlasWidth(), packer->dstAtlasHeight()));
+bail:
+  return err;
+}
+
+static void AllocOutputs(const char* effectName, const std::vector<cv::Mat>& frames, std::vector<cv::Mat> *outputs) {
+  unsigned dw, dh;
+  GetDstSize(effectName, frames[0].cols, frames[0].rows, &dw, &dh);
+  outputs->resize(frames.size());
+  for (cv::Mat& out : *outputs)
+    out.create(dh, dw, CV_8UC3);
+}
+
+
+NvCV_Status MosaicProcessImages(const char* effectName, const std::vector<const char*>& srcImages, const char *outfilePattern) {
+  NvCV_Status           err;
+  App                   app;
+  MosaicPacker          packer;
+  NvCVImage             atlas, dstAtlas;
+  std::vector<cv::Mat>  frames, outputs;
+
+  BAIL_IF_ERR(err = ReadImages(srcImages, &frames));
+  BAIL_IF_ERR(err = InitMosaicApp(effectName, frames, &packer, &app, &atlas, &dstAtlas));
+  AllocOutputs(effectName, frames, &outputs);
+  BAIL_IF_ERR(err = RunMosaic(app, packer, frames, outputs, &atlas, &dstAtlas));
+
+  if (IsLossyImageFile(outfilePattern))
     fprintf(stderr, "WARNING: JPEG output file format will reduce image quality\n");
-  for (i = 0; i < batchSize; ++i) {
+  for (unsigned i = 0; i < outputs.size(); ++i) {
     char fileName[1024];
     snprintf(fileName, sizeof(fileName), outfilePattern, i);
-    BAIL_IF_ERR(err = TransferFromNthImage(i, &app._dst, &nvx, 255.f, app._stream, &app._stg));
-    if (!cv::imwrite(fileName, ocv)) {
+    if (!cv::imwrite(fileName, outputs[i])) {
       printf("Cannot write image file \"%s\"\n", fileName);
       BAIL(err, NVCV_ERR_WRITE);
     }
   }
-  // NvCVImage_Dealloc() is called in the destructors
+bail:
+  return err;
+}
+
+
+// Compare the throughput of running the images as separate batch entries with that of packing them into atlases.
+// Each pass includes the upload, the effect and the download, since packing and unpacking are part of the cost.
+NvCV_Status BenchmarkMosaic(const char* effectName, const std::vector<const char*>& srcImages, int iterations) {
+  typedef std::chrono::high_resolution_clock Clock;
+  NvCV_Status           err;
+  App                   batchApp, mosaicApp;
+  MosaicPacker          packer;
+  NvCVImage             atlas, dstAtlas, nvx;
+  std::vector<cv::Mat>  frames, outputs;
+  Clock::time_point     t0;
+  double                batchMs, mosaicMs;
+  int                   i;
+
+  BAIL_IF_ERR(err = ReadImages(srcImages, &frames));
+  AllocOutputs(effectName, frames, &outputs);
+  NVWrapperForCVMat(&frames[0], &nvx);
+  BAIL_IF_ERR(err = batchApp.init(effectName, (unsigned)frames.size(), &nvx));
+  BAIL_IF_ERR(err = InitMosaicApp(effectName, frames, &packer, &mosaicApp, &atlas, &dstAtlas));
+
+  BAIL_IF_ERR(err = RunBatch(batchApp, frames, outputs));                                     // Warm up
+  t0 = Clock::now();
+  for (i = 0; i < iterations; ++i)
+    BAIL_IF_ERR(err = RunBatch(batchApp, frames, outputs));
+  batchMs = std::chrono::duration<double, std::milli>(Clock::now() - t0).count() / iterations;
+
+  BAIL_IF_ERR(err = RunMosaic(mosaicApp, packer, frames, outputs, &atlas, &dstAtlas));       // Warm up
+  t0 = Clock::now();
+  for (i = 0; i < iterations; ++i)
+    BAIL_IF_ERR(err = RunMosaic(mosaicApp, packer, frames, outputs, &atlas, &dstAtlas));
+  mosaicMs = std::chrono::duration<double, std::milli>(Clock::now() - t0).count() / iterations;
+
+  printf("%s, %zu images of %dx%d, %d passes:\n", effectName, frames.size(), frames[0].cols, frames[0].rows, iterations);
+  printf("  batch  (batch of %zu):              %8.2f ms per pass, %8.1f images/s\n",
+    frames.size(), batchMs, frames.size() * 1000. / batchMs);
+  printf("  mosaic (batch of %u atlases %ux%u): %8.2f ms per pass, %8.1f images/s\n",
+    packer.numAtlases(), packer.atlasWidth(), packer.atlasHeight(), mosaicMs, frames.size() * 1000. / mosaicMs);
+bail:
+  return err;
+}
+
+
+// Time every combination of model batch size and run batch size, up to the maximum, on synthetic frames at the given
+// resolution, and record the Pareto front of throughput and p99 latency in the tune file. The latency of a Run() is
+// that of every image in its batch, so a larger batch usually buys throughput at the expense of latency.
+NvCV_Status AutoTuneBatch(const char* effectName, unsigned width, unsigned height, const char *tuneFile) {
+  typedef std::chrono::high_resolution_clock Clock;
+  NvCV_Status                   err;
+  std::vector<BatchTuneResult>  results, front;
+  std::vector<unsigned>         sizes, loaded;
+  std::vector<float>            runMs;
+  cv::Mat                       frame((int)height, (int)width, CV_8UC3);
+  NvCVImage                     nvx, dims;
+  const BatchTuneResult         *choice;
+  Clock::time_point             t0, tStart;
+  BatchTuneResult               r;
+  unsigned                      version, maxBatch, i;
+  int                           iters = (FLAG_tuneIters > 0) ? FLAG_tuneIters : 100;
+
+  BAIL_IF_ERR(err = NvVFX_GetVersion(&version));
+  maxBatch = (FLAG_maxBatch > 0) ? FLAG_maxBatch : 32;
+  for (i = 1; i < maxBatch; i *= 2)
+    sizes.push_back(i);
+  sizes.push_back(maxBatch);
+  cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(256));
+  NVWrapperForCVMat(&frame, &nvx);
+  dims.width  = width;
+  dims.height = height;
+
+  for (unsigned modelBatch : sizes) {
+    App app;
+    BAIL_IF_ERR(err = app.init(effectName, maxBatch, &dims, 0, 0, modelBatch));
+    if (std::find(loaded.begin(), loaded.end(), app._modelBatch) != loaded.end())
+      continue;   // The same model was substituted for a smaller request
+    loaded.push_back(app._modelBatch);
+    for (i = 0; i < maxBatch; ++i)
+      BAIL_IF_ERR(err = TransferToNthImage(i, &nvx, &app._src, 1.f / 255.f, app._stream, &app._stg));
+
+    for (unsigned runBatch : sizes) {
+      BAIL_IF_ERR(err = NvVFX_SetU32(app._eff, NVVFX_BATCH_SIZE, runBatch));
+      for (i = 0; i < 3; ++i)                                                   // Warm up
+        BAIL_IF_ERR(err = NvVFX_Run(app._eff, 0));
+      BAIL_IF_FALSE(cudaSuccess == cudaStreamSynchronize((cudaStream_t)app._stream), err, NVCV_ERR_CUDA);
+      runMs.clear();
+      tStart = Clock::now();
+      for (i = 0; i < (unsigned)iters; ++i) {
+        t0 = Clock::now();
+        BAIL_IF_ERR(err = NvVFX_Run(app._eff, 0));
+        BAIL_IF_FALSE(cudaSuccess == cudaStreamSynchronize((cudaStream_t)app._stream), err, NVCV_ERR_CUDA);
+        runMs.push_back(std::chrono::duration<float, std::milli>(Clock::now() - t0).count());
+      }
+      r.modelBatch   = app._modelBatch;
+      r.runBatch     = runBatch;
+      r.meanMs       = std::chrono::duration<float, std::milli>(Clock::now() - tStart).count() / iters;
+      r.imagesPerSec = runBatch * 1000.f / r.meanMs;
+      r.p99Ms        = Percentile(runMs, 99.f);
+      results.push_back(r);
+      if (FLAG_verbose)
+        printf("model batch %2u, run batch %2u: %8.1f images/s, p99 %7.2f ms\n",
+          r.modelBatch, r.runBatch, r.imagesPerSec, r.p99Ms);
+    }
+  }
+
+  front  = BatchParetoFront(results);
+  choice = ChooseBatchConfig(front, FLAG_latencyBudget);
+  printf("%s at %ux%u, Pareto-optimal batch sizes:\n", effectName, width, height);
+  printf("   model  run   images/s  p99 ms  mean ms\n");
+  for (const BatchTuneResult& p : front)
+    printf(" %c %5u %4u %10.1f %7.2f %8.2f\n", (&p == choice ? '*' : ' '), p.modelBatch, p.runBatch, p.imagesPerSec,
+      p.p99Ms, p.meanMs);
+
+  gTuneCache.store(BatchTuneCache::makeKey(effectName, width, height, version), front);
+  if (!gTuneCache.save(tuneFile)) {
+    printf("Cannot write the tune file \"%s\"\n", tuneFile);
+    BAIL(err, NVCV_ERR_WRITE);
+  }
+  printf("Written to \"%s\"\n", tuneFile);
 
 bail:
   return err;
@@ -385,12 +897,41 @@ int main(int argc, char** argv) {
   if (nErrs)
     return nErrs;
 
+  if (FLAG_resolution && FLAG_padTo > 1) {
+    printf("--resolution sets the height of each output, so images of different sizes cannot be padded to share "
+           "a batch; use --scale with --pad_to\n");
+    return 1;
+  }
   if (FLAG_outFile.empty())
     FLAG_outFile = "BatchOut_%02u.png";
   else if (std::string::npos == FLAG_outFile.find_first_of('%'))
     FLAG_outFile.insert(FLAG_outFile.size() - 4, "_%02u");  // assuming .xxx, i.e. .jpg, .png
 
-  vfxErr = BatchProcessImages(FLAG_effect.c_str(), FLAG_inFiles, FLAG_outFile.c_str());
+  gTuneCache.load(FLAG_tuneFile.c_str());  // It need not exist
+
+  if (FLAG_autoTune) {
+    unsigned width = 0, height = 0;
+    if (!FLAG_tuneSize.empty())
+      sscanf(FLAG_tuneSize.c_str(), "%ux%u", &width, &height);
+    else if (!FLAG_inFiles.empty()) {
+      cv::Mat im = cv::imread(FLAG_inFiles[0]);
+      width  = im.cols;
+      height = im.rows;
+    }
+    if (!width || !height) {
+      printf("Specify the resolution to tune for with --tune_size=<W>x<H> or an input image\n");
+      return 1;
+    }
+    vfxErr = AutoTuneBatch(FLAG_effect.c_str(), width, height, FLAG_tuneFile.c_str());
+  }
+  else if (FLAG_benchmark > 0)
+    vfxErr = BenchmarkMosaic(FLAG_effect.c_str(), FLAG_inFiles, FLAG_benchmark);
+  else if (!FLAG_inDir.empty())
+    vfxErr = StreamProcessImages(FLAG_effect.c_str(), FLAG_inDir.c_str(), FLAG_outFile.c_str());
+  else if (FLAG_mosaic)
+    vfxErr = MosaicProcessImages(FLAG_effect.c_str(), FLAG_inFiles, FLAG_outFile.c_str());
+  else
+    vfxErr = BatchProcessImages(FLAG_effect.c_str(), FLAG_inFiles, FLAG_outFile.c_str());
   if (NVCV_SUCCESS != vfxErr) {
     printf("Error: %s\n", NvCV_GetErrorStringFromCode(vfxErr));
     nErrs = (int)vfxErr;
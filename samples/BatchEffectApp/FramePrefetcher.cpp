@@ -0,0 +1,183 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include "FramePrefetcher.h"
+#include "nvCVOpenCV.h"
+
+
+/********************************************************************************
+ * PinnedFrameRing
+ ********************************************************************************/
+
+NvCV_Status PinnedFrameRing::alloc(unsigned depth, unsigned width, unsigned height) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _slots.clear();
+  _head = _count = _published = _taken = 0;
+  _aborted = false;
+  for (unsigned i = 0; i < depth; ++i) {
+    _slots.push_back(std::unique_ptr<NvCVImage>(new NvCVImage));
+    NvCV_Status err = NvCVImage_Alloc(_slots.back().get(), width, height, NVCV_BGR, NVCV_U8, NVCV_CHUNKY,
+                                      NVCV_CPU_PINNED, 0);
+    if (NVCV_SUCCESS != err) {
+      _slots.clear();
+      return err;
+    }
+  }
+  return NVCV_SUCCESS;
+}
+
+NvCVImage* PinnedFrameRing::beginWrite() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _free.wait(lock, [this] { return _aborted || _count < _slots.size(); });
+  if (_aborted)
+    return nullptr;
+  return _slots[(_head + _count++) % _slots.size()].get();
+}
+
+void PinnedFrameRing::endWrite() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  ++_published;
+}
+
+void PinnedFrameRing::cancelWrite() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  --_count;
+}
+
+unsigned PinnedFrameRing::ready() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _published;
+}
+
+NvCVImage* PinnedFrameRing::take() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (!_published)
+    return nullptr;
+  --_published;
+  return _slots[(_head + _taken++) % _slots.size()].get();
+}
+
+void PinnedFrameRing::release() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_taken)
+      return;
+    _head = (_head + 1) % _slots.size();
+    --_taken;
+    --_count;
+  }
+  _free.notify_one();
+}
+
+void PinnedFrameRing::abort() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _aborted = true;
+  }
+  _free.notify_all();
+}
+
+
+/********************************************************************************
+ * FramePrefetcher
+ ********************************************************************************/
+
+NvCV_Status FramePrefetcher::start(std::vector<cv::VideoCapture>& caps, const std::vector<cv::Size>& sizes,
+                                   unsigned depth, const std::vector<unsigned long long> *limits) {
+  NvCV_Status err;
+  stop();
+  _streams.clear();
+  _events   = 0;
+  _stopping = false;
+  for (size_t i = 0; i < caps.size(); ++i) {
+    _streams.push_back(std::unique_ptr<Stream>(new Stream));
+    Stream *s = _streams.back().get();
+    s->cap   = &caps[i];
+    s->limit = limits ? (*limits)[i] : 0;
+    s->ended = false;
+    if (NVCV_SUCCESS != (err = s->ring.alloc(depth ? depth : 1, sizes[i].width, sizes[i].height)))
+      return err;
+  }
+  for (auto& s : _streams)
+    s->thread = std::thread(&FramePrefetcher::decodeLoop, this, s.get());
+  return NVCV_SUCCESS;
+}
+
+void FramePrefetcher::stop() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  for (auto& s : _streams)
+    s->ring.abort();
+  for (auto& s : _streams)
+    if (s->thread.joinable())
+      s->thread.join();
+}
+
+void FramePrefetcher::decodeLoop(Stream *s) {
+  cv::Mat wrap;
+  for (unsigned long long n = 0; !s->limit || n < s->limit; ++n) {
+    NvCVImage *slot = s->ring.beginWrite();
+    if (!slot)
+      break;
+    CVWrapperForNvCVImage(slot, &wrap);
+    // The frame is decoded in place, unless its size differs, in which case OpenCV reallocates, and the stream ends.
+    if (!s->cap->read(wrap) || wrap.data != slot->pixels) {
+      s->ring.cancelWrite();
+      break;
+    }
+    s->ring.endWrite();
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      ++_events;
+    }
+    _cond.notify_all();
+  }
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    s->ended = true;
+    ++_events;
+  }
+  _cond.notify_all();
+}
+
+bool FramePrefetcher::ended(unsigned stream) {
+  Stream *s = _streams[stream].get();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!s->ended)
+      return false;
+  }
+  return 0 == s->ring.ready();  // The last frame is published before the stream is marked as ended
+}
+
+unsigned long long FramePrefetcher::events() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _events;
+}
+
+void FramePrefetcher::waitForEvent(unsigned long long seen) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _cond.wait(lock, [&] { return _events != seen || _stopping; });
+}
@@ -0,0 +1,136 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __FRAME_PREFETCHER_H__
+#define __FRAME_PREFETCHER_H__
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "nvCVImage.h"
+#include "opencv2/opencv.hpp"
+
+//! A bounded ring of pinned BGR frame buffers, written by one decode thread and released in order by one consumer.
+//! Frames are decoded directly into the pinned buffers, so that they can be uploaded asynchronously without staging.
+class PinnedFrameRing {
+public:
+  PinnedFrameRing() : _head(0), _count(0), _published(0), _taken(0), _aborted(false) {}
+
+  //! Allocate the ring.
+  //! \param[in]  depth   the number of frames that can be in flight.
+  //! \param[in]  width   the width of the frames.
+  //! \param[in]  height  the height of the frames.
+  //! \return     NVCV_SUCCESS, or NVCV_ERR_MEMORY if the pinned memory could not be allocated.
+  NvCV_Status alloc(unsigned depth, unsigned width, unsigned height);
+
+  //! Get the next free slot to decode into, waiting until the consumer releases one.
+  //! \return     the slot, or NULL if the ring has been aborted.
+  NvCVImage* beginWrite();
+
+  //! Publish the slot obtained from beginWrite().
+  void endWrite();
+
+  //! Return the slot obtained from beginWrite() unpublished, e.g. at the end of the video.
+  void cancelWrite();
+
+  //! The number of published frames that have not yet been taken.
+  unsigned ready();
+
+  //! Get the oldest published frame that has not yet been taken, without waiting.
+  //! \return     the frame, or NULL if none is ready.
+  NvCVImage* take();
+
+  //! Release the oldest frame in flight back to the decoder. Any asynchronous transfer from it must have completed.
+  void release();
+
+  //! Unblock the decoder, e.g. when stopping early.
+  void abort();
+
+private:
+  std::vector<std::unique_ptr<NvCVImage> > _slots;
+  unsigned                _head;        // The oldest slot in flight
+  unsigned                _count;       // The number of slots in flight, i.e. published or being written
+  unsigned                _published;   // The number of published slots that have not yet been taken
+  unsigned                _taken;       // The number of taken slots that have not yet been released
+  bool                    _aborted;
+  std::mutex              _mutex;
+  std::condition_variable _free;
+};
+
+
+//! Decode a set of videos on one thread each, prefetching their frames into pinned rings.
+//! The consumer takes whichever frames are ready, and releases them once it is done with them.
+class FramePrefetcher {
+public:
+  FramePrefetcher() : _events(0), _stopping(false) {}
+  ~FramePrefetcher() { stop(); }
+
+  //! Start decoding. The captures must outlive the prefetcher, or stop() must be called.
+  //! \param[in]  caps    the opened captures.
+  //! \param[in]  sizes   the size of the frames of each capture; a frame of any other size ends its stream.
+  //! \param[in]  depth   the number of frames to prefetch for each stream.
+  //! \param[in]  limits  if not NULL, the number of frames to read from each capture, 0 meaning to the end.
+  //! \return     NVCV_SUCCESS, or NVCV_ERR_MEMORY if the pinned memory could not be allocated.
+  NvCV_Status start(std::vector<cv::VideoCapture>& caps, const std::vector<cv::Size>& sizes, unsigned depth,
+                    const std::vector<unsigned long long> *limits = nullptr);
+
+  //! Stop decoding and join the threads. This is called automatically by the destructor.
+  void stop();
+
+  //! Get the next frame of a stream if it is ready, without waiting.
+  NvCVImage* take(unsigned stream) { return _streams[stream]->ring.take(); }
+
+  //! Release the oldest frame taken from a stream.
+  void release(unsigned stream) { _streams[stream]->ring.release(); }
+
+  //! Determine whether a stream has ended and all of its frames have been taken.
+  bool ended(unsigned stream);
+
+  //! The number of frames published or streams ended so far, for waitForEvent().
+  unsigned long long events();
+
+  //! Wait until a frame is published or a stream ends, after the given count of events().
+  void waitForEvent(unsigned long long seen);
+
+private:
+  struct Stream {
+    PinnedFrameRing   ring;
+    cv::VideoCapture  *cap;
+    unsigned long long limit;   // 0 for no limit
+    bool              ended;    // The decoder has stopped; the ring may still hold frames
+    std::thread       thread;
+  };
+
+  void decodeLoop(Stream *s);
+
+  std::vector<std::unique_ptr<Stream> > _streams;
+  unsigned long long                    _events;
+  bool                                  _stopping;
+  std::mutex                            _mutex;
+  std::condition_variable               _cond;
+};
+
+#endif // __FRAME_PREFETCHER_H__
@@ -0,0 +1,125 @@
+/*###############################################################################
+#
+# Copyright (c) 2020 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "MosaicPacker.h"
+
+
+static unsigned RoundUp(unsigned x, unsigned n) { return (x + n - 1) / n * n; }
+
+
+/********************************************************************************
+ * MosaicPacker::init
+ ********************************************************************************/
+
+NvCV_Status MosaicPacker::init(unsigned frameWidth, unsigned frameHeight, unsigned numFrames, unsigned maxWidth,
+                               unsigned maxHeight, unsigned guard, unsigned scaleNum, unsigned scaleDen) {
+  _cols = _rows = 0;
+  if (!numFrames || !scaleNum || !scaleDen || frameWidth % scaleDen || frameHeight % scaleDen)
+    return NVCV_ERR_RESOLUTION;
+  _frameWidth  = frameWidth;
+  _frameHeight = frameHeight;
+  _numFrames   = numFrames;
+  _scaleNum    = scaleNum;
+  _scaleDen    = scaleDen;
+  _guard       = RoundUp(guard, scaleDen);          // So that every frame lands on whole pixels after scaling
+  _cellWidth   = frameWidth  + 2 * _guard;
+  _cellHeight  = frameHeight + 2 * _guard;
+  if (_cellWidth > maxWidth || _cellHeight > maxHeight)
+    return NVCV_ERR_RESOLUTION;
+
+  // Fill as many columns as fit, then just enough rows for the frames, spreading them evenly over the atlases.
+  unsigned maxCols = maxWidth / _cellWidth, maxRows = maxHeight / _cellHeight;
+  _cols = (numFrames < maxCols) ? numFrames : maxCols;
+  _rows = (numFrames + _cols - 1) / _cols;
+  if (_rows > maxRows) {
+    unsigned atlases = (_rows + maxRows - 1) / maxRows;
+    _rows = (_rows + atlases - 1) / atlases;
+  }
+  return NVCV_SUCCESS;
+}
+
+
+/********************************************************************************
+ * MosaicPacker::srcRect, dstRect
+ ********************************************************************************/
+
+NvCVRect2i MosaicPacker::srcRect(unsigned frame) const {
+  unsigned   cell = frame % framesPerAtlas();
+  NvCVRect2i r;
+  r.x      = (int)((cell % _cols) * _cellWidth  + _guard);
+  r.y      = (int)((cell / _cols) * _cellHeight + _guard);
+  r.width  = (int)_frameWidth;
+  r.height = (int)_frameHeight;
+  return r;
+}
+
+NvCVRect2i MosaicPacker::dstRect(unsigned frame) const {
+  NvCVRect2i r = srcRect(frame);
+  r.x      = r.x      / (int)_scaleDen * (int)_scaleNum;
+  r.y      = r.y      / (int)_scaleDen * (int)_scaleNum;
+  r.width  = r.width  / (int)_scaleDen * (int)_scaleNum;
+  r.height = r.height / (int)_scaleDen * (int)_scaleNum;
+  return r;
+}
+
+
+/********************************************************************************
+ * MosaicPacker::pack
+ ********************************************************************************/
+
+NvCV_Status MosaicPacker::pack(unsigned frame, const NvCVImage *src, NvCVImage *atlas) const {
+  if (NVCV_U8 != src->componentType || NVCV_CHUNKY != src->planar || NVCV_U8 != atlas->componentType ||
+      NVCV_CHUNKY != atlas->planar || src->pixelBytes != atlas->pixelBytes)
+    return NVCV_ERR_PIXELFORMAT;
+  if (src->width != _frameWidth || src->height != _frameHeight ||
+      atlas->width != atlasWidth() || atlas->height != atlasHeight())
+    return NVCV_ERR_MISMATCH;
+
+  const unsigned   nb = src->pixelBytes;
+  const NvCVRect2i r  = srcRect(frame);
+  for (int y = -(int)_guard; y < (int)(_frameHeight + _guard); ++y) {
+    int sy = (y < 0) ? 0 : (y >= (int)_frameHeight) ? (int)_frameHeight - 1 : y;   // Replicate the top and bottom
+    const unsigned char *s = (const unsigned char*)src->pixels + (ptrdiff_t)sy * src->pitch;
+    unsigned char *d = (unsigned char*)atlas->pixels + (ptrdiff_t)(r.y + y) * atlas->pitch + (ptrdiff_t)r.x * nb;
+    memcpy(d, s, (size_t)_frameWidth * nb);
+    for (unsigned g = 1; g <= _guard; ++g) {                                        // Replicate the left and right
+      memcpy(d - (ptrdiff_t)g * nb, s, nb);
+      memcpy(d + (ptrdiff_t)(_frameWidth - 1 + g) * nb, s + (ptrdiff_t)(_frameWidth - 1) * nb, nb);
+    }
+  }
+  return NVCV_SUCCESS;
+}
+
+
+/********************************************************************************
+ * MosaicPacker::unpack
+ ********************************************************************************/
+
+NvCV_Status MosaicPacker::unpack(unsigned frame, const NvCVImage *atlas, NvCVImage *dst, float scale,
+                                 struct CUstream_st *stream, NvCVImage *tmp) const {
+  NvCVRect2i r = dstRect(frame);
+  return NvCVImage_TransferRect(atlas, &r, dst, nullptr, scale, stream, tmp);
+}
@@ -0,0 +1,95 @@
+/*###############################################################################
+#
+# Copyright (c) 2020 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __MOSAIC_PACKER__
+#define __MOSAIC_PACKER__
+
+#include "nvCVImage.h"
+
+
+//! Packs many small, equally sized frames into a grid in one or more larger atlas images, so that a stateless effect
+//! can process them in one pass at an input size that makes better use of the model.
+//! Each frame is surrounded by a guard band of replicated edge pixels, so that the effect's receptive field sees
+//! plausible content, rather than the neighboring frame, at the frame boundaries.
+class MosaicPacker {
+public:
+  MosaicPacker() : _frameWidth(0), _frameHeight(0), _guard(0), _cellWidth(0), _cellHeight(0), _cols(0), _rows(0),
+                   _numFrames(0), _scaleNum(1), _scaleDen(1) {}
+
+  //! Choose the atlas layout.
+  //! \param[in]  frameWidth  the width  of each frame.
+  //! \param[in]  frameHeight the height of each frame.
+  //! \param[in]  numFrames   the number of frames to be packed.
+  //! \param[in]  maxWidth    the maximum width  of the atlas, typically the maximum input width  of the effect.
+  //! \param[in]  maxHeight   the maximum height of the atlas, typically the maximum input height of the effect.
+  //! \param[in]  guard       the desired width of the guard band around each frame, in pixels.
+  //! \param[in]  scaleNum    the numerator   of the scale applied by the effect.
+  //! \param[in]  scaleDen    the denominator of the scale applied by the effect.
+  //! \return NVCV_SUCCESS        if a layout was found.
+  //! \return NVCV_ERR_RESOLUTION if even a single frame with its guard band does not fit within the maximum size,
+  //!                             or the scaled frame size is not a whole number of pixels.
+  NvCV_Status init(unsigned frameWidth, unsigned frameHeight, unsigned numFrames, unsigned maxWidth,
+                   unsigned maxHeight, unsigned guard, unsigned scaleNum = 1, unsigned scaleDen = 1);
+
+  unsigned framesPerAtlas() const { return _cols * _rows; }                                   //!< Cells per atlas.
+  unsigned numAtlases()     const { return (_numFrames + framesPerAtlas() - 1) / framesPerAtlas(); }
+  unsigned atlasWidth()     const { return _cols * _cellWidth;  }                             //!< Source atlas width.
+  unsigned atlasHeight()    const { return _rows * _cellHeight; }                             //!< Source atlas height.
+  unsigned dstAtlasWidth()  const { return atlasWidth()  / _scaleDen * _scaleNum; }           //!< Output atlas width.
+  unsigned dstAtlasHeight() const { return atlasHeight() / _scaleDen * _scaleNum; }           //!< Output atlas height.
+
+  //! Get the atlas index of a frame.
+  unsigned atlasOf(unsigned frame) const { return frame / framesPerAtlas(); }
+
+  //! Get the rectangle of a frame within the output atlas, excluding its guard band.
+  NvCVRect2i dstRect(unsigned frame) const;
+
+  //! Copy a frame into its cell in the source atlas, and fill in its guard band.
+  //! \param[in]  frame the index of the frame.
+  //! \param[in]  src   the frame, a CPU-accessible chunky 8-bit image of frameWidth x frameHeight.
+  //! \param[out] atlas the source atlas for this frame, of the same format, and atlasWidth x atlasHeight.
+  //! \return NVCV_SUCCESS          if successful.
+  //! \return NVCV_ERR_PIXELFORMAT  if the images are not chunky 8-bit images of the same format.
+  //! \return NVCV_ERR_MISMATCH     if the images are not of the expected size.
+  NvCV_Status pack(unsigned frame, const NvCVImage *src, NvCVImage *atlas) const;
+
+  //! Copy a frame out of its cell in the output atlas.
+  //! \param[in]  frame the index of the frame.
+  //! \param[in]  atlas the output atlas for this frame.
+  //! \param[out] dst   the output frame.
+  //! \param[in]  scale the scale applied to the pixel values, as in NvCVImage_Transfer().
+  //! \param[in]  stream the CUDA stream.
+  //! \param[in]  tmp   a staging buffer.
+  //! \return NVCV_SUCCESS if successful.
+  NvCV_Status unpack(unsigned frame, const NvCVImage *atlas, NvCVImage *dst, float scale, struct CUstream_st *stream,
+                     NvCVImage *tmp) const;
+
+private:
+  NvCVRect2i srcRect(unsigned frame) const;
+
+  unsigned _frameWidth, _frameHeight, _guard, _cellWidth, _cellHeight, _cols, _rows, _numFrames;
+  unsigned _scaleNum, _scaleDen;
+};
+
+
+#endif // __MOSAIC_PACKER__
@@ -0,0 +1,153 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <algorithm>
+
+#include "ResolutionBuckets.h"
+
+
+static unsigned RoundUp(unsigned x, unsigned n) { return (n > 1) ? (x + n - 1) / n * n : x; }
+
+
+void ResolutionBuckets::init(unsigned padTo, unsigned maxBatch, float maxPadWaste) {
+  _padTo       = padTo;
+  _maxBatch    = maxBatch;
+  _maxPadWaste = maxPadWaste;
+  _sizes.clear();
+  _bucketOf.clear();
+  _buckets.clear();
+}
+
+unsigned ResolutionBuckets::add(unsigned width, unsigned height) {
+  _sizes.push_back(width);
+  _sizes.push_back(height);
+  return numItems() - 1;
+}
+
+
+/********************************************************************************
+ * ResolutionBuckets::build
+ ********************************************************************************/
+
+void ResolutionBuckets::build() {
+  unsigned i, j, n = numItems();
+  _buckets.clear();
+  _bucketOf.assign(n, 0);
+
+  // Bucket by padded resolution
+  for (i = 0; i < n; ++i) {
+    unsigned w = RoundUp(_sizes[2 * i], _padTo), h = RoundUp(_sizes[2 * i + 1], _padTo);
+    for (j = 0; j < _buckets.size(); ++j)
+      if (_buckets[j].width == w && _buckets[j].height == h)
+        break;
+    if (j == _buckets.size()) {
+      _buckets.push_back(Bucket());
+      _buckets[j].width  = w;
+      _buckets[j].height = h;
+    }
+    _buckets[j].items.push_back(i);
+  }
+
+  // Fold sparse buckets into enclosing ones, smallest first, so that folds can cascade
+  std::sort(_buckets.begin(), _buckets.end(), [](const Bucket& a, const Bucket& b) {
+    return (unsigned long long)a.width * a.height < (unsigned long long)b.width * b.height;
+  });
+  for (i = 0; i < _buckets.size(); ++i) {
+    Bucket& b = _buckets[i];
+    double  area = (double)b.width * b.height;
+    for (j = i + 1; j < _buckets.size(); ++j) {
+      Bucket& c = _buckets[j];
+      if (c.width < b.width || c.height < b.height || 1. - area / ((double)c.width * c.height) > _maxPadWaste)
+        continue;
+      if (numRuns(b.items.size() + c.items.size()) < numRuns(b.items.size()) + numRuns(c.items.size())) {
+        c.items.insert(c.items.end(), b.items.begin(), b.items.end());
+        std::sort(c.items.begin(), c.items.end());
+        b.items.clear();
+      }
+      break;  // Only consider the smallest enclosing bucket
+    }
+  }
+  _buckets.erase(std::remove_if(_buckets.begin(), _buckets.end(), [](const Bucket& b) { return b.items.empty(); }),
+                 _buckets.end());
+  for (j = 0; j < _buckets.size(); ++j)
+    for (unsigned item : _buckets[j].items)
+      _bucketOf[item] = j;
+}
+
+
+/********************************************************************************
+ * ResolutionBuckets::split, schedule
+ ********************************************************************************/
+
+std::vector<std::vector<unsigned> > ResolutionBuckets::split(const std::vector<unsigned>& items) const {
+  std::vector<std::vector<unsigned> > batches(numRuns(items.size()));
+  size_t k = 0;
+  for (size_t b = 0; b < batches.size(); ++b) {
+    size_t size = (items.size() - k) / (batches.size() - b);   // Spread the remainder over the last batches
+    batches[b].assign(items.begin() + k, items.begin() + k + size);
+    k += size;
+  }
+  return batches;
+}
+
+std::vector<ResolutionBuckets::Batch> ResolutionBuckets::schedule() const {
+  std::vector<std::vector<std::vector<unsigned> > > perBucket;
+  std::vector<Batch> batches;
+  size_t most = 0;
+  for (const Bucket& b : _buckets) {
+    perBucket.push_back(split(b.items));
+    most = std::max(most, perBucket.back().size());
+  }
+  for (size_t k = 0; k < most; ++k) {
+    for (unsigned j = 0; j < perBucket.size(); ++j) {
+      if (k >= perBucket[j].size())
+        continue;
+      batches.push_back(Batch());
+      batches.back().bucket = j;
+      batches.back().items.swap(perBucket[j][k]);
+    }
+  }
+  return batches;
+}
+
+unsigned ResolutionBuckets::maxBatchOf(unsigned bucket) const {
+  size_t n = _buckets[bucket].items.size(), runs = numRuns(n);
+  return runs ? (unsigned)((n + runs - 1) / runs) : 0;
+}
+
+
+/********************************************************************************
+ * ResolutionBuckets::print
+ ********************************************************************************/
+
+void ResolutionBuckets::print(FILE *fp) const {
+  for (unsigned j = 0; j < _buckets.size(); ++j) {
+    const Bucket& b = _buckets[j];
+    unsigned long long used = 0;
+    for (unsigned item : b.items)
+      used += (unsigned long long)_sizes[2 * item] * _sizes[2 * item + 1];
+    fprintf(fp, "Bucket %u: %ux%u, %zu items in %u runs of up to %u, %.1f%% padding\n", j, b.width, b.height,
+      b.items.size(), numRuns(b.items.size()), maxBatchOf(j),
+      100. * (1. - (double)used / ((double)b.width * b.height * b.items.size())));
+  }
+}
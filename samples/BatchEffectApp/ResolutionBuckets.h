@@ -0,0 +1,87 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __RESOLUTION_BUCKETS_H__
+#define __RESOLUTION_BUCKETS_H__
+
+#include <stdio.h>
+
+#include <vector>
+
+//! Group images or streams of differing resolutions into buckets that can each be batched through one effect instance.
+//! Each item is assigned the bucket of its resolution, rounded up to a multiple of padTo; an item smaller than its
+//! bucket is padded at the right and bottom, and the result cropped. A bucket too sparse to fill its batches on its own
+//! is folded into a larger bucket that encloses it, when that saves a Run and the padding wastes no more than
+//! maxPadWaste of the larger bucket's area.
+class ResolutionBuckets {
+public:
+  struct Bucket {
+    unsigned              width, height;  //!< The resolution of the effect instance for this bucket.
+    std::vector<unsigned> items;          //!< The items in this bucket, in the order in which they were added.
+  };
+  struct Batch {
+    unsigned              bucket;         //!< The bucket of the items.
+    std::vector<unsigned> items;          //!< The items to run together.
+  };
+
+  //! Initialize, removing any items.
+  //! \param[in]  padTo       the granularity of the bucket resolutions; 0 or 1 buckets only identical resolutions.
+  //! \param[in]  maxBatch    the largest number of items to run at once; 0 for no limit.
+  //! \param[in]  maxPadWaste the largest fraction of a bucket's area that folding in a smaller bucket may waste.
+  void init(unsigned padTo, unsigned maxBatch, float maxPadWaste = 0.5f);
+
+  //! Add an item, before build().
+  //! \return the index of the item.
+  unsigned add(unsigned width, unsigned height);
+
+  //! Form the buckets from the items added so far.
+  void build();
+
+  //! Divide each bucket into batches of nearly equal size, rather than full batches and a remnant,
+  //! interleaving the buckets.
+  std::vector<Batch> schedule() const;
+
+  //! Split a set of items of one bucket into batches of nearly equal size.
+  std::vector<std::vector<unsigned> > split(const std::vector<unsigned>& items) const;
+
+  const std::vector<Bucket>& buckets() const { return _buckets; }
+  unsigned bucketOf(unsigned item) const { return _bucketOf[item]; }
+  unsigned numItems() const { return (unsigned)(_sizes.size() / 2); }
+
+  //! The size of the largest batch that a bucket will run.
+  unsigned maxBatchOf(unsigned bucket) const;
+
+  //! Print the buckets.
+  void print(FILE *fp) const;
+
+private:
+  unsigned numRuns(size_t n) const { return _maxBatch ? (unsigned)((n + _maxBatch - 1) / _maxBatch) : (n ? 1u : 0u); }
+
+  unsigned                _padTo, _maxBatch;
+  float                   _maxPadWaste;
+  std::vector<unsigned>   _sizes;     // width, height pairs
+  std::vector<unsigned>   _bucketOf;
+  std::vector<Bucket>     _buckets;
+};
+
+#endif // __RESOLUTION_BUCKETS_H__
@@ -0,0 +1,268 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <algorithm>
+
+#include "ShardManager.h"
+
+
+ShardManager::ShardManager() : _streamsPerDevice(0), _saturation(0.9f), _cooldownMs(1000.f), _closed(false), _moves(0) {}
+
+
+/********************************************************************************
+ * ShardManager::init
+ ********************************************************************************/
+
+void ShardManager::init(unsigned numDevices, unsigned streamsPerDevice, float saturation, float cooldownMs) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  DeviceStats zero;
+  zero.streams  = 0;
+  zero.load     = zero.capacity = zero.utilization = 0.f;
+  zero.batches  = zero.placed = 0;
+  _devices.assign(numDevices, zero);
+  _streams.clear();
+  _streamsPerDevice = streamsPerDevice;
+  _saturation       = saturation;
+  _cooldownMs       = cooldownMs;
+  _closed           = false;
+  _moves            = 0;
+  _lastMove         = Clock::time_point();
+}
+
+
+/********************************************************************************
+ * Helpers
+ ********************************************************************************/
+
+ShardManager::Stream& ShardManager::streamOf(unsigned stream) {
+  if (stream >= _streams.size()) {
+    Stream unplaced;
+    unplaced.device = -1;
+    unplaced.weight = 0.f;
+    unplaced.move   = kMoveNone;
+    _streams.resize(stream + 1, unplaced);
+  }
+  return _streams[stream];
+}
+
+// A device that has not run anything yet is assumed to be as capable as the average of those that have.
+float ShardManager::capacityOf(const DeviceStats& d) const {
+  float sum = 0.f;
+  unsigned n = 0;
+  if (d.capacity > 0.f)
+    return d.capacity;
+  for (const DeviceStats& e : _devices)
+    if (e.capacity > 0.f) {
+      sum += e.capacity;
+      ++n;
+    }
+  return n ? sum / n : 1.f;
+}
+
+
+/********************************************************************************
+ * ShardManager::place, remove
+ ********************************************************************************/
+
+int ShardManager::place(unsigned stream, float weight) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  for (;;) {
+    int   best = -1;
+    float bestScore = 0.f;
+    if (_closed)
+      return -1;
+    for (unsigned i = 0; i < _devices.size(); ++i) {
+      const DeviceStats& d = _devices[i];
+      if (d.streams >= _streamsPerDevice)
+        continue;
+      float score = (d.load + weight) / capacityOf(d);
+      if (best < 0 || score < bestScore) {
+        best      = (int)i;
+        bestScore = score;
+      }
+    }
+    if (best >= 0) {
+      Stream& s = streamOf(stream);
+      DeviceStats& d = _devices[best];
+      s.device = best;
+      s.weight = weight;
+      s.move   = kMoveNone;
+      ++d.streams;
+      d.load  += weight;
+      ++d.placed;
+      return best;
+    }
+    _cond.wait(lock);   // Every device is full; wait for a stream to end
+  }
+}
+
+void ShardManager::remove(unsigned stream) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  Stream& s = streamOf(stream);
+  if (s.device >= 0) {
+    DeviceStats& d = _devices[s.device];
+    --d.streams;
+    d.load = std::max(0.f, d.load - s.weight);
+  }
+  s.device = -1;
+  s.move   = kMoveNone;
+  _cond.notify_all();
+}
+
+
+/********************************************************************************
+ * ShardManager::report, rebalance
+ ********************************************************************************/
+
+void ShardManager::report(unsigned device, float work, float busyMs, float idleMs) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  DeviceStats& d = _devices[device];
+  if (work > 0.f && busyMs > 0.f) {
+    float capacity = work / busyMs;
+    d.capacity = d.capacity ? d.capacity + (capacity - d.capacity) * (1.f / 8.f) : capacity;  // 1 pole IIR filter
+  }
+  if (busyMs + idleMs > 0.f) {
+    float utilization = busyMs / (busyMs + idleMs);
+    d.utilization = d.batches ? d.utilization + (utilization - d.utilization) * (1.f / 8.f) : utilization;
+  }
+  ++d.batches;
+  rebalance(device);
+}
+
+// Move the stream off a saturated device that best evens out the utilization of it and the destination,
+// as long as the destination stays below saturation.
+void ShardManager::rebalance(unsigned from) {
+  Clock::time_point now = Clock::now();
+  DeviceStats& src = _devices[from];
+  int   bestStream = -1, bestDevice = -1;
+  float bestPeak = src.utilization;
+
+  if (_devices.size() < 2 || src.utilization <= _saturation ||
+      std::chrono::duration<float, std::milli>(now - _lastMove).count() < _cooldownMs)
+    return;
+  for (unsigned i = 0; i < _streams.size(); ++i) {
+    const Stream& s = _streams[i];
+    if (s.device != (int)from || s.move != kMoveNone)
+      continue;
+    for (unsigned j = 0; j < _devices.size(); ++j) {
+      const DeviceStats& dst = _devices[j];
+      if (j == from || dst.streams >= _streamsPerDevice)
+        continue;
+      float dstAfter = dst.utilization + s.weight / capacityOf(dst);
+      float srcAfter = src.utilization - s.weight / capacityOf(src);
+      float peak     = std::max(dstAfter, srcAfter);
+      if (dstAfter < _saturation && peak < bestPeak) {
+        bestPeak   = peak;
+        bestStream = (int)i;
+        bestDevice = (int)j;
+      }
+    }
+  }
+  if (bestStream < 0)
+    return;
+
+  Stream& s = _streams[bestStream];
+  DeviceStats& dst = _devices[bestDevice];
+  --src.streams;
+  src.load = std::max(0.f, src.load - s.weight);
+  ++dst.streams;
+  dst.load += s.weight;
+  ++dst.placed;
+  s.device  = bestDevice;
+  s.move    = kMovePending;
+  _lastMove = now;
+  ++_moves;
+}
+
+
+/********************************************************************************
+ * Moving a stream: moving, isMoving, drained, waitDrained
+ ********************************************************************************/
+
+bool ShardManager::moving(unsigned stream, unsigned *to) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  Stream& s = streamOf(stream);
+  if (s.move != kMovePending)
+    return false;
+  s.move = kMoveLeaving;
+  *to = (unsigned)s.device;
+  return true;
+}
+
+bool ShardManager::isMoving(unsigned stream) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return streamOf(stream).move == kMoveLeaving;
+}
+
+void ShardManager::drained(unsigned stream) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  Stream& s = streamOf(stream);
+  if (s.move == kMoveLeaving)
+    s.move = kMoveDrained;
+  _cond.notify_all();
+}
+
+bool ShardManager::waitDrained(unsigned stream) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _cond.wait(lock, [&] { return _closed || streamOf(stream).move == kMoveDrained; });
+  if (_closed)
+    return false;
+  streamOf(stream).move = kMoveNone;
+  return true;
+}
+
+void ShardManager::close() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _closed = true;
+  _cond.notify_all();
+}
+
+
+/********************************************************************************
+ * ShardManager::deviceOf, stats, moves, printStats
+ ********************************************************************************/
+
+int ShardManager::deviceOf(unsigned stream) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return streamOf(stream).device;
+}
+
+std::vector<ShardManager::DeviceStats> ShardManager::stats() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _devices;
+}
+
+unsigned long long ShardManager::moves() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _moves;
+}
+
+void ShardManager::printStats(FILE *fp) {
+  std::vector<DeviceStats> devices = stats();
+  for (unsigned i = 0; i < devices.size(); ++i) {
+    const DeviceStats& d = devices[i];
+    fprintf(fp, "Shard %u: %llu streams placed, %llu batches, %.1f%% utilized, capacity %.0f per ms\n",
+      i, d.placed, d.batches, 100.f * d.utilization, d.capacity);
+  }
+  fprintf(fp, "%llu streams moved between shards\n", moves());
+}
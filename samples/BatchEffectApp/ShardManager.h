@@ -0,0 +1,133 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __SHARD_MANAGER_H__
+#define __SHARD_MANAGER_H__
+
+#include <stdio.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+//! Placement of streams onto a set of devices, each running its own effect instance.
+//! A new stream is placed on the device where it adds the least load relative to the measured capacity of the device.
+//! Each device reports the work and the busy and idle time of every batch; a device that is busy more than the
+//! saturation fraction of the time sheds one stream to the least utilized device that can absorb it,
+//! at most once per cooldown interval, so that the streams do not ping-pong.
+//! Moving a stream is a handoff: the producer of the stream polls moving(), leaves the old device, waits until that
+//! device has drained the stream's frames, and then joins the new one.
+//! This class holds no effect handles or CUDA resources, so it can be exercised with simulated devices.
+class ShardManager {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  struct DeviceStats {
+    unsigned            streams;      //!< The number of streams currently placed on the device.
+    float               load;         //!< The sum of the weights of those streams.
+    float               capacity;     //!< The measured work per busy millisecond; 0 until the first report.
+    float               utilization;  //!< The smoothed fraction of the time that the device is busy.
+    unsigned long long  batches;      //!< The number of batches reported.
+    unsigned long long  placed;       //!< The number of streams placed on the device, including moves.
+  };
+
+  ShardManager();
+
+  //! Initialize, forgetting all streams.
+  //! \param[in]  numDevices        the number of devices.
+  //! \param[in]  streamsPerDevice  the largest number of streams that a device can hold at once.
+  //! \param[in]  saturation        the utilization above which a device sheds streams.
+  //! \param[in]  cooldownMs        the shortest time between moves.
+  void init(unsigned numDevices, unsigned streamsPerDevice, float saturation = 0.9f, float cooldownMs = 1000.f);
+
+  //! Place a new stream, waiting until some device has room for it.
+  //! \param[in]  stream  the identifier of the stream, e.g. the index of its video.
+  //! \param[in]  weight  the demand of the stream, in the units of work reported by report(), per millisecond.
+  //! \return     the device, or -1 if the manager has been closed.
+  int place(unsigned stream, float weight);
+
+  //! Remove a stream that has ended, making room for another.
+  void remove(unsigned stream);
+
+  //! Report a completed batch. A move may be scheduled as a result.
+  //! \param[in]  device  the device that ran the batch.
+  //! \param[in]  work    the amount of work in the batch, e.g. the number of pixels.
+  //! \param[in]  busyMs  the time taken to run the batch.
+  //! \param[in]  idleMs  the time spent waiting for the batch to be gathered.
+  void report(unsigned device, float work, float busyMs, float idleMs);
+
+  //! Poll whether a stream should be moved, from the stream's producer.
+  //! \param[in]  stream  the stream.
+  //! \param[out] to      the device to move to.
+  //! \return     true if the stream should leave its current device, wait in waitDrained(), and join device *to.
+  bool moving(unsigned stream, unsigned *to);
+
+  //! Whether a stream is leaving its device because it is being moved, rather than because it has ended.
+  bool isMoving(unsigned stream);
+
+  //! Note that the old device has finished all of a moving stream's frames. Call this from that device's consumer.
+  void drained(unsigned stream);
+
+  //! Wait until the old device has finished all of a moving stream's frames, completing the move.
+  //! \return     false if the manager has been closed.
+  bool waitDrained(unsigned stream);
+
+  //! Make place() and waitDrained() fail, to unblock the producers.
+  void close();
+
+  //! The device that a stream is placed on, or -1 if it is not placed.
+  int deviceOf(unsigned stream);
+
+  //! Get the statistics of every device.
+  std::vector<DeviceStats> stats();
+
+  //! The number of streams that have been moved.
+  unsigned long long moves();
+
+  //! Print the statistics accumulated so far.
+  void printStats(FILE *fp);
+
+private:
+  enum { kMoveNone, kMovePending, kMoveLeaving, kMoveDrained };
+  struct Stream {
+    int       device;   // -1 if not placed
+    float     weight;
+    int       move;     // kMove*
+  };
+  Stream& streamOf(unsigned stream);
+  float capacityOf(const DeviceStats& d) const;
+  void rebalance(unsigned device);
+
+  unsigned                  _streamsPerDevice;
+  float                     _saturation, _cooldownMs;
+  bool                      _closed;
+  Clock::time_point         _lastMove;
+  unsigned long long        _moves;
+  std::vector<DeviceStats>  _devices;
+  std::vector<Stream>       _streams;   // Indexed by stream identifier
+  std::mutex                _mutex;
+  std::condition_variable   _cond;
+};
+
+#endif // __SHARD_MANAGER_H__
@@ -0,0 +1,359 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "StatefulBatcher.h"
+
+
+StatefulBatcher::StatefulBatcher() : _eff(nullptr), _pool(nullptr), _maxBatch(0), _maxQueued(0), _maxWaitMs(0.f),
+                                     _agingMs(0.f), _predictedMs(0.f), _closed(false), _aborted(false) {
+  _stats.batches = _stats.frames = _stats.full = _stats.timeouts = _stats.joins = _stats.urgent = _stats.promoted = 0;
+}
+
+StatefulBatcher::~StatefulBatcher() {
+  release();
+}
+
+
+/********************************************************************************
+ * StatefulBatcher::init
+ ********************************************************************************/
+
+NvCV_Status StatefulBatcher::init(NvVFX_Handle eff, unsigned maxBatch, unsigned maxStreams, float maxWaitMs,
+                                  StateObjectPool *pool, unsigned maxQueued) {
+  if (!eff || !maxBatch || !maxStreams || !maxQueued)
+    return NVCV_ERR_PARAMETER;
+  release();
+  std::lock_guard<std::mutex> lock(_mutex);
+  _eff       = eff;
+  _pool      = pool;
+  _maxBatch  = maxBatch;
+  _maxQueued = maxQueued;
+  _maxWaitMs = maxWaitMs;
+  _predictedMs = 0.f;
+  _closed    = false;
+  _aborted   = false;
+  _slots.assign(maxStreams, Slot());
+  for (Slot& s : _slots) {
+    s.active = s.leaving = false;
+    s.tag    = s.next = s.priority = 0;
+    s.deadlineMs = 0.f;
+    s.statsIdx = 0;
+    s.state  = nullptr;
+  }
+  _streamStats.clear();
+  _batchStates.reserve(maxBatch);
+  return NVCV_SUCCESS;
+}
+
+
+/********************************************************************************
+ * StatefulBatcher::acquireState, releaseState
+ ********************************************************************************/
+
+NvCV_Status StatefulBatcher::acquireState(NvVFX_StateObjectHandle *state) {
+  return _pool ? _pool->acquire(state) : NvVFX_AllocateState(_eff, state);
+}
+
+void StatefulBatcher::releaseState(NvVFX_StateObjectHandle state) {
+  if (_pool)  _pool->recycle(state);
+  else        NvVFX_DeallocateState(_eff, state);
+}
+
+
+/********************************************************************************
+ * Producer side: join, submit, leave, close
+ ********************************************************************************/
+
+void StatefulBatcher::setAging(float agingMs) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _agingMs = agingMs;
+}
+
+int StatefulBatcher::join(unsigned tag, unsigned priority, float deadlineMs) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  for (;;) {
+    if (_closed)
+      return -1;
+    for (unsigned i = 0; i < _slots.size(); ++i) {
+      Slot& s = _slots[i];
+      if (s.active)
+        continue;
+      s.active  = true;
+      s.leaving = false;
+      s.tag     = tag;
+      s.priority   = priority;
+      s.deadlineMs = deadlineMs;
+      s.next    = 0;
+      s.queue.clear();
+      s.statsIdx = _streamStats.size();
+      _streamStats.push_back(StreamStats());
+      StreamStats& st = _streamStats.back();
+      st.tag        = tag;
+      st.priority   = priority;
+      st.deadlineMs = deadlineMs;
+      st.frames     = st.misses = 0;
+      st.meanLatencyMs = st.maxLatencyMs = 0.f;
+      ++_stats.joins;
+      return (int)i;
+    }
+    _space.wait(lock);  // All slots are taken; wait for a stream to finish
+  }
+}
+
+bool StatefulBatcher::submit(unsigned stream, cv::Mat &frame) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  Slot& s = _slots[stream];
+  _space.wait(lock, [&] { return _aborted || s.queue.size() < _maxQueued; });
+  if (_aborted)
+    return false;
+  s.queue.push_back(Queued());
+  Queued& q = s.queue.back();
+  cv::swap(q.frame, frame);
+  q.arrival  = Clock::now();
+  q.deadline = (s.deadlineMs > 0.f) ? q.arrival + std::chrono::microseconds((long long)(s.deadlineMs * 1000.f))
+                                    : Clock::time_point::max();
+  _ready.notify_one();
+  return true;
+}
+
+void StatefulBatcher::leave(unsigned stream) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _slots[stream].leaving = true;
+  _ready.notify_one();
+}
+
+void StatefulBatcher::close(bool abort) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _closed = true;
+    if (abort) {
+      _aborted = true;
+      for (Slot& s : _slots) {
+        s.queue.clear();
+        s.leaving = true;
+      }
+    }
+  }
+  _ready.notify_all();
+  _space.notify_all();
+}
+
+
+/********************************************************************************
+ * StatefulBatcher::gather
+ ********************************************************************************/
+
+NvCV_Status StatefulBatcher::gather(std::vector<Entry> *batch, std::vector<unsigned> *finished) {
+  struct Candidate {
+    unsigned          slot;
+    unsigned          priority; // After aging
+    Clock::time_point deadline, arrival;
+    bool operator<(const Candidate& c) const {
+      if (priority != c.priority) return priority < c.priority;
+      if (deadline != c.deadline) return deadline < c.deadline;
+      return arrival < c.arrival;
+    }
+  };
+  std::unique_lock<std::mutex> lock(_mutex);
+  std::vector<Candidate> candidates;
+  batch->clear();
+  finished->clear();
+  _batchStates.clear();
+
+  for (;;) {
+    unsigned          numActive = 0, numReady = 0;
+    Clock::time_point oldest    = Clock::time_point::max(),
+                      earliest  = Clock::time_point::max();
+    for (Slot& s : _slots) {
+      if (!s.active)
+        continue;
+      if (s.leaving && s.queue.empty()) {           // Retire the stream, now that all of its frames have been run
+        if (s.state)
+          releaseState(s.state);
+        s.state  = nullptr;
+        s.active = false;
+        finished->push_back(s.tag);
+        _space.notify_all();                        // Someone may be waiting to join
+        continue;
+      }
+      ++numActive;
+      if (!s.queue.empty()) {
+        ++numReady;
+        oldest   = std::min(oldest,   s.queue.front().arrival);
+        earliest = std::min(earliest, s.queue.front().deadline);
+      }
+    }
+    if (!numActive && _closed)
+      return NVCV_SUCCESS;                          // Every stream has finished
+    if (!numReady && !finished->empty())
+      return NVCV_SUCCESS;                          // Report the finished streams now, rather than with the next batch
+    if (numReady) {
+      if (numReady >= _maxBatch || numReady == numActive)
+        break;                                      // Waiting cannot make the batch any larger
+      Clock::time_point release = oldest + std::chrono::microseconds((long long)(_maxWaitMs * 1000.f));
+      bool urgent = false;
+      if (earliest != Clock::time_point::max()) {   // Leave time to run the batch before the earliest deadline
+        Clock::time_point latest = earliest - std::chrono::microseconds((long long)(_predictedMs * 1000.f));
+        if (latest < release) {
+          release = latest;
+          urgent  = true;
+        }
+      }
+      if (Clock::now() >= release) {
+        ++(urgent ? _stats.urgent : _stats.timeouts);
+        break;
+      }
+      _ready.wait_until(lock, release);
+    } else {
+      _ready.wait(lock);
+    }
+  }
+
+  // Rank the oldest frame of each ready stream, so that the most urgent ones get the batch entries
+  // when there are more ready streams than entries.
+  Clock::time_point now = Clock::now();
+  for (unsigned i = 0; i < (unsigned)_slots.size(); ++i) {
+    const Slot& s = _slots[i];
+    if (!s.active || s.queue.empty())
+      continue;
+    Candidate c;
+    c.slot     = i;
+    c.priority = s.priority;
+    c.deadline = s.queue.front().deadline;
+    c.arrival  = s.queue.front().arrival;
+    if (_agingMs > 0.f) {
+      unsigned steps = (unsigned)(std::chrono::duration<float, std::milli>(now - c.arrival).count() / _agingMs);
+      c.priority = (steps < c.priority) ? c.priority - steps : 0;
+    }
+    candidates.push_back(c);
+  }
+  std::sort(candidates.begin(), candidates.end());
+  if (candidates.size() > _maxBatch)
+    candidates.resize(_maxBatch);
+
+  for (const Candidate& c : candidates) {
+    Slot& s = _slots[c.slot];
+    if (!s.state) {
+      NvCV_Status err = acquireState(&s.state);
+      if (NVCV_SUCCESS != err) {
+        s.state = nullptr;
+        batch->clear();
+        _batchStates.clear();
+        return err;
+      }
+    }
+    if (c.priority < s.priority)
+      ++_stats.promoted;
+    batch->push_back(Entry());
+    Entry& e = batch->back();
+    e.stream   = c.slot;
+    e.tag      = s.tag;
+    e.index    = s.next++;
+    e.arrival  = s.queue.front().arrival;
+    e.deadline = s.queue.front().deadline;
+    cv::swap(e.frame, s.queue.front().frame);
+    s.queue.pop_front();
+    _batchStates.push_back(s.state);
+  }
+  _gatherTime = now;
+
+  ++_stats.batches;
+  _stats.frames += batch->size();
+  if (batch->size() == _maxBatch)
+    ++_stats.full;
+  _space.notify_all();                              // Make room for the producers
+  return NVCV_SUCCESS;
+}
+
+
+/********************************************************************************
+ * StatefulBatcher::complete
+ ********************************************************************************/
+
+void StatefulBatcher::complete(const std::vector<Entry>& batch) {
+  Clock::time_point now = Clock::now();
+  std::lock_guard<std::mutex> lock(_mutex);
+  float runMs = std::chrono::duration<float, std::milli>(now - _gatherTime).count();
+  _predictedMs = _predictedMs ? _predictedMs + (runMs - _predictedMs) * (1.f / 8.f) : runMs;  // 1 pole IIR filter
+  for (const Entry& e : batch) {
+    StreamStats& st = _streamStats[_slots[e.stream].statsIdx];  // The stream cannot retire until its frames are gathered
+    float latencyMs = std::chrono::duration<float, std::milli>(now - e.arrival).count();
+    ++st.frames;
+    st.meanLatencyMs += (latencyMs - st.meanLatencyMs) / st.frames;
+    st.maxLatencyMs   = std::max(st.maxLatencyMs, latencyMs);
+    if (now > e.deadline)
+      ++st.misses;
+  }
+}
+
+
+/********************************************************************************
+ * StatefulBatcher::release
+ ********************************************************************************/
+
+void StatefulBatcher::release() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (Slot& s : _slots) {
+    if (s.state)
+      releaseState(s.state);
+    s.state  = nullptr;
+    s.active = false;
+    s.queue.clear();
+  }
+  _batchStates.clear();
+}
+
+
+/********************************************************************************
+ * StatefulBatcher::stats, printStats
+ ********************************************************************************/
+
+StatefulBatcher::Stats StatefulBatcher::stats() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _stats;
+}
+
+std::vector<StatefulBatcher::StreamStats> StatefulBatcher::streamStats() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _streamStats;
+}
+
+void StatefulBatcher::printStats(FILE *fp) {
+  Stats s = stats();
+  fprintf(fp, "%llu streams, %llu frames in %llu batches (mean %.2f of %u); %llu full, %llu released after %.0f ms, "
+    "%llu released early for a deadline; %llu frames promoted by aging\n",
+    s.joins, s.frames, s.batches, (s.batches ? (double)s.frames / s.batches : 0.), _maxBatch, s.full, s.timeouts,
+    _maxWaitMs, s.urgent, s.promoted);
+  for (const StreamStats& st : streamStats()) {
+    fprintf(fp, "  stream %u, class %u: %llu frames, latency mean %.1f ms, max %.1f ms", st.tag, st.priority, st.frames,
+      st.meanLatencyMs, st.maxLatencyMs);
+    if (st.deadlineMs > 0.f)
+      fprintf(fp, ", %llu missed the %.0f ms deadline (%.1f%%)", st.misses, st.deadlineMs,
+        (st.frames ? 100. * st.misses / st.frames : 0.));
+    fprintf(fp, "\n");
+  }
+}
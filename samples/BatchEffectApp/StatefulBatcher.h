@@ -0,0 +1,191 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __STATEFUL_BATCHER_H__
+#define __STATEFUL_BATCHER_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "StateObjectPool.h"
+#include "nvVideoEffects.h"
+#include "opencv2/opencv.hpp"
+
+//! Continuous batching of frames from a changing set of streams through a stateful effect.
+//! Producer threads join() a stream, submit() its frames and leave() at the end; the thread that runs the effect
+//! calls gather() to collect up to maxBatch ready frames, at most one per stream, so that each batch entry can be
+//! paired with the state of its stream. A partial batch is released once its oldest frame has waited maxWaitMs,
+//! or immediately if every active stream already has a frame in it.
+//! The state objects are acquired and released inside gather(), on the thread that calls NvVFX_Run(),
+//! so that streams can come and go without synchronizing with the effect.
+//!
+//! When more streams have a frame ready than fit in a batch, the frames are chosen by priority class, then earliest
+//! deadline first, then oldest first. A stream may join with a deadline, the latency within which each of its frames
+//! should be completed, as for a live stream; a partial batch is then released early enough for the most urgent frame
+//! to meet its deadline, judging by how long recent batches took. To protect the lower classes from starvation,
+//! a frame is promoted one class for every agingMs that it waits. The frames of each stream remain in order.
+class StatefulBatcher {
+public:
+  typedef std::chrono::high_resolution_clock Clock;
+
+  struct Entry {
+    unsigned  stream;   //!< The slot of the stream that the frame came from, in [0, maxStreams).
+    unsigned  tag;      //!< The tag given to join().
+    unsigned  index;    //!< The index of the frame within its stream.
+    cv::Mat   frame;    //!< The frame.
+    Clock::time_point arrival;  //!< When the frame was submitted.
+    Clock::time_point deadline; //!< When the frame should be completed, or Clock::time_point::max() if never.
+  };
+
+  struct Stats {
+    unsigned long long  batches;      //!< The number of batches gathered.
+    unsigned long long  frames;       //!< The number of frames gathered.
+    unsigned long long  full;         //!< The number of batches with maxBatch frames.
+    unsigned long long  timeouts;     //!< The number of partial batches released because of the wait limit.
+    unsigned long long  joins;        //!< The number of streams that have joined.
+    unsigned long long  urgent;       //!< The number of partial batches released early to meet a deadline.
+    unsigned long long  promoted;     //!< The number of frames gathered ahead of their class because of their age.
+  };
+
+  struct StreamStats {
+    unsigned            tag;          //!< The tag given to join().
+    unsigned            priority;     //!< The priority class given to join().
+    float               deadlineMs;   //!< The deadline given to join(); 0 if none.
+    unsigned long long  frames;       //!< The number of frames completed.
+    unsigned long long  misses;       //!< The number of frames completed after their deadline.
+    float               meanLatencyMs;//!< The mean time from submit() to complete().
+    float               maxLatencyMs; //!< The maximum time from submit() to complete().
+  };
+
+  StatefulBatcher();
+  ~StatefulBatcher();
+
+  //! Initialize the batcher. The effect must already be loaded.
+  //! \param[in]  eff         the stateful effect.
+  //! \param[in]  maxBatch    the largest batch to gather, typically NVVFX_MODEL_BATCH.
+  //! \param[in]  maxStreams  the largest number of concurrent streams, typically NVVFX_MAX_NUMBER_STREAMS.
+  //! \param[in]  maxWaitMs   the longest time that a ready frame waits for a batch to fill up.
+  //! \param[in]  pool        a pool of state handles with at least maxStreams states, which are recycled as streams
+  //!                         come and go; if NULL, states are allocated and deallocated with each stream.
+  //! \param[in]  maxQueued   the number of frames that a stream can have queued before submit() blocks.
+  //! \return     NVCV_SUCCESS, or NVCV_ERR_PARAMETER if any of the sizes are 0.
+  NvCV_Status init(NvVFX_Handle eff, unsigned maxBatch, unsigned maxStreams, float maxWaitMs,
+                   StateObjectPool *pool = nullptr, unsigned maxQueued = 4);
+
+  //! Set the time after which a waiting frame is promoted to the next higher priority class.
+  //! \param[in]  agingMs the aging interval in milliseconds; 0 disables promotion, so that a busy higher class can
+  //!                     starve the lower ones indefinitely.
+  void setAging(float agingMs);
+
+  //! Join a new stream, waiting for a free slot if maxStreams streams are already active.
+  //! \param[in]  tag         an arbitrary value to be returned with each of the stream's frames, e.g. an output index.
+  //! \param[in]  priority    the priority class of the stream; 0 is the most urgent.
+  //! \param[in]  deadlineMs  the time from submit() within which each frame should be completed; 0 for none.
+  //! \return     the slot of the stream, or -1 if the batcher has been closed.
+  int join(unsigned tag, unsigned priority = 0, float deadlineMs = 0.f);
+
+  //! Submit the next frame of a stream, waiting if the stream already has maxQueued frames queued.
+  //! \param[in]      stream  the slot returned by join().
+  //! \param[in,out]  frame   the frame, which is swapped with an empty Mat rather than copied.
+  //! \return         false if the batcher has been aborted.
+  bool submit(unsigned stream, cv::Mat &frame);
+
+  //! Note that a stream has no more frames. Its state is deallocated once its queued frames have been gathered,
+  //! and its tag is then reported by gather() in the list of finished streams.
+  void leave(unsigned stream);
+
+  //! Stop accepting new streams; any thread waiting in join() gets -1.
+  //! gather() returns an empty batch once all of the active streams have left.
+  //! \param[in]  abort if true, also drop all queued frames and make submit() fail, to unblock the producers.
+  void close(bool abort = false);
+
+  //! Gather the next batch. Call this from the thread that runs the effect.
+  //! \param[out] batch     the frames of the batch, in the order in which they should be placed in the batch image.
+  //! \param[out] finished  the tags of the streams that have left and been deallocated since the last call.
+  //! \return     NVCV_SUCCESS, or the error from acquiring a state.
+  //! \note       An empty batch is returned when streams have finished and no frames are ready, so that their
+  //!             finishing is not held up; an empty batch with no finished streams means that the batcher is closed
+  //!             and all streams have finished.
+  NvCV_Status gather(std::vector<Entry> *batch, std::vector<unsigned> *finished);
+
+  //! Note that the last gathered batch has been completed, i.e. its results have been downloaded,
+  //! to record the latency of its frames against their deadlines, and to predict the time taken by the next batch.
+  void complete(const std::vector<Entry>& batch);
+
+  //! The state objects for the last gathered batch, for NvVFX_SetStateObjectHandleArray().
+  NvVFX_StateObjectHandle* states() { return _batchStates.data(); }
+
+  //! Release the states of all streams. This is called by the destructor, but must be called explicitly
+  //! if the effect or the pool is destroyed before the batcher.
+  void release();
+
+  //! Get the statistics accumulated so far.
+  Stats stats();
+
+  //! Get the statistics of every stream that has joined, in the order in which they joined.
+  std::vector<StreamStats> streamStats();
+
+  //! Print the statistics accumulated so far, including the deadline misses of each stream.
+  void printStats(FILE *fp);
+
+private:
+  struct Queued {
+    cv::Mat           frame;
+    Clock::time_point arrival;
+    Clock::time_point deadline;
+  };
+  NvCV_Status acquireState(NvVFX_StateObjectHandle *state);
+  void releaseState(NvVFX_StateObjectHandle state);
+
+  struct Slot {
+    bool                    active;   // Joined and not yet deallocated
+    bool                    leaving;  // No more frames will be submitted
+    unsigned                tag;
+    unsigned                priority;
+    float                   deadlineMs;
+    unsigned                next;     // The index of the next frame to be gathered
+    size_t                  statsIdx; // Into _streamStats
+    NvVFX_StateObjectHandle state;
+    std::deque<Queued>      queue;
+  };
+
+  NvVFX_Handle                          _eff;
+  StateObjectPool                       *_pool;
+  unsigned                              _maxBatch, _maxQueued;
+  float                                 _maxWaitMs, _agingMs;
+  float                                 _predictedMs; // Smoothed time from gather() to complete()
+  Clock::time_point                     _gatherTime;
+  bool                                  _closed, _aborted;
+  std::vector<Slot>                     _slots;
+  std::vector<NvVFX_StateObjectHandle>  _batchStates;
+  Stats                                 _stats;
+  std::vector<StreamStats>              _streamStats;
+  std::mutex                            _mutex;
+  std::condition_variable               _ready;     // Signaled to the consumer
+  std::condition_variable               _space;     // Signaled to the producers
+};
+
+#endif // __STATEFUL_BATCHER_H__
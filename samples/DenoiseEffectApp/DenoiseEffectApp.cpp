@@ -31,6 +31,10 @@
 #include "nvCVOpenCV.h"
 #include "nvVideoEffects.h"
 #include "opencv2/opencv.hpp"
+#include "FrameFingerprint.h"
+#include "PinnedMatAllocator.h"
+#include "TileDiff.h"
+#include "Y4mIO.h"
 
 
 #ifdef _MSC_VER
@@ -42,6 +46,7 @@
 
 #define BAIL_IF_ERR(err)                    do { if (0 != (err)) {                      goto bail; } } while(0)
 #define BAIL_IF_NULL(x, err, code)          do { if ((void*)(x) == NULL)  { err = code; goto bail; } } while(0)
+#define BAIL_IF_FALSE(x, err, code)         do { if (!(x))                { err = code; goto bail; } } while(0)
 #define NVCV_ERR_HELP 411
 
 #ifdef _WIN32
@@ -55,8 +60,15 @@ bool        FLAG_debug          = false,
             FLAG_verbose        = false,
             FLAG_show           = false,
             FLAG_progress       = false,
-            FLAG_webcam         = false;
-float       FLAG_strength       = 0.f;
+            FLAG_webcam         = false,
+            FLAG_dirtyTiles     = false,
+            FLAG_skipRepeats    = false,
+            FLAG_feedRepeats    = false,
+            FLAG_pinned         = true;
+float       FLAG_strength       = 0.f,
+            FLAG_dirtyThreshold = 1.f,
+            FLAG_repeatThreshold = 1.f;
+int         FLAG_colorspace     = 709;
 std::string FLAG_codec          = DEFAULT_CODEC,
             FLAG_camRes         = "1280x720",
             FLAG_inFile,
@@ -139,13 +151,25 @@ static void Usage() {
   printf(
     "DenoiseEffectApp [args ...]\n"
     "  where args is:\n"
-    "  --in_file=<path>           input file to be processed (can be an image but the best denoising performance is observed on videos)\n"
+    "  --in_file=<path>           input file to be processed (can be an image but the best denoising performance is observed on videos);\n"
+    "                             a .y4m file is streamed, with no decoder\n"
     "  --webcam                   use a webcam as the input\n"
-    "  --out_file=<path>          output file to be written\n"
+    "  --out_file=<path>          output file to be written; a .y4m file stores raw frames, with no encoder\n"
+    "  --colorspace=<standard>    the YUV matrix of .y4m files, which do not record it: 601, 709 or 2020 (default 709)\n"
     "  --show                     display the results in a window (for webcam, it is always true)\n"
     "  --strength=<value>         strength of an effect [0-1]\n"
     "  --model_dir=<path>         the path to the directory that contains the models\n"
     "  --codec=<fourcc>           the fourcc code for the desired codec (default " DEFAULT_CODEC ")\n"
+    "  --dirty_tiles              skip denoising video frames that have not changed from the last one denoised\n"
+    "  --dirty_threshold=<diff>   the mean absolute difference, in 8-bit code values, for a 64x64 tile to be\n"
+    "                             considered changed (default 1)\n"
+    "  --skip_repeats             do not denoise video frames that repeat the last one denoised, but write its\n"
+    "                             output again\n"
+    "  --repeat_threshold=<diff>  the mean absolute difference, in 8-bit code values, for a 16x16 tile to be\n"
+    "                             considered changed by --skip_repeats; 0 only skips bit-identical frames (default 1)\n"
+    "  --feed_repeats             still run repeated frames, without downloading the output, to advance the state\n"
+    "  --pinned                   keep frames on the CPU in page-locked memory, so that they are uploaded and\n"
+    "                             downloaded without a staging copy; --pinned=false uses ordinary memory (default on)\n"
     "  --progress                 show progress\n"
     "  --verbose                  verbose output\n"
     "  --debug                    print extra debugging information\n"
@@ -169,9 +193,16 @@ static int ParseMyArgs(int argc, char **argv) {
         GetFlagArgVal("webcam",       arg, &FLAG_webcam)      ||
         GetFlagArgVal("cam_res",      arg, &FLAG_camRes)      ||
         GetFlagArgVal("strength",     arg, &FLAG_strength)    ||
+        GetFlagArgVal("dirty_tiles",  arg, &FLAG_dirtyTiles)  ||
+        GetFlagArgVal("dirty_threshold", arg, &FLAG_dirtyThreshold) ||
+        GetFlagArgVal("skip_repeats", arg, &FLAG_skipRepeats) ||
+        GetFlagArgVal("repeat_threshold", arg, &FLAG_repeatThreshold) ||
+        GetFlagArgVal("feed_repeats", arg, &FLAG_feedRepeats) ||
         GetFlagArgVal("model_dir",    arg, &FLAG_modelDir)    ||
         GetFlagArgVal("codec",        arg, &FLAG_codec)       ||
+        GetFlagArgVal("colorspace",   arg, &FLAG_colorspace)  ||
         GetFlagArgVal("progress",     arg, &FLAG_progress)    ||
+        GetFlagArgVal("pinned",       arg, &FLAG_pinned)      ||
         GetFlagArgVal("debug",        arg, &FLAG_debug)
         )) {
       continue;
@@ -224,6 +255,11 @@ static bool IsLossyImageFile(const char *str) {
   return HasOneOfTheseSuffixes(str, ".jpg", ".jpeg", nullptr);
 }
 
+// The YUV matrix chosen by --colorspace.
+static unsigned char ColorStandard() {
+  return (601 == FLAG_colorspace) ? NVCV_601 : (2020 == FLAG_colorspace) ? NVCV_2020 : NVCV_709;
+}
+
 static const char* DurationString(double sc) {
   static char buf[16];
   int         hr, mn;
@@ -328,6 +364,7 @@ struct FXApp {
   const char*   errorStringFromCode(Err code);
 
   NvVFX_Handle  _eff;
+  PinnedMatAllocator _pinned;       // Before the Mats that it allocates, so that it outlives them
   cv::Mat       _srcImg;
   cv::Mat       _dstImg;
   NvCVImage     _srcGpuBuf;
@@ -343,6 +380,10 @@ struct FXApp {
   bool          _drawVisualization;
   const char*   _effectName;
   float         _framePeriod;
+  cv::Mat       _refImg;      // The last frame denoised, for --dirty_tiles
+  NvCVImage     _refVFX;
+  DirtyTileMap  _tiles;
+  RepeatFrameDetector _repeats; // For --skip_repeats
   std::chrono::high_resolution_clock::time_point _lastTime;
 };
 
@@ -474,6 +515,11 @@ NvCV_Status FXApp::allocBuffers(unsigned width, unsigned height) {
   if (_inited)
     return NVCV_SUCCESS;
 
+  if (FLAG_pinned) {  // So that frames are decoded into, and downloaded to, memory that the GPU can reach directly
+    _srcImg.allocator = &_pinned;
+    _dstImg.allocator = &_pinned;
+  }
+
   if (!_srcImg.data) {
     _srcImg.create(height, width, CV_8UC3);                                                                                        // src CPU
     BAIL_IF_NULL(_srcImg.data, vfxErr, NVCV_ERR_MEMORY);
@@ -527,6 +573,7 @@ FXApp::Err FXApp::processImage(const char *inFile, const char *outFile) {
   BAIL_IF_ERR(vfxErr = NvVFX_Load(_eff));
   BAIL_IF_ERR(vfxErr = NvVFX_Run(_eff, 0));
   BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_dstGpuBuf, &_dstVFX, 255.f, stream, &_tmpVFX));
+  BAIL_IF_FALSE(cudaSuccess == cudaStreamSynchronize((cudaStream_t)stream), vfxErr, NVCV_ERR_CUDA);
 
   if (outFile && outFile[0]) {
     if(IsLossyImageFile(outFile))
@@ -552,36 +599,63 @@ FXApp::Err FXApp::processMovie(const char *inFile, const char *outFile) {
   bool            ok;
   cv::VideoCapture reader;
   cv::VideoWriter writer;
+  Y4mReader       y4mIn;
+  Y4mWriter       y4mOut;
+  NvCVImage       y4mFrame;
   NvCV_Status     vfxErr;
   unsigned        frameNum;
   VideoInfo       info;
 
   void* state = nullptr;
   void* stateArray[1];
+  unsigned long long framesSkipped = 0, framesFed = 0;
+  bool skip, repeat;
 
   if (inFile && !inFile[0]) inFile = nullptr;  // Set file paths to NULL if zero length
 
-  if (!FLAG_webcam && inFile) {
-    reader.open(inFile);
+  if (!FLAG_webcam && inFile && HasSuffix(inFile, ".y4m")) {
+    if (NVCV_SUCCESS != (vfxErr = y4mIn.open(inFile, NVCV_I420, ColorStandard()))) {
+      printf("Error: Could not read 8-bit 4:2:0 or 4:4:4 frames from \"%s\": %s\n", inFile,
+             NvCV_GetErrorStringFromCode(vfxErr));
+      return errRead;
+    }
+    info.codec      = 0;
+    info.width      = (int)y4mIn.format().width;
+    info.height     = (int)y4mIn.format().height;
+    info.frameRate  = y4mIn.frameRate();
+    info.frameCount = y4mIn.frameCount();
   } else {
-    appErr = initCamera(reader);
-    if (appErr != errNone)
-      return appErr;
-  }
+    if (!FLAG_webcam && inFile) {
+      reader.open(inFile);
+    } else {
+      appErr = initCamera(reader);
+      if (appErr != errNone)
+        return appErr;
+    }
 
-  if (!reader.isOpened()) {
-    if (!FLAG_webcam) printf("Error: Could not open video: \"%s\"\n", inFile);
-    else              printf("Error: Webcam not found\n");
-    return errRead;
-  }
+    if (!reader.isOpened()) {
+      if (!FLAG_webcam) printf("Error: Could not open video: \"%s\"\n", inFile);
+      else              printf("Error: Webcam not found\n");
+      return errRead;
+    }
 
-  GetVideoInfo(reader, (inFile ? inFile : "webcam"), &info);
-  if (!(fourcc_h264 == info.codec || cv::VideoWriter::fourcc('a', 'v', 'c', '1') == info.codec)) // avc1 is alias for h264
-    printf("Filters only target H264 videos, not %.4s\n", (char*)&info.codec);
+    GetVideoInfo(reader, (inFile ? inFile : "webcam"), &info);
+    if (!(fourcc_h264 == info.codec || cv::VideoWriter::fourcc('a', 'v', 'c', '1') == info.codec)) // avc1 is alias for h264
+      printf("Filters only target H264 videos, not %.4s\n", (char*)&info.codec);
+  }
 
   BAIL_IF_ERR(vfxErr = allocBuffers(info.width, info.height));
 
   if (outFile && !outFile[0]) outFile = nullptr;
+  if (outFile && HasSuffix(outFile, ".y4m")) {
+    if (NVCV_SUCCESS != y4mOut.open(outFile, _dstVFX.width, _dstVFX.height, info.frameRate, NVCV_YUV420,
+                                    ColorStandard() | NVCV_VIDEO_RANGE | NVCV_CHROMA_JPEG)) {
+      printf("Cannot open \"%s\" for writing %ux%u frames; 4:2:0 needs an even size\n", outFile, _dstVFX.width,
+             _dstVFX.height);
+      return errWrite;
+    }
+    outFile = nullptr;
+  }
   if (outFile) {
     ok = writer.open(outFile, StringToFourcc(FLAG_codec), info.frameRate, cv::Size(_dstVFX.width, _dstVFX.height));
     if (!ok) {
@@ -604,24 +678,58 @@ FXApp::Err FXApp::processMovie(const char *inFile, const char *outFile) {
   BAIL_IF_ERR(vfxErr = NvVFX_SetObject(_eff, NVVFX_STATE, (void*)stateArray));
 
   BAIL_IF_ERR(vfxErr = NvVFX_Load(_eff));
-
-  for (frameNum = 0; reader.read(_srcImg); frameNum++) {
-    if (_enableEffect) {
+  _repeats.setThreshold(FLAG_repeatThreshold);
+
+  // Y4M frames are converted to BGR in _srcImg, so that they can be compared with the last frame and shown
+  for (frameNum = 0; y4mIn.isOpen() ? (NVCV_SUCCESS == y4mIn.read(&y4mFrame) &&
+                                       NVCV_SUCCESS == NvCVImage_Transfer(&y4mFrame, &_srcVFX, 1.f, stream, nullptr)) :
+                                      reader.read(_srcImg); frameNum++) {
+    // The temporal state covers the whole frame, so it cannot be advanced for a sub-region of it: with --dirty_tiles
+    // the effect is either run on the whole frame, or not at all, in which case the last output is repeated.
+    skip = repeat = false;
+    if (FLAG_skipRepeats && _enableEffect)
+      BAIL_IF_ERR(vfxErr = _repeats.check(&_srcVFX, &repeat));
+    if (FLAG_dirtyTiles && _enableEffect && !repeat && !_refImg.empty()) {
+      BAIL_IF_ERR(vfxErr = ComputeDirtyTiles(&_srcVFX, &_refVFX, 64, FLAG_dirtyThreshold, &_tiles));
+      skip = (0 == _tiles.numDirty);
+    }
+    if (repeat) {
+      if (FLAG_feedRepeats) {   // The state keeps converging on a static scene, but the output is not downloaded
+        BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_srcVFX, &_srcGpuBuf, 1.f / 255.f, stream, &_tmpVFX));
+        BAIL_IF_ERR(vfxErr = NvVFX_Run(_eff, 0));
+        ++framesFed;
+      }
+    } else if (skip) {
+      ++framesSkipped;
+    } else if (_enableEffect) {
       BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_srcVFX, &_srcGpuBuf, 1.f / 255.f, stream, &_tmpVFX));
       BAIL_IF_ERR(vfxErr = NvVFX_Run(_eff, 0));
       BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_dstGpuBuf, &_dstVFX, 255.f, stream, &_tmpVFX));
+      if (FLAG_dirtyTiles) {
+        _srcImg.copyTo(_refImg);
+        NVWrapperForCVMat(&_refImg, &_refVFX);
+      }
     } else {
       BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_srcVFX, &_dstVFX, 1.f, stream, &_tmpVFX));
       cudaMemsetAsync(state, 0, stateSizeInBytes, stream);// reset state by setting to 0
+      _refImg.release();
+      _repeats.reset();
     }
+    // With pinned buffers the transfers are truly asynchronous: finish the download before the sinks read _dstImg,
+    // and the upload before the next read overwrites _srcImg.
+    BAIL_IF_FALSE(cudaSuccess == cudaStreamSynchronize((cudaStream_t)stream), vfxErr, NVCV_ERR_CUDA);
 
     if (outFile)
       writer.write(_dstImg);
+    if (y4mOut.isOpen())
+      BAIL_IF_ERR(vfxErr = y4mOut.write(&_dstVFX));
 
     if (_show) {
-      if (_drawVisualization)  drawEffectStatus(_dstImg);
-      drawFrameRate(_dstImg);
-      cv::imshow("Output", _dstImg);
+      // Keep overlays out of the retained output
+      cv::Mat shown = (FLAG_dirtyTiles || FLAG_skipRepeats) ? _dstImg.clone() : _dstImg;
+      if (_drawVisualization)  drawEffectStatus(shown);
+      drawFrameRate(shown);
+      cv::imshow("Output", shown);
       int key= cv::waitKey(1);
       if (key > 0) {
         appErr = processKey(key);
@@ -634,6 +742,15 @@ FXApp::Err FXApp::processMovie(const char *inFile, const char *outFile) {
   }
 
   if (_progress) fprintf(stderr, "\n");
+  if (FLAG_dirtyTiles)
+    printf("Dirty tiles: skipped %llu unchanged frames of %u\n", framesSkipped, frameNum);
+  if (FLAG_skipRepeats)
+    _repeats.printStats(stdout, framesFed);
+  if (FLAG_verbose && FLAG_pinned)
+    _pinned.printStats(stdout);
+  if (FLAG_verbose && y4mIn.isOpen())
+    y4mIn.printStats(stdout);
+  BAIL_IF_ERR(vfxErr = y4mOut.close());
   reader.release();
   if (outFile)
     writer.release();
@@ -0,0 +1,672 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "StateObjectPool.h"
+#include "nvCVOpenCV.h"
+#include "nvVideoEffects.h"
+#include "opencv2/opencv.hpp"
+
+#ifdef _MSC_VER
+  #define strcasecmp _stricmp
+#endif // _MSC_VER
+
+#define BAIL_IF_ERR(err)            do { if (0 != (err)) {                      goto bail; } } while(0)
+#define BAIL_IF_FALSE(x, err, code) do { if (!(x))                { err = code; goto bail; } } while(0)
+#define BAIL(err, code)             do {                            err = code; goto bail;   } while(0)
+
+#ifdef _WIN32
+  #define DEFAULT_CODEC "avc1"
+#else // !_WIN32
+  #define DEFAULT_CODEC "H264"
+#endif // _WIN32
+
+
+bool        FLAG_verbose        = false;
+int         FLAG_maxWarm        = 4,
+            FLAG_pollMs         = 200,
+            FLAG_maxJobs        = 0,
+            FLAG_idleExit       = 0;
+std::string FLAG_spool,
+            FLAG_modelDir;
+
+// Set this when using OTA Updates
+// This path is used by nvVideoEffectsProxy.cpp to load the SDK dll
+// when using  OTA Updates
+char *g_nvVFXSDKPath = NULL;
+
+static bool GetFlagArgVal(const char *flag, const char *arg, const char **val) {
+  if (*arg != '-')
+    return false;
+  while (*++arg == '-')
+    continue;
+  const char *s = strchr(arg, '=');
+  if (s == NULL)  {
+    if (strcmp(flag, arg) != 0)
+      return false;
+    *val = NULL;
+    return true;
+  }
+  size_t n = s - arg;
+  if ((strlen(flag) != n) || (strncmp(flag, arg, n) != 0))
+    return false;
+  *val = s + 1;
+  return true;
+}
+
+static bool GetFlagArgVal(const char *flag, const char *arg, std::string *val) {
+  const char *valStr;
+  if (!GetFlagArgVal(flag, arg, &valStr))
+    return false;
+  val->assign(valStr ? valStr : "");
+  return true;
+}
+
+static bool GetFlagArgVal(const char *flag, const char *arg, bool *val) {
+  const char *valStr;
+  bool success = GetFlagArgVal(flag, arg, &valStr);
+  if (success) {
+    *val = (valStr == NULL ||
+            strcasecmp(valStr, "true") == 0 ||
+            strcasecmp(valStr, "on")   == 0 ||
+            strcasecmp(valStr, "yes")  == 0 ||
+            strcasecmp(valStr, "1")    == 0
+      );
+  }
+  return success;
+}
+
+static bool GetFlagArgVal(const char *flag, const char *arg, long *val) {
+  const char *valStr;
+  bool success = GetFlagArgVal(flag, arg, &valStr);
+  if (success)
+    *val = strtol(valStr, NULL, 10);
+  return success;
+}
+
+static bool GetFlagArgVal(const char *flag, const char *arg, int *val) {
+  long longVal;
+  bool success = GetFlagArgVal(flag, arg, &longVal);
+  if (success)
+    *val = (int)longVal;
+  return success;
+}
+
+static void Usage() {
+  printf(
+    "EffectWorkerApp [args ...]\n"
+    "  where args is:\n"
+    "  --spool=<dir>              the spool directory to take jobs from\n"
+    "  --model_dir=<path>         the path to the directory that contains the models\n"
+    "  --max_warm=<n>             the number of loaded effect instances to keep between jobs (default 4)\n"
+    "  --poll_ms=<ms>             how often to look for new jobs when idle (default 200)\n"
+    "  --max_jobs=<n>             exit after this many jobs (default 0: no limit)\n"
+    "  --idle_exit=<s>            exit after this many seconds without a job (default 0: never)\n"
+    "  --verbose                  verbose output\n"
+    "\n"
+    "Jobs are taken from <dir>/*.job in order of name. A job is claimed by renaming it to .running, so several\n"
+    "workers can share a spool, and when it is finished its report is written to .done or .failed.\n"
+    "A job file has one key=value per line, with # for comments:\n"
+    "  effect=<name>[,<name>...]  the chain of effects: Transfer, ArtifactReduction, SuperRes, Upscale or Denoising\n"
+    "  in_file=<path>             the input image or video\n"
+    "  out_file=<path>            the output image or video\n"
+    "  mode=<0|1>                 the mode of ArtifactReduction and SuperRes (default 0)\n"
+    "  strength=<value>           the strength of SuperRes, Upscale and Denoising (default 0)\n"
+    "  resolution=<height>        the output height of SuperRes and Upscale\n"
+    "  codec=<fourcc>             the codec of a video output (default " DEFAULT_CODEC ")\n"
+    "Create <dir>/stop to make the workers exit once their current jobs are done; delete it before restarting them.\n"
+  );
+}
+
+static int ParseMyArgs(int argc, char **argv) {
+  int errs = 0;
+  for (--argc, ++argv; argc--; ++argv) {
+    bool help;
+    const char *arg = *argv;
+    if (arg[0] != '-') {
+      continue;
+    } else if ((arg[1] == '-') &&
+      ( GetFlagArgVal("verbose",      arg, &FLAG_verbose)     ||
+        GetFlagArgVal("spool",        arg, &FLAG_spool)       ||
+        GetFlagArgVal("model_dir",    arg, &FLAG_modelDir)    ||
+        GetFlagArgVal("max_warm",     arg, &FLAG_maxWarm)     ||
+        GetFlagArgVal("poll_ms",      arg, &FLAG_pollMs)      ||
+        GetFlagArgVal("max_jobs",     arg, &FLAG_maxJobs)     ||
+        GetFlagArgVal("idle_exit",    arg, &FLAG_idleExit)
+      )) {
+      continue;
+    } else if (GetFlagArgVal("help", arg, &help)) {
+      Usage();
+      errs = 1;
+    } else if (arg[1] != '-') {
+      for (++arg; *arg; ++arg) {
+        if (*arg == 'v') {
+          FLAG_verbose = true;
+        } else {
+          printf("Unknown flag ignored: \"-%c\"\n", *arg);
+        }
+      }
+      continue;
+    } else {
+      printf("Unknown flag ignored: \"%s\"\n", arg);
+    }
+  }
+  return errs;
+}
+
+static bool HasSuffix(const char *str, const char *suf) {
+  size_t  strSize = strlen(str),
+    sufSize = strlen(suf);
+  if (strSize < sufSize)
+    return false;
+  return (0 == strcasecmp(suf, str + strSize - sufSize));
+}
+
+static bool HasOneOfTheseSuffixes(const char *str, ...) {
+  bool matches = false;
+  const char *suf;
+  va_list ap;
+  va_start(ap, str);
+  while (nullptr != (suf = va_arg(ap, const char*))) {
+    if (HasSuffix(str, suf)) {
+      matches = true;
+      break;
+    }
+  }
+  va_end(ap);
+  return matches;
+}
+
+static bool IsImageFile(const char *str) {
+  return HasOneOfTheseSuffixes(str, ".bmp", ".jpg", ".jpeg", ".png", nullptr);
+}
+
+static int StringToFourcc(const std::string& str) {
+    union chint { int i; char c[4]; };
+    chint x = { 0 };
+    for (int n = (str.size() < 4) ? (int)str.size() : 4; n--;)
+      x.c[n] = str[n];
+    return x.i;
+}
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double MsSince(Clock::time_point t0) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+static std::string Trim(const std::string& str) {
+  size_t b = str.find_first_not_of(" \t\r\n"), e = str.find_last_not_of(" \t\r\n");
+  return (std::string::npos == b) ? std::string() : str.substr(b, e - b + 1);
+}
+
+
+/********************************************************************************
+ * Jobs
+ ********************************************************************************/
+
+// A job, as read from a job file.
+struct Job {
+  std::vector<std::string>  effects;
+  std::string               inFile, outFile, codec;
+  int                       mode, resolution;
+  float                     strength;
+
+  Job() : codec(DEFAULT_CODEC), mode(0), resolution(0), strength(0.f) {}
+};
+
+// The outcome of a job, which is written to its report.
+struct JobReport {
+  std::string         error;        // Empty if the job succeeded
+  unsigned long long  frames;
+  unsigned            queueDepth;   // The number of jobs still waiting when this one was claimed
+  unsigned            warm, cold;   // The number of effects in the chain that were already loaded, or had to be
+  double              loadMs, runMs, totalMs;
+
+  JobReport() : frames(0), queueDepth(0), warm(0), cold(0), loadMs(0.), runMs(0.), totalMs(0.) {}
+};
+
+static bool ReadJob(const char *path, Job *job, std::string *why) {
+  char line[2048];
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    *why = "cannot read the job file";
+    return false;
+  }
+  while (fgets(line, sizeof(line), fp)) {
+    std::string str = Trim(line);
+    if (str.empty() || '#' == str[0])
+      continue;
+    size_t eq = str.find('=');
+    std::string key = Trim(str.substr(0, eq)), val = (std::string::npos == eq) ? "" : Trim(str.substr(eq + 1));
+    if      ("effect"     == key) {
+      job->effects.clear();
+      for (size_t b = 0, e; b <= val.size(); b = e + 1) {
+        e = val.find(',', b);
+        if (std::string::npos == e)
+          e = val.size();
+        if (e > b)
+          job->effects.push_back(Trim(val.substr(b, e - b)));
+      }
+    }
+    else if ("in_file"    == key) job->inFile     = val;
+    else if ("out_file"   == key) job->outFile    = val;
+    else if ("codec"      == key) job->codec      = val;
+    else if ("mode"       == key) job->mode       = atoi(val.c_str());
+    else if ("resolution" == key) job->resolution = atoi(val.c_str());
+    else if ("strength"   == key) job->strength   = (float)atof(val.c_str());
+    else {
+      *why = "unknown key \"" + key + "\"";
+      fclose(fp);
+      return false;
+    }
+  }
+  fclose(fp);
+  if      (job->effects.empty())  *why = "no effect was given";
+  else if (job->inFile.empty())   *why = "no in_file was given";
+  else if (job->outFile.empty())  *why = "no out_file was given";
+  else                            return true;
+  return false;
+}
+
+static void WriteReport(const std::string& path, const Job& job, const JobReport& report) {
+  FILE *fp = fopen(path.c_str(), "w");
+  if (!fp) {
+    printf("Cannot write the report \"%s\"\n", path.c_str());
+    return;
+  }
+  std::string effects;
+  for (const std::string& name : job.effects)
+    effects += (effects.empty() ? "" : ",") + name;
+  fprintf(fp, "status=%s\n", report.error.empty() ? "done" : "failed");
+  if (!report.error.empty())
+    fprintf(fp, "error=%s\n", report.error.c_str());
+  fprintf(fp,
+    "effect=%s\n"
+    "in_file=%s\n"
+    "out_file=%s\n"
+    "frames=%llu\n"
+    "queue_depth=%u\n"
+    "warm=%u\n"
+    "cold=%u\n"
+    "load_ms=%.1f\n"
+    "run_ms=%.1f\n"
+    "total_ms=%.1f\n"
+    "fps=%.2f\n",
+    effects.c_str(), job.inFile.c_str(), job.outFile.c_str(), report.frames, report.queueDepth, report.warm,
+    report.cold, report.loadMs, report.runMs, report.totalMs,
+    (report.runMs > 0. ? 1000. * report.frames / report.runMs : 0.));
+  fclose(fp);
+}
+
+
+/********************************************************************************
+ * Worker
+ ********************************************************************************/
+
+// A loaded effect instance, with its GPU buffers, that is kept warm between jobs.
+struct Stage {
+  std::string         key;
+  std::string         name;
+  NvVFX_Handle        eff;
+  NvCVImage           src, dst;
+  StateObjectPool     states;       // For Denoising, which must start each job with a clear state
+  void                *stateArray[1];
+  unsigned long long  lastUsed;
+
+  Stage() : eff(nullptr), lastUsed(0) { stateArray[0] = nullptr; }
+  ~Stage() { states.destroy(); NvVFX_DestroyEffect(eff); }
+};
+
+// Runs jobs with a cache of loaded effects, so that a job whose effects are already loaded with the same parameters
+// and input size pays for neither the model Load nor the allocation of its buffers. The CUDA context and stream are
+// created once for the life of the worker.
+class Worker {
+public:
+  struct Stats {
+    unsigned long long  jobs, failed, frames, warm, cold, evictions;
+    double              loadMs, runMs, totalMs;
+  };
+
+  Worker() : _stream(0), _tick(0) { memset(&_stats, 0, sizeof(_stats)); }
+  ~Worker() { _cache.clear(); if (_stream) NvVFX_CudaStreamDestroy(_stream); }
+
+  NvCV_Status init() { return NvVFX_CudaStreamCreate(&_stream); }
+
+  //! Run a job, filling in its report, other than the queue depth.
+  void run(const Job& job, JobReport *report);
+
+  //! Destroy the least recently used effects, beyond the given number.
+  void trim(unsigned maxWarm);
+
+  const Stats& stats() const { return _stats; }
+
+private:
+  NvCV_Status getStage(const std::string& name, const Job& job, unsigned width, unsigned height,
+                       const std::vector<Stage*>& chain, JobReport *report, Stage **stage);
+  NvCV_Status loadStage(Stage *st, const Job& job, unsigned width, unsigned height);
+  NvCV_Status runChain(const std::vector<Stage*>& chain, NvCVImage *src, NvCVImage *dst);
+  NvCV_Status buildChain(const Job& job, unsigned width, unsigned height, std::vector<Stage*> *chain,
+                         JobReport *report);
+  void        endChain(const std::vector<Stage*>& chain);
+
+  CUstream                              _stream;
+  NvCVImage                             _tmp;
+  std::vector<std::unique_ptr<Stage> >  _cache;
+  unsigned long long                    _tick;
+  Stats                                 _stats;
+};
+
+static bool IsScaler(const std::string& name) {
+  return NVVFX_FX_SUPER_RES == name || NVVFX_FX_SR_UPSCALE == name;
+}
+
+static float TransferScale(const NvCVImage *from, const NvCVImage *to) {
+  if (NVCV_F32 == from->componentType && NVCV_U8 == to->componentType) return 255.f;
+  if (NVCV_U8 == from->componentType && NVCV_F32 == to->componentType) return 1.f / 255.f;
+  return 1.f;
+}
+
+NvCV_Status Worker::loadStage(Stage *st, const Job& job, unsigned width, unsigned height) {
+  NvCV_Status err;
+  unsigned    dstWidth = width, dstHeight = height;
+  bool        upscale  = (NVVFX_FX_SR_UPSCALE == st->name);
+
+  if (IsScaler(st->name)) {
+    BAIL_IF_FALSE(job.resolution > 0, err, NVCV_ERR_PARAMETER);
+    dstHeight = (unsigned)job.resolution;
+    dstWidth  = width * dstHeight / height;
+    BAIL_IF_FALSE(width * dstHeight == height * dstWidth, err, NVCV_ERR_RESOLUTION);  // The scale must be isotropic
+  }
+  BAIL_IF_ERR(err = NvVFX_CreateEffect(st->name.c_str(), &st->eff));
+  // Do not set NVVFX_MODEL_DIRECTORY for NVVFX_FX_SR_UPSCALE feature as it is not a valid selector for that feature
+  if (!FLAG_modelDir.empty() && !upscale)
+    BAIL_IF_ERR(err = NvVFX_SetString(st->eff, NVVFX_MODEL_DIRECTORY, FLAG_modelDir.c_str()));
+  if (upscale) {
+    BAIL_IF_ERR(err = NvCVImage_Alloc(&st->src, width, height, NVCV_RGBA, NVCV_U8, NVCV_INTERLEAVED, NVCV_GPU, 32));
+    BAIL_IF_ERR(err = NvCVImage_Alloc(&st->dst, dstWidth, dstHeight, NVCV_RGBA, NVCV_U8, NVCV_INTERLEAVED, NVCV_GPU, 32));
+  } else {
+    BAIL_IF_ERR(err = NvCVImage_Alloc(&st->src, width, height, NVCV_BGR, NVCV_F32, NVCV_PLANAR, NVCV_GPU, 1));
+    BAIL_IF_ERR(err = NvCVImage_Alloc(&st->dst, dstWidth, dstHeight, NVCV_BGR, NVCV_F32, NVCV_PLANAR, NVCV_GPU, 1));
+  }
+  BAIL_IF_ERR(err = NvVFX_SetImage(st->eff, NVVFX_INPUT_IMAGE,  &st->src));
+  BAIL_IF_ERR(err = NvVFX_SetImage(st->eff, NVVFX_OUTPUT_IMAGE, &st->dst));
+  BAIL_IF_ERR(err = NvVFX_SetCudaStream(st->eff, NVVFX_CUDA_STREAM, _stream));
+  if (NVVFX_FX_ARTIFACT_REDUCTION == st->name || NVVFX_FX_SUPER_RES == st->name)
+    BAIL_IF_ERR(err = NvVFX_SetU32(st->eff, NVVFX_MODE, (unsigned)job.mode));
+  if (IsScaler(st->name) || NVVFX_FX_DENOISING == st->name)
+    BAIL_IF_ERR(err = NvVFX_SetF32(st->eff, NVVFX_STRENGTH, job.strength));
+  BAIL_IF_ERR(err = NvVFX_Load(st->eff));
+  if (NVVFX_FX_DENOISING == st->name)
+    BAIL_IF_ERR(err = st->states.initSlabs(st->eff, 1, _stream));
+bail:
+  return err;
+}
+
+NvCV_Status Worker::getStage(const std::string& name, const Job& job, unsigned width, unsigned height,
+                             const std::vector<Stage*>& chain, JobReport *report, Stage **stage) {
+  char        buf[128];
+  NvCV_Status err;
+  bool        hasMode = (NVVFX_FX_ARTIFACT_REDUCTION == name || NVVFX_FX_SUPER_RES == name),
+              hasStrength = (IsScaler(name) || NVVFX_FX_DENOISING == name);
+  snprintf(buf, sizeof(buf), "|%ux%u|%d|%g|%d", width, height, (hasMode ? job.mode : 0),
+           (hasStrength ? job.strength : 0.f), (IsScaler(name) ? job.resolution : 0));  // Only what it was loaded with
+  std::string key = name + buf;
+
+  for (auto& st : _cache) {
+    if (st->key != key || chain.end() != std::find(chain.begin(), chain.end(), st.get()))
+      continue;                             // A chain can use the same effect twice, but not the same instance
+    st->lastUsed = ++_tick;
+    ++report->warm;
+    *stage = st.get();
+    return NVCV_SUCCESS;
+  }
+
+  Clock::time_point t0 = Clock::now();
+  std::unique_ptr<Stage> st(new Stage);
+  st->key  = key;
+  st->name = name;
+  err = loadStage(st.get(), job, width, height);
+  report->loadMs += MsSince(t0);
+  if (NVCV_SUCCESS != err)
+    return err;
+  st->lastUsed = ++_tick;
+  ++report->cold;
+  *stage = st.get();
+  _cache.push_back(std::move(st));
+  return NVCV_SUCCESS;
+}
+
+NvCV_Status Worker::buildChain(const Job& job, unsigned width, unsigned height, std::vector<Stage*> *chain,
+                               JobReport *report) {
+  NvCV_Status err = NVCV_SUCCESS;
+  Stage       *st;
+  for (const std::string& name : job.effects) {
+    BAIL_IF_ERR(err = getStage(name, job, width, height, *chain, report, &st));
+    chain->push_back(st);
+    width  = st->dst.width;
+    height = st->dst.height;
+    if (st->states.slabs()) {               // Start the job with a clear state
+      BAIL_IF_ERR(err = st->states.acquire(&st->stateArray[0]));
+      BAIL_IF_ERR(err = NvVFX_SetObject(st->eff, NVVFX_STATE, (void*)st->stateArray));
+    }
+  }
+bail:
+  return err;
+}
+
+void Worker::endChain(const std::vector<Stage*>& chain) {
+  for (Stage *st : chain) {
+    if (st->stateArray[0]) {
+      (void)st->states.recycle(st->stateArray[0]);
+      st->stateArray[0] = nullptr;
+    }
+  }
+}
+
+// frame --> chain[0].src --> chain[0].dst --> chain[1].src --> ... --> chain[n-1].dst --> dst
+NvCV_Status Worker::runChain(const std::vector<Stage*>& chain, NvCVImage *src, NvCVImage *dst) {
+  NvCV_Status err;
+  BAIL_IF_ERR(err = NvCVImage_Transfer(src, &chain[0]->src, TransferScale(src, &chain[0]->src), _stream, &_tmp));
+  for (size_t i = 0; i < chain.size(); ++i) {
+    NvCVImage *next = (i + 1 < chain.size()) ? &chain[i + 1]->src : dst;
+    BAIL_IF_ERR(err = NvVFX_Run(chain[i]->eff, 0));
+    BAIL_IF_ERR(err = NvCVImage_Transfer(&chain[i]->dst, next, TransferScale(&chain[i]->dst, next), _stream, &_tmp));
+  }
+bail:
+  return err;
+}
+
+void Worker::run(const Job& job, JobReport *report) {
+  NvCV_Status         err     = NVCV_SUCCESS;
+  Clock::time_point   t0      = Clock::now(), t1;
+  bool                isImage = IsImageFile(job.inFile.c_str());
+  cv::Mat             srcImg, dstImg;
+  NvCVImage           srcVFX, dstVFX;
+  cv::VideoCapture    reader;
+  cv::VideoWriter     writer;
+  std::vector<Stage*> chain;
+  unsigned            width, height;
+
+  if (isImage) {
+    srcImg = cv::imread(job.inFile);
+    BAIL_IF_FALSE(!srcImg.empty(), err, NVCV_ERR_READ);
+    width  = srcImg.cols;
+    height = srcImg.rows;
+  } else {
+    BAIL_IF_FALSE(reader.open(job.inFile), err, NVCV_ERR_READ);
+    width  = (unsigned)reader.get(cv::CAP_PROP_FRAME_WIDTH);
+    height = (unsigned)reader.get(cv::CAP_PROP_FRAME_HEIGHT);
+  }
+  BAIL_IF_ERR(err = buildChain(job, width, height, &chain, report));
+  dstImg.create(chain.back()->dst.height, chain.back()->dst.width, CV_8UC3);
+  NVWrapperForCVMat(&dstImg, &dstVFX);
+
+  t1 = Clock::now();
+  if (isImage) {
+    NVWrapperForCVMat(&srcImg, &srcVFX);
+    BAIL_IF_ERR(err = runChain(chain, &srcVFX, &dstVFX));
+    BAIL_IF_FALSE(cv::imwrite(job.outFile, dstImg), err, NVCV_ERR_WRITE);
+    report->frames = 1;
+  } else {
+    BAIL_IF_FALSE(writer.open(job.outFile, StringToFourcc(job.codec), reader.get(cv::CAP_PROP_FPS), dstImg.size()),
+                  err, NVCV_ERR_WRITE);
+    while (reader.read(srcImg)) {
+      NVWrapperForCVMat(&srcImg, &srcVFX);
+      BAIL_IF_ERR(err = runChain(chain, &srcVFX, &dstVFX));
+      writer.write(dstImg);
+      ++report->frames;
+    }
+    writer.release();
+  }
+  report->runMs = MsSince(t1);
+
+bail:
+  endChain(chain);
+  if (NVCV_SUCCESS != err)
+    report->error = NvCV_GetErrorStringFromCode(err);
+  report->totalMs = MsSince(t0);
+  ++_stats.jobs;
+  if (NVCV_SUCCESS != err)
+    ++_stats.failed;
+  _stats.frames  += report->frames;
+  _stats.warm    += report->warm;
+  _stats.cold    += report->cold;
+  _stats.loadMs  += report->loadMs;
+  _stats.runMs   += report->runMs;
+  _stats.totalMs += report->totalMs;
+}
+
+void Worker::trim(unsigned maxWarm) {
+  while (_cache.size() > maxWarm) {
+    auto lru = _cache.begin();
+    for (auto it = _cache.begin(); it != _cache.end(); ++it)
+      if ((*it)->lastUsed < (*lru)->lastUsed)
+        lru = it;
+    if (FLAG_verbose)
+      printf("Unloading %s\n", (*lru)->key.c_str());
+    _cache.erase(lru);
+    ++_stats.evictions;
+  }
+}
+
+
+/********************************************************************************
+ * Spool
+ ********************************************************************************/
+
+static bool ListJobs(const std::string& spool, std::vector<cv::String> *jobs) {
+  try {
+    cv::glob(spool + "/*.job", *jobs, false);   // Sorted by name
+  } catch (const cv::Exception&) {
+    return false;                               // The spool does not exist
+  }
+  return true;
+}
+
+static bool FileExists(const std::string& path) {
+  FILE *fp = fopen(path.c_str(), "r");
+  if (fp)
+    fclose(fp);
+  return nullptr != fp;
+}
+
+int main(int argc, char **argv) {
+  int                     nErrs;
+  NvCV_Status             vfxErr;
+  Worker                  worker;
+  std::vector<cv::String> jobs;
+  std::string             stopFile;
+  Clock::time_point       idleSince;
+  int                     numJobs = 0;
+
+  nErrs = ParseMyArgs(argc, argv);
+  if (nErrs)
+    return nErrs;
+  if (FLAG_spool.empty()) {
+    printf("Please specify --spool=<dir>\n");
+    Usage();
+    return 1;
+  }
+  if (!ListJobs(FLAG_spool, &jobs)) {
+    printf("Cannot read the spool directory \"%s\"\n", FLAG_spool.c_str());
+    return 1;
+  }
+  vfxErr = worker.init();
+  if (NVCV_SUCCESS != vfxErr) {
+    printf("Error: %s\n", NvCV_GetErrorStringFromCode(vfxErr));
+    return (int)vfxErr;
+  }
+
+  stopFile  = FLAG_spool + "/stop";
+  idleSince = Clock::now();
+  printf("Waiting for jobs in \"%s\"\n", FLAG_spool.c_str());
+  while (!FileExists(stopFile)) {
+    if (!ListJobs(FLAG_spool, &jobs) || jobs.empty()) {
+      if (FLAG_idleExit > 0 && MsSince(idleSince) > 1000. * FLAG_idleExit)
+        break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(FLAG_pollMs > 0 ? FLAG_pollMs : 1));
+      continue;
+    }
+
+    std::string base    = jobs[0].substr(0, jobs[0].size() - 4);  // Strip .job
+    std::string running = base + ".running";
+    if (0 != rename(jobs[0].c_str(), running.c_str()))
+      continue;                                   // Another worker claimed it first
+
+    Job       job;
+    JobReport report;
+    report.queueDepth = (unsigned)jobs.size() - 1;
+    if (!ReadJob(running.c_str(), &job, &report.error))
+      printf("Job \"%s\": %s\n", running.c_str(), report.error.c_str());
+    else
+      worker.run(job, &report);
+    WriteReport(base + (report.error.empty() ? ".done" : ".failed"), job, report);
+    remove(running.c_str());
+    worker.trim(FLAG_maxWarm > 0 ? (unsigned)FLAG_maxWarm : 0);
+
+    printf("%s: %s, %llu frames, %u warm, %u cold, load %.0f ms, run %.0f ms, %u queued\n", base.c_str(),
+      (report.error.empty() ? "done" : report.error.c_str()), report.frames, report.warm, report.cold, report.loadMs,
+      report.runMs, report.queueDepth);
+    idleSince = Clock::now();
+    if (FLAG_maxJobs > 0 && ++numJobs >= FLAG_maxJobs)
+      break;
+  }
+
+  const Worker::Stats& s = worker.stats();
+  printf("Jobs %llu (%llu failed), frames %llu; effects loaded warm %llu, cold %llu, unloaded %llu;\n"
+         "load %.0f ms, run %.0f ms, total %.0f ms\n",
+    s.jobs, s.failed, s.frames, s.warm, s.cold, s.evictions, s.loadMs, s.runMs, s.totalMs);
+  return 0;
+}
@@ -0,0 +1,7 @@
+SETLOCAL
+SET PATH=%PATH%;..\external\opencv\bin;
+IF NOT EXIST spool MKDIR spool
+REM Queue two jobs that share the ArtifactReduction instance, then let the worker exit once the spool is idle
+(ECHO effect=ArtifactReduction& ECHO in_file=..\input\input1.jpg& ECHO out_file=worker_ar_1.png& ECHO mode=1) > spool\job_0001.job
+(ECHO effect=ArtifactReduction,SuperRes& ECHO in_file=..\input\input1.jpg& ECHO out_file=worker_ar_sr_1.png& ECHO mode=1& ECHO resolution=2160) > spool\job_0002.job
+EffectWorkerApp.exe --spool=spool --idle_exit=5 --verbose
@@ -0,0 +1,510 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BufferPool.h"
+#include "FrameLayout.h"
+#include "RawFrameFile.h"
+#include "ShardManager.h"
+#include "nvCVImage.h"
+
+#ifdef _MSC_VER
+  #define strcasecmp _stricmp
+#endif // _MSC_VER
+
+
+bool                      FLAG_verbose  = false;
+std::string               FLAG_tempDir  = ".";
+std::vector<const char*>  FLAG_checks;
+
+static bool GetFlagArgVal(const char *flag, const char *arg, const char **val) {
+  if (*arg != '-')
+    return false;
+  while (*++arg == '-')
+    continue;
+  const char *s = strchr(arg, '=');
+  if (s == NULL)  {
+    if (strcmp(flag, arg) != 0)
+      return false;
+    *val = NULL;
+    return true;
+  }
+  size_t n = s - arg;
+  if ((strlen(flag) != n) || (strncmp(flag, arg, n) != 0))
+    return false;
+  *val = s + 1;
+  return true;
+}
+
+static bool GetFlagArgVal(const char *flag, const char *arg, std::string *val) {
+  const char *valStr;
+  if (!GetFlagArgVal(flag, arg, &valStr))
+    return false;
+  val->assign(valStr ? valStr : "");
+  return true;
+}
+
+static bool GetFlagArgVal(const char *flag, const char *arg, bool *val) {
+  const char *valStr;
+  bool success = GetFlagArgVal(flag, arg, &valStr);
+  if (success) {
+    *val = (valStr == NULL ||
+      strcasecmp(valStr, "true") == 0 ||
+      strcasecmp(valStr, "on")   == 0 ||
+      strcasecmp(valStr, "yes")  == 0 ||
+      strcasecmp(valStr, "1")    == 0
+      );
+  }
+  return success;
+}
+
+static void Usage() {
+  printf(
+    "SelfTestApp [flags ...] [check ...]\n"
+    "  Runs checks of the sample utilities that need no GPU, effects or models, and returns the number that failed.\n"
+    "  where flags is:\n"
+    "  --temp_dir=<path>     the directory for the files written by the checks (default: the current directory)\n"
+    "  --verbose             verbose output\n"
+    "  and check is one of the following; all of them are run if none is given:\n"
+    "    nvrf_f16            round-trip BGR frames through a .nvrf file with an F16 payload\n"
+    "    shard_manager       place streams on simulated devices, and drain a saturated one by moving its streams\n"
+    "    buffer_pool         recycle buffers by size through a BufferPool of ordinary host memory\n"
+  );
+}
+
+static int ParseMyArgs(int argc, char **argv) {
+  int errs = 0;
+  for (--argc, ++argv; argc--; ++argv) {
+    bool help;
+    const char *arg = *argv;
+    if (arg[0] == '-') {
+      if (arg[1] == '-') {                                      // double-dash
+        if (GetFlagArgVal("verbose",  arg, &FLAG_verbose) ||
+            GetFlagArgVal("temp_dir", arg, &FLAG_tempDir)
+        ) {
+          continue;
+        } else if (GetFlagArgVal("help", arg, &help)) {         // --help
+          Usage();
+          errs = 1;
+        } else {
+          printf("Unknown flag: \"%s\"\n", arg);
+          errs = 1;
+        }
+      }
+      else {                                                    // single dash
+        for (++arg; *arg; ++arg) {
+          if (*arg == 'v') {
+            FLAG_verbose = true;
+          } else {
+            printf("Unknown flag ignored: \"-%c\"\n", *arg);
+          }
+        }
+        continue;
+      }
+    }
+    else {                                                      // no dash
+      FLAG_checks.push_back(arg);
+    }
+  }
+  return errs;
+}
+
+
+#define CHECK(x)  do { if (!(x)) { printf("  %s:%d: failed: %s\n", __FILE__, __LINE__, #x); return false; } } while(0)
+
+
+// Write BGR frames to a .nvrf file as planar F16, which NvCVImage_Transfer() cannot convert U8 to directly,
+// then read them back and convert them to BGR again, by way of F32 both times.
+// Half floats carry 11 significant bits, so every U8 value survives the round trip exactly.
+static bool CheckNvrfF16() {
+  const unsigned      kWidth = 67, kHeight = 35, kFrames = 3;   // Odd sizes, so rows are padded in the file
+  std::string         path = FLAG_tempDir + "/SelfTest_f16.nvrf";
+  RawFrameFileWriter  writer;
+  RawFrameFileReader  reader;
+  NvCVImage           src, view, dst, f32;
+  unsigned            x, y, f, diffs;
+
+  CHECK(NVCV_SUCCESS == NvCVImage_Alloc(&src, kWidth, kHeight, NVCV_BGR, NVCV_U8, NVCV_CHUNKY, NVCV_CPU, 0));
+  CHECK(NVCV_SUCCESS == NvCVImage_Alloc(&dst, kWidth, kHeight, NVCV_BGR, NVCV_U8, NVCV_CHUNKY, NVCV_CPU, 0));
+  CHECK(NVCV_SUCCESS == writer.open(path.c_str(), 30., NVCV_BGR, NVCV_F16, NVCV_PLANAR));
+  for (f = 0; f < kFrames; ++f) {
+    for (y = 0; y < kHeight; ++y)
+      for (x = 0; x < kWidth * 3; ++x)
+        ((unsigned char*)src.pixels)[y * src.pitch + x] = (unsigned char)(x * 7 + y * 13 + f * 101);
+    CHECK(NVCV_SUCCESS == writer.write(&src));
+  }
+  CHECK(NVCV_SUCCESS == writer.close());
+
+  CHECK(NVCV_SUCCESS == reader.open(path.c_str()));
+  CHECK(kFrames == reader.frameCount());
+  for (f = 0, diffs = 0; f < kFrames; ++f) {
+    CHECK(NVCV_F16 == reader.desc(f)->componentType && NVCV_PLANAR == reader.desc(f)->planar);
+    CHECK(NVCV_SUCCESS == reader.frame(f, &view));
+    CHECK(NVCV_SUCCESS == TransferViaF32(&view, &dst, 255.f, 0, &f32, nullptr));
+    for (y = 0; y < kHeight; ++y)
+      for (x = 0; x < kWidth * 3; ++x)
+        diffs += ((unsigned char*)dst.pixels)[y * dst.pitch + x] != (unsigned char)(x * 7 + y * 13 + f * 101);
+  }
+  reader.close();
+  remove(path.c_str());
+  if (FLAG_verbose)
+    printf("  %u frames of %ux%u, %u components differ\n", kFrames, kWidth, kHeight, diffs);
+  CHECK(0 == diffs);
+  return true;
+}
+
+
+// A simulated device for CheckShardManager(): a queue of frames, each tagged with its stream, that a consumer thread
+// runs in order, as the batcher of a shard would.
+struct SimDevice {
+  struct Item {
+    unsigned  stream;
+    int       frame;    // -1 when the stream leaves the device
+  };
+  std::deque<Item>        queue;
+  std::mutex              mutex;
+  std::condition_variable cond;
+  bool                    closed;
+
+  SimDevice() : closed(false) {}
+  void push(unsigned stream, int frame) {
+    Item item = { stream, frame };
+    { std::lock_guard<std::mutex> lock(mutex);  queue.push_back(item); }
+    cond.notify_one();
+  }
+  bool pop(Item *item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [this] { return closed || !queue.empty(); });
+    if (queue.empty())
+      return false;
+    *item = queue.front();
+    queue.pop_front();
+    return true;
+  }
+  void close() {
+    { std::lock_guard<std::mutex> lock(mutex);  closed = true; }
+    cond.notify_all();
+  }
+};
+
+// The progress of the simulated streams, shared by the producers and the devices.
+struct SimStreams {
+  std::vector<int>        next;       // The next frame of each stream that should be run
+  std::vector<unsigned>   runOn[2];   // The number of frames of each stream run on each device
+  unsigned                outOfOrder, finished;
+  std::mutex              mutex;
+  std::condition_variable cond;
+};
+
+// Run the frames queued to a simulated device, reporting each as a batch. Device 0 reports that it is always busy,
+// so that it sheds its streams; device 1 reports that it is mostly idle.
+static void RunSimDevice(ShardManager *manager, SimDevice *device, unsigned index, SimStreams *streams) {
+  SimDevice::Item item;
+  while (device->pop(&item)) {
+    if (item.frame < 0) {
+      if (manager->isMoving(item.stream)) {
+        manager->drained(item.stream);          // The stream continues on the other device
+      } else {
+        std::lock_guard<std::mutex> lock(streams->mutex);
+        ++streams->finished;
+      }
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> lock(streams->mutex);
+      if (streams->next[item.stream] != item.frame)
+        ++streams->outOfOrder;
+      streams->next[item.stream] = item.frame + 1;
+      ++streams->runOn[index][item.stream];
+    }
+    manager->report(index, 1.f, (0 == index) ? 10.f : 1.f, (0 == index) ? 0.f : 9.f);
+    streams->cond.notify_all();
+  }
+}
+
+static const int kSimInFlight = 3;
+
+// Submit the frames of a stream, a few at a time, following the stream when the manager moves it:
+// leave the old device, wait until it has run the frames already queued to it, and continue on the new one.
+static void ProduceSimStream(ShardManager *manager, SimDevice *devices, unsigned stream, int device, int numFrames,
+                             SimStreams *streams, std::atomic<unsigned> *handoffs) {
+  unsigned to;
+  for (int f = 0; f < numFrames; ++f) {
+    if (manager->moving(stream, &to)) {
+      devices[device].push(stream, -1);
+      if (!manager->waitDrained(stream))
+        break;
+      device = (int)to;
+      ++*handoffs;
+    }
+    devices[device].push(stream, f);
+    std::unique_lock<std::mutex> lock(streams->mutex);   // Keep a few frames in flight, like a shallow ring,
+    streams->cond.wait(lock, [&] { return streams->next[stream] + kSimInFlight > f; });  // so that moves must drain
+  }
+  devices[device].push(stream, -1);
+  manager->remove(stream);
+}
+
+
+// Place streams on two simulated devices, then run them with the first device saturated, so that the manager moves
+// every stream off it; each handoff must keep the frames of the stream in order, each run exactly once.
+// Also check that place() waits for room, and that close() releases it.
+static bool CheckShardManager() {
+  const unsigned        kStreams = 4, kFrames = 200;
+  ShardManager          manager;
+  SimDevice             devices[2];
+  SimStreams            streams;
+  std::vector<std::thread> producers;
+  std::thread           consumers[2], waiter;
+  std::atomic<unsigned> handoffs(0);
+  std::atomic<int>      placed(-2);
+  std::atomic<bool>     entered(false), released(false), placedEarly(false);
+  std::vector<ShardManager::DeviceStats> stats;
+  unsigned              s, onFirst, ranOnFirst;
+  int                   placement[kStreams], placedBefore;
+
+  // place() waits while every device is full, until a stream is removed, and fails once the manager is closed
+  manager.init(1, 1, 0.8f, 0.f);
+  CHECK(0 == manager.place(0, 1.f));
+  waiter = std::thread([&] {
+    entered = true;
+    placed = manager.place(1, 1.f);
+    placedEarly = !released;  // place() must not return until the room has been made
+  });
+  while (!entered)
+    std::this_thread::yield();
+  placedBefore = placed;
+  released = true;
+  manager.remove(0);
+  waiter.join();  // Before any check can return
+  CHECK(-2 == placedBefore && !placedEarly);
+  CHECK(0 == placed && 0 == manager.deviceOf(1) && -1 == manager.deviceOf(0));
+  waiter = std::thread([&] { placed = manager.place(2, 1.f); });
+  manager.close();
+  waiter.join();
+  CHECK(-1 == placed);
+
+  // New streams go to the least loaded device
+  manager.init(2, kStreams, 0.8f, 0.f);
+  for (s = 0, onFirst = 0; s < kStreams; ++s) {
+    placement[s] = manager.place(s, 0.05f);
+    CHECK(placement[s] == (int)(s & 1));
+    onFirst += (0 == placement[s]);
+  }
+  stats = manager.stats();
+  CHECK(stats[0].streams == kStreams / 2 && stats[1].streams == kStreams / 2);
+
+  // Drain the saturated device while its streams keep running
+  streams.next.assign(kStreams, 0);
+  streams.runOn[0].assign(kStreams, 0);
+  streams.runOn[1].assign(kStreams, 0);
+  streams.outOfOrder = streams.finished = 0;
+  for (s = 0; s < 2; ++s)
+    consumers[s] = std::thread(RunSimDevice, &manager, &devices[s], s, &streams);
+  for (s = 0; s < kStreams; ++s)
+    producers.push_back(std::thread(ProduceSimStream, &manager, devices, s, placement[s], (int)kFrames, &streams,
+                                    &handoffs));
+  for (std::thread& t : producers)
+    t.join();
+  for (s = 0; s < 2; ++s) {
+    devices[s].close();
+    consumers[s].join();
+  }
+
+  for (s = 0, ranOnFirst = 0; s < kStreams; ++s) {
+    CHECK(kFrames == (unsigned)streams.next[s]);
+    CHECK(kFrames == streams.runOn[0][s] + streams.runOn[1][s]);
+    ranOnFirst += streams.runOn[0][s];
+  }
+  if (FLAG_verbose) {
+    printf("  %u handoffs, %u frames run on the saturated device\n", (unsigned)handoffs, ranOnFirst);
+    manager.printStats(stdout);
+  }
+  CHECK(0 == streams.outOfOrder);
+  CHECK(kStreams == streams.finished);
+  CHECK(onFirst == handoffs && onFirst == manager.moves());   // Every stream left the saturated device, once
+  CHECK(ranOnFirst < kFrames);
+  stats = manager.stats();
+  CHECK(0 == stats[0].streams && 0 == stats[1].streams);
+  return true;
+}
+
+
+// The host memory backend of CheckBufferPool(), which counts the buffers that are alive, and can be made to fail.
+struct HostBuffers {
+  std::atomic<int>  live;
+  bool              failNext;
+};
+
+static bool MakeHostBuffer(size_t bytes, BufferPool::Block *block, void *cookie) {
+  HostBuffers *host = (HostBuffers*)cookie;
+  if (host->failNext) {
+    host->failNext = false;
+    return false;
+  }
+  if (nullptr == (block->data = malloc(bytes)))
+    return false;
+  block->owner = nullptr;
+  block->bytes = bytes;
+  ++host->live;
+  return true;
+}
+
+static void DestroyHostBuffer(const BufferPool::Block& block, void *cookie) {
+  free(block.data);
+  --((HostBuffers*)cookie)->live;
+}
+
+
+// Exercise the bucketing of requests by size, the reuse of idle buffers, the cap on idle memory, the retry after a
+// failure, and the accounting of busy and idle bytes, with a pool of malloc()ed buffers rounded up to 1 KiB.
+static bool CheckBufferPool() {
+  const size_t  kK = 1024;
+  HostBuffers   host;
+  void          *a, *b, *c, *d, *e, *f;
+  int           notFromPool;
+
+  host.live     = 0;
+  host.failNext = false;
+  {
+    BufferPool pool(MakeHostBuffer, DestroyHostBuffer, &host, 24 * kK, kK);
+
+    // Requests are rounded up to the granularity, and counted as busy
+    a = pool.acquire(5000);
+    b = pool.acquire(5000);
+    CHECK(a && b && a != b && 2 == host.live);
+    CHECK(pool.owns(a) && pool.owns(b));
+    CHECK(10 * kK == pool.stats().busyBytes && 0 == pool.stats().idleBytes && 2 == pool.stats().made);
+
+    // A released buffer becomes idle, and serves a request that rounds up to the same size
+    CHECK(pool.release(a) && !pool.owns(a));
+    CHECK(5 * kK == pool.stats().busyBytes && 5 * kK == pool.stats().idleBytes);
+    c = pool.acquire(5100);
+    CHECK(c == a && 1 == pool.stats().reused && 2 == host.live);
+
+    // An idle buffer more than twice the size is not used for a small request
+    CHECK(pool.release(c) && pool.release(b));
+    d = pool.acquire(1000);
+    CHECK(d != a && d != b && 3 == host.live && 3 == pool.stats().made);
+
+    // A buffer that did not come from the pool is refused
+    CHECK(!pool.release(&notFromPool) && !pool.owns(&notFromPool));
+
+    // A buffer released beyond the idle cap is destroyed rather than kept
+    CHECK(pool.release(d));
+    CHECK(11 * kK == pool.stats().idleBytes && 0 == pool.stats().busyBytes);
+    e = pool.acquire(20000);
+    CHECK(e && 4 == host.live);
+    CHECK(pool.release(e));
+    CHECK(3 == host.live && 11 * kK == pool.stats().idleBytes);
+
+    // When the backend fails, the idle buffers are destroyed and the request is retried
+    host.failNext = true;
+    f = pool.acquire(100000);
+    CHECK(f && 1 == host.live && 0 == pool.stats().idleBytes && 0 == pool.stats().failed);
+    CHECK(pool.release(f));
+    CHECK(0 == host.live && 0 == pool.stats().busyBytes && 0 == pool.stats().idleBytes);  // It was over the cap
+
+    // The peak covers the most that was held at once
+    CHECK(98 * kK == pool.stats().peakBytes);
+
+    // Concurrent use keeps the accounting consistent
+    std::vector<std::thread> threads;
+    std::atomic<unsigned>    failures(0);
+    unsigned long long       made = pool.stats().made, reused = pool.stats().reused;
+    for (unsigned t = 0; t < 4; ++t)
+      threads.push_back(std::thread([&pool, &failures] {
+        for (unsigned i = 0; i < 10000; ++i) {
+          void *p = pool.acquire(4 * kK * (1 + i % 3));
+          if (!p || !pool.release(p))
+            ++failures;
+        }
+      }));
+    for (std::thread& t : threads)
+      t.join();
+    CHECK(0 == failures);
+    CHECK(40000 == pool.stats().made - made + pool.stats().reused - reused);
+    CHECK(0 == pool.stats().busyBytes && pool.stats().idleBytes <= 24 * kK);
+    if (FLAG_verbose)
+      printf("  %llu buffers made, %llu reused, peak %zu bytes\n", pool.stats().made, pool.stats().reused,
+             pool.stats().peakBytes);
+  }
+  CHECK(0 == host.live);    // The idle buffers are destroyed with the pool
+  return true;
+}
+
+
+struct Check {
+  const char  *name;
+  bool        (*run)();
+};
+
+static const Check kChecks[] = {
+  { "nvrf_f16",      CheckNvrfF16 },
+  { "shard_manager", CheckShardManager },
+  { "buffer_pool",   CheckBufferPool },
+};
+
+
+int main(int argc, char **argv) {
+  int       nErrs;
+  unsigned  i, numRun = 0;
+
+  nErrs = ParseMyArgs(argc, argv);
+  if (nErrs)
+    return nErrs;
+
+  for (const char *name : FLAG_checks) {
+    for (i = 0; i < sizeof(kChecks) / sizeof(kChecks[0]) && strcmp(name, kChecks[i].name); ++i)
+      continue;
+    if (i == sizeof(kChecks) / sizeof(kChecks[0])) {
+      printf("Unknown check \"%s\"\n", name);
+      Usage();
+      return 1;
+    }
+  }
+  for (i = 0; i < sizeof(kChecks) / sizeof(kChecks[0]); ++i) {
+    bool selected = FLAG_checks.empty();
+    for (const char *name : FLAG_checks)
+      selected = selected || !strcmp(name, kChecks[i].name);
+    if (!selected)
+      continue;
+    printf("%s\n", kChecks[i].name);
+    if (!kChecks[i].run())
+      ++nErrs;
+    ++numRun;
+  }
+  printf("%u of %u checks passed\n", numRun - nErrs, numRun);
+  return nErrs;
+}
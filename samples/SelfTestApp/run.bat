@@ -0,0 +1,3 @@
+SETLOCAL
+REM Checks of the sample utilities that need no GPU, effects or models
+SelfTestApp.exe --verbose
@@ -28,9 +28,25 @@
 #include <string>
 #include <iostream>
 
+#include <cuda_runtime_api.h>
+
+#include "BatchUtilities.h"
+#include "EffectLimits.h"
+#include "DecoderPipe.h"
+#include "EffectTiler.h"
+#include "FrameFingerprint.h"
+#include "FrameLayout.h"
+#include "FrameScheduler.h"
+#include "PinnedMatAllocator.h"
+#include "RenditionFanout.h"
+#include "ShmFrameRing.h"
 #include "nvCVOpenCV.h"
+#include "RawFrameFile.h"
+#include "RawFrameIO.h"
+#include "Y4mIO.h"
 #include "nvVideoEffects.h"
 #include "opencv2/opencv.hpp"
+#include "TileDiff.h"
 
 
 #ifdef _MSC_VER
@@ -42,6 +58,7 @@
 
 #define BAIL_IF_ERR(err)                    do { if (0 != (err)) {                      goto bail; } } while(0)
 #define BAIL_IF_NULL(x, err, code)          do { if ((void*)(x) == NULL)  { err = code; goto bail; } } while(0)
+#define BAIL_IF_FALSE(x, err, code)         do { if (!(x))                { err = code; goto bail; } } while(0)
 #define NVCV_ERR_HELP 411
 
 #ifdef _WIN32
@@ -55,17 +72,36 @@ bool        FLAG_debug          = false,
             FLAG_verbose        = false,
             FLAG_show           = false,
             FLAG_progress       = false,
-            FLAG_webcam         = false;
-float       FLAG_strength       = 0.f;
+            FLAG_webcam         = false,
+            FLAG_dirtyTiles     = false,
+            FLAG_skipRepeats    = false,
+            FLAG_renditionGpu   = false,
+            FLAG_yuvIngest      = false,
+            FLAG_pinned         = true;
+float       FLAG_strength       = 0.f,
+            FLAG_latencyBudget  = 0.f,
+            FLAG_rawFps         = 30.f,
+            FLAG_dirtyThreshold = 1.f,
+            FLAG_repeatThreshold = 1.f;
 int         FLAG_mode           = 0;
-int         FLAG_resolution     = 0;
+int         FLAG_resolution     = 0,
+            FLAG_tileOverlap    = 32,
+            FLAG_shmSlots       = 4,
+            FLAG_colorspace     = 709;
 std::string FLAG_codec          = DEFAULT_CODEC,
             FLAG_camRes         = "1280x720",
             FLAG_inFile,
             FLAG_outFile,
             FLAG_outDir,
             FLAG_modelDir,
-            FLAG_effect;
+            FLAG_effect,
+            FLAG_tileSize,
+            FLAG_renditions,
+            FLAG_pixFmt         = "bgr24",
+            FLAG_outPixFmt,
+            FLAG_rawSize,
+            FLAG_nvrfPayload    = "bgr24",
+            FLAG_ffmpeg         = "ffmpeg";
 
 // Set this when using OTA Updates
 // This path is used by nvVideoEffectsProxy.cpp to load the SDK dll
@@ -141,9 +177,27 @@ static void Usage() {
   printf(
     "VideoEffectsApp [args ...]\n"
     "  where args is:\n"
-    "  --in_file=<path>           input file to be processed\n"
+    "  --in_file=<path>           input file to be processed, or shm:<name> to read BGR frames in place from the\n"
+    "                             shared-memory ring of that name, written by another process, or - to read raw\n"
+    "                             frames from stdin; a .nvrf file of raw frames is read in place, and a .y4m file is\n"
+    "                             streamed, with no decoder\n"
+    "  --yuv_ingest               decode the input video to NV12 with ffmpeg, and convert it to the input of the\n"
+    "                             effect as it is uploaded, rather than have OpenCV convert it to BGR first\n"
+    "  --ffmpeg=<path>            the ffmpeg executable for --yuv_ingest (default ffmpeg, on the PATH)\n"
     "  --webcam                   use a webcam as the input\n"
-    "  --out_file=<path>          output file to be written\n"
+    "  --out_file=<path>          output file to be written, or shm:<name> to write the frames to a shared-memory\n"
+    "                             ring of that name, to be read by another process, or - to write raw frames to stdout;\n"
+    "                             a .nvrf or .y4m file stores raw frames, with no encoder\n"
+    "  --nvrf_payload=<fmt>       the format of the frames in a .nvrf output: bgr24, nv12, or f16 for planar BGR in\n"
+    "                             half floats (default bgr24)\n"
+    "  --shm_slots=<n>            the number of frames that can be in flight in a shm:<name> output (default 4)\n"
+    "  --pix_fmt=<fmt>            the format of raw frames on stdin: bgr24, rgba, nv12, yuv420p or yuv444p\n"
+    "                             (default bgr24)\n"
+    "  --out_pix_fmt=<fmt>        the format of raw frames on stdout (default: that of --pix_fmt)\n"
+    "  --raw_size=WxH             the size of the raw frames on stdin\n"
+    "  --raw_fps=<fps>            the frame rate of the raw frames on stdin, for an encoded output (default 30)\n"
+    "  --colorspace=<standard>    the colorspace of raw YUV frames, 601, 709 or 2020, in video range,\n"
+    "                             and the YUV matrix of .y4m files, which do not record it (default 709)\n"
     "  --effect=<effect>          the effect to apply\n"
     "  --show                     display the results in a window (for webcam, it is always true)\n"
     "  --strength=<value>         strength of the upscaling effect, [0.0, 1.0]\n"
@@ -151,9 +205,25 @@ static void Usage() {
     "                             where 0 - conservative and 1 - aggressive\n"
     "  --cam_res=[WWWx]HHH        specify camera resolution as height or width x height\n"
     "                             supports 720 and 1080 resolutions (default \"720\") \n"
+    "  --latency_budget=<ms>      webcam frames that would exceed this glass-to-glass latency are dropped\n"
+    "                             (default 0: only drop frames that are superseded by newer ones)\n"
     "  --resolution=<height>      the desired height of the output\n"
+    "  --renditions=<h1,h2,...>   also write the video at each of these smaller heights, downscaled from the output,\n"
+    "                             to <out_file>_<height>p, each with its own encoder\n"
+    "  --rendition_gpu            downscale the renditions with OpenCL, where available\n"
+    "  --tile_overlap=<pixels>    the overlap between tiles, when the input is too large for the effect (default 32)\n"
+    "  --tile_size=WxH            process the input in tiles of at most this size, rather than the effect maximum\n"
+    "  --dirty_tiles              only run ArtifactReduction on the region of a video frame that has changed\n"
+    "  --dirty_threshold=<diff>   the mean absolute difference, in 8-bit code values, for a 64x64 tile to be\n"
+    "                             considered changed (default 1)\n"
+    "  --skip_repeats             do not run the effect on video frames that repeat the last one processed,\n"
+    "                             but write its output again\n"
+    "  --repeat_threshold=<diff>  the mean absolute difference, in 8-bit code values, for a 16x16 tile to be\n"
+    "                             considered changed by --skip_repeats; 0 only skips bit-identical frames (default 1)\n"
     "  --model_dir=<path>         the path to the directory that contains the models\n"
     "  --codec=<fourcc>           the fourcc code for the desired codec (default " DEFAULT_CODEC ")\n"
+    "  --pinned                   keep frames on the CPU in page-locked memory, so that they are uploaded and\n"
+    "                             downloaded without a staging copy; --pinned=false uses ordinary memory (default on)\n"
     "  --progress                 show progress\n"
     "  --verbose                  verbose output\n"
     "  --debug                    print extra debugging information\n"
@@ -181,13 +251,32 @@ static int ParseMyArgs(int argc, char **argv) {
         GetFlagArgVal("effect",       arg, &FLAG_effect)      ||
         GetFlagArgVal("show",         arg, &FLAG_show)        ||
         GetFlagArgVal("webcam",       arg, &FLAG_webcam)      ||
+        GetFlagArgVal("yuv_ingest",   arg, &FLAG_yuvIngest)   ||
+        GetFlagArgVal("ffmpeg",       arg, &FLAG_ffmpeg)      ||
         GetFlagArgVal("cam_res",      arg, &FLAG_camRes)      ||
+        GetFlagArgVal("latency_budget", arg, &FLAG_latencyBudget) ||
         GetFlagArgVal("strength",     arg, &FLAG_strength)    ||
         GetFlagArgVal("mode",         arg, &FLAG_mode)        ||
         GetFlagArgVal("resolution",   arg, &FLAG_resolution)  ||
+        GetFlagArgVal("renditions",   arg, &FLAG_renditions)  ||
+        GetFlagArgVal("shm_slots",    arg, &FLAG_shmSlots)    ||
+        GetFlagArgVal("pix_fmt",      arg, &FLAG_pixFmt)      ||
+        GetFlagArgVal("out_pix_fmt",  arg, &FLAG_outPixFmt)   ||
+        GetFlagArgVal("raw_size",     arg, &FLAG_rawSize)     ||
+        GetFlagArgVal("raw_fps",      arg, &FLAG_rawFps)      ||
+        GetFlagArgVal("colorspace",   arg, &FLAG_colorspace)  ||
+        GetFlagArgVal("nvrf_payload", arg, &FLAG_nvrfPayload) ||
+        GetFlagArgVal("rendition_gpu", arg, &FLAG_renditionGpu) ||
+        GetFlagArgVal("tile_overlap", arg, &FLAG_tileOverlap) ||
+        GetFlagArgVal("tile_size",    arg, &FLAG_tileSize)    ||
+        GetFlagArgVal("dirty_tiles",  arg, &FLAG_dirtyTiles)  ||
+        GetFlagArgVal("dirty_threshold", arg, &FLAG_dirtyThreshold) ||
+        GetFlagArgVal("skip_repeats", arg, &FLAG_skipRepeats) ||
+        GetFlagArgVal("repeat_threshold", arg, &FLAG_repeatThreshold) ||
         GetFlagArgVal("model_dir",    arg, &FLAG_modelDir)    ||
         GetFlagArgVal("codec",        arg, &FLAG_codec)       ||
         GetFlagArgVal("progress",     arg, &FLAG_progress)    ||
+        GetFlagArgVal("pinned",       arg, &FLAG_pinned)      ||
         GetFlagArgVal("debug",        arg, &FLAG_debug)
         )) {
       continue;
@@ -206,6 +295,10 @@ static int ParseMyArgs(int argc, char **argv) {
       printf("Unknown flag ignored: \"%s\"\n", arg);
     }
   }
+  if (FLAG_tileOverlap < 0) {
+    printf("--tile_overlap=%d should not be negative\n", FLAG_tileOverlap);
+    ++errs;
+  }
   return errs;
 }
 
@@ -240,6 +333,37 @@ static bool IsLossyImageFile(const char *str) {
   return HasOneOfTheseSuffixes(str, ".jpg", ".jpeg", nullptr);
 }
 
+// Get the name of the shared-memory ring in a path of the form shm:<name>, or NULL for any other path.
+static const char* ShmName(const char *path) {
+  return (path && !strncmp(path, "shm:", 4) && path[4]) ? path + 4 : nullptr;
+}
+
+// The YUV matrix chosen by --colorspace.
+static unsigned char ColorStandard() {
+  return (601 == FLAG_colorspace) ? NVCV_601 : (2020 == FLAG_colorspace) ? NVCV_2020 : NVCV_709;
+}
+
+// The colorspace bits of raw YUV frames, which are in video range with MPEG-2 chroma siting, as ffmpeg has them.
+static unsigned char RawColorspace() {
+  return ColorStandard() | NVCV_VIDEO_RANGE | NVCV_CHROMA_MPEG2;
+}
+
+// The payload format of a .nvrf output.
+static bool ParseNvrfPayload(const char *str, NvCVImage_PixelFormat *format, NvCVImage_ComponentType *type,
+                             unsigned *layout) {
+  if      (!strcmp(str, "bgr24")) { *format = NVCV_BGR;    *type = NVCV_U8;  *layout = NVCV_CHUNKY; }
+  else if (!strcmp(str, "nv12"))  { *format = NVCV_YUV420; *type = NVCV_U8;  *layout = NVCV_NV12;   }
+  else if (!strcmp(str, "f16"))   { *format = NVCV_BGR;    *type = NVCV_F16; *layout = NVCV_PLANAR; }
+  else                            return false;
+  return true;
+}
+
+// A shared-memory, raw or .nvrf frame can only be processed in place if it is in the format of a decoded video frame.
+static bool IsBgrFrame(const NvCVImage *im, unsigned width, unsigned height) {
+  return NVCV_BGR == im->pixelFormat && NVCV_U8 == im->componentType && NVCV_CHUNKY == im->planar &&
+         width == im->width && height == im->height;
+}
+
 
 static const char* DurationString(double sc) {
   static char buf[16];
@@ -327,24 +451,34 @@ struct FXApp {
   };
 
   FXApp()   { _eff = nullptr; _effectName = nullptr; _inited = false; _showFPS = false; _progress = false;
-              _show = false; _enableEffect = true, _drawVisualization = true, _framePeriod = 0.f; }
-  ~FXApp()  { NvVFX_DestroyEffect(_eff); }
+              _show = false; _enableEffect = true, _drawVisualization = true, _framePeriod = 0.f;
+              _tileBatch = 0; _rawOutFd = -1;
+              _regionEff = nullptr; _fullRuns = _regionRuns = _framesSkipped = _tilesDirty = _tilesTotal = 0; }
+  ~FXApp()  { NvVFX_DestroyEffect(_regionEff); NvVFX_DestroyEffect(_eff); }
 
   void          setShow(bool show) { _show = show; }
   Err           createEffect(const char *effectSelector, const char *modelDir);
   void          destroyEffect();
   NvCV_Status   allocBuffers(unsigned width, unsigned height);
   NvCV_Status   allocTempBuffers();
+  NvCV_Status   allocGpuBuffers(NvCVImage_PixelFormat format, NvCVImage_ComponentType type, unsigned layout,
+                                unsigned alignment);
+  NvCV_Status   setEffectImages();
+  NvCV_Status   runTiles(CUstream stream);
   Err           processImage(const char *inFile, const char *outFile);
   Err           processMovie(const char *inFile, const char *outFile);
   Err           initCamera(cv::VideoCapture& cap);
   Err           processKey(int key);
+  NvCV_Status   initDirtyTiles(CUstream stream);
+  NvCV_Status   runDirtyTiles(CUstream stream);
+  void          printDirtyTileStats();
   void          drawFrameRate(cv::Mat& img);
   void          drawEffectStatus(cv::Mat& img);
   Err           appErrFromVfxStatus(NvCV_Status status)  { return (Err)status; }
   const char*   errorStringFromCode(Err code);
 
   NvVFX_Handle  _eff;
+  PinnedMatAllocator _pinned;       // Before the Mats that it allocates, so that it outlives them
   cv::Mat       _srcImg;
   cv::Mat       _dstImg;
   NvCVImage     _srcGpuBuf;
@@ -352,6 +486,7 @@ struct FXApp {
   NvCVImage     _srcVFX;
   NvCVImage     _dstVFX;
   NvCVImage     _tmpVFX;  // We use the same temporary buffer for source and dst, since it auto-shapes as needed
+  NvCVImage     _f32VFX;  // Stages an F16 .nvrf input through F32
   bool          _show;
   bool          _inited;
   bool          _showFPS;
@@ -361,6 +496,25 @@ struct FXApp {
   const char*   _effectName;
   float         _framePeriod;
   std::chrono::high_resolution_clock::time_point _lastTime;
+
+  // Tiled processing, for inputs larger than the effect accepts
+  EffectTiler   _tiler;
+  unsigned      _tileBatch;         // The number of tiles in the GPU buffers; 0 if the frame is not tiled
+  NvCVImage     _tileVFX;           // One output tile, on the CPU
+
+  // Dirty tile processing
+  NvVFX_Handle  _regionEff;         // A second instance of the effect, loaded for the smaller region window
+  NvCVImage     _regionSrcGpuBuf;
+  NvCVImage     _regionDstGpuBuf;
+  cv::Mat       _refImg;            // The source as of the last time each of its regions was processed
+  NvCVImage     _refVFX;
+  DirtyTileMap  _tiles;
+  unsigned long long _fullRuns, _regionRuns, _framesSkipped, _tilesDirty, _tilesTotal;
+
+  // Repeated frame skipping
+  RepeatFrameDetector _repeats;
+
+  int           _rawOutFd;          // Where raw frames are written for --out_file=-, from the original stdout
 };
 
 const char* FXApp::errorStringFromCode(Err code) {
@@ -468,6 +622,8 @@ bail:
 }
 
 void FXApp::destroyEffect() {
+  NvVFX_DestroyEffect(_regionEff);
+  _regionEff = nullptr;
   NvVFX_DestroyEffect(_eff);
   _eff = nullptr;
 }
@@ -493,12 +649,102 @@ static NvCV_Status CheckScaleIsotropy(const NvCVImage *src, const NvCVImage *dst
   return NVCV_SUCCESS;
 }
 
+// Allocate the GPU buffers for the effect. If the frame is larger than the effect accepts, they are instead
+// allocated to hold a batch of overlapping tiles.
+NvCV_Status FXApp::allocGpuBuffers(NvCVImage_PixelFormat format, NvCVImage_ComponentType type, unsigned layout,
+                                   unsigned alignment) {
+  const unsigned kMaxTileBatch = 8;
+  NvCV_Status vfxErr = NVCV_SUCCESS;
+  unsigned maxWidth, maxHeight;
+
+  GetEffectMaxInputSize(_eff, _effectName, (float)_dstImg.rows / _srcImg.rows, &maxWidth, &maxHeight);
+  if (!FLAG_tileSize.empty()) {
+    unsigned w, h;
+    if (2 == sscanf(FLAG_tileSize.c_str(), "%u%*[xX]%u", &w, &h)) {
+      if (maxWidth  > w) maxWidth  = w;
+      if (maxHeight > h) maxHeight = h;
+    }
+  }
+  _tileBatch = 0;
+  if ((unsigned)_srcImg.cols <= maxWidth && (unsigned)_srcImg.rows <= maxHeight) {
+    BAIL_IF_ERR(vfxErr = NvCVImage_Alloc(&_srcGpuBuf, _srcImg.cols, _srcImg.rows, format, type, layout, NVCV_GPU, alignment));
+    BAIL_IF_ERR(vfxErr = NvCVImage_Alloc(&_dstGpuBuf, _dstImg.cols, _dstImg.rows, format, type, layout, NVCV_GPU, alignment));
+    goto bail;
+  }
+
+  vfxErr = _tiler.init(_srcImg.cols, _srcImg.rows, _dstImg.cols, _dstImg.rows, maxWidth, maxHeight, FLAG_tileOverlap);
+  if (NVCV_SUCCESS != vfxErr) {
+    printf("%dx%d --> %dx%d cannot be tiled into %ux%u with an overlap of %d\n",
+      _srcImg.cols, _srcImg.rows, _dstImg.cols, _dstImg.rows, maxWidth, maxHeight, FLAG_tileOverlap);
+    goto bail;
+  }
+  _tileBatch = _tiler.numTiles() < kMaxTileBatch ? _tiler.numTiles() : kMaxTileBatch;
+  BAIL_IF_ERR(vfxErr = AllocateBatchBuffer(&_srcGpuBuf, _tileBatch, _tiler.tileWidth(), _tiler.tileHeight(),
+                                           format, type, layout, NVCV_GPU, alignment));
+  BAIL_IF_ERR(vfxErr = AllocateBatchBuffer(&_dstGpuBuf, _tileBatch, _tiler.dstTileWidth(), _tiler.dstTileHeight(),
+                                           format, type, layout, NVCV_GPU, alignment));
+  BAIL_IF_ERR(vfxErr = NvCVImage_Alloc(&_tileVFX, _tiler.dstTileWidth(), _tiler.dstTileHeight(),
+                                       NVCV_BGR, NVCV_U8, NVCV_CHUNKY, NVCV_CPU, 0));
+  if (FLAG_verbose)
+    printf("Processing %dx%d in %u tiles of %ux%u, %u at a time\n",
+      _srcImg.cols, _srcImg.rows, _tiler.numTiles(), _tiler.tileWidth(), _tiler.tileHeight(), _tileBatch);
+bail:
+  return vfxErr;
+}
+
+// Set the effect images; when tiling, these are the first of the batch of tiles, and a batched model is requested.
+NvCV_Status FXApp::setEffectImages() {
+  NvCV_Status vfxErr = NVCV_SUCCESS;
+  NvCVImage   nth;
+  if (!_tileBatch) {
+    BAIL_IF_ERR(vfxErr = NvVFX_SetImage(_eff, NVVFX_INPUT_IMAGE,  &_srcGpuBuf));
+    BAIL_IF_ERR(vfxErr = NvVFX_SetImage(_eff, NVVFX_OUTPUT_IMAGE, &_dstGpuBuf));
+  } else {
+    BAIL_IF_ERR(vfxErr = NvVFX_SetImage(_eff, NVVFX_INPUT_IMAGE,  NthImage(0, _tiler.tileHeight(),    &_srcGpuBuf, &nth)));
+    BAIL_IF_ERR(vfxErr = NvVFX_SetImage(_eff, NVVFX_OUTPUT_IMAGE, NthImage(0, _tiler.dstTileHeight(), &_dstGpuBuf, &nth)));
+    BAIL_IF_ERR(vfxErr = NvVFX_SetU32(_eff, NVVFX_MODEL_BATCH, _tileBatch));
+  }
+bail:
+  return vfxErr;
+}
+
+// Run the effect on each batch of tiles, and blend them into the destination image.
+//   _srcVFX --> _srcGpuBuf[k] --> _dstGpuBuf[k] --> _tileVFX --> _dstVFX
+NvCV_Status FXApp::runTiles(CUstream stream) {
+  NvCV_Status vfxErr = NVCV_SUCCESS;
+  NvCVImage   nth;
+  unsigned    numTiles = _tiler.numTiles(), t0, k, n;
+
+  for (t0 = 0; t0 < numTiles; t0 += n) {
+    n = (numTiles - t0 < _tileBatch) ? numTiles - t0 : _tileBatch;
+    for (k = 0; k < n; ++k) {
+      NvCVRect2i r = _tiler.srcRect(t0 + k);
+      BAIL_IF_ERR(vfxErr = NvCVImage_TransferRect(&_srcVFX, &r, NthImage(k, _tiler.tileHeight(), &_srcGpuBuf, &nth),
+                                                  nullptr, 1.f / 255.f, stream, &_tmpVFX));
+    }
+    BAIL_IF_ERR(vfxErr = NvVFX_SetU32(_eff, NVVFX_BATCH_SIZE, n));  // The last batch may be partial
+    BAIL_IF_ERR(vfxErr = NvVFX_Run(_eff, 0));
+    for (k = 0; k < n; ++k) {
+      BAIL_IF_ERR(vfxErr = TransferFromNthImage(k, &_dstGpuBuf, &_tileVFX, 255.f, stream, &_tmpVFX));
+      BAIL_IF_FALSE(cudaSuccess == cudaStreamSynchronize((cudaStream_t)stream), vfxErr, NVCV_ERR_CUDA);  // blend on the CPU
+      BAIL_IF_ERR(vfxErr = _tiler.blend(t0 + k, &_tileVFX, &_dstVFX));
+    }
+  }
+bail:
+  return vfxErr;
+}
+
 NvCV_Status FXApp::allocBuffers(unsigned width, unsigned height) {
   NvCV_Status  vfxErr = NVCV_SUCCESS;
 
   if (_inited)
     return NVCV_SUCCESS;
 
+  if (FLAG_pinned) {  // So that frames are decoded into, and downloaded to, memory that the GPU can reach directly
+    _srcImg.allocator = &_pinned;
+    _dstImg.allocator = &_pinned;
+  }
+
   if (!_srcImg.data) {
     _srcImg.create(height, width, CV_8UC3);                                                                                        // src CPU
     BAIL_IF_NULL(_srcImg.data, vfxErr, NVCV_ERR_MEMORY);
@@ -506,14 +752,12 @@ NvCV_Status FXApp::allocBuffers(unsigned width, unsigned height) {
   if (!strcmp(_effectName, NVVFX_FX_TRANSFER)) {
     _dstImg.create(_srcImg.rows, _srcImg.cols, _srcImg.type());                                                                    // dst CPU
     BAIL_IF_NULL(_dstImg.data, vfxErr, NVCV_ERR_MEMORY);
-    BAIL_IF_ERR(vfxErr = NvCVImage_Alloc(&_srcGpuBuf, _srcImg.cols, _srcImg.rows, NVCV_BGR, NVCV_F32, NVCV_PLANAR, NVCV_GPU, 1));  // src GPU
-    BAIL_IF_ERR(vfxErr = NvCVImage_Alloc(&_dstGpuBuf, _dstImg.cols, _dstImg.rows, NVCV_BGR, NVCV_F32, NVCV_PLANAR, NVCV_GPU, 1));  // dst GPU
+    BAIL_IF_ERR(vfxErr = allocGpuBuffers(NVCV_BGR, NVCV_F32, NVCV_PLANAR, 1));                                                    // src, dst GPU
   }
   else if (!strcmp(_effectName, NVVFX_FX_ARTIFACT_REDUCTION)) {
     _dstImg.create(_srcImg.rows, _srcImg.cols, _srcImg.type());                                                                    // dst CPU
     BAIL_IF_NULL(_dstImg.data, vfxErr, NVCV_ERR_MEMORY);
-    BAIL_IF_ERR(vfxErr = NvCVImage_Alloc(&_srcGpuBuf, _srcImg.cols, _srcImg.rows, NVCV_BGR, NVCV_F32, NVCV_PLANAR, NVCV_GPU, 1));  // src GPU
-    BAIL_IF_ERR(vfxErr = NvCVImage_Alloc(&_dstGpuBuf, _dstImg.cols, _dstImg.rows, NVCV_BGR, NVCV_F32, NVCV_PLANAR, NVCV_GPU, 1));  // dst GPU
+    BAIL_IF_ERR(vfxErr = allocGpuBuffers(NVCV_BGR, NVCV_F32, NVCV_PLANAR, 1));                                                    // src, dst GPU
   }
   else if (!strcmp(_effectName, NVVFX_FX_SUPER_RES)) {
     if (!FLAG_resolution) {
@@ -524,8 +768,7 @@ NvCV_Status FXApp::allocBuffers(unsigned width, unsigned height) {
     int dstWidth = _srcImg.cols * FLAG_resolution / _srcImg.rows;
     _dstImg.create(FLAG_resolution, dstWidth, _srcImg.type());                                                                     // dst CPU
     BAIL_IF_NULL(_dstImg.data, vfxErr, NVCV_ERR_MEMORY);
-    BAIL_IF_ERR(vfxErr = NvCVImage_Alloc(&_srcGpuBuf, _srcImg.cols, _srcImg.rows, NVCV_BGR, NVCV_F32, NVCV_PLANAR, NVCV_GPU, 1));  // src GPU
-    BAIL_IF_ERR(vfxErr = NvCVImage_Alloc(&_dstGpuBuf, _dstImg.cols, _dstImg.rows, NVCV_BGR, NVCV_F32, NVCV_PLANAR, NVCV_GPU, 1));  // dst GPU
+    BAIL_IF_ERR(vfxErr = allocGpuBuffers(NVCV_BGR, NVCV_F32, NVCV_PLANAR, 1));                                                    // src, dst GPU
     BAIL_IF_ERR(vfxErr = CheckScaleIsotropy(&_srcGpuBuf, &_dstGpuBuf));
   }
   else if (!strcmp(_effectName, NVVFX_FX_SR_UPSCALE)) {
@@ -538,10 +781,7 @@ NvCV_Status FXApp::allocBuffers(unsigned width, unsigned height) {
     int dstWidth = _srcImg.cols * FLAG_resolution / _srcImg.rows;
     _dstImg.create(FLAG_resolution, dstWidth, _srcImg.type());  // dst CPU
     BAIL_IF_NULL(_dstImg.data, vfxErr, NVCV_ERR_MEMORY);
-    BAIL_IF_ERR(vfxErr = NvCVImage_Alloc(&_srcGpuBuf, _srcImg.cols, _srcImg.rows, NVCV_RGBA, NVCV_U8, NVCV_INTERLEAVED,
-                                         NVCV_GPU, 32));  // src GPU
-    BAIL_IF_ERR(vfxErr = NvCVImage_Alloc(&_dstGpuBuf, _dstImg.cols, _dstImg.rows, NVCV_RGBA, NVCV_U8, NVCV_INTERLEAVED,
-                                         NVCV_GPU, 32));  // dst GPU
+    BAIL_IF_ERR(vfxErr = allocGpuBuffers(NVCV_RGBA, NVCV_U8, NVCV_INTERLEAVED, 32));  // src, dst GPU
     BAIL_IF_ERR(vfxErr = CheckScaleIsotropy(&_srcGpuBuf, &_dstGpuBuf));
   }
   NVWrapperForCVMat(&_srcImg, &_srcVFX);      // _srcVFX is an alias for _srcImg
@@ -558,6 +798,102 @@ bail:
   return vfxErr;
 }
 
+static int ClampInt(int x, int lo, int hi) { return (x < lo) ? lo : (x > hi) ? hi : x; }
+
+static const unsigned kDirtyTileSize = 64;  // The granularity of change detection
+static const int      kDirtyContext  = 16;  // Extra pixels around a dirty region to give the network some context
+static const unsigned kShmWaitMs     = 30000; // How long to wait for the producer of a shared-memory input to start
+
+// Dirty tile mode runs a second instance of the effect on a window half the size of the frame in each dimension.
+// Frames whose changes fit inside the window are processed there and composited into the previous output;
+// those with more widespread changes are processed in full by the main effect instance.
+NvCV_Status FXApp::initDirtyTiles(CUstream stream) {
+  NvCV_Status vfxErr = NVCV_SUCCESS;
+  unsigned winWidth, winHeight;
+
+  if (strcmp(_effectName, NVVFX_FX_ARTIFACT_REDUCTION)) {
+    printf("--dirty_tiles is only supported for %s\n", NVVFX_FX_ARTIFACT_REDUCTION);
+    return NVCV_ERR_FEATURENOTFOUND;
+  }
+  if (_tileBatch) {
+    printf("--dirty_tiles is not supported for inputs that need to be tiled\n");
+    return NVCV_ERR_RESOLUTION;
+  }
+  winWidth  = (_srcVFX.width  / 2 + kDirtyTileSize - 1) / kDirtyTileSize * kDirtyTileSize;
+  winHeight = (_srcVFX.height / 2 + kDirtyTileSize - 1) / kDirtyTileSize * kDirtyTileSize;
+  if (winWidth < _srcVFX.width && winHeight < _srcVFX.height) {  // Otherwise, only skip unchanged frames
+    BAIL_IF_ERR(vfxErr = NvVFX_CreateEffect(_effectName, &_regionEff));
+    if (FLAG_modelDir[0] != '\0')
+      BAIL_IF_ERR(vfxErr = NvVFX_SetString(_regionEff, NVVFX_MODEL_DIRECTORY, FLAG_modelDir.c_str()));
+    BAIL_IF_ERR(vfxErr = NvCVImage_Alloc(&_regionSrcGpuBuf, winWidth, winHeight, NVCV_BGR, NVCV_F32, NVCV_PLANAR, NVCV_GPU, 1));
+    BAIL_IF_ERR(vfxErr = NvCVImage_Alloc(&_regionDstGpuBuf, winWidth, winHeight, NVCV_BGR, NVCV_F32, NVCV_PLANAR, NVCV_GPU, 1));
+    BAIL_IF_ERR(vfxErr = NvVFX_SetImage(_regionEff, NVVFX_INPUT_IMAGE,  &_regionSrcGpuBuf));
+    BAIL_IF_ERR(vfxErr = NvVFX_SetImage(_regionEff, NVVFX_OUTPUT_IMAGE, &_regionDstGpuBuf));
+    BAIL_IF_ERR(vfxErr = NvVFX_SetCudaStream(_regionEff, NVVFX_CUDA_STREAM, stream));
+    BAIL_IF_ERR(vfxErr = NvVFX_SetU32(_regionEff, NVVFX_MODE, (unsigned int)FLAG_mode));
+    BAIL_IF_ERR(vfxErr = NvVFX_Load(_regionEff));
+  }
+  _refImg.release();
+bail:
+  return vfxErr;
+}
+
+NvCV_Status FXApp::runDirtyTiles(CUstream stream) {
+  NvCV_Status vfxErr = NVCV_SUCCESS;
+  NvCVRect2i  dirty = { 0, 0, (int)_srcVFX.width, (int)_srcVFX.height }, win = dirty;
+  bool        full  = true;
+
+  if (!_refImg.empty()) {
+    BAIL_IF_ERR(vfxErr = ComputeDirtyTiles(&_srcVFX, &_refVFX, kDirtyTileSize, FLAG_dirtyThreshold, &_tiles));
+    _tilesDirty += _tiles.numDirty;
+    _tilesTotal += _tiles.cols * _tiles.rows;
+    if (!_tiles.numDirty) {  // _dstImg still holds the output for the last processed frame
+      ++_framesSkipped;
+      goto bail;
+    }
+    _tiles.boundingRect(_srcVFX.width, _srcVFX.height, &dirty);
+    if (_regionEff) {
+      int x0 = ClampInt(dirty.x - kDirtyContext, 0, (int)_srcVFX.width);
+      int x1 = ClampInt(dirty.x + dirty.width + kDirtyContext, 0, (int)_srcVFX.width);
+      int y0 = ClampInt(dirty.y - kDirtyContext, 0, (int)_srcVFX.height);
+      int y1 = ClampInt(dirty.y + dirty.height + kDirtyContext, 0, (int)_srcVFX.height);
+      win.width  = (int)_regionSrcGpuBuf.width;
+      win.height = (int)_regionSrcGpuBuf.height;
+      full = (x1 - x0 > win.width || y1 - y0 > win.height);
+      win.x = ClampInt((x0 + x1 - win.width)  / 2, 0, (int)_srcVFX.width  - win.width);   // Center the window on the region
+      win.y = ClampInt((y0 + y1 - win.height) / 2, 0, (int)_srcVFX.height - win.height);
+    }
+  }
+
+  if (full) {
+    BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_srcVFX, &_srcGpuBuf, 1.f / 255.f, stream, &_tmpVFX));
+    BAIL_IF_ERR(vfxErr = NvVFX_Run(_eff, 0));
+    BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_dstGpuBuf, &_dstVFX, 255.f, stream, &_tmpVFX));
+    _srcImg.copyTo(_refImg);
+    NVWrapperForCVMat(&_refImg, &_refVFX);
+    ++_fullRuns;
+  } else {
+    NvCVRect2i  winDirty = { dirty.x - win.x, dirty.y - win.y, dirty.width, dirty.height };
+    NvCVPoint2i dstPt    = { dirty.x, dirty.y };
+    BAIL_IF_ERR(vfxErr = NvCVImage_TransferRect(&_srcVFX, &win, &_regionSrcGpuBuf, nullptr, 1.f / 255.f, stream, &_tmpVFX));
+    BAIL_IF_ERR(vfxErr = NvVFX_Run(_regionEff, 0));
+    BAIL_IF_ERR(vfxErr = NvCVImage_TransferRect(&_regionDstGpuBuf, &winDirty, &_dstVFX, &dstPt, 255.f, stream, &_tmpVFX));
+    cv::Rect roi(dirty.x, dirty.y, dirty.width, dirty.height);
+    _srcImg(roi).copyTo(_refImg(roi));  // Changes below threshold elsewhere keep accumulating against the old reference
+    ++_regionRuns;
+  }
+bail:
+  return vfxErr;
+}
+
+void FXApp::printDirtyTileStats() {
+  unsigned long long frames = _fullRuns + _regionRuns + _framesSkipped;
+  if (!frames)
+    return;
+  printf("Dirty tiles: %llu frames, %llu full, %llu region, %llu skipped; %.1f%% of tiles were dirty\n",
+    frames, _fullRuns, _regionRuns, _framesSkipped, _tilesTotal ? 100. * _tilesDirty / _tilesTotal : 0.);
+}
+
 FXApp::Err FXApp::processImage(const char *inFile, const char *outFile) {
   CUstream      stream  = 0;
   NvCV_Status   vfxErr;
@@ -571,9 +907,9 @@ FXApp::Err FXApp::processImage(const char *inFile, const char *outFile) {
   BAIL_IF_ERR(vfxErr = allocBuffers(_srcImg.cols, _srcImg.rows));
 
   // Since images are uploaded asynchronously, we may as well do this first.
-  BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_srcVFX, &_srcGpuBuf, 1.f/255.f, stream, &_tmpVFX)); // _srcVFX--> _tmpVFX --> _srcGpuBuf
-  BAIL_IF_ERR(vfxErr = NvVFX_SetImage(_eff, NVVFX_INPUT_IMAGE,  &_srcGpuBuf));
-  BAIL_IF_ERR(vfxErr = NvVFX_SetImage(_eff, NVVFX_OUTPUT_IMAGE, &_dstGpuBuf));
+  if (!_tileBatch)
+    BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_srcVFX, &_srcGpuBuf, 1.f/255.f, stream, &_tmpVFX)); // _srcVFX--> _tmpVFX --> _srcGpuBuf
+  BAIL_IF_ERR(vfxErr = setEffectImages());
   BAIL_IF_ERR(vfxErr = NvVFX_SetCudaStream(_eff, NVVFX_CUDA_STREAM, stream));
   if (!strcmp(_effectName, NVVFX_FX_ARTIFACT_REDUCTION)) {
     BAIL_IF_ERR(vfxErr = NvVFX_SetU32(_eff, NVVFX_MODE, (unsigned int)FLAG_mode));
@@ -581,9 +917,17 @@ FXApp::Err FXApp::processImage(const char *inFile, const char *outFile) {
     BAIL_IF_ERR(vfxErr = NvVFX_SetU32(_eff, NVVFX_MODE, (unsigned int)FLAG_mode));
   }
 
-  BAIL_IF_ERR(vfxErr = NvVFX_Load(_eff));
-  BAIL_IF_ERR(vfxErr = NvVFX_Run(_eff, 0));                                                   // _srcGpuBuf --> _dstGpuBuf
-  BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_dstGpuBuf, &_dstVFX, 255.f, stream, &_tmpVFX));   // _dstGpuBuf --> _tmpVFX --> _dstVFX
+  vfxErr = NvVFX_Load(_eff);
+  if (NVCV_ERR_MODELSUBSTITUTION == vfxErr && _tileBatch)
+    vfxErr = NVCV_SUCCESS;  // There is no model for the requested tile batch; smaller batches will be run instead
+  BAIL_IF_ERR(vfxErr);
+  if (_tileBatch) {
+    BAIL_IF_ERR(vfxErr = runTiles(stream));
+  } else {
+    BAIL_IF_ERR(vfxErr = NvVFX_Run(_eff, 0));                                                   // _srcGpuBuf --> _dstGpuBuf
+    BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_dstGpuBuf, &_dstVFX, 255.f, stream, &_tmpVFX));   // _dstGpuBuf --> _tmpVFX --> _dstVFX
+  }
+  BAIL_IF_FALSE(cudaSuccess == cudaStreamSynchronize((cudaStream_t)stream), vfxErr, NVCV_ERR_CUDA);
 
   if (outFile && outFile[0]) {
     if(IsLossyImageFile(outFile))
@@ -611,30 +955,161 @@ FXApp::Err FXApp::processMovie(const char *inFile, const char *outFile) {
   NvCV_Status     vfxErr;
   unsigned        frameNum;
   VideoInfo       info;
+  RealtimeFrameScheduler scheduler;
+  bool            repeat;
+  RenditionFanout renditions;
+  std::vector<int> heights;
+  ShmFrameRing    shmIn, shmOut;
+  const char      *shmInName, *shmOutName;
+  bool            shmInPlace;
+  DecoderPipe     decoder;          // Before rawIn, so that on any exit rawIn closes the pipe before the decoder is reaped
+  RawFrameReader  rawIn;
+  RawFrameWriter  rawOut;
+  RawFrameFormat  rawFmt;
+  NvCVImage       rawFrame;
+  bool            rawInput, rawUpload;
+  int             rawWidth, rawHeight;
+  RawFrameFileReader nvrfIn;
+  RawFrameFileWriter nvrfOut;
+  Y4mReader       y4mIn;
+  Y4mWriter       y4mOut;
+  NvCVImage_PixelFormat   nvrfFormat;
+  NvCVImage_ComponentType nvrfType;
+  unsigned        nvrfLayout;
+  std::chrono::high_resolution_clock::time_point startTime;
 
   if (inFile && !inFile[0]) inFile = nullptr;  // Set file paths to NULL if zero length
-
-  if (!FLAG_webcam && inFile) {
-    reader.open(inFile);
+  shmInName  = FLAG_webcam ? nullptr : ShmName(inFile);
+  shmOutName = ShmName(outFile);
+
+  if (shmInName) {
+    // The first frame gives the size; the loop below acquires it again, rather than waiting for the next one
+    if (NVCV_SUCCESS != shmIn.open(shmInName, kShmWaitMs) || NVCV_SUCCESS != shmIn.acquireRead(&_srcVFX)) {
+      printf("Error: No frames were shared as \"%s\"\n", shmInName);
+      return errRead;
+    }
+    if (!IsBgrFrame(&_srcVFX, _srcVFX.width, _srcVFX.height)) {
+      printf("Error: The frames shared as \"%s\" are not BGR\n", shmInName);
+      return errPixelFormat;
+    }
+    CVWrapperForNvCVImage(&_srcVFX, &_srcImg);
+    info.codec      = 0;
+    info.width      = (int)_srcVFX.width;
+    info.height     = (int)_srcVFX.height;
+    info.frameRate  = shmIn.frameRate();
+    info.frameCount = 0;
+  } else if (inFile && !strcmp(inFile, "-")) {
+    if (2 != sscanf(FLAG_rawSize.c_str(), "%d%*[xX]%d", &rawWidth, &rawHeight) || rawWidth <= 0 || rawHeight <= 0 ||
+        NVCV_SUCCESS != rawFmt.init(FLAG_pixFmt.c_str(), rawWidth, rawHeight, RawColorspace())) {
+      printf("Raw frames on stdin need --raw_size=WxH, with an even size for 4:2:0, and a --pix_fmt of bgr24, rgba, "
+             "nv12, yuv420p or yuv444p\n");
+      return errFlag;
+    }
+    BAIL_IF_ERR(vfxErr = rawIn.open(RawFrameReader::StdinFd(), rawFmt));
+    info.codec      = 0;
+    info.width      = rawWidth;
+    info.height     = rawHeight;
+    info.frameRate  = FLAG_rawFps;
+    info.frameCount = 0;
+  } else if (inFile && HasSuffix(inFile, ".nvrf")) {
+    if (NVCV_SUCCESS != nvrfIn.open(inFile) || !nvrfIn.frameCount()) {
+      printf("Error: Could not read frames from \"%s\"\n", inFile);
+      return errRead;
+    }
+    info.codec      = 0;
+    info.width      = (int)nvrfIn.desc(0)->width;
+    info.height     = (int)nvrfIn.desc(0)->height;
+    info.frameRate  = nvrfIn.frameRate();
+    info.frameCount = (long long)nvrfIn.frameCount();
+  } else if (inFile && HasSuffix(inFile, ".y4m")) {
+    if (NVCV_SUCCESS != (vfxErr = y4mIn.open(inFile, NVCV_I420, ColorStandard()))) {
+      printf("Error: Could not read 8-bit 4:2:0 or 4:4:4 frames from \"%s\": %s\n", inFile,
+             NvCV_GetErrorStringFromCode(vfxErr));
+      return errRead;
+    }
+    info.codec      = 0;
+    info.width      = (int)y4mIn.format().width;
+    info.height     = (int)y4mIn.format().height;
+    info.frameRate  = y4mIn.frameRate();
+    info.frameCount = y4mIn.frameCount();
   } else {
-    appErr = initCamera(reader);
-    if (appErr != errNone)
-      return appErr;
-  }
+    if (!FLAG_webcam && inFile) {
+      reader.open(inFile);
+    } else {
+      appErr = initCamera(reader);
+      if (appErr != errNone)
+        return appErr;
+    }
 
-  if (!reader.isOpened()) {
-    if (!FLAG_webcam) printf("Error: Could not open video: \"%s\"\n", inFile);
-    else              printf("Error: Webcam not found\n");
-    return errRead;
-  }
+    if (!reader.isOpened()) {
+      if (!FLAG_webcam) printf("Error: Could not open video: \"%s\"\n", inFile);
+      else              printf("Error: Webcam not found\n");
+      return errRead;
+    }
 
-  GetVideoInfo(reader, (inFile ? inFile : "webcam"), &info);
-  if (!(fourcc_h264 == info.codec || cv::VideoWriter::fourcc('a', 'v', 'c', '1') == info.codec)) // avc1 is alias for h264
-    printf("Filters only target H264 videos, not %.4s\n", (char*)&info.codec);
+    GetVideoInfo(reader, (inFile ? inFile : "webcam"), &info);
+    if (!(fourcc_h264 == info.codec || cv::VideoWriter::fourcc('a', 'v', 'c', '1') == info.codec)) // avc1 is alias for h264
+      printf("Filters only target H264 videos, not %.4s\n", (char*)&info.codec);
+
+    // OpenCV decodes to YUV and converts it to BGR, only for the frame to be converted again to the input of the
+    // effect. With --yuv_ingest, ffmpeg decodes the frames again, leaving them in NV12, and OpenCV only probes.
+    if (FLAG_yuvIngest && !FLAG_webcam) {
+      if (NVCV_SUCCESS == rawFmt.init("nv12", info.width, info.height, RawColorspace()) &&
+          NVCV_SUCCESS == rawIn.open(decoder.start(inFile, "nv12", FLAG_ffmpeg.c_str()), rawFmt, 3, true)) {
+        reader.release();
+      } else {
+        printf("Cannot decode \"%s\" to NV12 with %s; OpenCV decodes it to BGR instead\n", inFile,
+               FLAG_ffmpeg.c_str());
+        decoder.stop();
+      }
+    }
+  }
 
   BAIL_IF_ERR(vfxErr = allocBuffers(info.width, info.height));
 
   if (outFile && !outFile[0]) outFile = nullptr;
+  if (outFile && !strcmp(outFile, "-")) {
+    outFile = nullptr;
+    vfxErr = rawFmt.init((FLAG_outPixFmt.empty() ? FLAG_pixFmt : FLAG_outPixFmt).c_str(), _dstVFX.width,
+                         _dstVFX.height, RawColorspace());
+    if (NVCV_SUCCESS == vfxErr)
+      vfxErr = rawOut.open(_rawOutFd, rawFmt);
+    if (NVCV_SUCCESS != vfxErr) {
+      printf("Cannot write %ux%u raw frames to stdout; 4:2:0 needs an even size\n", _dstVFX.width, _dstVFX.height);
+      goto bail;
+    }
+  }
+  if (outFile && HasSuffix(outFile, ".nvrf")) {
+    if (!ParseNvrfPayload(FLAG_nvrfPayload.c_str(), &nvrfFormat, &nvrfType, &nvrfLayout)) {
+      printf("--nvrf_payload should be bgr24, nv12 or f16\n");
+      BAIL_IF_ERR(vfxErr = NVCV_ERR_PARAMETER);
+    }
+    if (NVCV_SUCCESS != nvrfOut.open(outFile, info.frameRate, nvrfFormat, nvrfType, nvrfLayout, RawColorspace())) {
+      printf("Cannot open \"%s\" for writing\n", outFile);
+      return errWrite;
+    }
+    outFile = nullptr;
+  }
+  if (outFile && HasSuffix(outFile, ".y4m")) {
+    if (NVCV_SUCCESS != y4mOut.open(outFile, _dstVFX.width, _dstVFX.height, info.frameRate, NVCV_YUV420,
+                                    ColorStandard() | NVCV_VIDEO_RANGE | NVCV_CHROMA_JPEG)) {
+      printf("Cannot open \"%s\" for writing %ux%u frames; 4:2:0 needs an even size\n", outFile, _dstVFX.width,
+             _dstVFX.height);
+      return errWrite;
+    }
+    outFile = nullptr;
+  }
+  if (shmOutName) {
+    outFile = nullptr;  // Another process takes the frames from here
+    if (NVCV_SUCCESS != shmOut.create(shmOutName, (unsigned)FLAG_shmSlots, PackedFrameBytes(_dstVFX.width,
+                                      _dstVFX.height, NVCV_BGR, NVCV_U8, NVCV_CHUNKY, nullptr), info.frameRate)) {
+      printf("Cannot share frames as \"%s\"\n", shmOutName);
+      if (!_show)
+        return errWrite;
+    }
+  }
+  // The output is written straight into the slots of the ring, unless it has to persist from one frame to the next
+  shmInPlace = shmOut.isOpen() && !FLAG_dirtyTiles && !FLAG_skipRepeats;
   if (outFile) {
     ok = writer.open(outFile, StringToFourcc(FLAG_codec), info.frameRate, cv::Size(_dstVFX.width, _dstVFX.height));
     if (!ok) {
@@ -645,36 +1120,128 @@ FXApp::Err FXApp::processMovie(const char *inFile, const char *outFile) {
     }
   }
 
-  BAIL_IF_ERR(vfxErr = NvVFX_SetImage(_eff, NVVFX_INPUT_IMAGE,  &_srcGpuBuf));
-  BAIL_IF_ERR(vfxErr = NvVFX_SetImage(_eff, NVVFX_OUTPUT_IMAGE, &_dstGpuBuf));
+  // The lower rungs of the ladder are downscaled from the output of the one Run, rather than each needing its own
+  if (outFile && !FLAG_renditions.empty()) {
+    if (!RenditionFanout::ParseHeights(FLAG_renditions.c_str(), &heights)) {
+      printf("--renditions should be a list of heights, such as 1440,1080\n");
+      BAIL_IF_ERR(vfxErr = NVCV_ERR_PARAMETER);
+    }
+    vfxErr = renditions.open(outFile, heights, cv::Size(_dstVFX.width, _dstVFX.height), info.frameRate,
+                             StringToFourcc(FLAG_codec), FLAG_renditionGpu);
+    if (NVCV_ERR_PARAMETER == vfxErr)
+      printf("Each of the --renditions must be smaller than the output height of %u\n", _dstVFX.height);
+    BAIL_IF_ERR(vfxErr);
+  }
+
+  BAIL_IF_ERR(vfxErr = setEffectImages());
   BAIL_IF_ERR(vfxErr = NvVFX_SetCudaStream(_eff, NVVFX_CUDA_STREAM, stream));
   if (!strcmp(_effectName, NVVFX_FX_ARTIFACT_REDUCTION)) {
     BAIL_IF_ERR(vfxErr = NvVFX_SetU32(_eff, NVVFX_MODE, (unsigned int)FLAG_mode));
   } else if (!strcmp(_effectName, NVVFX_FX_SUPER_RES)) {
     BAIL_IF_ERR(vfxErr = NvVFX_SetU32(_eff, NVVFX_MODE, (unsigned int)FLAG_mode));
   }
-  BAIL_IF_ERR(vfxErr = NvVFX_Load(_eff));
+  vfxErr = NvVFX_Load(_eff);
+  if (NVCV_ERR_MODELSUBSTITUTION == vfxErr && _tileBatch)
+    vfxErr = NVCV_SUCCESS;  // There is no model for the requested tile batch; smaller batches will be run instead
+  BAIL_IF_ERR(vfxErr);
+  if (FLAG_dirtyTiles)
+    BAIL_IF_ERR(vfxErr = initDirtyTiles(stream));
+  _repeats.setThreshold(FLAG_repeatThreshold);
+
+  // With a webcam, always process the newest frame rather than the oldest one buffered by the driver
+  if (FLAG_webcam && !scheduler.start(&reader, FLAG_latencyBudget))
+    return errRead;
 
-  for (frameNum = 0; reader.read(_srcImg); ++frameNum) {
+  rawInput  = rawIn.isOpen() || nvrfIn.isOpen() || y4mIn.isOpen();
+  startTime = std::chrono::high_resolution_clock::now();
+  for (frameNum = 0; shmIn.isOpen()  ? NVCV_SUCCESS == shmIn.acquireRead(&_srcVFX) :
+                     rawIn.isOpen()  ? NVCV_SUCCESS == rawIn.read(&rawFrame) :
+                     nvrfIn.isOpen() ? NVCV_SUCCESS == nvrfIn.frame(frameNum, &rawFrame) :
+                     y4mIn.isOpen()  ? NVCV_SUCCESS == y4mIn.read(&rawFrame) :
+                     FLAG_webcam     ? scheduler.acquire(_srcImg) : reader.read(_srcImg); ++frameNum) {
+    if (shmIn.isOpen()) {   // _srcVFX wraps the frame in its slot of the ring
+      if (!IsBgrFrame(&_srcVFX, info.width, info.height)) {
+        printf("Frame %u of \"%s\" is not %dx%d BGR\n", frameNum, shmInName, info.width, info.height);
+        BAIL_IF_ERR(vfxErr = NVCV_ERR_PIXELFORMAT);
+      }
+      CVWrapperForNvCVImage(&_srcVFX, &_srcImg);
+    }
+    rawUpload = false;
+    if (rawInput) {
+      if (rawFrame.width != (unsigned)info.width || rawFrame.height != (unsigned)info.height) {
+        printf("Frame %u is not %dx%d\n", frameNum, info.width, info.height);
+        BAIL_IF_ERR(vfxErr = NVCV_ERR_MISMATCH);
+      }
+      if (IsBgrFrame(&rawFrame, info.width, info.height)) {   // Processed in place
+        CVWrapperForNvCVImage(&rawFrame, &_srcImg);
+        NVWrapperForCVMat(&_srcImg, &_srcVFX);
+      } else if (_enableEffect && !FLAG_dirtyTiles && !FLAG_skipRepeats && !_tileBatch) {
+        rawUpload = true;                         // Converted to the input of the effect as it is uploaded
+      } else {                                    // Converted to BGR on the CPU; a float .nvrf payload is in [0, 1]
+        BAIL_IF_ERR(vfxErr = TransferViaF32(&rawFrame, &_srcVFX, (NVCV_U8 == rawFrame.componentType ? 1.f : 255.f),
+                                            stream, &_f32VFX, nullptr));
+      }
+    }
     if (_srcImg.empty()) {
       printf("Frame %u is empty\n", frameNum);
     }
+    if (FLAG_webcam)
+      NVWrapperForCVMat(&_srcImg, &_srcVFX);  // The scheduler swaps frame buffers rather than copying them
+    if (shmInPlace) {
+      BAIL_IF_ERR(vfxErr = shmOut.acquireWrite(_dstVFX.width, _dstVFX.height, NVCV_BGR, NVCV_U8, NVCV_CHUNKY, 0, &_dstVFX));
+      CVWrapperForNvCVImage(&_dstVFX, &_dstImg);
+    }
+
+    // A repeated frame is not uploaded or run at all; _dstImg still holds the output of the frame that it repeats
+    repeat = false;
+    if (_enableEffect && FLAG_skipRepeats)
+      BAIL_IF_ERR(vfxErr = _repeats.check(&_srcVFX, &repeat));
 
     // _srcVFX   --> _srcTmpVFX --> _srcGpuBuf --> _dstGpuBuf --> _dstTmpVFX --> _dstVFX
-    if (_enableEffect) {
-      BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_srcVFX, &_srcGpuBuf, 1.f / 255.f, stream, &_tmpVFX));
+    if (repeat) {
+      // Nothing to do
+    } else if (_enableEffect && FLAG_dirtyTiles) {
+      BAIL_IF_ERR(vfxErr = runDirtyTiles(stream));
+    } else if (_enableEffect && _tileBatch) {
+      BAIL_IF_ERR(vfxErr = runTiles(stream));
+    } else if (_enableEffect) {
+      if (rawUpload)
+        BAIL_IF_ERR(vfxErr = TransferViaF32(&rawFrame, &_srcGpuBuf, (NVCV_U8 == rawFrame.componentType ? 1.f / 255.f :
+                                            NVCV_U8 == _srcGpuBuf.componentType ? 255.f : 1.f), stream, &_f32VFX,
+                                            &_tmpVFX));
+      else
+        BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_srcVFX, &_srcGpuBuf, 1.f / 255.f, stream, &_tmpVFX));
       BAIL_IF_ERR(vfxErr = NvVFX_Run(_eff, 0));
       BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_dstGpuBuf, &_dstVFX, 255.f, stream, &_tmpVFX));
     } else {
       BAIL_IF_ERR(vfxErr = NvCVImage_Transfer(&_srcVFX, &_dstVFX, 1.f / 255.f, stream, &_tmpVFX));
+      _refImg.release();                        // The output is no longer that of the reference frame,
+      _repeats.reset();                         // so --dirty_tiles must run the whole of the next frame
     }
+    // With pinned buffers the transfers are truly asynchronous: finish the download before the sinks read _dstImg,
+    // and the upload before the next read overwrites _srcImg.
+    BAIL_IF_FALSE(cudaSuccess == cudaStreamSynchronize((cudaStream_t)stream), vfxErr, NVCV_ERR_CUDA);
 
     if (outFile)
       writer.write(_dstImg);
+    if (renditions.isOpen())
+      renditions.write(_dstImg);
+    if (shmOut.isOpen())
+      BAIL_IF_ERR(vfxErr = shmInPlace ? shmOut.commitWrite() : shmOut.write(&_dstVFX));
+    if (rawOut.isOpen())
+      BAIL_IF_ERR(vfxErr = rawOut.write(&_dstVFX));
+    if (nvrfOut.isOpen())
+      BAIL_IF_ERR(vfxErr = nvrfOut.write(&_dstVFX, stream));
+    if (y4mOut.isOpen())
+      BAIL_IF_ERR(vfxErr = y4mOut.write(&_dstVFX));
 
     if (_show) {
-      drawFrameRate(_dstImg);
-      cv::imshow("Output", _dstImg);
+      // Keep overlays out of the retained and shared output
+      cv::Mat shown = (FLAG_dirtyTiles || FLAG_skipRepeats || shmOut.isOpen()) ? _dstImg.clone() : _dstImg;
+      drawFrameRate(shown);
+      cv::imshow("Output", shown);
+      if (FLAG_webcam)
+        scheduler.present();
       int key= cv::waitKey(1);
       if (key > 0) {
           appErr = processKey(key);
@@ -682,11 +1249,49 @@ FXApp::Err FXApp::processMovie(const char *inFile, const char *outFile) {
             break;
       }
     }
-    if (_progress)
+    if (_progress && info.frameCount)
       fprintf(stderr, "\b\b\b\b%3.0f%%", 100.f * frameNum / info.frameCount);
+    if (shmIn.isOpen())
+      shmIn.releaseRead();  // Give the slot back to the producer
   }
 
   if (_progress) fprintf(stderr, "\n");
+  if (FLAG_verbose) {
+    double sc = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+    printf("Processed %u frames in %.3f seconds: %.1f frames per second\n", frameNum, sc, (sc > 0. ? frameNum / sc : 0.));
+  }
+  if (FLAG_dirtyTiles)
+    printDirtyTileStats();
+  if (FLAG_skipRepeats)
+    _repeats.printStats(stdout);
+  if (FLAG_verbose && FLAG_pinned)
+    _pinned.printStats(stdout);
+  if (FLAG_webcam) {
+    scheduler.stop();
+    scheduler.printStats(stdout);
+  }
+  renditions.close();
+  if (FLAG_verbose && renditions.isOpen())
+    renditions.printStats(stdout);
+  if (shmOut.isOpen()) {
+    shmOut.close();         // This waits for the consumer to read the frames in flight
+    if (FLAG_verbose)
+      shmOut.printStats(stdout);
+  }
+  if (shmIn.isOpen()) {
+    shmIn.close();
+    if (FLAG_verbose)
+      shmIn.printStats(stdout);
+  }
+  rawOut.close();           // So that the reader sees the end of the stream
+  BAIL_IF_ERR(vfxErr = nvrfOut.close());
+  BAIL_IF_ERR(vfxErr = y4mOut.close());
+  if (FLAG_verbose && rawIn.isOpen())
+    rawIn.printStats(stdout);
+  rawIn.close();
+  decoder.stop();
+  if (FLAG_verbose && y4mIn.isOpen())
+    y4mIn.printStats(stdout);
   reader.release();
   if (outFile)
     writer.release();
@@ -702,6 +1307,8 @@ int main(int argc, char **argv) {
   nErrs = ParseMyArgs(argc, argv);
   if (nErrs)
     std::cerr << nErrs << " command line syntax problems\n";
+  if (FLAG_outFile == "-")
+    app._rawOutFd = RawFrameWriter::DetachStdout();  // From here on, anything printed goes to stderr, not the frames
 
   if (FLAG_verbose) {
     const char *cstr = nullptr;
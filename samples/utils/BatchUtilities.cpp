@@ -154,3 +154,18 @@ NvCV_Status TransferBatchImage(const NvCVImage *srcBatch, NvCVImage *dstBatch,
   }
   return err;
 }
+
+static unsigned GCD(unsigned a, unsigned b) {
+  while (b) { unsigned t = a % b; a = b; b = t; }
+  return a;
+}
+
+NvCV_Status ReduceScale(unsigned srcWidth, unsigned srcHeight, unsigned dstWidth, unsigned dstHeight,
+  unsigned* num, unsigned* den) {
+  if (!srcWidth || !srcHeight || (unsigned long long)srcWidth * dstHeight != (unsigned long long)srcHeight * dstWidth)
+    return NVCV_ERR_RESOLUTION;
+  unsigned g = GCD(srcHeight, dstHeight);
+  *num = dstHeight / g;
+  *den = srcHeight / g;
+  return NVCV_SUCCESS;
+}
@@ -123,5 +123,18 @@ NvCV_Status TransferFromBatchImage(
 NvCV_Status TransferBatchImage(const NvCVImage* srcBatch, NvCVImage* dstBatch,
   unsigned imHeight, unsigned batchSize, float scale, struct CUstream_st* stream);
 
+//! Reduce the scale of an effect to lowest terms, e.g. 3/2 for 720 --> 1080.
+//! Regions of the source aligned to the denominator correspond to whole pixels of the destination.
+//! \param[in]  srcWidth  the width  of the source, in pixels.
+//! \param[in]  srcHeight the height of the source, in pixels.
+//! \param[in]  dstWidth  the width  of the destination, in pixels.
+//! \param[in]  dstHeight the height of the destination, in pixels.
+//! \param[out] num       the numerator   of dst / src.
+//! \param[out] den       the denominator of dst / src.
+//! \return NVCV_SUCCESS         if the operation was successful.
+//! \return NVCV_ERR_RESOLUTION  if the source is empty, or the width and height are scaled differently.
+NvCV_Status ReduceScale(unsigned srcWidth, unsigned srcHeight, unsigned dstWidth, unsigned dstHeight,
+  unsigned* num, unsigned* den);
+
 
 #endif // __BATCH_UTILITIES__
@@ -0,0 +1,124 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <iterator>
+#include <vector>
+
+#include "BufferPool.h"
+
+
+/********************************************************************************
+ * BufferPool
+ ********************************************************************************/
+
+BufferPool::BufferPool(MakeFunc make, DestroyFunc destroy, void *cookie, size_t maxIdleBytes, size_t granularity)
+    : _make(make), _destroy(destroy), _cookie(cookie), _maxIdleBytes(maxIdleBytes),
+      _granularity(granularity ? granularity : 1) {
+  _stats.made = _stats.reused = _stats.failed = 0;
+  _stats.busyBytes = _stats.idleBytes = _stats.peakBytes = 0;
+}
+
+BufferPool::~BufferPool() {
+  trim(0);
+}
+
+void* BufferPool::acquire(size_t bytes) {
+  Block block;
+  bool  made;
+
+  bytes = (bytes ? (bytes + _granularity - 1) / _granularity : 1) * _granularity;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::multimap<size_t, Block>::iterator it = _idle.lower_bound(bytes);
+    if (it != _idle.end() && it->first / 2 <= bytes) {   // Not so large that most of it would be wasted
+      block = it->second;
+      _idle.erase(it);
+      _busy[block.data] = block;
+      _stats.idleBytes -= block.bytes;
+      _stats.busyBytes += block.bytes;
+      ++_stats.reused;
+      return block.data;
+    }
+  }
+  made = _make(bytes, &block, _cookie);   // Outside the lock, since it can be slow
+  if (!made && stats().idleBytes) {       // Idle buffers of other sizes may be holding the memory that we need
+    trim(0);
+    made = _make(bytes, &block, _cookie);
+  }
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (!made) {
+    ++_stats.failed;
+    return nullptr;
+  }
+  _busy[block.data] = block;
+  _stats.busyBytes += block.bytes;
+  ++_stats.made;
+  if (_stats.peakBytes < _stats.busyBytes + _stats.idleBytes)
+    _stats.peakBytes = _stats.busyBytes + _stats.idleBytes;
+  return block.data;
+}
+
+bool BufferPool::release(void *data) {
+  Block block;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::unordered_map<const void*, Block>::iterator it = _busy.find(data);
+    if (it == _busy.end())
+      return false;
+    block = it->second;
+    _busy.erase(it);
+    _stats.busyBytes -= block.bytes;
+    if (_stats.idleBytes + block.bytes <= _maxIdleBytes) {
+      _idle.insert(std::make_pair(block.bytes, block));
+      _stats.idleBytes += block.bytes;
+      return true;
+    }
+  }
+  _destroy(block, _cookie);
+  return true;
+}
+
+bool BufferPool::owns(const void *data) const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _busy.end() != _busy.find(data);
+}
+
+void BufferPool::trim(size_t maxIdleBytes) {
+  std::vector<Block> doomed;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    while (_stats.idleBytes > maxIdleBytes) {   // Largest first
+      std::multimap<size_t, Block>::iterator it = std::prev(_idle.end());
+      doomed.push_back(it->second);
+      _stats.idleBytes -= it->first;
+      _idle.erase(it);
+    }
+  }
+  for (const Block& block : doomed)
+    _destroy(block, _cookie);
+}
+
+BufferPool::Stats BufferPool::stats() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _stats;
+}
@@ -0,0 +1,101 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __BUFFER_POOL_H__
+#define __BUFFER_POOL_H__
+
+#include <stddef.h>
+
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+//! A pool of buffers that are recycled by size.
+//! The pool only does the bookkeeping: buffers are made and destroyed by the functions that it is given, so that it
+//! can be exercised on hosts without a GPU. It is safe to use from several threads.
+class BufferPool {
+public:
+  //! A buffer, and the object that owns it, if any.
+  struct Block {
+    void    *data;    //!< The first byte of the buffer.
+    void    *owner;   //!< The object to be destroyed with the buffer, such as an NvCVImage.
+    size_t  bytes;    //!< The capacity of the buffer.
+  };
+
+  //! Make a buffer of at least the given size; return false if there is not enough memory.
+  typedef bool (*MakeFunc)(size_t bytes, Block *block, void *cookie);
+  //! Destroy a buffer made by the MakeFunc.
+  typedef void (*DestroyFunc)(const Block& block, void *cookie);
+
+  struct Stats {
+    unsigned long long  made;         //!< The number of buffers made.
+    unsigned long long  reused;       //!< The number of requests satisfied with an idle buffer.
+    unsigned long long  failed;       //!< The number of requests that could not be satisfied.
+    size_t              busyBytes;    //!< The capacity of the buffers that are handed out.
+    size_t              idleBytes;    //!< The capacity of the buffers that are kept for reuse.
+    size_t              peakBytes;    //!< The most that has been busy and idle at once.
+  };
+
+  //! Constructor.
+  //! \param[in]  make          the function that makes buffers.
+  //! \param[in]  destroy       the function that destroys them.
+  //! \param[in]  cookie        passed to make and destroy.
+  //! \param[in]  maxIdleBytes  the most idle capacity to keep; buffers returned beyond that are destroyed.
+  //! \param[in]  granularity   the multiple to which requests are rounded up, so that similar sizes share buffers.
+  BufferPool(MakeFunc make, DestroyFunc destroy, void *cookie, size_t maxIdleBytes, size_t granularity = 4096);
+
+  //! Destroy the idle buffers. Buffers still handed out are leaked, since something may still be using them.
+  ~BufferPool();
+
+  //! Get a buffer, reusing an idle one if one of at least the size and at most twice the size is available.
+  //! \param[in]  bytes   the size needed.
+  //! \return     the buffer, or NULL if none could be made.
+  void* acquire(size_t bytes);
+
+  //! Return a buffer to the pool.
+  //! \param[in]  data    a buffer from acquire().
+  //! \return     false if the buffer did not come from this pool, in which case nothing was done.
+  bool release(void *data);
+
+  //! Query whether a buffer was handed out by this pool, and has not yet been released.
+  bool owns(const void *data) const;
+
+  //! Destroy idle buffers until no more than the given capacity is idle.
+  void trim(size_t maxIdleBytes);
+
+  //! Get the statistics.
+  Stats stats() const;
+
+private:
+  MakeFunc                              _make;
+  DestroyFunc                           _destroy;
+  void                                  *_cookie;
+  size_t                                _maxIdleBytes;
+  size_t                                _granularity;
+  std::multimap<size_t, Block>          _idle;    // By capacity
+  std::unordered_map<const void*, Block> _busy;   // By data
+  Stats                                 _stats;
+  mutable std::mutex                    _mutex;
+};
+
+#endif // __BUFFER_POOL_H__
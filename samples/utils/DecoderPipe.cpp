@@ -0,0 +1,119 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <string.h>
+
+#include <string>
+
+#ifdef _WIN32
+  #include <io.h>
+#else // !_WIN32
+  #include <fcntl.h>
+  #include <signal.h>
+  #include <spawn.h>
+  #include <sys/types.h>
+  #include <sys/wait.h>
+  #include <unistd.h>
+#endif // _WIN32
+
+#include "DecoderPipe.h"
+
+#ifdef _WIN32
+
+DecoderPipe::DecoderPipe() : _pipe(nullptr) {}
+
+int DecoderPipe::start(const char *path, const char *pixFmt, const char *ffmpeg) {
+  std::string cmd;
+  int         fd;
+
+  stop();
+  if (strchr(path, '"') || strchr(ffmpeg, '"'))
+    return -1;
+  cmd = std::string("\"") + ffmpeg + "\" -nostdin -v error -noautorotate -i \"" + path + "\" -f rawvideo -pix_fmt "
+      + pixFmt + " -";
+  if (nullptr == (_pipe = _popen(cmd.c_str(), "rb")))
+    return -1;
+  if ((fd = _dup(_fileno(_pipe))) < 0)  // A descriptor of its own, so that the caller can close it
+    stop();
+  return fd;
+}
+
+bool DecoderPipe::isRunning() const {
+  return nullptr != _pipe;
+}
+
+void DecoderPipe::stop() {
+  if (!_pipe)
+    return;
+  _pclose(_pipe);   // ffmpeg exits once the reader closes its end of the pipe
+  _pipe = nullptr;
+}
+
+#else // !_WIN32
+
+extern char **environ;
+
+DecoderPipe::DecoderPipe() : _pid(-1) {}
+
+int DecoderPipe::start(const char *path, const char *pixFmt, const char *ffmpeg) {
+  int                         fds[2], err;
+  pid_t                       pid;
+  posix_spawn_file_actions_t  actions;
+  const char                  *argv[] = { ffmpeg, "-nostdin", "-v", "error", "-noautorotate", "-i", path,
+                                          "-f", "rawvideo", "-pix_fmt", pixFmt, "-", nullptr };
+
+  stop();
+  if (pipe(fds))
+    return -1;
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);   // So that other children do not hold the pipe open
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, fds[1], 1);
+  posix_spawn_file_actions_addclose(&actions, fds[0]);
+  posix_spawn_file_actions_addclose(&actions, fds[1]);
+  err = posix_spawnp(&pid, ffmpeg, &actions, nullptr, (char* const*)argv, environ);
+  posix_spawn_file_actions_destroy(&actions);
+  close(fds[1]);                        // The reader sees the end of the stream when ffmpeg exits
+  if (err) {
+    close(fds[0]);
+    return -1;
+  }
+  _pid = (int)pid;
+  return fds[0];
+}
+
+bool DecoderPipe::isRunning() const {
+  return _pid > 0;
+}
+
+void DecoderPipe::stop() {
+  int status;
+  if (_pid <= 0)
+    return;
+  if (0 == waitpid(_pid, &status, WNOHANG)) {   // Still decoding frames that we no longer want
+    kill(_pid, SIGTERM);
+    waitpid(_pid, &status, 0);
+  }
+  _pid = -1;
+}
+
+#endif // _WIN32
@@ -0,0 +1,59 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __DECODER_PIPE_H__
+#define __DECODER_PIPE_H__
+
+#include <stdio.h>
+
+//! Decode a video file to raw frames with an ffmpeg process, and read them through a pipe.
+//! The frames keep the decoder's YUV, rather than being converted to BGR, as cv::VideoCapture would.
+class DecoderPipe {
+public:
+  DecoderPipe();
+  ~DecoderPipe() { stop(); }
+
+  //! Start decoding.
+  //! \param[in]  path    the video file.
+  //! \param[in]  pixFmt  the ffmpeg pix_fmt of the frames, such as "nv12" or "yuv420p".
+  //! \param[in]  ffmpeg  the ffmpeg executable, which is looked up on the PATH if it has no directory.
+  //! \return     the file descriptor of the pipe, from which raw frames can be read, or -1 if ffmpeg could not be
+  //!             started. The caller closes it, after stop() if it may still be read on another thread.
+  int start(const char *path, const char *pixFmt, const char *ffmpeg = "ffmpeg");
+
+  //! Query whether a decoder has been started and not yet stopped.
+  bool isRunning() const;
+
+  //! Wait for the decoder to exit, terminating it first if it has not yet finished.
+  //! This is called by the destructor.
+  void stop();
+
+private:
+#ifdef _WIN32
+  FILE  *_pipe;
+#else // !_WIN32
+  int   _pid;
+#endif // _WIN32
+};
+
+#endif // __DECODER_PIPE_H__
@@ -0,0 +1,58 @@
+/*###############################################################################
+#
+# Copyright (c) 2020 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __EFFECT_LIMITS_H__
+#define __EFFECT_LIMITS_H__
+
+#include <string.h>
+
+#include "nvVideoEffects.h"
+
+//! Get the largest input that an effect accepts.
+//! Effects that do not report it through NVVFX_MAX_INPUT_WIDTH and NVVFX_MAX_INPUT_HEIGHT fall back to the
+//! documented input ranges.
+//! \param[in]  eff         the effect.
+//! \param[in]  effectName  the selector with which the effect was created.
+//! \param[in]  scale       the ratio of the output to input height, which determines the range for SuperRes.
+//! \param[out] width       the maximum input width.
+//! \param[out] height      the maximum input height.
+inline void GetEffectMaxInputSize(NvVFX_Handle eff, const char *effectName, float scale,
+                                  unsigned *width, unsigned *height) {
+  if (NVCV_SUCCESS == NvVFX_GetU32(eff, NVVFX_MAX_INPUT_WIDTH,  width) &&
+      NVCV_SUCCESS == NvVFX_GetU32(eff, NVVFX_MAX_INPUT_HEIGHT, height) && *width && *height)
+    return;
+  if (!strcmp(effectName, NVVFX_FX_ARTIFACT_REDUCTION)) {
+    *width = 1920; *height = 1080;
+  } else if (!strcmp(effectName, NVVFX_FX_SUPER_RES)) {
+    if      (scale > 3.f) { *width =  960; *height =  540; }
+    else if (scale > 2.f) { *width = 1280; *height =  720; }
+    else if (scale > 1.5f){ *width = 1920; *height = 1080; }
+    else                  { *width = 3840; *height = 2160; }
+  } else if (!strcmp(effectName, NVVFX_FX_SR_UPSCALE)) {
+    *width = 3840; *height = 2160;
+  } else {
+    *width = *height = ~0u;  // Unlimited
+  }
+}
+
+#endif // __EFFECT_LIMITS_H__
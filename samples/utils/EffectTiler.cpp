@@ -0,0 +1,146 @@
+/*###############################################################################
+#
+# Copyright (c) 2020 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "BatchUtilities.h"
+#include "EffectTiler.h"
+
+
+/********************************************************************************
+ * EffectTiler::layoutAxis
+ ********************************************************************************/
+
+void EffectTiler::layoutAxis(unsigned len, unsigned maxTile, unsigned overlap, unsigned align, unsigned *tile,
+                             std::vector<int> *pos) {
+  pos->clear();
+  if (len <= maxTile) {
+    *tile = len;
+    pos->push_back(0);
+    return;
+  }
+  unsigned t    = maxTile / align * align;
+  unsigned step = (t - overlap) / align * align;      // The longest aligned stride that keeps the overlap
+  unsigned n    = (len - t + step - 1) / step + 1;    // ceil((len - t) / step) + 1
+  *tile = t;
+  for (unsigned i = 0; i < n; ++i) {    // Spread the tiles evenly, aligned so that the scaled origin is integral
+    // Rounding the origins up keeps every stride within step: each is at most the even stride rounded up to align,
+    // and the last, up to the unaligned final origin, is at most the even stride.
+    unsigned long long x = ((unsigned long long)(len - t) * i + (unsigned long long)(n - 1) * align - 1) /
+                           ((unsigned long long)(n - 1) * align) * align;
+    pos->push_back((int)((i == n - 1 || x > len - t) ? len - t : x));
+  }
+}
+
+
+/********************************************************************************
+ * EffectTiler::init
+ ********************************************************************************/
+
+NvCV_Status EffectTiler::init(unsigned srcWidth, unsigned srcHeight, unsigned dstWidth, unsigned dstHeight,
+                              unsigned maxTileWidth, unsigned maxTileHeight, unsigned overlap) {
+  _srcX.clear();
+  _srcY.clear();
+  if (NVCV_SUCCESS != ReduceScale(srcWidth, srcHeight, dstWidth, dstHeight, &_scaleNum, &_scaleDen))
+    return NVCV_ERR_RESOLUTION;   // Source tiles are aligned to _scaleDen, so that destination tiles are whole pixels
+  if ((srcWidth > maxTileWidth  && maxTileWidth  / _scaleDen * _scaleDen < overlap + _scaleDen) ||
+      (srcHeight > maxTileHeight && maxTileHeight / _scaleDen * _scaleDen < overlap + _scaleDen))
+    return NVCV_ERR_RESOLUTION;   // The tiles could not advance by a whole aligned step
+  layoutAxis(srcWidth,  maxTileWidth,  overlap, _scaleDen, &_tileWidth,  &_srcX);
+  layoutAxis(srcHeight, maxTileHeight, overlap, _scaleDen, &_tileHeight, &_srcY);
+  _dstTileWidth  = _tileWidth  / _scaleDen * _scaleNum;
+  _dstTileHeight = _tileHeight / _scaleDen * _scaleNum;
+  return NVCV_SUCCESS;
+}
+
+
+/********************************************************************************
+ * EffectTiler::srcRect, dstRect
+ ********************************************************************************/
+
+NvCVRect2i EffectTiler::srcRect(unsigned i) const {
+  NvCVRect2i r;
+  r.x      = _srcX[i % _srcX.size()];
+  r.y      = _srcY[i / _srcX.size()];
+  r.width  = (int)_tileWidth;
+  r.height = (int)_tileHeight;
+  return r;
+}
+
+NvCVRect2i EffectTiler::dstRect(unsigned i) const {
+  NvCVRect2i r;
+  r.x      = _srcX[i % _srcX.size()] / (int)_scaleDen * (int)_scaleNum;
+  r.y      = _srcY[i / _srcX.size()] / (int)_scaleDen * (int)_scaleNum;
+  r.width  = (int)_dstTileWidth;
+  r.height = (int)_dstTileHeight;
+  return r;
+}
+
+
+/********************************************************************************
+ * EffectTiler::blend
+ ********************************************************************************/
+
+void EffectTiler::rampIn(unsigned n, unsigned overlap, std::vector<float> *ramp) {
+  ramp->assign(n, 1.f);
+  for (unsigned x = 0; x < overlap && x < n; ++x)
+    (*ramp)[x] = (x + 0.5f) / overlap;
+}
+
+NvCV_Status EffectTiler::blend(unsigned i, const NvCVImage *tile, NvCVImage *dst) const {
+  if (NVCV_U8 != tile->componentType || NVCV_CHUNKY != tile->planar || NVCV_U8 != dst->componentType ||
+      NVCV_CHUNKY != dst->planar || tile->pixelBytes != dst->pixelBytes)
+    return NVCV_ERR_PIXELFORMAT;
+
+  unsigned   col = i % _srcX.size(), row = i / (unsigned)_srcX.size();
+  NvCVRect2i r   = dstRect(i);
+  int        ovlX = 0, ovlY = 0;   // The overlap with the tiles to the left and above, which were blended earlier
+  if (col) ovlX = dstRect(i - 1).x + r.width - r.x;
+  if (row) ovlY = dstRect(i - (unsigned)_srcX.size()).y + r.height - r.y;
+  ovlX = (ovlX < 0) ? 0 : (ovlX > r.width)  ? r.width  : ovlX;   // Abutting tiles have none
+  ovlY = (ovlY < 0) ? 0 : (ovlY > r.height) ? r.height : ovlY;
+  std::vector<float> ax, ay;
+  rampIn(_dstTileWidth,  (unsigned)ovlX, &ax);
+  rampIn(_dstTileHeight, (unsigned)ovlY, &ay);
+
+  const unsigned nc = tile->pixelBytes;
+  for (unsigned y = 0; y < _dstTileHeight && r.y + y < dst->height; ++y) {
+    const unsigned char *s = (const unsigned char*)tile->pixels + (ptrdiff_t)y * tile->pitch;
+    unsigned char       *d = (unsigned char*)dst->pixels + (ptrdiff_t)(r.y + y) * dst->pitch + (ptrdiff_t)r.x * nc;
+    unsigned             w = (r.x + _dstTileWidth <= dst->width) ? _dstTileWidth : dst->width - r.x;
+    if (ay[y] >= 1.f && !ovlX) {
+      memcpy(d, s, (size_t)w * nc);
+      continue;
+    }
+    for (unsigned x = 0; x < w; ++x, s += nc, d += nc) {
+      float a = ax[x] * ay[y];
+      if (a >= 1.f) {
+        for (unsigned c = 0; c < nc; ++c) d[c] = s[c];
+      } else {
+        for (unsigned c = 0; c < nc; ++c) d[c] = (unsigned char)(d[c] + (s[c] - d[c]) * a + 0.5f);
+      }
+    }
+  }
+  return NVCV_SUCCESS;
+}
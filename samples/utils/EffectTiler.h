@@ -0,0 +1,87 @@
+/*###############################################################################
+#
+# Copyright (c) 2020 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __EFFECT_TILER__
+#define __EFFECT_TILER__
+
+#include <vector>
+
+#include "nvCVImage.h"
+
+
+//! Splits an image that is too large for an effect into a grid of overlapping tiles, and blends the processed tiles
+//! back together with feathered seams. The effect may scale the image, as long as the scale is the same in both
+//! dimensions; tiles are placed so that their destinations land on whole pixels.
+class EffectTiler {
+public:
+  EffectTiler() : _tileWidth(0), _tileHeight(0), _dstTileWidth(0), _dstTileHeight(0) {}
+
+  //! Lay out the tiles.
+  //! \param[in]  srcWidth      the width  of the source image.
+  //! \param[in]  srcHeight     the height of the source image.
+  //! \param[in]  dstWidth      the width  of the destination image.
+  //! \param[in]  dstHeight     the height of the destination image.
+  //! \param[in]  maxTileWidth  the maximum width  of the input that the effect accepts.
+  //! \param[in]  maxTileHeight the maximum height of the input that the effect accepts.
+  //! \param[in]  overlap       the desired overlap between adjacent source tiles, in pixels.
+  //! \return NVCV_SUCCESS        if the tiles were laid out successfully.
+  //! \return NVCV_ERR_RESOLUTION if the scale differs between width and height, or the maximum tile is too small to
+  //!                             accommodate the overlap. Adjacent tiles overlap by at least the overlap.
+  NvCV_Status init(unsigned srcWidth, unsigned srcHeight, unsigned dstWidth, unsigned dstHeight,
+                   unsigned maxTileWidth, unsigned maxTileHeight, unsigned overlap);
+
+  //! The number of tiles. 1 means that the image fits in one tile, and no tiling is necessary.
+  unsigned numTiles() const { return (unsigned)(_srcX.size() * _srcY.size()); }
+
+  unsigned tileWidth()     const { return _tileWidth;     } //!< The width  of each source tile.
+  unsigned tileHeight()    const { return _tileHeight;    } //!< The height of each source tile.
+  unsigned dstTileWidth()  const { return _dstTileWidth;  } //!< The width  of each destination tile.
+  unsigned dstTileHeight() const { return _dstTileHeight; } //!< The height of each destination tile.
+
+  //! Get the source rectangle of the i-th tile, in raster order.
+  NvCVRect2i srcRect(unsigned i) const;
+
+  //! Get the destination rectangle of the i-th tile, in raster order.
+  NvCVRect2i dstRect(unsigned i) const;
+
+  //! Blend a processed tile into the destination image. The tiles must be blended in raster order: each tile is
+  //! composited over those above and to the left of it, ramping in across the overlap.
+  //! \param[in]      i     the index of the tile.
+  //! \param[in]      tile  the processed tile, a CPU-accessible chunky 8-bit image of dstTileWidth x dstTileHeight.
+  //! \param[in,out]  dst   the destination image, of the same format as the tile.
+  //! \return NVCV_SUCCESS          if the operation was successful.
+  //! \return NVCV_ERR_PIXELFORMAT  if the images are not chunky 8-bit images of the same format.
+  NvCV_Status blend(unsigned i, const NvCVImage *tile, NvCVImage *dst) const;
+
+private:
+  static void layoutAxis(unsigned len, unsigned maxTile, unsigned overlap, unsigned align, unsigned *tile,
+                         std::vector<int> *pos);
+  static void rampIn(unsigned n, unsigned overlap, std::vector<float> *ramp);
+
+  unsigned          _tileWidth, _tileHeight, _dstTileWidth, _dstTileHeight;
+  unsigned          _scaleNum, _scaleDen;     // dst / src
+  std::vector<int>  _srcX, _srcY;             // The tile origins along each axis
+};
+
+
+#endif // __EFFECT_TILER__
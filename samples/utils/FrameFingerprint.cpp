@@ -0,0 +1,185 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "FrameFingerprint.h"
+#include "TileDiff.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define FRAME_FINGERPRINT_SSE2 1
+  #include <emmintrin.h>
+#endif // __SSE2__
+
+
+static const unsigned long long kPrime1 = 0x9E3779B185EBCA87ULL,
+                                kPrime2 = 0xC2B2AE3D27D4EB4FULL,
+                                kPrime3 = 0x165667B19E3779F9ULL;
+static const unsigned           kKeyInit[4] = { 0x85EBCA77u, 0xC2B2AE3Du, 0x27D4EB2Fu, 0x165667B1u },
+                                kKeyStep[4] = { 0x9E3779B1u, 0x85EBCA6Bu, 0xC2B2AE35u, 0x27D4EB2Du };
+
+
+/********************************************************************************
+ * FingerprintAccumulator
+ ********************************************************************************/
+
+// Each 16 bytes are XORed with a key that changes with their position, and the product of the low and high 32 bits of
+// each 64-bit half is accumulated, along with the other half, as in the XXH3 accumulation loop. The multiplies make
+// the hash nonlinear, and the changing key makes it depend on the order of the data.
+class FingerprintAccumulator {
+public:
+  FingerprintAccumulator() {
+#ifdef FRAME_FINGERPRINT_SSE2
+    _acc  = _mm_setzero_si128();
+    _key  = _mm_loadu_si128((const __m128i*)kKeyInit);
+    _step = _mm_loadu_si128((const __m128i*)kKeyStep);
+#else // !FRAME_FINGERPRINT_SSE2
+    _acc[0] = _acc[1] = 0;
+    memcpy(_key, kKeyInit, sizeof(_key));
+#endif // FRAME_FINGERPRINT_SSE2
+  }
+
+  void add(const unsigned char *p, size_t n) {
+    for (; n >= 16; n -= 16, p += 16)
+      add16(p);
+    if (n) {
+      unsigned char last[16] = { 0 };
+      memcpy(last, p, n);
+      add16(last);
+    }
+  }
+
+  unsigned long long result(unsigned long long seed) const {
+    unsigned long long a[2];
+#ifdef FRAME_FINGERPRINT_SSE2
+    _mm_storeu_si128((__m128i*)a, _acc);
+#else // !FRAME_FINGERPRINT_SSE2
+    a[0] = _acc[0];
+    a[1] = _acc[1];
+#endif // FRAME_FINGERPRINT_SSE2
+    unsigned long long h = a[0] * kPrime1 + ((a[1] << 27) | (a[1] >> 37)) * kPrime2 + seed * kPrime3;
+    h ^= h >> 33;   // The XXH64 avalanche
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+  }
+
+private:
+#ifdef FRAME_FINGERPRINT_SSE2
+  void add16(const unsigned char *p) {
+    __m128i data    = _mm_loadu_si128((const __m128i*)p);
+    __m128i dataKey = _mm_xor_si128(data, _key);
+    __m128i product = _mm_mul_epu32(dataKey, _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(2, 3, 0, 1)));
+    _acc = _mm_add_epi64(_acc, _mm_add_epi64(product, _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2))));
+    _key = _mm_add_epi32(_key, _step);
+  }
+  __m128i _acc, _key, _step;
+#else // !FRAME_FINGERPRINT_SSE2
+  void add16(const unsigned char *p) {
+    unsigned long long data[2];
+    memcpy(data, p, sizeof(data));  // Little-endian, as with SSE2
+    for (unsigned i = 0; i < 2; ++i) {
+      unsigned long long dataKey = data[i] ^ (_key[2 * i] | ((unsigned long long)_key[2 * i + 1] << 32));
+      _acc[i] += (dataKey & 0xFFFFFFFFu) * (dataKey >> 32) + data[i ^ 1];
+    }
+    for (unsigned i = 0; i < 4; ++i)
+      _key[i] += kKeyStep[i];
+  }
+  unsigned long long  _acc[2];
+  unsigned            _key[4];
+#endif // FRAME_FINGERPRINT_SSE2
+};
+
+
+/********************************************************************************
+ * ComputeFrameFingerprint
+ ********************************************************************************/
+
+NvCV_Status ComputeFrameFingerprint(const NvCVImage *img, unsigned long long *hash) {
+  if (NVCV_CHUNKY != img->planar)
+    return NVCV_ERR_PIXELFORMAT;
+  if (NVCV_GPU == img->gpuMem || NVCV_CUDA == img->gpuMem)
+    return NVCV_ERR_MEMORY;
+
+  FingerprintAccumulator acc;
+  const size_t rowBytes = (size_t)img->width * img->pixelBytes;
+  for (unsigned y = 0; y < img->height; ++y)
+    acc.add((const unsigned char*)img->pixels + (ptrdiff_t)y * img->pitch, rowBytes);
+  *hash = acc.result(((unsigned long long)img->width << 32) ^ ((unsigned long long)img->height << 8) ^
+                     (unsigned long long)img->pixelFormat);
+  return NVCV_SUCCESS;
+}
+
+
+/********************************************************************************
+ * RepeatFrameDetector
+ ********************************************************************************/
+
+NvCV_Status RepeatFrameDetector::check(const NvCVImage *frame, bool *repeat) {
+  unsigned long long hash;
+  bool dirty = true;
+  NvCV_Status err = ComputeFrameFingerprint(frame, &hash);
+  if (NVCV_SUCCESS != err)
+    return err;
+
+  ++_stats.frames;
+  *repeat = false;
+  if (_haveRef && hash == _hash) {
+    ++_stats.exact;
+    *repeat = true;
+    return NVCV_SUCCESS;
+  }
+  if (_threshold <= 0.f) {  // Only exact repeats are of interest, so there is no need to keep a copy of the frame
+    _hash    = hash;
+    _haveRef = true;
+    return NVCV_SUCCESS;
+  }
+  if (_haveRef && NVCV_SUCCESS == (err = FindDirtyTile(frame, &_ref, _tileSize, _threshold, &dirty)) && !dirty) {
+    ++_stats.near;          // The reference is kept, so that a series of small changes is eventually noticed
+    *repeat = true;
+    return NVCV_SUCCESS;
+  }
+  if (NVCV_SUCCESS != err && NVCV_ERR_MISMATCH != err)   // A change of size is simply not a repeat
+    return err;
+
+  err = NvCVImage_Realloc(&_ref, frame->width, frame->height, frame->pixelFormat, frame->componentType,
+                          frame->planar, NVCV_CPU, 1);
+  if (NVCV_SUCCESS != err)
+    return err;
+  const size_t rowBytes = (size_t)frame->width * frame->pixelBytes;
+  for (unsigned y = 0; y < frame->height; ++y)
+    memcpy((unsigned char*)_ref.pixels + (ptrdiff_t)y * _ref.pitch,
+           (const unsigned char*)frame->pixels + (ptrdiff_t)y * frame->pitch, rowBytes);
+  _hash    = hash;
+  _haveRef = true;
+  return NVCV_SUCCESS;
+}
+
+void RepeatFrameDetector::printStats(FILE *fp, unsigned long long fed) const {
+  unsigned long long repeats = _stats.exact + _stats.near, skipped = repeats - fed;
+  fprintf(fp, "Repeated frames: %llu of %llu (%llu identical, %llu near-identical); %llu Runs skipped (%.1f%%)\n",
+    repeats, _stats.frames, _stats.exact, _stats.near, skipped, _stats.frames ? 100. * skipped / _stats.frames : 0.);
+}
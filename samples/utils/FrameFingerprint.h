@@ -0,0 +1,91 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __FRAME_FINGERPRINT_H__
+#define __FRAME_FINGERPRINT_H__
+
+#include <stdio.h>
+
+#include "nvCVImage.h"
+
+
+//! Compute a 64-bit fingerprint of the pixels of an image, for detecting bit-identical frames.
+//! Only the visible pixels are hashed, not the padding at the end of each row, and the dimensions are mixed in.
+//! \param[in]  img   the image, chunky and accessible by the CPU.
+//! \param[out] hash  the fingerprint.
+//! \return NVCV_SUCCESS          if the operation was successful.
+//! \return NVCV_ERR_PIXELFORMAT  if the image is not chunky.
+//! \return NVCV_ERR_MEMORY       if the image is not accessible by the CPU.
+//! \note   The SSE2 PMULUDQ instruction is used where available, with a scalar fallback that computes the same hash.
+NvCV_Status ComputeFrameFingerprint(const NvCVImage *img, unsigned long long *hash);
+
+
+//! Detects the frames of a video that repeat the last frame processed, such as those of captured slides or of a
+//! paused video, so that the effect need not be run on them again.
+//! A frame whose fingerprint matches that of the reference frame is an exact repeat. Otherwise, if a threshold is set,
+//! the frame is compared to the reference in small tiles, and it is a near repeat if no tile has changed by more than
+//! the threshold. A frame that is not a repeat becomes the new reference, so slow drift is never accumulated.
+class RepeatFrameDetector {
+public:
+  struct Stats {
+    unsigned long long  frames;     //!< The number of frames checked.
+    unsigned long long  exact;      //!< The number of bit-identical repeats.
+    unsigned long long  near;       //!< The number of near-identical repeats.
+  };
+
+  RepeatFrameDetector() : _threshold(0.f), _tileSize(16), _hash(0), _haveRef(false) { _stats = Stats(); }
+
+  //! Set the mean absolute difference per component, in 8-bit code values, that a tile must exceed for the frame not
+  //! to be a near repeat. 0, the default, only detects exact repeats.
+  //! \param[in]  threshold the threshold.
+  //! \param[in]  tileSize  the tile size, in pixels.
+  void setThreshold(float threshold, unsigned tileSize = 16) { _threshold = threshold; _tileSize = tileSize; }
+
+  //! Forget the reference frame, e.g. when the output no longer corresponds to it.
+  void reset() { _haveRef = false; }
+
+  //! Determine whether a frame repeats the reference frame; if it does not, it becomes the reference.
+  //! \param[in]  frame   the frame, chunky 8-bit and accessible by the CPU.
+  //! \param[out] repeat  set to true if the frame is a repeat.
+  //! \return NVCV_SUCCESS, or an error from ComputeFrameFingerprint(), FindDirtyTile() or NvCVImage_Realloc().
+  NvCV_Status check(const NvCVImage *frame, bool *repeat);
+
+  //! Get the statistics accumulated so far.
+  const Stats& stats() const { return _stats; }
+
+  //! Print the statistics accumulated so far, including the fraction of Runs skipped.
+  //! \param[in]  fp    the file to print to.
+  //! \param[in]  fed   the number of repeats that were run anyway, to advance the state of a temporal effect.
+  void printStats(FILE *fp, unsigned long long fed = 0) const;
+
+private:
+  float               _threshold;
+  unsigned            _tileSize;
+  unsigned long long  _hash;      // The fingerprint of the reference
+  bool                _haveRef;
+  NvCVImage           _ref;       // A copy of the last frame that was not a repeat, for the tile comparison
+  Stats               _stats;
+};
+
+
+#endif // __FRAME_FINGERPRINT_H__
@@ -0,0 +1,112 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include "FrameLayout.h"
+
+static const size_t kRowAlignment = 64;
+
+
+static unsigned ComponentBytes(NvCVImage_ComponentType type) {
+  switch (type) {
+  case NVCV_U8:                                 return 1;
+  case NVCV_U16: case NVCV_S16: case NVCV_F16:  return 2;
+  case NVCV_U32: case NVCV_S32: case NVCV_F32:  return 4;
+  case NVCV_U64: case NVCV_S64: case NVCV_F64:  return 8;
+  default:                                      return 0;
+  }
+}
+
+static unsigned NumComponents(NvCVImage_PixelFormat format) {
+  switch (format) {
+  case NVCV_Y:    case NVCV_A:    return 1;
+  case NVCV_YA:                   return 2;
+  case NVCV_RGB:  case NVCV_BGR:  return 3;
+  case NVCV_RGBA: case NVCV_BGRA: return 4;
+#if !RTX_CAMERA_IMAGE
+  case NVCV_ARGB: case NVCV_ABGR: return 4;
+#endif // !RTX_CAMERA_IMAGE
+  case NVCV_YUV420: case NVCV_YUV422: case NVCV_YUV444: return 3;
+  default:                        return 0;
+  }
+}
+
+
+size_t PackedFrameBytes(unsigned width, unsigned height, NvCVImage_PixelFormat format, NvCVImage_ComponentType type,
+                        unsigned layout, int *pitch) {
+  unsigned  compBytes = ComponentBytes(type),
+            numComps  = NumComponents(format);
+  size_t    rowBytes, rows = height;
+  bool      yuv = (NVCV_YUV420 == format || NVCV_YUV422 == format || NVCV_YUV444 == format);
+
+  if (!compBytes || !numComps || !width || !height)
+    return 0;
+  if (!yuv) {
+    if (NVCV_CHUNKY == layout)      { rowBytes = (size_t)width * numComps * compBytes;              }
+    else if (NVCV_PLANAR == layout) { rowBytes = (size_t)width * compBytes;     rows *= numComps;  }
+    else                            return 0;
+  } else switch (layout) {
+    case NVCV_UYVY: case NVCV_VYUY: case NVCV_YUYV: case NVCV_YVYU:   // Chunky 4:2:2
+      if (NVCV_YUV422 != format) return 0;
+      rowBytes = (size_t)((width + 1) & ~1u) * 2 * compBytes;
+      break;
+    case NVCV_CYUV: case NVCV_CYVU:                                   // Chunky 4:4:4
+      if (NVCV_YUV444 != format) return 0;
+      rowBytes = (size_t)width * 3 * compBytes;
+      break;
+    case NVCV_YUV: case NVCV_YVU: case NVCV_YCUV: case NVCV_YCVU:     // Planar and semi-planar
+      // The chroma of planar 4:2:x has half the pitch of the luma, so either way it takes the same number of rows
+      rowBytes = (size_t)((width + 1) & ~1u) * compBytes;
+      rows += (NVCV_YUV420 == format) ? (height + 1) / 2 : (NVCV_YUV422 == format) ? height : 2 * (size_t)height;
+      break;
+    default:
+      return 0;
+  }
+  rowBytes = (rowBytes + kRowAlignment - 1) / kRowAlignment * kRowAlignment;
+  if (pitch)
+    *pitch = (int)rowBytes;
+  return rowBytes * rows;
+}
+
+
+NvCV_Status TransferViaF32(const NvCVImage *src, NvCVImage *dst, float scale, struct CUstream_st *stream,
+                           NvCVImage *f32, NvCVImage *tmp) {
+  const NvCVImage *half;
+  NvCV_Status     err;
+
+  if ((NVCV_F16 == src->componentType) == (NVCV_F16 == dst->componentType) ||
+      NVCV_F32 == src->componentType || NVCV_F32 == dst->componentType)
+    return NvCVImage_Transfer(src, dst, scale, stream, tmp);
+  half = (NVCV_F16 == src->componentType) ? src : dst;
+  err = NvCVImage_Realloc(f32, half->width, half->height, half->pixelFormat, NVCV_F32, half->planar, half->gpuMem, 0);
+  if (NVCV_SUCCESS != err)
+    return err;
+  f32->colorspace = half->colorspace;
+  if (half == src) {
+    if (NVCV_SUCCESS != (err = NvCVImage_Transfer(src, f32, 1.f, stream, tmp)))
+      return err;
+    return NvCVImage_Transfer(f32, dst, scale, stream, tmp);
+  }
+  if (NVCV_SUCCESS != (err = NvCVImage_Transfer(src, f32, scale, stream, tmp)))
+    return err;
+  return NvCVImage_Transfer(f32, dst, 1.f, stream, tmp);
+}
@@ -0,0 +1,57 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __FRAME_LAYOUT_H__
+#define __FRAME_LAYOUT_H__
+
+#include <stddef.h>
+
+#include "nvCVImage.h"
+
+//! Compute the pitch and size of a frame, packed in memory of its own, with 64-byte aligned rows.
+//! The planes follow one another, with the chroma of planar 4:2:0 and 4:2:2 at half the pitch of the luma, as
+//! NvCVImage_Init() lays them out, so a frame stored this way can be wrapped with NvCVImage_Init() and this pitch.
+//! \param[in]  width   the width of the frame.
+//! \param[in]  height  the height of the frame.
+//! \param[in]  format  the pixel format.
+//! \param[in]  type    the component type.
+//! \param[in]  layout  the layout, e.g. NVCV_CHUNKY, NVCV_PLANAR or NVCV_NV12.
+//! \param[out] pitch   the byte stride between rows; that of the luma, for YUV. This may be NULL.
+//! \return     the number of bytes needed, or 0 if the format is not accommodated.
+size_t PackedFrameBytes(unsigned width, unsigned height, NvCVImage_PixelFormat format, NvCVImage_ComponentType type,
+                        unsigned layout, int *pitch);
+
+//! Transfer a frame as NvCVImage_Transfer() does, also to or from F16 with a type other than F32.
+//! NvCVImage_Transfer() only converts F16 to and from F32, so such a frame is staged through an F32 image with the
+//! format, layout and memory of the F16 side.
+//! \param[in]      src     the source image.
+//! \param[out]     dst     the destination image.
+//! \param[in]      scale   the scale applied between an integer and a floating-point type, as for NvCVImage_Transfer().
+//! \param[in]      stream  the CUDA stream.
+//! \param[in,out]  f32     the staging image, reallocated as necessary.
+//! \param[in,out]  tmp     the temporary image for NvCVImage_Transfer(). This may be NULL.
+//! \return         NVCV_SUCCESS, or an error from NvCVImage_Realloc() or NvCVImage_Transfer().
+NvCV_Status TransferViaF32(const NvCVImage *src, NvCVImage *dst, float scale, struct CUstream_st *stream,
+                           NvCVImage *f32, NvCVImage *tmp);
+
+#endif // __FRAME_LAYOUT_H__
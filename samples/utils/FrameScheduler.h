@@ -0,0 +1,216 @@
+/*###############################################################################
+#
+# Copyright (c) 2020 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __FRAMESCHEDULER_H__
+#define __FRAMESCHEDULER_H__
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "opencv2/opencv.hpp"
+
+//! Real-time frame scheduler for live capture.
+//! A capture thread drains the camera continuously, so that the driver never queues up stale frames,
+//! and keeps only the newest one. The processing loop always picks up the newest frame; any frame that is
+//! overwritten before it is picked up is counted as dropped. A frame whose age plus the predicted processing time
+//! would exceed the latency budget is also dropped, in favor of the next capture.
+//! Glass-to-glass latency is measured from the capture of a frame to the call to present().
+class RealtimeFrameScheduler {
+public:
+  typedef std::chrono::high_resolution_clock Clock;
+
+  struct Stats {
+    unsigned long long  captured;         //!< The number of frames read from the camera.
+    unsigned long long  processed;        //!< The number of frames handed out by acquire().
+    unsigned long long  superseded;       //!< The number of frames overwritten by a newer frame before acquire().
+    unsigned long long  late;             //!< The number of frames dropped because they would exceed the budget.
+    unsigned long long  overBudget;       //!< The number of presented frames whose latency exceeded the budget.
+    float               meanLatencyMs;    //!< Mean glass-to-glass latency.
+    float               p50LatencyMs;     //!< Median glass-to-glass latency.
+    float               p95LatencyMs;     //!< 95th percentile glass-to-glass latency.
+    float               maxLatencyMs;     //!< Maximum glass-to-glass latency.
+  };
+
+  RealtimeFrameScheduler() : _cap(nullptr), _budgetMs(0.f), _running(false), _fresh(false), _eof(false),
+                             _predictedMs(0.f), _latencyCount(0), _latencySum(0.) { resetCounts(); }
+  ~RealtimeFrameScheduler() { stop(); }
+
+  //! Start draining the capture device on a background thread.
+  //! \param[in]  cap             the opened capture device. It must outlive the scheduler, or stop() must be called.
+  //! \param[in]  latencyBudgetMs the glass-to-glass latency budget, in milliseconds; 0 disables late frame dropping.
+  //! \return     true if the capture thread was started.
+  bool start(cv::VideoCapture *cap, float latencyBudgetMs) {
+    stop();
+    if (!cap || !cap->isOpened())
+      return false;
+    cap->set(cv::CAP_PROP_BUFFERSIZE, 1);   // Not all backends honor this, which is why we drain on a thread
+    _cap      = cap;
+    _budgetMs = latencyBudgetMs;
+    _running  = true;
+    _fresh    = false;
+    _eof      = false;
+    _thread   = std::thread(&RealtimeFrameScheduler::captureLoop, this);
+    return true;
+  }
+
+  //! Stop the capture thread. This is called automatically by the destructor.
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _running = false;
+    }
+    _cond.notify_all();
+    if (_thread.joinable())
+      _thread.join();
+    _cap = nullptr;
+  }
+
+  //! Get the newest captured frame, waiting for one if necessary.
+  //! The frame buffers are swapped rather than copied, so any NvCVImage wrapper of the frame must be refreshed.
+  //! \param[out] frame the newest frame.
+  //! \return     false if the capture device has stopped delivering frames.
+  bool acquire(cv::Mat &frame) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+      _cond.wait(lock, [this] { return _fresh || _eof || !_running; });
+      if (!_fresh)
+        return false;
+      _fresh = false;
+      float ageMs = msSince(_latestTime);
+      if (_budgetMs > 0.f && _predictedMs < _budgetMs && ageMs + _predictedMs > _budgetMs) {
+        ++_stats.late;  // The next capture will make it in time, whereas this one will not
+        continue;
+      }
+      cv::swap(frame, _latest);
+      _acquiredTime = _latestTime;
+      _acquireStart = Clock::now();
+      ++_stats.processed;
+      return true;
+    }
+  }
+
+  //! Note that the most recently acquired frame has been displayed or written, to record its latency.
+  void present() {
+    Clock::time_point now = Clock::now();
+    float latencyMs = msBetween(_acquiredTime, now);
+    float workMs    = msBetween(_acquireStart, now);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _predictedMs = _predictedMs ? _predictedMs + (workMs - _predictedMs) * (1.f / 8.f) : workMs;  // 1 pole IIR filter
+    if (_budgetMs > 0.f && latencyMs > _budgetMs)
+      ++_stats.overBudget;
+    _latencySum += latencyMs;
+    if (latencyMs > _stats.maxLatencyMs)
+      _stats.maxLatencyMs = latencyMs;
+    if (_latencies.size() < kMaxSamples) _latencies.push_back(latencyMs);           // Keep a window of the most recent
+    else                                 _latencies[_latencyCount % kMaxSamples] = latencyMs;
+    ++_latencyCount;
+  }
+
+  //! Get the statistics accumulated so far.
+  Stats stats() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Stats s = _stats;
+    if (_latencyCount) {
+      std::vector<float> sorted(_latencies);
+      std::sort(sorted.begin(), sorted.end());
+      s.meanLatencyMs = (float)(_latencySum / _latencyCount);
+      s.p50LatencyMs  = sorted[sorted.size() * 50 / 100];
+      s.p95LatencyMs  = sorted[sorted.size() * 95 / 100];
+    }
+    return s;
+  }
+
+  //! Print the statistics accumulated so far.
+  void printStats(FILE *fp) {
+    Stats s = stats();
+    unsigned long long dropped = s.superseded + s.late;
+    fprintf(fp,
+      "Frames captured %llu, processed %llu, dropped %llu (%.1f%%: %llu superseded, %llu late)\n"
+      "Glass-to-glass latency: mean %.1f ms, p50 %.1f ms, p95 %.1f ms, max %.1f ms",
+      s.captured, s.processed, dropped, (s.captured ? 100. * dropped / s.captured : 0.), s.superseded, s.late,
+      s.meanLatencyMs, s.p50LatencyMs, s.p95LatencyMs, s.maxLatencyMs);
+    if (_budgetMs > 0.f)
+      fprintf(fp, ", %llu frames over the %.0f ms budget", s.overBudget, _budgetMs);
+    fprintf(fp, "\n");
+  }
+
+private:
+  static const size_t kMaxSamples = 4096;
+
+  static float msBetween(Clock::time_point t0, Clock::time_point t1) {
+    return std::chrono::duration<float, std::milli>(t1 - t0).count();
+  }
+  static float msSince(Clock::time_point t0) { return msBetween(t0, Clock::now()); }
+
+  void resetCounts() {
+    _stats.captured = _stats.processed = _stats.superseded = _stats.late = _stats.overBudget = 0;
+    _stats.meanLatencyMs = _stats.p50LatencyMs = _stats.p95LatencyMs = _stats.maxLatencyMs = 0.f;
+  }
+
+  void captureLoop() {
+    cv::Mat back;
+    for (;;) {
+      bool ok = _cap->read(back);
+      Clock::time_point now = Clock::now();   // The best available approximation of the time of capture
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (!_running)
+        break;
+      if (!ok || back.empty()) {
+        _eof = true;
+        break;
+      }
+      ++_stats.captured;
+      if (_fresh)
+        ++_stats.superseded;
+      cv::swap(back, _latest);
+      _latestTime = now;
+      _fresh = true;
+      _cond.notify_one();
+    }
+    _cond.notify_all();
+  }
+
+  cv::VideoCapture        *_cap;
+  float                   _budgetMs;
+  bool                    _running;
+  bool                    _fresh;       // _latest has not yet been acquired
+  bool                    _eof;
+  cv::Mat                 _latest;
+  Clock::time_point       _latestTime, _acquiredTime, _acquireStart;
+  float                   _predictedMs; // Smoothed time from acquire() to present()
+  Stats                   _stats;
+  std::vector<float>      _latencies;
+  unsigned long long      _latencyCount;
+  double                  _latencySum;
+  std::mutex              _mutex;
+  std::condition_variable _cond;
+  std::thread             _thread;
+};
+
+#endif // __FRAMESCHEDULER_H__
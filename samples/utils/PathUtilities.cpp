@@ -0,0 +1,41 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include "PathUtilities.h"
+
+
+// The position of the dot that starts the extension of the file name, or the end of the path if there is none.
+static size_t ExtensionPos(const std::string& path) {
+  size_t dot = path.find_last_of('.');
+  return (std::string::npos == dot || dot < path.find_last_of("/\\") + 1) ? path.size() : dot;
+}
+
+std::string InsertSuffix(std::string path, const char *suffix) {
+  path.insert(ExtensionPos(path), suffix);
+  return path;
+}
+
+std::string ReplaceExtension(std::string path, const char *ext) {
+  path.replace(ExtensionPos(path), std::string::npos, ext);
+  return path;
+}
@@ -0,0 +1,44 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __PATH_UTILITIES_H__
+#define __PATH_UTILITIES_H__
+
+#include <string>
+
+//! Insert a suffix into a path, before the extension of its file name, e.g. "out/video.mp4" becomes
+//! "out/video_720p.mp4". A dot in a directory name is not taken for an extension: "out.d/video" becomes
+//! "out.d/video_720p".
+//! \param[in]  path    the path, with either kind of directory separator.
+//! \param[in]  suffix  the suffix.
+//! \return     the path with the suffix inserted.
+std::string InsertSuffix(std::string path, const char *suffix);
+
+//! Replace the extension of the file name in a path, or append one if it has none, e.g. "out/video.mp4" becomes
+//! "out/video.avi", and "out.d/video" becomes "out.d/video.avi".
+//! \param[in]  path  the path, with either kind of directory separator.
+//! \param[in]  ext   the new extension, including its dot.
+//! \return     the path with the new extension.
+std::string ReplaceExtension(std::string path, const char *ext);
+
+#endif // __PATH_UTILITIES_H__
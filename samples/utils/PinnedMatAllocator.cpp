@@ -0,0 +1,105 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <limits.h>
+
+#include "nvCVImage.h"
+#include "PinnedMatAllocator.h"
+
+
+/********************************************************************************
+ * PinnedMatAllocator
+ ********************************************************************************/
+
+static bool MakePinnedImage(size_t bytes, BufferPool::Block *block, void * /*cookie*/) {
+  if (bytes > UINT_MAX)
+    return false;
+  NvCVImage *im = new NvCVImage;
+  if (NVCV_SUCCESS != NvCVImage_Alloc(im, (unsigned)bytes, 1, NVCV_Y, NVCV_U8, NVCV_CHUNKY, NVCV_CPU_PINNED, 0)) {
+    delete im;
+    return false;
+  }
+  block->data  = im->pixels;
+  block->owner = im;
+  block->bytes = bytes;
+  return true;
+}
+
+static void DestroyPinnedImage(const BufferPool::Block& block, void * /*cookie*/) {
+  delete (NvCVImage*)block.owner;   // Which frees the buffer
+}
+
+PinnedMatAllocator::PinnedMatAllocator(size_t maxIdleBytes)
+    : _pool(MakePinnedImage, DestroyPinnedImage, nullptr, maxIdleBytes), _unavailable(false) {}
+
+// This follows the default allocator, other than where the memory comes from.
+cv::UMatData* PinnedMatAllocator::allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+                                           AccessFlags /*flags*/, cv::UMatUsageFlags /*usageFlags*/) const {
+  size_t total = CV_ELEM_SIZE(type);
+  uchar  *data = (uchar*)data0;
+
+  for (int i = dims - 1; i >= 0; --i) {
+    if (step) {
+      if (data0 && step[i] != cv::Mat::AUTO_STEP) {
+        CV_Assert(total <= step[i]);
+        total = step[i];
+      } else {
+        step[i] = total;
+      }
+    }
+    total *= sizes[i];
+  }
+  if (!data && !_unavailable) {
+    if (nullptr == (data = (uchar*)_pool.acquire(total)))
+      _unavailable = true;
+  }
+  if (!data)
+    data = (uchar*)cv::fastMalloc(total);
+  cv::UMatData* u = new cv::UMatData(this);
+  u->data = u->origdata = data;
+  u->size = total;
+  if (data0)
+    u->flags |= cv::UMatData::USER_ALLOCATED;
+  return u;
+}
+
+bool PinnedMatAllocator::allocate(cv::UMatData* u, AccessFlags /*accessFlags*/,
+                                  cv::UMatUsageFlags /*usageFlags*/) const {
+  return nullptr != u;
+}
+
+void PinnedMatAllocator::deallocate(cv::UMatData* u) const {
+  if (!u)
+    return;
+  CV_Assert(0 == u->urefcount);
+  CV_Assert(0 == u->refcount);
+  if (!(u->flags & cv::UMatData::USER_ALLOCATED) && !_pool.release(u->origdata))
+    cv::fastFree(u->origdata);    // Ordinary memory, since page-locked memory was unavailable
+  delete u;
+}
+
+void PinnedMatAllocator::printStats(FILE *fp) const {
+  BufferPool::Stats s = _pool.stats();
+  fprintf(fp, "Page-locked frame buffers: %llu allocated, %llu reused, peak %.1f MB%s\n", s.made, s.reused,
+          s.peakBytes / (1024. * 1024.), (_unavailable ? "; ordinary memory was used when none could be had" : ""));
+}
@@ -0,0 +1,72 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __PINNED_MAT_ALLOCATOR_H__
+#define __PINNED_MAT_ALLOCATOR_H__
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <atomic>
+
+#include "BufferPool.h"
+#include "opencv2/core.hpp"
+
+//! A cv::MatAllocator that gives cv::Mat page-locked host memory, from NVCV_CPU_PINNED NvCVImage buffers that are
+//! recycled through a BufferPool. The CUDA driver copies page-locked memory to and from the GPU directly, rather than
+//! through a staging buffer, so frames decoded into such a Mat are uploaded in place.
+//! If page-locked memory cannot be had, as on a host without a GPU, ordinary memory is used instead.
+//! Set cv::Mat::allocator before the Mat is created; note that assigning one Mat to another replaces it.
+//! The allocator must outlive the Mats that it has allocated.
+class PinnedMatAllocator : public cv::MatAllocator {
+public:
+#if CV_VERSION_MAJOR >= 4
+  typedef cv::AccessFlag AccessFlags;
+#else // CV_VERSION_MAJOR < 4
+  typedef int AccessFlags;
+#endif // CV_VERSION_MAJOR
+
+  //! Constructor.
+  //! \param[in]  maxIdleBytes  the most page-locked memory to keep for reuse when it is not in use.
+  explicit PinnedMatAllocator(size_t maxIdleBytes = (size_t)256 << 20);
+
+  cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, AccessFlags flags,
+                         cv::UMatUsageFlags usageFlags) const override;
+  bool          allocate(cv::UMatData* data, AccessFlags accessFlags, cv::UMatUsageFlags usageFlags) const override;
+  void          deallocate(cv::UMatData* data) const override;
+
+  //! Query whether the memory of a Mat was allocated by this allocator, and is page-locked.
+  bool isPinned(const cv::Mat& mat) const { return mat.u && _pool.owns(mat.u->origdata); }
+
+  //! Get the statistics of the pool.
+  BufferPool::Stats stats() const { return _pool.stats(); }
+
+  //! Print the statistics of the pool.
+  void printStats(FILE *fp) const;
+
+private:
+  mutable BufferPool        _pool;
+  mutable std::atomic<bool> _unavailable;   // Page-locked memory could not be had, so do not keep asking for it
+};
+
+#endif // __PINNED_MAT_ALLOCATOR_H__
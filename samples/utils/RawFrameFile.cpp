@@ -0,0 +1,251 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <string.h>
+
+#ifdef _WIN32
+  #include <Windows.h>
+#else // !_WIN32
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif // _WIN32
+
+#include "FrameLayout.h"
+#include "RawFrameFile.h"
+
+static const char     kMagic[4]   = { 'N', 'V', 'R', 'F' };
+static const uint32_t kVersion    = 1;
+static const size_t   kPageBytes  = 4096;
+
+// The first page of the file. The magic number is only written by close(), so a file that was not finished is not read.
+struct RawFrameFileHeader {
+  char      magic[4];
+  uint32_t  version;
+  uint32_t  headerBytes;    // The offset of the first frame
+  uint32_t  descBytes;      // sizeof(RawFrameFileDesc), so that descriptors can be extended
+  uint64_t  frameCount;
+  uint64_t  indexOffset;    // The offset of the descriptors, after the last frame
+  double    frameRate;
+};
+
+
+static bool IsFloat(NvCVImage_ComponentType type) {
+  return NVCV_F16 == type || NVCV_F32 == type || NVCV_F64 == type;
+}
+
+static bool WriteZeros(FILE *fp, size_t bytes) {
+  static const unsigned char zeros[kPageBytes] = { 0 };
+  while (bytes) {
+    size_t n = (bytes < kPageBytes) ? bytes : kPageBytes;
+    if (n != fwrite(zeros, 1, n, fp))
+      return false;
+    bytes -= n;
+  }
+  return true;
+}
+
+
+NvCV_Status RawFrameFileWriter::open(const char *path, double frameRate, NvCVImage_PixelFormat format,
+                                     NvCVImage_ComponentType type, unsigned layout, unsigned char colorspace) {
+  close();
+  _index.clear();
+  _path       = path;
+  _frameRate  = frameRate;
+  _format     = format;
+  _type       = type;
+  _layout     = layout;
+  _colorspace = colorspace;
+  if (nullptr == (_fp = fopen(path, "wb")))
+    return NVCV_ERR_WRITE;
+  if (!WriteZeros(_fp, kPageBytes)) {     // The header is written last
+    fclose(_fp);
+    _fp = nullptr;
+    return NVCV_ERR_WRITE;
+  }
+  _offset = kPageBytes;
+  return NVCV_SUCCESS;
+}
+
+NvCV_Status RawFrameFileWriter::write(const NvCVImage *src, struct CUstream_st *stream) {
+  NvCV_Status       vfxErr;
+  RawFrameFileDesc  desc;
+  const void        *data;
+  size_t            padded;
+  int               pitch;
+  bool              asIs = (NVCV_FORMAT_UNKNOWN == _format);
+
+  if (!_fp)
+    return NVCV_ERR_INITIALIZATION;
+  memset(&desc, 0, sizeof(desc));
+  desc.width         = src->width;
+  desc.height        = src->height;
+  desc.pixelFormat   = asIs ? src->pixelFormat   : _format;
+  desc.componentType = asIs ? src->componentType : _type;
+  desc.planar        = asIs ? src->planar        : (uint8_t)_layout;
+  desc.colorspace    = asIs ? src->colorspace    : _colorspace;
+  desc.bytes = PackedFrameBytes(desc.width, desc.height, (NvCVImage_PixelFormat)desc.pixelFormat,
+                                (NvCVImage_ComponentType)desc.componentType, desc.planar, &pitch);
+  if (!desc.bytes)
+    return NVCV_ERR_PIXELFORMAT;
+  desc.pitch  = pitch;
+  desc.offset = _offset;
+
+  if (desc.pixelFormat == (uint32_t)src->pixelFormat && desc.componentType == (uint32_t)src->componentType &&
+      desc.planar == src->planar && desc.pitch == src->pitch && desc.colorspace == src->colorspace &&
+      (NVCV_CPU == src->gpuMem || NVCV_CPU_PINNED == src->gpuMem)) {
+    data = src->pixels;     // Already packed as we store it
+  } else {
+    NvCVImage stage;
+    float     scale = (IsFloat(src->componentType) == IsFloat((NvCVImage_ComponentType)desc.componentType)) ? 1.f :
+                      IsFloat(src->componentType) ? 255.f : 1.f / 255.f;
+    _stage.resize(desc.bytes);
+    vfxErr = NvCVImage_Init(&stage, desc.width, desc.height, desc.pitch, _stage.data(),
+                            (NvCVImage_PixelFormat)desc.pixelFormat, (NvCVImage_ComponentType)desc.componentType,
+                            desc.planar, NVCV_CPU);
+    if (NVCV_SUCCESS != vfxErr)
+      return vfxErr;
+    stage.colorspace = desc.colorspace;
+    if (NVCV_SUCCESS != (vfxErr = TransferViaF32(src, &stage, scale, stream, &_f32, &_tmp)))
+      return vfxErr;
+    data = _stage.data();
+  }
+
+  padded = (size_t)((desc.bytes + kPageBytes - 1) / kPageBytes * kPageBytes);
+  if (desc.bytes != fwrite(data, 1, (size_t)desc.bytes, _fp) || !WriteZeros(_fp, padded - (size_t)desc.bytes))
+    return NVCV_ERR_WRITE;
+  _offset += padded;
+  _index.push_back(desc);
+  return NVCV_SUCCESS;
+}
+
+NvCV_Status RawFrameFileWriter::close() {
+  RawFrameFileHeader  hdr;
+  bool                ok;
+
+  if (!_fp)
+    return NVCV_SUCCESS;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, kMagic, sizeof(hdr.magic));
+  hdr.version     = kVersion;
+  hdr.headerBytes = (uint32_t)kPageBytes;
+  hdr.descBytes   = (uint32_t)sizeof(RawFrameFileDesc);
+  hdr.frameCount  = _index.size();
+  hdr.indexOffset = _offset;
+  hdr.frameRate   = _frameRate;
+  ok = _index.empty() || _index.size() == fwrite(_index.data(), sizeof(RawFrameFileDesc), _index.size(), _fp);
+  ok = ok && 0 == fseek(_fp, 0, SEEK_SET) && 1 == fwrite(&hdr, sizeof(hdr), 1, _fp);
+  ok = (0 == fclose(_fp)) && ok;
+  _fp = nullptr;
+  if (!ok) {
+    printf("Error writing \"%s\"\n", _path.c_str());
+    return NVCV_ERR_WRITE;
+  }
+  return NVCV_SUCCESS;
+}
+
+
+NvCV_Status RawFrameFileReader::open(const char *path) {
+  const RawFrameFileHeader *hdr;
+
+  close();
+#ifdef _WIN32
+  LARGE_INTEGER size;
+  _file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (INVALID_HANDLE_VALUE == _file) {
+    _file = nullptr;
+    return NVCV_ERR_FILE;
+  }
+  if (!GetFileSizeEx(_file, &size) || (size_t)size.QuadPart < sizeof(RawFrameFileHeader) ||
+      nullptr == (_mapping = CreateFileMappingA(_file, NULL, PAGE_WRITECOPY, 0, 0, NULL)) ||
+      nullptr == (_base = (unsigned char*)MapViewOfFile(_mapping, FILE_MAP_COPY, 0, 0, 0))) {
+    close();
+    return NVCV_ERR_FILE;
+  }
+  _fileBytes = (size_t)size.QuadPart;
+#else // !_WIN32
+  struct stat st;
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    return NVCV_ERR_FILE;
+  if (0 != fstat(fd, &st) || (size_t)st.st_size < sizeof(RawFrameFileHeader)) {
+    ::close(fd);
+    return NVCV_ERR_FILE;
+  }
+  void *mem = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (MAP_FAILED == mem)
+    return NVCV_ERR_FILE;
+  _base      = (unsigned char*)mem;
+  _fileBytes = (size_t)st.st_size;
+  (void)madvise(_base, _fileBytes, MADV_SEQUENTIAL);   // Frames are usually read in order
+#endif // _WIN32
+
+  hdr = (const RawFrameFileHeader*)_base;
+  if (memcmp(hdr->magic, kMagic, sizeof(kMagic)) || kVersion != hdr->version ||
+      hdr->descBytes < sizeof(RawFrameFileDesc) || hdr->indexOffset > _fileBytes ||
+      hdr->frameCount > (_fileBytes - hdr->indexOffset) / hdr->descBytes) {
+    close();
+    return NVCV_ERR_PARSE;
+  }
+  _frameRate = hdr->frameRate;
+  _index.resize((size_t)hdr->frameCount);
+  for (size_t i = 0; i < _index.size(); ++i) {
+    memcpy(&_index[i], _base + hdr->indexOffset + i * hdr->descBytes, sizeof(RawFrameFileDesc));
+    if (_index[i].offset > hdr->indexOffset || _index[i].bytes > hdr->indexOffset - _index[i].offset) {
+      close();
+      return NVCV_ERR_PARSE;
+    }
+  }
+  return NVCV_SUCCESS;
+}
+
+NvCV_Status RawFrameFileReader::frame(unsigned long long i, NvCVImage *view) const {
+  NvCV_Status vfxErr;
+
+  if (i >= _index.size())
+    return NVCV_ERR_READ;
+  const RawFrameFileDesc& desc = _index[(size_t)i];
+  vfxErr = NvCVImage_Init(view, desc.width, desc.height, desc.pitch, _base + desc.offset,
+                          (NvCVImage_PixelFormat)desc.pixelFormat, (NvCVImage_ComponentType)desc.componentType,
+                          desc.planar, NVCV_CPU);
+  view->colorspace = desc.colorspace;
+  return vfxErr;
+}
+
+void RawFrameFileReader::close() {
+#ifdef _WIN32
+  if (_base)    UnmapViewOfFile(_base);
+  if (_mapping) CloseHandle(_mapping);
+  if (_file)    CloseHandle(_file);
+  _mapping = nullptr;
+  _file    = nullptr;
+#else // !_WIN32
+  if (_base)
+    munmap(_base, _fileBytes);
+#endif // _WIN32
+  _base      = nullptr;
+  _fileBytes = 0;
+  _index.clear();
+}
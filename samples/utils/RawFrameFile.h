@@ -0,0 +1,154 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __RAW_FRAME_FILE_H__
+#define __RAW_FRAME_FILE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "nvCVImage.h"
+
+//! The description of one frame in a .nvrf file.
+struct RawFrameFileDesc {
+  uint64_t  offset;           //!< The position of the frame in the file, on a page boundary.
+  uint64_t  bytes;            //!< The size of the frame, from PackedFrameBytes().
+  uint32_t  width;
+  uint32_t  height;
+  int32_t   pitch;
+  uint32_t  pixelFormat;      //!< NvCVImage_PixelFormat
+  uint32_t  componentType;    //!< NvCVImage_ComponentType
+  uint8_t   planar;           //!< The layout, e.g. NVCV_CHUNKY, NVCV_PLANAR or NVCV_NV12.
+  uint8_t   colorspace;       //!< An OR of the NVCV_601 ... NVCV_CHROMA_* flags, for YUV.
+  uint8_t   reserved[2];
+};
+
+//! Write a .nvrf file of raw video frames, for feeding effects without a decoder, or for caching the results of one
+//! offline pass for the next without an encoder.
+//! The file has a header page, then the frames, each starting on a page boundary, then an index of frame
+//! descriptors, so frames can be appended without knowing how many there will be. Each frame can be stored as it is
+//! given, or converted to one payload format for the whole file, such as NV12 to halve the size of BGR, or planar F16
+//! to have it ready for the input of an effect.
+class RawFrameFileWriter {
+public:
+  RawFrameFileWriter() : _fp(nullptr), _offset(0), _format(NVCV_FORMAT_UNKNOWN), _type(NVCV_TYPE_UNKNOWN), _layout(0),
+                         _colorspace(0), _frameRate(0.) {}
+  ~RawFrameFileWriter() { close(); }
+
+  //! Create the file.
+  //! \param[in]  path        the path of the file, conventionally with the .nvrf suffix.
+  //! \param[in]  frameRate   the frame rate, to be passed on to the reader.
+  //! \param[in]  format      the pixel format of the payload, or NVCV_FORMAT_UNKNOWN to store frames as they are given.
+  //! \param[in]  type        the component type of the payload. Floating-point payloads are stored in [0, 1].
+  //! \param[in]  layout      the layout of the payload, e.g. NVCV_CHUNKY, NVCV_PLANAR or NVCV_NV12.
+  //! \param[in]  colorspace  the colorspace of a YUV payload.
+  //! \return     NVCV_SUCCESS, or NVCV_ERR_WRITE if the file could not be created.
+  NvCV_Status open(const char *path, double frameRate, NvCVImage_PixelFormat format = NVCV_FORMAT_UNKNOWN,
+                   NvCVImage_ComponentType type = NVCV_TYPE_UNKNOWN, unsigned layout = NVCV_CHUNKY,
+                   unsigned char colorspace = 0);
+
+  //! Query whether the file is being written.
+  bool isOpen() const { return nullptr != _fp; }
+
+  //! Append a frame, converting it to the payload format if necessary.
+  //! \param[in]  frame   the frame, on the CPU or the GPU.
+  //! \param[in]  stream  the CUDA stream, for a frame on the GPU.
+  //! \return     NVCV_SUCCESS, NVCV_ERR_PIXELFORMAT if the payload cannot be stored, NVCV_ERR_WRITE, or an error
+  //!             from the conversion.
+  NvCV_Status write(const NvCVImage *frame, struct CUstream_st *stream = 0);
+
+  //! Write the index and the header, and close the file. Until then, the file cannot be read.
+  //! This is called by the destructor.
+  NvCV_Status close();
+
+  //! Get the number of frames written.
+  unsigned long long frames() const { return _index.size(); }
+
+private:
+  FILE                          *_fp;
+  std::string                   _path;
+  std::vector<RawFrameFileDesc> _index;
+  uint64_t                      _offset;
+  NvCVImage_PixelFormat         _format;
+  NvCVImage_ComponentType       _type;
+  unsigned                      _layout;
+  unsigned char                 _colorspace;
+  double                        _frameRate;
+  std::vector<unsigned char>    _stage;   // A frame converted to the payload format
+  NvCVImage                     _tmp;     // For conversion on the way from the GPU
+  NvCVImage                     _f32;     // For conversion to or from F16
+};
+
+//! Read a .nvrf file by mapping it into memory, and hand out views of its frames without copying them.
+//! The mapping is copy-on-write, so a view can be modified without changing the file.
+class RawFrameFileReader {
+public:
+  RawFrameFileReader() : _base(nullptr), _fileBytes(0), _frameRate(0.)
+#ifdef _WIN32
+                         , _file(nullptr), _mapping(nullptr)
+#endif // _WIN32
+                         {}
+  ~RawFrameFileReader() { close(); }
+
+  //! Map the file.
+  //! \param[in]  path  the path of the file.
+  //! \return     NVCV_SUCCESS, NVCV_ERR_FILE if it could not be opened, or NVCV_ERR_PARSE if it is not a complete
+  //!             .nvrf file.
+  NvCV_Status open(const char *path);
+
+  //! Query whether a file is mapped.
+  bool isOpen() const { return nullptr != _base; }
+
+  //! Get the number of frames in the file.
+  unsigned long long frameCount() const { return _index.size(); }
+
+  //! Get the frame rate given to the writer.
+  double frameRate() const { return _frameRate; }
+
+  //! Get the description of a frame.
+  const RawFrameFileDesc* desc(unsigned long long i) const { return (i < _index.size()) ? &_index[i] : nullptr; }
+
+  //! Get a view of a frame, in place in the mapping. It is valid until close().
+  //! \param[in]  i     the index of the frame.
+  //! \param[out] view  the view. It should not own a buffer of its own.
+  //! \return     NVCV_SUCCESS, or NVCV_ERR_READ if there is no such frame.
+  NvCV_Status frame(unsigned long long i, NvCVImage *view) const;
+
+  //! Unmap the file. This is called by the destructor.
+  void close();
+
+private:
+  unsigned char                 *_base;
+  size_t                        _fileBytes;
+  double                        _frameRate;
+  std::vector<RawFrameFileDesc> _index;
+#ifdef _WIN32
+  void                          *_file, *_mapping;
+#endif // _WIN32
+};
+
+#endif // __RAW_FRAME_FILE_H__
@@ -0,0 +1,323 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <errno.h>
+#include <string.h>
+
+#include <thread>
+
+#ifdef _WIN32
+  #include <fcntl.h>
+  #include <io.h>
+#else // !_WIN32
+  #include <fcntl.h>
+  #include <signal.h>
+  #include <unistd.h>
+#endif // _WIN32
+
+#include "RawFrameIO.h"
+
+static const unsigned kPipeBytes = 1 << 20;   // The pipe buffer we ask for, so that ffmpeg can run further ahead
+static const unsigned kMaxIoBytes = 1 << 30;
+
+
+static int SysRead(int fd, void *buf, unsigned bytes) {
+#ifdef _WIN32
+  return _read(fd, buf, bytes);
+#else // !_WIN32
+  return (int)::read(fd, buf, bytes);
+#endif // _WIN32
+}
+
+static int SysWrite(int fd, const void *buf, unsigned bytes) {
+#ifdef _WIN32
+  return _write(fd, buf, bytes);
+#else // !_WIN32
+  return (int)::write(fd, buf, bytes);
+#endif // _WIN32
+}
+
+// Read until the buffer is full or the stream ends; return the number of bytes read.
+static size_t ReadFully(int fd, unsigned char *buf, size_t bytes) {
+  size_t done = 0;
+  while (done < bytes) {
+    size_t n = bytes - done;
+    int got = SysRead(fd, buf + done, (unsigned)(n < kMaxIoBytes ? n : kMaxIoBytes));
+    if (got > 0)
+      done += got;
+    else if (got < 0 && EINTR == errno)
+      continue;
+    else
+      break;
+  }
+  return done;
+}
+
+static void CloseFd(int fd) {
+#ifdef _WIN32
+  _close(fd);
+#else // !_WIN32
+  ::close(fd);
+#endif // _WIN32
+}
+
+static bool WriteFully(int fd, const unsigned char *buf, size_t bytes) {
+  while (bytes) {
+    int put = SysWrite(fd, buf, (unsigned)(bytes < kMaxIoBytes ? bytes : kMaxIoBytes));
+    if (put > 0) {
+      buf   += put;
+      bytes -= put;
+    } else if (put < 0 && EINTR == errno) {
+      continue;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void EnlargePipe(int fd) {
+#if defined(__linux__) && defined(F_SETPIPE_SZ)
+  (void)fcntl(fd, F_SETPIPE_SZ, kPipeBytes);   // Not a pipe, or over the limit: the default is fine
+#else // !__linux__
+  (void)fd;
+#endif // __linux__
+}
+
+
+NvCV_Status RawFrameFormat::init(const char *pixFmt, unsigned w, unsigned h, unsigned char cs) {
+  width      = w;
+  height     = h;
+  colorspace = 0;
+  if      (!strcmp(pixFmt, "bgr24"))    { format = NVCV_BGR;    layout = NVCV_CHUNKY; pitch = w * 3; }
+  else if (!strcmp(pixFmt, "rgba"))     { format = NVCV_RGBA;   layout = NVCV_CHUNKY; pitch = w * 4; }
+  else if (!strcmp(pixFmt, "nv12"))     { format = NVCV_YUV420; layout = NVCV_NV12;   pitch = w;     }
+  else if (!strcmp(pixFmt, "yuv420p"))  { format = NVCV_YUV420; layout = NVCV_I420;   pitch = w;     }
+  else if (!strcmp(pixFmt, "yuv444p"))  { format = NVCV_YUV444; layout = NVCV_I444;   pitch = w;     }
+  else                                  return NVCV_ERR_PIXELFORMAT;
+  if (!w || !h)
+    return NVCV_ERR_RESOLUTION;
+  if (NVCV_YUV420 == format) {
+    if ((w | h) & 1)
+      return NVCV_ERR_RESOLUTION;
+    colorspace = cs;
+    frameBytes = (size_t)w * h * 3 / 2;
+  } else if (NVCV_YUV444 == format) {
+    colorspace = cs;
+    frameBytes = (size_t)w * h * 3;
+  } else {
+    frameBytes = (size_t)pitch * h;
+  }
+  return NVCV_SUCCESS;
+}
+
+NvCV_Status RawFrameFormat::wrap(void *pixels, NvCVImage *im) const {
+  NvCV_Status vfxErr = NvCVImage_Init(im, width, height, pitch, pixels, format, NVCV_U8, layout, NVCV_CPU);
+  im->colorspace = colorspace;
+  return vfxErr;
+}
+
+
+struct RawFrameReader::Shared {
+  int                                     fd;
+  bool                                    closeFd;
+  size_t                                  frameBytes;
+  std::vector<std::vector<unsigned char> > bufs;
+  std::deque<int>                         free, full;
+  size_t                                  partial;    // The size of an incomplete last frame
+  bool                                    stop, eof;
+  std::mutex                              mutex;
+  std::condition_variable                 cond;
+
+  ~Shared() { if (closeFd) CloseFd(fd); }
+};
+
+int RawFrameReader::StdinFd() {
+#ifdef _WIN32
+  _setmode(0, _O_BINARY);
+#endif // _WIN32
+  return 0;
+}
+
+NvCV_Status RawFrameReader::open(int fd, const RawFrameFormat& fmt, unsigned depth, bool closeFd) {
+  close();
+  if (fd < 0 || !fmt.frameBytes) {
+    if (closeFd && fd >= 0)
+      CloseFd(fd);
+    return NVCV_ERR_PARAMETER;
+  }
+  _fmt    = fmt;
+  _frames = _waits = 0;
+  _held   = -1;
+  _shared = std::make_shared<Shared>();
+  _shared->fd         = fd;
+  _shared->closeFd    = closeFd;
+  _shared->frameBytes = fmt.frameBytes;
+  _shared->partial    = 0;
+  _shared->stop       = false;
+  _shared->eof        = false;
+  _shared->bufs.resize(depth + 1);      // One more than is read ahead, for the frame that the caller holds
+  for (unsigned i = 0; i < depth + 1; ++i) {
+    _shared->bufs[i].resize(fmt.frameBytes);
+    _shared->free.push_back((int)i);
+  }
+  EnlargePipe(fd);
+  std::thread(ReadLoop, _shared).detach();
+  return NVCV_SUCCESS;
+}
+
+void RawFrameReader::ReadLoop(std::shared_ptr<Shared> s) {
+  for (;;) {
+    int index;
+    {
+      std::unique_lock<std::mutex> lock(s->mutex);
+      s->cond.wait(lock, [&s] { return s->stop || !s->free.empty(); });
+      if (s->stop)
+        break;
+      index = s->free.front();
+      s->free.pop_front();
+    }
+    size_t got = ReadFully(s->fd, s->bufs[index].data(), s->frameBytes);
+    std::lock_guard<std::mutex> lock(s->mutex);
+    if (got == s->frameBytes) {
+      s->full.push_back(index);
+    } else {
+      s->partial = got;
+      s->eof = true;
+    }
+    s->cond.notify_all();
+    if (s->eof || s->stop)
+      break;
+  }
+}
+
+NvCV_Status RawFrameReader::read(NvCVImage *frame) {
+  if (!_shared)
+    return NVCV_ERR_INITIALIZATION;
+  std::unique_lock<std::mutex> lock(_shared->mutex);
+  if (_held >= 0) {
+    _shared->free.push_back(_held);
+    _held = -1;
+    _shared->cond.notify_all();
+  }
+  if (_shared->full.empty() && !_shared->eof)
+    ++_waits;
+  _shared->cond.wait(lock, [this] { return !_shared->full.empty() || _shared->eof; });
+  if (_shared->full.empty()) {
+    if (_shared->partial)
+      printf("The last %zu bytes of the raw input are not a whole frame, and were ignored\n", _shared->partial);
+    _shared->partial = 0;
+    return NVCV_ERR_READ;
+  }
+  _held = _shared->full.front();
+  _shared->full.pop_front();
+  ++_frames;
+  return _fmt.wrap(_shared->bufs[_held].data(), frame);
+}
+
+void RawFrameReader::close() {
+  if (!_shared)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(_shared->mutex);
+    _shared->stop = true;
+  }
+  _shared->cond.notify_all();
+  _shared.reset();
+}
+
+void RawFrameReader::printStats(FILE *fp) {
+  fprintf(fp, "Raw frames read: %llu, of which %llu had not yet arrived when they were needed\n", _frames, _waits);
+}
+
+
+int RawFrameWriter::DetachStdout() {
+  fflush(stdout);
+#ifdef _WIN32
+  int fd = _dup(1);
+  if (fd < 0)
+    return -1;
+  _dup2(2, 1);
+  _setmode(fd, _O_BINARY);
+#else // !_WIN32
+  int fd = dup(1);
+  if (fd < 0)
+    return -1;
+  dup2(2, 1);
+#endif // _WIN32
+  return fd;
+}
+
+NvCV_Status RawFrameWriter::open(int fd, const RawFrameFormat& fmt) {
+  NvCV_Status vfxErr;
+
+  close();
+  if (fd < 0 || !fmt.frameBytes)
+    return NVCV_ERR_PARAMETER;
+  _fmt    = fmt;
+  _frames = 0;
+  _buf.assign(fmt.frameBytes, 0xFF);    // Conversions to RGBA leave alpha alone, so make it opaque
+  if (NVCV_SUCCESS != (vfxErr = _fmt.wrap(_buf.data(), &_frame)))
+    return vfxErr;
+#ifndef _WIN32
+  signal(SIGPIPE, SIG_IGN);   // If the reader goes away, fail the write rather than the process
+#endif // _WIN32
+  EnlargePipe(fd);
+  _fd = fd;
+  return NVCV_SUCCESS;
+}
+
+NvCV_Status RawFrameWriter::write(const NvCVImage *src) {
+  NvCV_Status vfxErr;
+  bool        ok;
+
+  if (_fd < 0)
+    return NVCV_ERR_INITIALIZATION;
+  if (src->width != _fmt.width || src->height != _fmt.height)
+    return NVCV_ERR_MISMATCH;
+  if (src->pixelFormat == _fmt.format && NVCV_U8 == src->componentType && NVCV_CHUNKY == src->planar &&
+      NVCV_CHUNKY == _fmt.layout && (NVCV_CPU == src->gpuMem || NVCV_CPU_PINNED == src->gpuMem)) {
+    if (src->pitch == _fmt.pitch) {   // Already in the output format; write it as it is
+      ok = WriteFully(_fd, (const unsigned char*)src->pixels, _fmt.frameBytes);
+    } else {
+      ok = true;
+      for (unsigned y = 0; ok && y < _fmt.height; ++y)
+        ok = WriteFully(_fd, (const unsigned char*)src->pixels + (ptrdiff_t)y * src->pitch, _fmt.pitch);
+    }
+  } else {
+    if (NVCV_SUCCESS != (vfxErr = NvCVImage_Transfer(src, &_frame, 1.f, 0, nullptr)))
+      return vfxErr;
+    ok = WriteFully(_fd, _buf.data(), _fmt.frameBytes);
+  }
+  if (!ok)
+    return NVCV_ERR_WRITE;
+  ++_frames;
+  return NVCV_SUCCESS;
+}
+
+void RawFrameWriter::close() {
+  if (_fd < 0)
+    return;
+  CloseFd(_fd);
+  _fd = -1;
+}
@@ -0,0 +1,147 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __RAW_FRAME_IO_H__
+#define __RAW_FRAME_IO_H__
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "nvCVImage.h"
+
+//! The layout of a raw video frame, as named by an ffmpeg pix_fmt: bgr24, rgba, nv12, yuv420p or yuv444p.
+//! Frames are tightly packed, as ffmpeg reads and writes rawvideo.
+struct RawFrameFormat {
+  unsigned              width;
+  unsigned              height;
+  NvCVImage_PixelFormat format;
+  unsigned              layout;       //!< NVCV_CHUNKY, NVCV_NV12, NVCV_I420 or NVCV_I444.
+  unsigned char         colorspace;   //!< The colorspace, range and chroma siting of YUV.
+  int                   pitch;        //!< The byte stride between rows; that of the luma, for YUV.
+  size_t                frameBytes;   //!< The size of each frame.
+
+  //! Describe frames of the given pix_fmt and size.
+  //! \param[in]  pixFmt      one of "bgr24", "rgba", "nv12", "yuv420p" or "yuv444p".
+  //! \param[in]  width       the width of the frames.
+  //! \param[in]  height      the height of the frames.
+  //! \param[in]  colorspace  an OR of NVCV_601, NVCV_709 or NVCV_2020, the range and the chroma siting, for YUV.
+  //! \return     NVCV_SUCCESS, NVCV_ERR_PIXELFORMAT if the pix_fmt is not one of those, or NVCV_ERR_RESOLUTION if the
+  //!             size is zero, or odd for 4:2:0.
+  NvCV_Status init(const char *pixFmt, unsigned width, unsigned height, unsigned char colorspace);
+
+  //! Make an image that wraps a frame of this format, without copying it.
+  //! \param[in]  pixels  the first byte of the frame.
+  //! \param[out] im      the image. It should not own a buffer of its own.
+  NvCV_Status wrap(void *pixels, NvCVImage *im) const;
+};
+
+//! Read raw frames from a pipe or file, such as the stdout of ffmpeg -f rawvideo.
+//! Whole frames are read straight into a ring of frame buffers, on a thread that keeps reading ahead of the caller.
+class RawFrameReader {
+public:
+  RawFrameReader() : _frames(0), _waits(0), _held(-1) {}
+  ~RawFrameReader() { close(); }
+
+  //! Get the file descriptor of stdin, switched to binary mode.
+  static int StdinFd();
+
+  //! Start reading frames.
+  //! \param[in]  fd      the file descriptor to read.
+  //! \param[in]  fmt     the format of the frames.
+  //! \param[in]  depth   the number of frames that can be read ahead.
+  //! \param[in]  closeFd true to close the file descriptor once it is no longer read, even if open() fails; that is
+  //!                     after the read thread has exited, so that the descriptor cannot be reused under it.
+  NvCV_Status open(int fd, const RawFrameFormat& fmt, unsigned depth = 3, bool closeFd = false);
+
+  //! Query whether frames are being read.
+  bool isOpen() const { return (bool)_shared; }
+
+  //! Get the next frame, waiting for it to be read if necessary.
+  //! \param[out] frame an image that wraps the frame, which is valid until the next call. It should not own a buffer.
+  //! \return     NVCV_SUCCESS, or NVCV_ERR_READ at the end of the stream.
+  NvCV_Status read(NvCVImage *frame);
+
+  //! Stop reading. A read that is blocked on the pipe is abandoned to its thread, which exits once it returns.
+  //! This is called by the destructor.
+  void close();
+
+  //! Print the number of frames read, and how often the caller had to wait for one.
+  void printStats(FILE *fp);
+
+private:
+  struct Shared;
+  static void ReadLoop(std::shared_ptr<Shared> shared);
+
+  RawFrameFormat            _fmt;
+  std::shared_ptr<Shared>   _shared;    // Shared with the read thread, which may outlive us
+  unsigned long long        _frames, _waits;
+  int                       _held;      // The buffer of the frame from the last read(), or -1
+};
+
+//! Write raw frames to a pipe or file, such as the stdin of ffmpeg -f rawvideo.
+//! A frame that is already in the output format is written directly from the caller's buffer; any other is converted
+//! with NvCVImage_Transfer() into a frame buffer first.
+class RawFrameWriter {
+public:
+  RawFrameWriter() : _fd(-1), _frames(0) {}
+  ~RawFrameWriter() { close(); }
+
+  //! Detach stdout for frames: get a new file descriptor for it, in binary mode, and send anything that is printed to
+  //! stdout after this to stderr instead, where it will not be mistaken for frames.
+  //! \return     the file descriptor of the original stdout, or -1 if it could not be duplicated.
+  static int DetachStdout();
+
+  //! Start writing frames.
+  //! \param[in]  fd    the file descriptor to write. It is closed by close(), so that the reader sees the end.
+  //! \param[in]  fmt   the format of the frames.
+  NvCV_Status open(int fd, const RawFrameFormat& fmt);
+
+  //! Query whether frames are being written.
+  bool isOpen() const { return _fd >= 0; }
+
+  //! Write a frame, converting it to the output format if necessary.
+  //! \param[in]  src   the frame, on the CPU, of the size of the output.
+  //! \return     NVCV_SUCCESS, NVCV_ERR_MISMATCH if the size is wrong, or NVCV_ERR_WRITE if the reader has gone away.
+  NvCV_Status write(const NvCVImage *src);
+
+  //! Close the file descriptor. This is called by the destructor.
+  void close();
+
+  //! Get the number of frames written.
+  unsigned long long frames() const { return _frames; }
+
+private:
+  RawFrameFormat              _fmt;
+  int                         _fd;
+  std::vector<unsigned char>  _buf;
+  NvCVImage                   _frame;   // Wraps _buf
+  unsigned long long          _frames;
+};
+
+#endif // __RAW_FRAME_IO_H__
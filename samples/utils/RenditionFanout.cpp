@@ -0,0 +1,190 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <stdlib.h>
+
+#include <chrono>
+
+#include "PathUtilities.h"
+#include "RenditionFanout.h"
+#include "opencv2/core/ocl.hpp"
+
+
+static double MsSince(std::chrono::high_resolution_clock::time_point t0) {
+  return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+}
+
+
+bool RenditionFanout::ParseHeights(const char *list, std::vector<int> *heights) {
+  heights->clear();
+  for (const char *s = list; *s;) {
+    char *end;
+    long h = strtol(s, &end, 10);
+    if (end == s || h <= 0 || (*end && *end != ','))
+      return false;
+    heights->push_back((int)h);
+    s = *end ? end + 1 : end;
+  }
+  return !heights->empty();
+}
+
+NvCV_Status RenditionFanout::open(const char *topPath, const std::vector<int>& heights, const cv::Size& top, double fps,
+                                  int fourcc, bool gpu, unsigned depth) {
+  close();
+  _rungs.clear();
+  _pool.clear();
+  _free.clear();
+  _frames = _stalls = 0;
+  _gpu = gpu && cv::ocl::haveOpenCL();
+  if (_gpu)
+    cv::ocl::setUseOpenCL(true);
+  else if (gpu)
+    printf("OpenCL is not available; renditions will be downscaled on the CPU\n");
+
+  for (int height : heights)
+    if (height <= 0 || height >= top.height)
+      return NVCV_ERR_PARAMETER;    // Before any file is created
+  for (int height : heights) {
+    std::unique_ptr<Rung> rung(new Rung);
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%dp", height);
+    rung->height  = height;
+    rung->size    = cv::Size((top.width * height / top.height + 1) & ~1, height);  // Encoders prefer even widths
+    rung->path    = InsertSuffix(topPath, suffix);
+    rung->written = 0;
+    rung->scaleMs = 0.;
+    if (!rung->writer.open(rung->path, fourcc, fps, rung->size)) {
+      printf("Cannot open \"%s\" for video writing\n", rung->path.c_str());
+      _rungs.clear();
+      return NVCV_ERR_WRITE;
+    }
+    _rungs.push_back(std::move(rung));
+  }
+  for (unsigned i = 0; i < (depth ? depth : 1); ++i) {
+    _pool.push_back(std::unique_ptr<Frame>(new Frame));
+    _pool.back()->scaled.resize(_rungs.size());
+    _free.push_back(_pool.back().get());
+  }
+  for (unsigned r = 0; r < _rungs.size(); ++r)
+    _rungs[r]->thread = std::thread(&RenditionFanout::encodeLoop, this, r);
+  return NVCV_SUCCESS;
+}
+
+void RenditionFanout::write(const cv::Mat& top) {
+  Frame *frame;
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_free.empty()) {
+      ++_stalls;
+      _freeCond.wait(lock, [this] { return !_free.empty(); });
+    }
+    frame = _free.back();
+    _free.pop_back();
+  }
+  if (_gpu) {
+    std::chrono::high_resolution_clock::time_point t0 = std::chrono::high_resolution_clock::now();
+    top.copyTo(_gpuTop);
+    for (unsigned r = 0; r < _rungs.size(); ++r) {
+      Rung& rung = *_rungs[r];
+      cv::resize(_gpuTop, rung.gpuScaled, rung.size, 0, 0, cv::INTER_AREA);
+      rung.gpuScaled.copyTo(frame->scaled[r]);
+    }
+    double ms = MsSince(t0) / _rungs.size();
+    for (auto& rung : _rungs)
+      rung->scaleMs += ms;    // The upload is shared among the rungs
+  } else {
+    top.copyTo(frame->top);   // Reallocated only if the size changes
+  }
+  frame->pending = (unsigned)_rungs.size();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& rung : _rungs)
+      rung->queue.push_back(frame);
+    ++_frames;
+  }
+  for (auto& rung : _rungs)
+    rung->cond.notify_one();
+}
+
+void RenditionFanout::releaseFrame(Frame *frame) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (--frame->pending)
+      return;
+    _free.push_back(frame);
+  }
+  _freeCond.notify_one();
+}
+
+void RenditionFanout::close() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& rung : _rungs)
+      if (rung->thread.joinable())
+        rung->queue.push_back(nullptr);
+  }
+  for (auto& rung : _rungs) {
+    rung->cond.notify_one();
+    if (rung->thread.joinable())
+      rung->thread.join();
+  }
+}
+
+void RenditionFanout::encodeLoop(unsigned r) {
+  Rung& rung = *_rungs[r];
+  for (;;) {
+    Frame *frame;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      rung.cond.wait(lock, [&rung] { return !rung.queue.empty(); });
+      frame = rung.queue.front();
+      rung.queue.pop_front();
+    }
+    if (!frame) {
+      rung.writer.release();
+      break;
+    }
+    if (_gpu) {
+      rung.writer << frame->scaled[r];
+    } else {
+      std::chrono::high_resolution_clock::time_point t0 = std::chrono::high_resolution_clock::now();
+      cv::resize(frame->top, rung.scaled, rung.size, 0, 0, cv::INTER_AREA);
+      rung.scaleMs += MsSince(t0);
+      releaseFrame(frame);    // The top frame is no longer needed by this rung
+      frame = nullptr;
+      rung.writer << rung.scaled;
+    }
+    if (frame)
+      releaseFrame(frame);
+    ++rung.written;
+  }
+}
+
+void RenditionFanout::printStats(FILE *fp) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  fprintf(fp, "Renditions: %llu frames on %s; waited for an encoder %llu times\n", _frames, (_gpu ? "OpenCL" : "CPU"),
+    _stalls);
+  for (auto& rung : _rungs)
+    fprintf(fp, "  %4dp %dx%d: %llu frames, %.2f ms per downscale, to \"%s\"\n", rung->height, rung->size.width,
+      rung->size.height, rung->written, (rung->written ? rung->scaleMs / rung->written : 0.), rung->path.c_str());
+}
@@ -0,0 +1,117 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __RENDITION_FANOUT_H__
+#define __RENDITION_FANOUT_H__
+
+#include <stdio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nvCVStatus.h"
+#include "opencv2/opencv.hpp"
+
+//! Produce the lower rungs of an adaptive bitrate ladder from the output of a single SuperRes or Upscale run.
+//! Each frame of the top rung is downscaled straight to every lower rung, with area averaging, and each rung is
+//! encoded on its own thread. On the CPU path, each rung thread also does its own downscaling, from a copy of the top
+//! frame that the rungs share. On the GPU path, the top frame is uploaded once to an OpenCL buffer, from which every
+//! rung is downscaled, and only the rungs are downloaded; OpenCV falls back to the CPU if OpenCL is not available.
+class RenditionFanout {
+public:
+  RenditionFanout() : _gpu(false), _frames(0), _stalls(0) {}
+  ~RenditionFanout() { close(); }
+
+  //! Parse a comma-separated list of rendition heights, such as "1440,1080".
+  //! \param[in]  list    the list.
+  //! \param[out] heights the heights.
+  //! \return     true if the list was well formed, and all heights are positive.
+  static bool ParseHeights(const char *list, std::vector<int> *heights);
+
+  //! Open an encoder for each lower rung, and start its thread.
+  //! Each rung is written to the path of the top rung, with "_<height>p" inserted before the extension.
+  //! \param[in]  topPath the path of the top-rung video, which is written by the caller.
+  //! \param[in]  heights the heights of the lower rungs, which must be smaller than that of the top rung.
+  //! \param[in]  top     the size of the top rung.
+  //! \param[in]  fps     the frame rate.
+  //! \param[in]  fourcc  the codec.
+  //! \param[in]  gpu     true to downscale with OpenCL where available.
+  //! \param[in]  depth   the number of top-rung frames that can be in flight; more allows the encoders to lag further.
+  //! \return     NVCV_SUCCESS, NVCV_ERR_PARAMETER if a height is not smaller than the top, or NVCV_ERR_WRITE.
+  NvCV_Status open(const char *topPath, const std::vector<int>& heights, const cv::Size& top, double fps, int fourcc,
+                   bool gpu, unsigned depth = 3);
+
+  //! Query whether any rungs are being written.
+  bool isOpen() const { return !_rungs.empty(); }
+
+  //! Queue a top-rung frame to be downscaled and encoded to every lower rung, waiting for an encoder if necessary.
+  //! The frame is not referenced after this returns, so the caller may overwrite it.
+  //! \param[in]  top     the top-rung frame, of the size given to open().
+  void write(const cv::Mat& top);
+
+  //! Wait for the queued frames to be written, finalize the files, and join the threads.
+  //! This is called by the destructor.
+  void close();
+
+  //! Print the number of frames written to each rung, and the mean time taken to downscale them.
+  void printStats(FILE *fp);
+
+private:
+  struct Frame {
+    cv::Mat               top;      // A copy of the top frame, for the CPU path
+    std::vector<cv::Mat>  scaled;   // Each rung, downscaled on the GPU path
+    unsigned              pending;  // The number of rungs that have yet to write this frame
+  };
+  struct Rung {
+    int                     height;
+    cv::Size                size;
+    std::string             path;
+    cv::VideoWriter         writer;
+    cv::Mat                 scaled;   // Downscaled on the rung thread, for the CPU path
+    cv::UMat                gpuScaled;
+    std::deque<Frame*>      queue;    // NULL to finish
+    unsigned long long      written;
+    double                  scaleMs;
+    std::condition_variable cond;
+    std::thread             thread;
+  };
+
+  void encodeLoop(unsigned r);
+  void releaseFrame(Frame *frame);
+
+  bool                                  _gpu;
+  cv::UMat                              _gpuTop;
+  std::vector<std::unique_ptr<Rung> >   _rungs;
+  std::vector<std::unique_ptr<Frame> >  _pool;
+  std::vector<Frame*>                   _free;
+  unsigned long long                    _frames, _stalls;
+  std::mutex                            _mutex;
+  std::condition_variable               _freeCond;
+};
+
+#endif // __RENDITION_FANOUT_H__
@@ -0,0 +1,434 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <limits.h>
+#include <string.h>
+
+#include <chrono>
+#include <new>
+#include <thread>
+
+#ifdef _WIN32
+  #include <Windows.h>
+#else // !_WIN32
+  #include <errno.h>
+  #include <fcntl.h>
+  #include <signal.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <time.h>
+  #include <unistd.h>
+  #ifdef __linux__
+    #include <linux/futex.h>
+    #include <sys/syscall.h>
+  #endif // __linux__
+#endif // _WIN32
+
+#include "FrameLayout.h"
+#include "ShmFrameRing.h"
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "The futex words must be plain 32-bit integers");
+
+static const uint32_t kMagic      = 0x474e5246;  // "FRNG"
+static const uint32_t kVersion    = 1;
+static const size_t   kPageBytes  = 4096;
+static const unsigned kPollMs     = 100;         // How often a waiting process checks that the other one is still there
+
+enum {
+  kProducerDone = 1,  // No more frames will be written
+  kConsumerGone = 2,  // No more frames will be read
+};
+
+//! The start of the shared memory. The descriptors of the slots follow it, and then the page-aligned slots.
+//! written and released are counters, modulo 2^32, of the frames published by the producer and given back by the
+//! consumer; written - released frames are in flight.
+struct ShmFrameRing::Header {
+  std::atomic<uint32_t> magic;        // Set last by the producer, once the rest of the header is valid
+  uint32_t              version;
+  uint32_t              numSlots;
+  uint32_t              descOffset;
+  uint64_t              slotBytes;
+  uint64_t              dataOffset;
+  double                frameRate;
+  int64_t               producerPid;
+  std::atomic<int64_t>  consumerPid;
+  std::atomic<uint32_t> flags;
+  std::atomic<uint32_t> written;
+  std::atomic<uint32_t> released;
+};
+
+
+static size_t RoundUp(size_t x, size_t align) { return (x + align - 1) / align * align; }
+
+static int64_t ThisPid() {
+#ifdef _WIN32
+  return (int64_t)GetCurrentProcessId();
+#else // !_WIN32
+  return (int64_t)getpid();
+#endif // _WIN32
+}
+
+static std::string ShmPath(const char *name) {
+#ifdef _WIN32
+  return std::string("Local\\") + name;
+#else // !_WIN32
+  return ('/' == name[0]) ? std::string(name) : (std::string("/") + name);
+#endif // _WIN32
+}
+
+static void WakeAll(std::atomic<uint32_t> *word) {
+#ifdef __linux__
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#else // !__linux__
+  (void)word;   // The waiter polls
+#endif // __linux__
+}
+
+// Sleep until *word is no longer seen, or until ms have passed. Either way, the caller checks again.
+static void WaitChange(std::atomic<uint32_t> *word, uint32_t seen, unsigned ms) {
+#ifdef __linux__
+  struct timespec ts;
+  ts.tv_sec  = ms / 1000;
+  ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, seen, &ts, nullptr, 0);
+#else // !__linux__
+  for (unsigned t = 0; t < ms && word->load(std::memory_order_acquire) == seen; ++t)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif // __linux__
+}
+
+
+ShmFrameRing::ShmFrameRing() : _hdr(nullptr), _desc(nullptr), _mapBytes(0), _producer(false), _holding(false),
+                               _index(0) {
+  _stats.frames = _stats.waits = 0;
+  _stats.waitMs = 0.;
+#ifdef _WIN32
+  _mapping = nullptr;
+#endif // _WIN32
+}
+
+NvCV_Status ShmFrameRing::create(const char *name, unsigned numSlots, size_t slotBytes, double frameRate) {
+  void    *mem;
+  size_t  descOffset, dataOffset, totalBytes;
+
+  close();
+  if (!name || !name[0] || !numSlots || !slotBytes)
+    return NVCV_ERR_PARAMETER;
+  slotBytes  = RoundUp(slotBytes, kPageBytes);
+  descOffset = RoundUp(sizeof(Header), 64);
+  dataOffset = RoundUp(descOffset + numSlots * sizeof(FrameDesc), kPageBytes);
+  totalBytes = dataOffset + numSlots * slotBytes;
+  _name = ShmPath(name);
+
+#ifdef _WIN32
+  _mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)totalBytes >> 32),
+                                (DWORD)totalBytes, _name.c_str());
+  if (_mapping && ERROR_ALREADY_EXISTS == GetLastError()) {   // Another producer is still using it
+    CloseHandle(_mapping);
+    _mapping = nullptr;
+  }
+  if (!_mapping)
+    return NVCV_ERR_MEMORY;
+  mem = MapViewOfFile(_mapping, FILE_MAP_ALL_ACCESS, 0, 0, totalBytes);
+  if (!mem) {
+    CloseHandle(_mapping);
+    _mapping = nullptr;
+    return NVCV_ERR_MEMORY;
+  }
+#else // !_WIN32
+  shm_unlink(_name.c_str());    // A stale ring, from a producer that did not get to close it
+  int fd = shm_open(_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0)
+    return NVCV_ERR_MEMORY;
+  if (0 != ftruncate(fd, (off_t)totalBytes)) {
+    ::close(fd);
+    shm_unlink(_name.c_str());
+    return NVCV_ERR_MEMORY;
+  }
+  mem = mmap(nullptr, totalBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (MAP_FAILED == mem) {
+    shm_unlink(_name.c_str());
+    return NVCV_ERR_MEMORY;
+  }
+#endif // _WIN32
+
+  _hdr      = new(mem) Header;    // The memory is zero-filled, so only the nonzero fields need to be set
+  _desc     = reinterpret_cast<FrameDesc*>((unsigned char*)mem + descOffset);
+  _mapBytes = totalBytes;
+  _producer = true;
+  _hdr->version     = kVersion;
+  _hdr->numSlots    = numSlots;
+  _hdr->descOffset  = (uint32_t)descOffset;
+  _hdr->slotBytes   = slotBytes;
+  _hdr->dataOffset  = dataOffset;
+  _hdr->frameRate   = frameRate;
+  _hdr->producerPid = ThisPid();
+  _hdr->magic.store(kMagic, std::memory_order_release);
+  return NVCV_SUCCESS;
+}
+
+NvCV_Status ShmFrameRing::open(const char *name, unsigned timeoutMs) {
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+  close();
+  if (!name || !name[0])
+    return NVCV_ERR_PARAMETER;
+  _name = ShmPath(name);
+  for (;;) {
+    void    *mem = nullptr;
+    size_t  bytes = 0;
+
+#ifdef _WIN32
+    _mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, _name.c_str());
+    if (_mapping) {
+      MEMORY_BASIC_INFORMATION info;
+      mem = MapViewOfFile(_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+      if (mem && VirtualQuery(mem, &info, sizeof(info)))
+        bytes = info.RegionSize;
+    }
+#else // !_WIN32
+    int fd = shm_open(_name.c_str(), O_RDWR, 0);
+    if (fd >= 0) {
+      struct stat st;
+      if (0 == fstat(fd, &st) && (size_t)st.st_size >= sizeof(Header)) {   // It may not have been sized yet
+        bytes = (size_t)st.st_size;
+        mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (MAP_FAILED == mem)
+          mem = nullptr;
+      }
+      ::close(fd);
+    }
+#endif // _WIN32
+
+    if (mem) {
+      _hdr      = static_cast<Header*>(mem);
+      _mapBytes = bytes;
+      if (kMagic == _hdr->magic.load(std::memory_order_acquire)) {
+        if (kVersion != _hdr->version || bytes < _hdr->dataOffset + _hdr->numSlots * _hdr->slotBytes) {
+          unmap();
+          return NVCV_ERR_MISMATCH;
+        }
+        _desc     = reinterpret_cast<FrameDesc*>((unsigned char*)mem + _hdr->descOffset);
+        _producer = false;
+        _hdr->consumerPid.store(ThisPid());
+        return NVCV_SUCCESS;
+      }
+    }
+    unmap();    // Not yet ready; try again
+    if (std::chrono::steady_clock::now() - t0 > std::chrono::milliseconds(timeoutMs))
+      return NVCV_ERR_FILE;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
+double ShmFrameRing::frameRate() const {
+  return _hdr ? _hdr->frameRate : 0.;
+}
+
+unsigned char* ShmFrameRing::slotPixels(uint32_t index) const {
+  return (unsigned char*)_hdr + _hdr->dataOffset + (index % _hdr->numSlots) * _hdr->slotBytes;
+}
+
+bool ShmFrameRing::peerAlive() const {
+#ifdef _WIN32
+  return true;    // A peer that goes away without closing will not be noticed
+#else // !_WIN32
+  int64_t pid = _producer ? _hdr->consumerPid.load() : _hdr->producerPid;
+  if (!pid)       // The consumer has not yet attached
+    return true;
+  return 0 == kill((pid_t)pid, 0) || EPERM == errno;
+#endif // _WIN32
+}
+
+bool ShmFrameRing::waitFor(std::atomic<uint32_t> *word, uint32_t seen) {
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  uint32_t  goneFlag = _producer ? kConsumerGone : kProducerDone;
+  bool      alive = true;
+
+  ++_stats.waits;
+  while (word->load(std::memory_order_acquire) == seen && !(_hdr->flags.load() & goneFlag)) {
+    WaitChange(word, seen, kPollMs);
+    if (!(alive = peerAlive()))
+      break;
+  }
+  _stats.waitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  return alive;
+}
+
+NvCV_Status ShmFrameRing::acquireWrite(unsigned width, unsigned height, NvCVImage_PixelFormat format,
+                                       NvCVImage_ComponentType type, unsigned layout, unsigned char colorspace,
+                                       NvCVImage *slot) {
+  NvCV_Status vfxErr;
+  int         pitch;
+  size_t      bytes;
+  uint32_t    n;
+
+  if (!_hdr || !_producer)
+    return NVCV_ERR_INITIALIZATION;
+  if (!(bytes = PackedFrameBytes(width, height, format, type, layout, &pitch)))
+    return NVCV_ERR_PIXELFORMAT;
+  if (bytes > _hdr->slotBytes)
+    return NVCV_ERR_TOOBIG;
+
+  n = _hdr->written.load(std::memory_order_relaxed);   // Only we change it
+  for (;;) {
+    if (_hdr->flags.load() & kConsumerGone)
+      return NVCV_ERR_WRITE;
+    uint32_t released = _hdr->released.load(std::memory_order_acquire);
+    if (n - released < _hdr->numSlots)
+      break;
+    if (!waitFor(&_hdr->released, released))
+      return NVCV_ERR_WRITE;
+  }
+
+  FrameDesc *desc = &_desc[n % _hdr->numSlots];
+  memset(desc, 0, sizeof(*desc));
+  desc->width         = width;
+  desc->height        = height;
+  desc->pitch         = pitch;
+  desc->pixelFormat   = (uint32_t)format;
+  desc->componentType = (uint32_t)type;
+  desc->planar        = (uint8_t)layout;
+  desc->colorspace    = colorspace;
+  desc->frameNum      = _stats.frames;
+  vfxErr = NvCVImage_Init(slot, width, height, pitch, slotPixels(n), format, type, layout, NVCV_CPU);
+  if (NVCV_SUCCESS != vfxErr)
+    return vfxErr;
+  slot->colorspace = colorspace;
+  _holding = true;
+  _index   = n;
+  return NVCV_SUCCESS;
+}
+
+NvCV_Status ShmFrameRing::commitWrite() {
+  if (!_hdr || !_producer || !_holding)
+    return NVCV_ERR_INITIALIZATION;
+  _hdr->written.store(_index + 1, std::memory_order_release);
+  WakeAll(&_hdr->written);
+  _holding = false;
+  ++_stats.frames;
+  return NVCV_SUCCESS;
+}
+
+NvCV_Status ShmFrameRing::write(const NvCVImage *src) {
+  NvCV_Status vfxErr;
+  NvCVImage   slot;
+
+  vfxErr = acquireWrite(src->width, src->height, src->pixelFormat, src->componentType, src->planar, src->colorspace,
+                        &slot);
+  if (NVCV_SUCCESS != vfxErr)
+    return vfxErr;
+  vfxErr = NvCVImage_Transfer(src, &slot, 1.f, 0, nullptr);
+  if (NVCV_SUCCESS != vfxErr)
+    return vfxErr;    // The slot is left held, and is reused by the next acquireWrite()
+  return commitWrite();
+}
+
+NvCV_Status ShmFrameRing::acquireRead(NvCVImage *frame, unsigned long long *frameNum) {
+  NvCV_Status vfxErr;
+  uint32_t    n;
+
+  if (!_hdr || _producer)
+    return NVCV_ERR_INITIALIZATION;
+  n = _hdr->released.load(std::memory_order_relaxed);  // Only we change it
+  for (;;) {
+    uint32_t flags   = _hdr->flags.load();              // Before written, so that no frame is missed at the end
+    uint32_t written = _hdr->written.load(std::memory_order_acquire);
+    if (written != n)
+      break;
+    if ((flags & kProducerDone) || !waitFor(&_hdr->written, written))
+      return NVCV_ERR_READ;
+  }
+
+  const FrameDesc *desc = &_desc[n % _hdr->numSlots];
+  vfxErr = NvCVImage_Init(frame, desc->width, desc->height, desc->pitch, slotPixels(n),
+                          (NvCVImage_PixelFormat)desc->pixelFormat, (NvCVImage_ComponentType)desc->componentType,
+                          desc->planar, NVCV_CPU);
+  if (NVCV_SUCCESS != vfxErr)
+    return vfxErr;
+  frame->colorspace = desc->colorspace;
+  if (frameNum)
+    *frameNum = desc->frameNum;
+  if (!_holding)
+    ++_stats.frames;
+  _holding = true;
+  _index   = n;
+  return NVCV_SUCCESS;
+}
+
+void ShmFrameRing::releaseRead() {
+  if (!_hdr || _producer || !_holding)
+    return;
+  _hdr->released.store(_index + 1, std::memory_order_release);
+  WakeAll(&_hdr->released);
+  _holding = false;
+}
+
+void ShmFrameRing::unmap() {
+  if (_hdr) {
+#ifdef _WIN32
+    UnmapViewOfFile(_hdr);
+#else // !_WIN32
+    munmap(_hdr, _mapBytes);
+#endif // _WIN32
+  }
+#ifdef _WIN32
+  if (_mapping)
+    CloseHandle(_mapping);
+  _mapping = nullptr;
+#endif // _WIN32
+  _hdr      = nullptr;
+  _desc     = nullptr;
+  _mapBytes = 0;
+}
+
+void ShmFrameRing::close() {
+  if (!_hdr)
+    return;
+  if (_producer) {
+    _hdr->flags.fetch_or(kProducerDone);
+    WakeAll(&_hdr->written);
+    for (;;) {    // Keep the name until every frame has been read, since a consumer that has yet to attach needs it
+      uint32_t released = _hdr->released.load(std::memory_order_acquire);
+      if (released == _hdr->written.load(std::memory_order_relaxed) || (_hdr->flags.load() & kConsumerGone) ||
+          !waitFor(&_hdr->released, released))
+        break;
+    }
+#ifndef _WIN32
+    shm_unlink(_name.c_str());
+#endif // _WIN32
+  } else {
+    releaseRead();
+    _hdr->flags.fetch_or(kConsumerGone);
+    WakeAll(&_hdr->released);
+  }
+  _holding = false;
+  unmap();
+}
+
+void ShmFrameRing::printStats(FILE *fp) {
+  fprintf(fp, "Shared-memory ring \"%s\": %llu frames %s, %llu waits for the ring to %s, %.1f ms in all\n",
+          _name.c_str(), _stats.frames, (_producer ? "written" : "read"), _stats.waits,
+          (_producer ? "drain" : "fill"), _stats.waitMs);
+}
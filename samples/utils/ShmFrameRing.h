@@ -0,0 +1,151 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __SHM_FRAME_RING_H__
+#define __SHM_FRAME_RING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <string>
+
+#include "nvCVImage.h"
+
+//! A ring of video frames in named shared memory, passed from one producer process to one consumer process.
+//! The producer writes each frame straight into a slot of the ring, and the consumer reads it in place, so a frame
+//! crosses the process boundary without being copied. Each slot has a descriptor with the geometry and format of its
+//! frame, so any NvCVImage layout can be passed, including planar RGB and the YUV layouts, as long as it fits in a slot.
+//! The number of frames written and the number released are counters in the shared header; on Linux, a process
+//! waits for the other one with a futex on those counters. The slots are page-aligned.
+//! On Windows, the ring is a named file mapping, and a process polls for the other one.
+class ShmFrameRing {
+public:
+  //! The description of the frame in a slot, kept in shared memory.
+  struct FrameDesc {
+    uint32_t  width;
+    uint32_t  height;
+    int32_t   pitch;
+    uint32_t  pixelFormat;      //!< NvCVImage_PixelFormat
+    uint32_t  componentType;    //!< NvCVImage_ComponentType
+    uint8_t   planar;           //!< The layout, e.g. NVCV_CHUNKY, NVCV_PLANAR or NVCV_NV12.
+    uint8_t   colorspace;       //!< An OR of the NVCV_601 ... NVCV_CHROMA_* flags, for YUV.
+    uint8_t   reserved[6];
+    uint64_t  frameNum;         //!< The sequence number of the frame, from 0.
+  };
+
+  struct Stats {
+    unsigned long long  frames;   //!< The number of frames written or read.
+    unsigned long long  waits;    //!< The number of times that the ring was full (producer) or empty (consumer).
+    double              waitMs;   //!< The total time spent waiting.
+  };
+
+  ShmFrameRing();
+  ~ShmFrameRing() { close(); }
+
+  //! Create the ring, as the producer. Any stale ring of the same name is replaced.
+  //! \param[in]  name      the name of the ring, such as "vfx0".
+  //! \param[in]  numSlots  the number of frames that can be in flight.
+  //! \param[in]  slotBytes the size of the largest frame that will be written, from PackedFrameBytes().
+  //! \param[in]  frameRate the frame rate of the stream, which is passed on to the consumer.
+  //! \return     NVCV_SUCCESS, NVCV_ERR_PARAMETER, or NVCV_ERR_MEMORY if the shared memory could not be created.
+  NvCV_Status create(const char *name, unsigned numSlots, size_t slotBytes, double frameRate);
+
+  //! Attach to a ring, as the consumer, waiting for the producer to create it.
+  //! \param[in]  name      the name of the ring.
+  //! \param[in]  timeoutMs the longest time to wait for the ring to appear.
+  //! \return     NVCV_SUCCESS, NVCV_ERR_FILE if it did not appear in time, or NVCV_ERR_MISMATCH if it is not a ring.
+  NvCV_Status open(const char *name, unsigned timeoutMs);
+
+  //! Query whether the ring has been created or opened.
+  bool isOpen() const { return nullptr != _hdr; }
+
+  //! Get the frame rate that the producer gave to create().
+  double frameRate() const;
+
+  //! Get the next free slot, as the producer, waiting for the consumer to release one if the ring is full.
+  //! The frame is to be written directly into the slot, and then published with commitWrite().
+  //! \param[in]  width       the width of the frame.
+  //! \param[in]  height      the height of the frame.
+  //! \param[in]  format      the pixel format.
+  //! \param[in]  type        the component type.
+  //! \param[in]  layout      the layout, e.g. NVCV_CHUNKY, NVCV_PLANAR or NVCV_NV12.
+  //! \param[in]  colorspace  the colorspace of YUV, or 0.
+  //! \param[out] slot        an image that wraps the slot memory. It should not own a buffer of its own.
+  //! \return     NVCV_SUCCESS, NVCV_ERR_TOOBIG if the frame does not fit in a slot, or NVCV_ERR_WRITE if the consumer
+  //!             has gone away.
+  NvCV_Status acquireWrite(unsigned width, unsigned height, NvCVImage_PixelFormat format, NvCVImage_ComponentType type,
+                           unsigned layout, unsigned char colorspace, NvCVImage *slot);
+
+  //! Publish the frame in the slot from acquireWrite() to the consumer.
+  NvCV_Status commitWrite();
+
+  //! Copy a frame into the next free slot, and publish it. This is for frames that have to stay in the caller's buffer.
+  //! \param[in]  src the frame, on the CPU.
+  //! \return     the same as acquireWrite().
+  NvCV_Status write(const NvCVImage *src);
+
+  //! Get the oldest unreleased frame, as the consumer, waiting for the producer if the ring is empty.
+  //! The frame stays valid until releaseRead(); until then, this returns the same frame again.
+  //! \param[out] frame     an image that wraps the frame in place. It should not own a buffer of its own.
+  //! \param[out] frameNum  the sequence number of the frame; may be NULL.
+  //! \return     NVCV_SUCCESS, or NVCV_ERR_READ at the end of the stream, or if the producer has gone away.
+  NvCV_Status acquireRead(NvCVImage *frame, unsigned long long *frameNum = nullptr);
+
+  //! Give the slot of the frame from acquireRead() back to the producer.
+  void releaseRead();
+
+  //! Detach from the ring. The producer marks the end of the stream, waits for the consumer to release every frame,
+  //! and removes the name; the consumer tells the producer that no more frames will be read.
+  //! This is called by the destructor.
+  void close();
+
+  //! Get the statistics of this side of the ring.
+  Stats stats() const { return _stats; }
+
+  //! Print the statistics of this side of the ring.
+  void printStats(FILE *fp);
+
+private:
+  struct Header;
+
+  bool waitFor(std::atomic<uint32_t> *word, uint32_t seen);
+  bool peerAlive() const;
+  void unmap();
+  unsigned char* slotPixels(uint32_t index) const;
+
+  Header        *_hdr;
+  FrameDesc     *_desc;
+  size_t        _mapBytes;
+  bool          _producer;
+  bool          _holding;   // The consumer has acquired a frame, or the producer a slot, that has not been passed on
+  uint32_t      _index;     // The counter value of the frame or slot being held
+  std::string   _name;
+  Stats         _stats;
+#ifdef _WIN32
+  void          *_mapping;
+#endif // _WIN32
+};
+
+#endif // __SHM_FRAME_RING_H__
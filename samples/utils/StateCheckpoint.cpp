@@ -0,0 +1,97 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <stdio.h>
+
+#include <string>
+
+#include "StateCheckpoint.h"
+
+
+// The file is a fixed header of little-endian 32-bit words, followed by the state bytes:
+//   magic, format version, SDK version, width, height, frames (low, high), state size
+static const unsigned kMagic = 0x4B435356;    // "VSCK"
+static const unsigned kFormatVersion = 1;
+enum { kMagicWord, kFormatWord, kSdkWord, kWidthWord, kHeightWord, kFramesLoWord, kFramesHiWord, kSizeWord, kHeaderWords };
+
+
+static void PutU32(unsigned char *p, unsigned x) {
+  p[0] = (unsigned char)x;  p[1] = (unsigned char)(x >> 8);  p[2] = (unsigned char)(x >> 16);  p[3] = (unsigned char)(x >> 24);
+}
+
+static unsigned GetU32(const unsigned char *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24);
+}
+
+
+NvCV_Status WriteStateCheckpoint(const char *path, const StateCheckpoint& ckpt) {
+  unsigned char header[kHeaderWords * 4];
+  std::string   tmpPath = std::string(path) + ".tmp";
+  FILE          *fp;
+  bool          ok;
+
+  PutU32(header + 4 * kMagicWord,    kMagic);
+  PutU32(header + 4 * kFormatWord,   kFormatVersion);
+  PutU32(header + 4 * kSdkWord,      ckpt.sdkVersion);
+  PutU32(header + 4 * kWidthWord,    ckpt.width);
+  PutU32(header + 4 * kHeightWord,   ckpt.height);
+  PutU32(header + 4 * kFramesLoWord, (unsigned)ckpt.frames);
+  PutU32(header + 4 * kFramesHiWord, (unsigned)(ckpt.frames >> 32));
+  PutU32(header + 4 * kSizeWord,     (unsigned)ckpt.state.size());
+  if (nullptr == (fp = fopen(tmpPath.c_str(), "wb")))
+    return NVCV_ERR_WRITE;
+  ok = (1 == fwrite(header, sizeof(header), 1, fp)) &&
+       (ckpt.state.empty() || 1 == fwrite(ckpt.state.data(), ckpt.state.size(), 1, fp));
+  ok = (0 == fclose(fp)) && ok;
+  remove(path);   // rename() does not replace an existing file on Windows
+  if (!ok || 0 != rename(tmpPath.c_str(), path)) {
+    remove(tmpPath.c_str());
+    return NVCV_ERR_WRITE;
+  }
+  return NVCV_SUCCESS;
+}
+
+
+NvCV_Status ReadStateCheckpoint(const char *path, StateCheckpoint *ckpt) {
+  unsigned char header[kHeaderWords * 4];
+  NvCV_Status   err = NVCV_SUCCESS;
+  FILE          *fp;
+
+  if (nullptr == (fp = fopen(path, "rb")))
+    return NVCV_ERR_READ;
+  if (1 != fread(header, sizeof(header), 1, fp)) {
+    err = NVCV_ERR_READ;
+  } else if (GetU32(header + 4 * kMagicWord) != kMagic || GetU32(header + 4 * kFormatWord) != kFormatVersion) {
+    err = NVCV_ERR_MISMATCH;
+  } else {
+    ckpt->sdkVersion = GetU32(header + 4 * kSdkWord);
+    ckpt->width      = GetU32(header + 4 * kWidthWord);
+    ckpt->height     = GetU32(header + 4 * kHeightWord);
+    ckpt->frames     = GetU32(header + 4 * kFramesLoWord) | ((unsigned long long)GetU32(header + 4 * kFramesHiWord) << 32);
+    ckpt->state.resize(GetU32(header + 4 * kSizeWord));
+    if (!ckpt->state.empty() && 1 != fread(ckpt->state.data(), ckpt->state.size(), 1, fp))
+      err = NVCV_ERR_READ;
+  }
+  fclose(fp);
+  return err;
+}
@@ -0,0 +1,51 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __STATE_CHECKPOINT_H__
+#define __STATE_CHECKPOINT_H__
+
+#include <vector>
+
+#include "nvCVStatus.h"
+
+//! A snapshot of the state of one stream of a stateful effect, with the position in the stream that it corresponds to,
+//! so that a long transcode can be resumed without re-warming the temporal state.
+//! The state is only valid for the same SDK version and the same effect resolution; readers should check both.
+struct StateCheckpoint {
+  unsigned                    sdkVersion;   //!< From NvVFX_GetVersion().
+  unsigned                    width;        //!< The width of the effect instance that the state came from.
+  unsigned                    height;       //!< The height of the effect instance that the state came from.
+  unsigned long long          frames;       //!< The number of frames of the stream that had been run.
+  std::vector<unsigned char>  state;        //!< The NVVFX_STATE_SIZE bytes of the state.
+};
+
+//! Write a checkpoint file. The file is written under a temporary name and then renamed,
+//! so that a crash while writing leaves the previous checkpoint intact.
+//! \return NVCV_SUCCESS, or NVCV_ERR_WRITE.
+NvCV_Status WriteStateCheckpoint(const char *path, const StateCheckpoint& ckpt);
+
+//! Read a checkpoint file.
+//! \return NVCV_SUCCESS, NVCV_ERR_READ if it cannot be read, or NVCV_ERR_MISMATCH if it is not a checkpoint file.
+NvCV_Status ReadStateCheckpoint(const char *path, StateCheckpoint *ckpt);
+
+#endif // __STATE_CHECKPOINT_H__
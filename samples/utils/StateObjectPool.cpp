@@ -0,0 +1,196 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <algorithm>
+
+#include <cuda_runtime_api.h>
+#include "StateObjectPool.h"
+
+
+static const size_t kSlabAlignment = 256;   // The alignment that cudaMalloc() guarantees
+
+
+StateObjectPool::StateObjectPool() : _eff(nullptr), _stream(0), _arena(nullptr), _stateBytes(0) {
+  destroy();
+}
+
+StateObjectPool::~StateObjectPool() {
+  destroy();
+}
+
+
+/********************************************************************************
+ * StateObjectPool::destroy
+ ********************************************************************************/
+
+void StateObjectPool::destroy() {
+  if (_arena) {
+    cudaFree(_arena);
+    _arena = nullptr;
+  } else {
+    // If DeallocateState fails, all memory allocated in the SDK returns to the heap when the effect handle is destroyed.
+    for (void *state : _states)
+      NvVFX_DeallocateState(_eff, (NvVFX_StateObjectHandle)state);
+  }
+  _states.clear();
+  _free.clear();
+  _inUse.clear();
+  _stats.capacity = _stats.inUse = _stats.peakInUse = 0;
+  _stats.acquired = _stats.recycled = _stats.exhausted = 0;
+  _stats.arenaBytes = 0;
+}
+
+
+/********************************************************************************
+ * StateObjectPool::initHandles, initSlabs
+ ********************************************************************************/
+
+NvCV_Status StateObjectPool::initHandles(NvVFX_Handle eff, unsigned capacity) {
+  NvCV_Status err = NVCV_SUCCESS;
+  destroy();
+  _eff = eff;
+  for (unsigned i = 0; i < capacity; ++i) {
+    NvVFX_StateObjectHandle state;
+    if (NVCV_SUCCESS != (err = NvVFX_AllocateState(_eff, &state))) {
+      destroy();
+      return err;
+    }
+    _states.push_back(state);
+  }
+  _inUse.assign(capacity, false);
+  for (unsigned i = capacity; i--;)
+    _free.push_back(i);
+  _stats.capacity = capacity;
+  return err;
+}
+
+NvCV_Status StateObjectPool::initSlabs(NvVFX_Handle eff, unsigned capacity, CUstream stream) {
+  NvCV_Status err;
+  size_t      stride;
+  destroy();
+  _eff    = eff;
+  _stream = stream;
+  if (NVCV_SUCCESS != (err = NvVFX_GetU32(_eff, NVVFX_STATE_SIZE, &_stateBytes)))
+    return err;
+  stride = (_stateBytes + kSlabAlignment - 1) / kSlabAlignment * kSlabAlignment;
+  if (cudaSuccess != cudaMalloc(&_arena, stride * capacity)) {
+    _arena = nullptr;
+    return NVCV_ERR_MEMORY;
+  }
+  if (cudaSuccess != cudaMemsetAsync(_arena, 0, stride * capacity, (cudaStream_t)_stream)) {
+    destroy();
+    return NVCV_ERR_CUDA;
+  }
+  for (unsigned i = 0; i < capacity; ++i)
+    _states.push_back((char*)_arena + i * stride);
+  _inUse.assign(capacity, false);
+  for (unsigned i = capacity; i--;)
+    _free.push_back(i);
+  _stats.capacity   = capacity;
+  _stats.arenaBytes = stride * capacity;
+  return NVCV_SUCCESS;
+}
+
+
+/********************************************************************************
+ * StateObjectPool::acquire, recycle
+ ********************************************************************************/
+
+NvCV_Status StateObjectPool::acquire(void **state) {
+  if (_free.empty()) {
+    ++_stats.exhausted;
+    *state = nullptr;
+    return NVCV_ERR_MEMORY;
+  }
+  unsigned i = _free.back();
+  _free.pop_back();
+  _inUse[i] = true;
+  *state = _states[i];
+  ++_stats.acquired;
+  if (++_stats.inUse > _stats.peakInUse)
+    _stats.peakInUse = _stats.inUse;
+  return NVCV_SUCCESS;
+}
+
+NvCV_Status StateObjectPool::reset(void *state) {
+  if (_arena)   // The clear is ordered before any subsequent Run on the same stream
+    return (cudaSuccess == cudaMemsetAsync(state, 0, _stateBytes, (cudaStream_t)_stream)) ? NVCV_SUCCESS : NVCV_ERR_CUDA;
+  return NvVFX_ResetState(_eff, (NvVFX_StateObjectHandle)state);
+}
+
+int StateObjectPool::inUseIndex(const void *state) const {
+  std::vector<void*>::const_iterator it = std::find(_states.begin(), _states.end(), state);
+  if (it == _states.end() || !_inUse[it - _states.begin()])
+    return -1;
+  return (int)(it - _states.begin());
+}
+
+NvCV_Status StateObjectPool::recycle(void *state) {
+  int i = inUseIndex(state);
+  if (i < 0)
+    return NVCV_ERR_PARAMETER;
+  NvCV_Status err = reset(state);
+  _inUse[i] = false;
+  _free.push_back(i);
+  --_stats.inUse;
+  ++_stats.recycled;
+  return err;
+}
+
+
+/********************************************************************************
+ * StateObjectPool::snapshot, restore
+ ********************************************************************************/
+
+NvCV_Status StateObjectPool::snapshot(const void *state, void *host) const {
+  if (!_arena)
+    return NVCV_ERR_UNIMPLEMENTED;
+  if (inUseIndex(state) < 0)
+    return NVCV_ERR_PARAMETER;
+  return (cudaSuccess == cudaMemcpyAsync(host, state, _stateBytes, cudaMemcpyDeviceToHost, (cudaStream_t)_stream))
+         ? NVCV_SUCCESS : NVCV_ERR_CUDA;
+}
+
+NvCV_Status StateObjectPool::restore(const void *host, size_t bytes, void *state) {
+  if (!_arena)
+    return NVCV_ERR_UNIMPLEMENTED;
+  if (bytes != _stateBytes)
+    return NVCV_ERR_MISMATCH;
+  if (inUseIndex(state) < 0)
+    return NVCV_ERR_PARAMETER;
+  return (cudaSuccess == cudaMemcpyAsync(state, host, _stateBytes, cudaMemcpyHostToDevice, (cudaStream_t)_stream))
+         ? NVCV_SUCCESS : NVCV_ERR_CUDA;
+}
+
+
+/********************************************************************************
+ * StateObjectPool::printStats
+ ********************************************************************************/
+
+void StateObjectPool::printStats(FILE *fp) const {
+  fprintf(fp, "State pool: %u %s", _stats.capacity, (_arena ? "slabs" : "handles"));
+  if (_arena)
+    fprintf(fp, " (%u bytes each, %zu byte arena)", _stateBytes, _stats.arenaBytes);
+  fprintf(fp, ", %u in use, peak %u; %llu acquired, %llu recycled, %llu times exhausted\n",
+    _stats.inUse, _stats.peakInUse, _stats.acquired, _stats.recycled, _stats.exhausted);
+}
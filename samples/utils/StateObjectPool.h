@@ -0,0 +1,131 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __STATE_OBJECT_POOL_H__
+#define __STATE_OBJECT_POOL_H__
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "nvVideoEffects.h"
+
+//! A fixed pool of state objects for a stateful effect, so that streams can come and go without allocator traffic.
+//! All of the states are allocated up front, and a state is reset when it is recycled, rather than deallocated.
+//! Two kinds of state are accommodated:
+//! - handles, from NvVFX_AllocateState(), recycled with NvVFX_ResetState(), for NvVFX_SetStateObjectHandleArray();
+//! - slabs of NVVFX_STATE_SIZE bytes, carved out of a single cudaMalloc() arena and recycled with
+//!   cudaMemsetAsync(), for effects such as denoising whose state is set as an array of raw pointers.
+//! The pool is not thread-safe; it is meant to be used on the thread that runs the effect.
+class StateObjectPool {
+public:
+  struct Stats {
+    unsigned            capacity;     //!< The number of states in the pool.
+    unsigned            inUse;        //!< The number of states currently acquired.
+    unsigned            peakInUse;    //!< The largest number of states acquired at once.
+    unsigned long long  acquired;     //!< The number of successful calls to acquire().
+    unsigned long long  recycled;     //!< The number of states reset and returned to the pool.
+    unsigned long long  exhausted;    //!< The number of calls to acquire() that found no free state.
+    size_t              arenaBytes;   //!< The size of the slab arena, or 0 for handles.
+  };
+
+  StateObjectPool();
+  ~StateObjectPool();
+
+  //! Allocate a pool of state handles. The effect must already be loaded.
+  //! \param[in]  eff       the stateful effect.
+  //! \param[in]  capacity  the number of states, typically NVVFX_MAX_NUMBER_STREAMS.
+  //! \return     NVCV_SUCCESS, or the error from NvVFX_AllocateState().
+  NvCV_Status initHandles(NvVFX_Handle eff, unsigned capacity);
+
+  //! Allocate a pool of state slabs in one contiguous GPU arena. The effect must already be loaded.
+  //! \param[in]  eff       the stateful effect, queried for NVVFX_STATE_SIZE.
+  //! \param[in]  capacity  the number of states.
+  //! \param[in]  stream    the CUDA stream on which the effect runs, used to clear the slabs.
+  //! \return     NVCV_SUCCESS, NVCV_ERR_MEMORY if the arena could not be allocated, or NVCV_ERR_CUDA on other CUDA errors.
+  NvCV_Status initSlabs(NvVFX_Handle eff, unsigned capacity, CUstream stream);
+
+  //! Acquire a freshly reset state.
+  //! \param[out] state the state handle or slab.
+  //! \return     NVCV_SUCCESS, or NVCV_ERR_MEMORY if all of the states are in use.
+  NvCV_Status acquire(void **state);
+  NvCV_Status acquire(NvVFX_StateObjectHandle *state) { return acquire((void**)state); }
+
+  //! Reset a state and return it to the pool, when its stream ends.
+  //! \param[in]  state the state returned by acquire().
+  //! \return     NVCV_SUCCESS, NVCV_ERR_PARAMETER if the state is not in use from this pool,
+  //!             or the error from resetting it; in the latter case the state is still returned to the pool.
+  NvCV_Status recycle(void *state);
+  NvCV_Status recycle(NvVFX_StateObjectHandle state) { return recycle((void*)state); }
+
+  //! Copy a slab to host memory, e.g. to checkpoint its stream, or to move the stream to another effect instance.
+  //! The copy is queued on the effect's stream, so it captures the state left by any Run already queued;
+  //! synchronize the stream before using the copy.
+  //! \param[in]  state the slab, in use from this pool.
+  //! \param[out] host  stateBytes() bytes of host memory, which should be pinned for the copy to be asynchronous.
+  //! \return     NVCV_SUCCESS, NVCV_ERR_UNIMPLEMENTED for handles, whose contents are opaque,
+  //!             NVCV_ERR_PARAMETER if the state is not in use from this pool, or NVCV_ERR_CUDA.
+  NvCV_Status snapshot(const void *state, void *host) const;
+
+  //! Copy a snapshot into a slab, e.g. from another pool of the same effect at the same resolution, or from a
+  //! checkpoint, so that the stream continues without re-warming its temporal state. The copy is queued on the
+  //! effect's stream, before any subsequent Run; the host memory must remain valid until the stream is synchronized.
+  //! \param[in]  host  the snapshot.
+  //! \param[in]  bytes the size of the snapshot, which must match stateBytes().
+  //! \param[in]  state the slab, in use from this pool.
+  //! \return     NVCV_SUCCESS, NVCV_ERR_UNIMPLEMENTED for handles, NVCV_ERR_MISMATCH if the size differs,
+  //!             NVCV_ERR_PARAMETER if the state is not in use from this pool, or NVCV_ERR_CUDA.
+  NvCV_Status restore(const void *host, size_t bytes, void *state);
+
+  //! Free all of the states. This is called by the destructor, but must be called explicitly
+  //! if the effect is destroyed before the pool.
+  void destroy();
+
+  //! Determine whether the pool holds slabs rather than handles.
+  bool slabs() const { return _arena != nullptr; }
+
+  //! The size of each slab in bytes, i.e. of a snapshot, or 0 for handles.
+  unsigned stateBytes() const { return _arena ? _stateBytes : 0; }
+
+  //! Get the occupancy of the pool.
+  Stats stats() const { return _stats; }
+
+  //! Print the occupancy of the pool.
+  void printStats(FILE *fp) const;
+
+private:
+  NvCV_Status reset(void *state);
+  int inUseIndex(const void *state) const;  // -1 if not in use from this pool
+
+  NvVFX_Handle          _eff;
+  CUstream              _stream;
+  void                  *_arena;
+  unsigned              _stateBytes;
+  std::vector<void*>    _states;
+  std::vector<unsigned> _free;    // Indices of the free states; the most recently recycled are reused first
+  std::vector<bool>     _inUse;
+  Stats                 _stats;
+};
+
+#endif // __STATE_OBJECT_POOL_H__
@@ -0,0 +1,180 @@
+/*###############################################################################
+#
+# Copyright (c) 2020 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "TileDiff.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define TILE_DIFF_SSE2 1
+  #include <emmintrin.h>
+#endif // __SSE2__
+
+
+/********************************************************************************
+ * RowSAD
+ ********************************************************************************/
+
+static unsigned long long RowSAD(const unsigned char *a, const unsigned char *b, unsigned n) {
+  unsigned long long sad = 0;
+#ifdef TILE_DIFF_SSE2
+  __m128i acc = _mm_setzero_si128();
+  for (; n >= 16; n -= 16, a += 16, b += 16)  // PSADBW yields two 16-bit sums in the low halves of 64-bit lanes
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)a), _mm_loadu_si128((const __m128i*)b)));
+  sad = (unsigned long long)_mm_cvtsi128_si32(acc) + (unsigned long long)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif // TILE_DIFF_SSE2
+  for (; n--; ++a, ++b)
+    sad += (*a > *b) ? (*a - *b) : (*b - *a);
+  return sad;
+}
+
+
+/********************************************************************************
+ * DirtyTileMap::boundingRect
+ ********************************************************************************/
+
+void DirtyTileMap::boundingRect(unsigned width, unsigned height, NvCVRect2i *rect) const {
+  unsigned c0 = cols, r0 = rows, c1 = 0, r1 = 0;
+  for (unsigned r = 0; r < rows; ++r) {
+    for (unsigned c = 0; c < cols; ++c) {
+      if (!isDirty(c, r)) continue;
+      if (c0 > c)     c0 = c;
+      if (c1 < c + 1) c1 = c + 1;
+      if (r0 > r)     r0 = r;
+      if (r1 < r + 1) r1 = r + 1;
+    }
+  }
+  if (c1 <= c0) {
+    rect->x = rect->y = rect->width = rect->height = 0;
+    return;
+  }
+  unsigned x1 = c1 * tileSize, y1 = r1 * tileSize;
+  if (x1 > width)  x1 = width;
+  if (y1 > height) y1 = height;
+  rect->x      = (int)(c0 * tileSize);
+  rect->y      = (int)(r0 * tileSize);
+  rect->width  = (int)x1 - rect->x;
+  rect->height = (int)y1 - rect->y;
+}
+
+
+/********************************************************************************
+ * CheckTileDiffArgs
+ ********************************************************************************/
+
+static NvCV_Status CheckTileDiffArgs(const NvCVImage *cur, const NvCVImage *ref, unsigned tileSize) {
+  if (NVCV_U8 != cur->componentType || NVCV_CHUNKY != cur->planar)
+    return NVCV_ERR_PIXELFORMAT;
+  if (cur->width != ref->width || cur->height != ref->height || cur->pixelFormat != ref->pixelFormat ||
+      cur->componentType != ref->componentType || cur->planar != ref->planar)
+    return NVCV_ERR_MISMATCH;
+  if (NVCV_GPU == cur->gpuMem || NVCV_CUDA == cur->gpuMem || NVCV_GPU == ref->gpuMem || NVCV_CUDA == ref->gpuMem)
+    return NVCV_ERR_MEMORY;
+  if (!tileSize)
+    return NVCV_ERR_PARAMETER;
+  return NVCV_SUCCESS;
+}
+
+
+/********************************************************************************
+ * ComputeDirtyTiles
+ ********************************************************************************/
+
+NvCV_Status ComputeDirtyTiles(const NvCVImage *cur, const NvCVImage *ref, unsigned tileSize, float threshold,
+  DirtyTileMap *map) {
+  NvCV_Status err = CheckTileDiffArgs(cur, ref, tileSize);
+  if (NVCV_SUCCESS != err)
+    return err;
+
+  map->tileSize = tileSize;
+  map->cols     = (cur->width  + tileSize - 1) / tileSize;
+  map->rows     = (cur->height + tileSize - 1) / tileSize;
+  map->numDirty = 0;
+  map->dirty.assign(map->cols * map->rows, 0);
+
+  const unsigned pixBytes = cur->pixelBytes;
+  std::vector<unsigned long long> sads(map->cols);
+  for (unsigned r = 0; r < map->rows; ++r) {
+    unsigned y0 = r * tileSize, y1 = y0 + tileSize;
+    if (y1 > cur->height) y1 = cur->height;
+    memset(sads.data(), 0, sads.size() * sizeof(sads[0]));
+    for (unsigned y = y0; y < y1; ++y) {  // Walk each scanline once, splitting it among the tiles in this row
+      const unsigned char *a = (const unsigned char*)cur->pixels + (ptrdiff_t)y * cur->pitch;
+      const unsigned char *b = (const unsigned char*)ref->pixels + (ptrdiff_t)y * ref->pitch;
+      for (unsigned c = 0; c < map->cols; ++c) {
+        unsigned x0 = c * tileSize, x1 = x0 + tileSize;
+        if (x1 > cur->width) x1 = cur->width;
+        sads[c] += RowSAD(a + x0 * pixBytes, b + x0 * pixBytes, (x1 - x0) * pixBytes);
+      }
+    }
+    for (unsigned c = 0; c < map->cols; ++c) {
+      unsigned x0 = c * tileSize, x1 = x0 + tileSize;
+      if (x1 > cur->width) x1 = cur->width;
+      double limit = (double)threshold * (x1 - x0) * (y1 - y0) * pixBytes;
+      if ((double)sads[c] > limit) {
+        map->dirty[r * map->cols + c] = 1;
+        ++map->numDirty;
+      }
+    }
+  }
+  return NVCV_SUCCESS;
+}
+
+
+/********************************************************************************
+ * FindDirtyTile
+ ********************************************************************************/
+
+NvCV_Status FindDirtyTile(const NvCVImage *cur, const NvCVImage *ref, unsigned tileSize, float threshold, bool *dirty) {
+  NvCV_Status err = CheckTileDiffArgs(cur, ref, tileSize);
+  if (NVCV_SUCCESS != err)
+    return err;
+
+  const unsigned pixBytes = cur->pixelBytes, cols = (cur->width + tileSize - 1) / tileSize;
+  std::vector<unsigned long long> sads(cols);
+  *dirty = false;
+  for (unsigned y0 = 0; y0 < cur->height && !*dirty; y0 += tileSize) {
+    unsigned y1 = y0 + tileSize;
+    if (y1 > cur->height) y1 = cur->height;
+    memset(sads.data(), 0, sads.size() * sizeof(sads[0]));
+    for (unsigned y = y0; y < y1; ++y) {
+      const unsigned char *a = (const unsigned char*)cur->pixels + (ptrdiff_t)y * cur->pitch;
+      const unsigned char *b = (const unsigned char*)ref->pixels + (ptrdiff_t)y * ref->pitch;
+      for (unsigned c = 0; c < cols; ++c) {
+        unsigned x0 = c * tileSize, x1 = x0 + tileSize;
+        if (x1 > cur->width) x1 = cur->width;
+        sads[c] += RowSAD(a + x0 * pixBytes, b + x0 * pixBytes, (x1 - x0) * pixBytes);
+      }
+    }
+    for (unsigned c = 0; c < cols; ++c) {
+      unsigned x0 = c * tileSize, x1 = x0 + tileSize;
+      if (x1 > cur->width) x1 = cur->width;
+      if ((double)sads[c] > (double)threshold * (x1 - x0) * (y1 - y0) * pixBytes) {
+        *dirty = true;
+        break;
+      }
+    }
+  }
+  return NVCV_SUCCESS;
+}
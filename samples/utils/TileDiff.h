@@ -0,0 +1,84 @@
+/*###############################################################################
+#
+# Copyright (c) 2020 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __TILE_DIFF__
+#define __TILE_DIFF__
+
+#include <vector>
+
+#include "nvCVImage.h"
+
+
+//! A map of the tiles of an image that have changed since a reference image.
+struct DirtyTileMap {
+  unsigned                    tileSize;   //!< The width and height of each tile, in pixels.
+  unsigned                    cols;       //!< The number of tiles across the image.
+  unsigned                    rows;       //!< The number of tiles down the image.
+  unsigned                    numDirty;   //!< The number of dirty tiles.
+  std::vector<unsigned char>  dirty;      //!< rows x cols flags, nonzero for each tile that has changed.
+
+  DirtyTileMap() : tileSize(0), cols(0), rows(0), numDirty(0) {}
+
+  //! Query whether a particular tile is dirty.
+  bool isDirty(unsigned col, unsigned row) const { return 0 != dirty[row * cols + col]; }
+
+  //! Compute the bounding rectangle of all the dirty tiles, in pixels.
+  //! \param[in]  width   the width  of the image, used to clip the last column of tiles.
+  //! \param[in]  height  the height of the image, used to clip the last row    of tiles.
+  //! \param[out] rect    the bounding rectangle; it is empty (width = height = 0) if there are no dirty tiles.
+  void boundingRect(unsigned width, unsigned height, NvCVRect2i *rect) const;
+};
+
+
+//! Compute the dirty tiles between two images, by way of the sum of absolute differences (SAD) over each tile.
+//! A tile is dirty if its SAD exceeds threshold times the number of bytes in the tile.
+//! \param[in]  cur       the current image.
+//! \param[in]  ref       the reference image, typically the last one processed. It must have the same
+//!                       dimensions and format as cur.
+//! \param[in]  tileSize  the tile size, in pixels, e.g. 64.
+//! \param[in]  threshold the mean absolute difference per component, in code values, that a tile must exceed to be
+//!                       considered dirty. 0 marks any change at all.
+//! \param[out] map       the resultant map of dirty tiles.
+//! \return NVCV_SUCCESS          if the operation was successful.
+//! \return NVCV_ERR_PIXELFORMAT  if the images are not chunky 8-bit images.
+//! \return NVCV_ERR_MISMATCH     if the images do not have the same dimensions and format.
+//! \return NVCV_ERR_MEMORY       if the images are not accessible by the CPU.
+//! \return NVCV_ERR_PARAMETER    if the tile size is 0.
+//! \note   The SSE2 PSADBW instruction is used where available, otherwise it falls back to scalar code.
+NvCV_Status ComputeDirtyTiles(const NvCVImage *cur, const NvCVImage *ref, unsigned tileSize, float threshold,
+  DirtyTileMap *map);
+
+
+//! Determine whether any tile has changed between two images, by the same measure as ComputeDirtyTiles().
+//! This stops at the first row of tiles that has a dirty tile, so it is cheaper when the images are expected to match.
+//! \param[in]  cur       the current image.
+//! \param[in]  ref       the reference image, with the same dimensions and format as cur.
+//! \param[in]  tileSize  the tile size, in pixels, e.g. 16.
+//! \param[in]  threshold the mean absolute difference per component, in code values, that a tile must exceed to be
+//!                       considered dirty.
+//! \param[out] dirty     set to true if any tile is dirty.
+//! \return the same codes as ComputeDirtyTiles().
+NvCV_Status FindDirtyTile(const NvCVImage *cur, const NvCVImage *ref, unsigned tileSize, float threshold, bool *dirty);
+
+
+#endif // __TILE_DIFF__
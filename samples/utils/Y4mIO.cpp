@@ -0,0 +1,348 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+  #include <io.h>
+  #define fdopen  _fdopen
+  #define fileno  _fileno
+  #define fstat   _fstat64
+  #define stat    _stat64
+#else // !_WIN32
+  #include <signal.h>
+#endif // _WIN32
+
+#include "Y4mIO.h"
+
+static const char   kFrameTag[]  = "FRAME\n";
+static const size_t kFrameTagLen = sizeof(kFrameTag) - 1;
+static const size_t kStdioBytes  = 1 << 20;   // So that a frame is read or written with a few large calls
+
+
+// Read a header line, without its newline. A line that is longer than the buffer is truncated.
+static bool ReadLine(FILE *fp, char *buf, size_t size) {
+  size_t n = 0;
+  int    c;
+  while (EOF != (c = getc(fp)) && '\n' != c)
+    if (n + 1 < size)
+      buf[n++] = (char)c;
+  buf[n] = 0;
+  return '\n' == c;
+}
+
+// Express a frame rate as the ratio that a Y4M header needs, recognizing the NTSC rates.
+static void FrameRateRatio(double fps, unsigned *num, unsigned *den) {
+  double ntsc = fps * 1.001;
+  if (fps <= 0.) {
+    *num = 30;
+    *den = 1;
+  } else if (fabs(fps - floor(fps + .5)) < 1e-3) {
+    *num = (unsigned)floor(fps + .5);
+    *den = 1;
+  } else if (fabs(ntsc - floor(ntsc + .5)) < 1e-3) {
+    *num = (unsigned)floor(ntsc + .5) * 1000;
+    *den = 1001;
+  } else {
+    *num = (unsigned)floor(fps * 1000. + .5);
+    *den = 1000;
+  }
+}
+
+
+struct Y4mReader::Shared {
+  FILE                                    *fp;
+  bool                                    nv12;       // The 4:2:0 chroma planes are interleaved as they are read
+  unsigned                                width, height;
+  size_t                                  frameBytes;
+  std::vector<std::vector<unsigned char> > bufs;
+  std::vector<unsigned char>              chroma;     // The planar chroma of a frame that is interleaved
+  std::deque<int>                         free, full;
+  unsigned long long                      frames;
+  bool                                    badHeader, partial;
+  bool                                    stop, eof;
+  std::mutex                              mutex;
+  std::condition_variable                 cond;
+
+  ~Shared() { if (fp && stdin != fp) fclose(fp); }
+};
+
+NvCV_Status Y4mReader::open(const char *path, unsigned layout, unsigned char standard, unsigned depth) {
+  char          line[512], *tok, *end;
+  const char    *pixFmt   = "yuv420p";
+  unsigned char siting    = NVCV_CHROMA_JPEG,   // The default, 420jpeg
+                range     = NVCV_VIDEO_RANGE;
+  unsigned      width     = 0,
+                height    = 0;
+  FILE          *fp;
+  NvCV_Status   vfxErr;
+  struct stat   st;
+
+  close();
+  if (!path || !path[0])
+    return NVCV_ERR_PARAMETER;
+  if (!strcmp(path, "-")) {
+    (void)RawFrameReader::StdinFd();    // In binary mode
+    fp = stdin;
+  } else {
+    fp = fopen(path, "rb");
+  }
+  if (!fp)
+    return NVCV_ERR_FILE;
+  _shared = std::make_shared<Shared>();   // From here on, it owns fp
+  _shared->fp = fp;
+  setvbuf(fp, nullptr, _IOFBF, kStdioBytes);
+
+  if (!ReadLine(fp, line, sizeof(line)) || strncmp(line, "YUV4MPEG2", 9) || (line[9] && ' ' != line[9])) {
+    _shared.reset();
+    return NVCV_ERR_PARSE;
+  }
+  _fpsNum = 30;
+  _fpsDen = 1;
+  for (tok = line + 9; *tok; tok = end) {
+    while (' ' == *tok)
+      ++tok;
+    for (end = tok; *end && ' ' != *end; ++end)
+      continue;
+    if (*end)
+      *end++ = 0;
+    switch (*tok) {
+    case 'W': width  = (unsigned)strtoul(tok + 1, nullptr, 10); break;
+    case 'H': height = (unsigned)strtoul(tok + 1, nullptr, 10); break;
+    case 'F': if (2 != sscanf(tok + 1, "%u:%u", &_fpsNum, &_fpsDen) || !_fpsDen) { _fpsNum = 30; _fpsDen = 1; } break;
+    case 'C':
+      if      (!strcmp(tok, "C420jpeg") || !strcmp(tok, "C420"))  { pixFmt = "yuv420p"; siting = NVCV_CHROMA_JPEG;    }
+      else if (!strcmp(tok, "C420mpeg2"))                         { pixFmt = "yuv420p"; siting = NVCV_CHROMA_MPEG2;   }
+      else if (!strcmp(tok, "C420paldv"))                         { pixFmt = "yuv420p"; siting = NVCV_CHROMA_TOPLEFT; }
+      else if (!strcmp(tok, "C444"))                              { pixFmt = "yuv444p"; siting = NVCV_CHROMA_COSITED; }
+      else    { _shared.reset(); return NVCV_ERR_PIXELFORMAT; }   // mono, 4:2:2, or more than 8 bits
+      break;
+    case 'X':
+      if      (!strcmp(tok, "XCOLORRANGE=FULL"))    range = NVCV_FULL_RANGE;
+      else if (!strcmp(tok, "XCOLORRANGE=LIMITED")) range = NVCV_VIDEO_RANGE;
+      break;
+    default:  // Interlacing, aspect ratio and comments do not affect the frames
+      break;
+    }
+  }
+  if (!strcmp(pixFmt, "yuv444p") || NVCV_NV12 != layout) layout = NVCV_I420;    // 4:4:4 has the same planar layout
+  else                                                   pixFmt = "nv12";
+  if (NVCV_SUCCESS != (vfxErr = _fmt.init(pixFmt, width, height, (unsigned char)(standard | range | siting)))) {
+    _shared.reset();
+    return vfxErr;
+  }
+
+  _frameCount = 0;
+  if (0 == fstat(fileno(fp), &st) && (st.st_mode & S_IFMT) == S_IFREG)
+    _frameCount = (long long)(st.st_size - ftell(fp)) / (long long)(_fmt.frameBytes + kFrameTagLen);
+  _frames = _waits = 0;
+  _held   = -1;
+  _shared->nv12       = (NVCV_NV12 == layout);
+  _shared->width      = width;
+  _shared->height     = height;
+  _shared->frameBytes = _fmt.frameBytes;
+  _shared->frames     = 0;
+  _shared->badHeader  = false;
+  _shared->partial    = false;
+  _shared->stop       = false;
+  _shared->eof        = false;
+  if (_shared->nv12)
+    _shared->chroma.resize(_fmt.frameBytes - (size_t)width * height);
+  _shared->bufs.resize(depth + 1);      // One more than is read ahead, for the frame that the caller holds
+  for (unsigned i = 0; i < depth + 1; ++i) {
+    _shared->bufs[i].resize(_fmt.frameBytes);
+    _shared->free.push_back((int)i);
+  }
+  std::thread(ReadLoop, _shared).detach();
+  return NVCV_SUCCESS;
+}
+
+void Y4mReader::ReadLoop(std::shared_ptr<Shared> s) {
+  char line[256];
+  for (;;) {
+    int  index;
+    bool ok;
+    {
+      std::unique_lock<std::mutex> lock(s->mutex);
+      s->cond.wait(lock, [&s] { return s->stop || !s->free.empty(); });
+      if (s->stop)
+        break;
+      index = s->free.front();
+      s->free.pop_front();
+    }
+    unsigned char *buf = s->bufs[index].data();
+    ok = ReadLine(s->fp, line, sizeof(line));   // Frame parameters, if any, are ignored
+    if (ok && strncmp(line, "FRAME", 5)) {
+      s->badHeader = true;
+      ok = false;
+    } else if (ok && s->nv12) {
+      size_t lumaBytes = (size_t)s->width * s->height, planeBytes = s->chroma.size() / 2;
+      ok = lumaBytes == fread(buf, 1, lumaBytes, s->fp) && s->chroma.size() == fread(s->chroma.data(), 1,
+                                                                                      s->chroma.size(), s->fp);
+      const unsigned char *u = s->chroma.data(), *v = u + planeBytes;
+      unsigned char *uv = buf + lumaBytes;
+      for (size_t i = 0; ok && i < planeBytes; ++i, uv += 2) {
+        uv[0] = u[i];
+        uv[1] = v[i];
+      }
+      s->partial = !ok;
+    } else if (ok) {
+      ok = s->frameBytes == fread(buf, 1, s->frameBytes, s->fp);
+      s->partial = !ok;
+    }
+    std::lock_guard<std::mutex> lock(s->mutex);
+    if (ok) {
+      s->full.push_back(index);
+      ++s->frames;
+    } else {
+      s->eof = true;
+    }
+    s->cond.notify_all();
+    if (s->eof || s->stop)
+      break;
+  }
+}
+
+NvCV_Status Y4mReader::read(NvCVImage *frame) {
+  if (!_shared)
+    return NVCV_ERR_INITIALIZATION;
+  std::unique_lock<std::mutex> lock(_shared->mutex);
+  if (_held >= 0) {
+    _shared->free.push_back(_held);
+    _held = -1;
+    _shared->cond.notify_all();
+  }
+  if (_shared->full.empty() && !_shared->eof)
+    ++_waits;
+  _shared->cond.wait(lock, [this] { return !_shared->full.empty() || _shared->eof; });
+  if (_shared->full.empty()) {
+    if (_shared->badHeader)
+      printf("Y4M frame %llu does not start with FRAME, and the rest of the stream was ignored\n", _shared->frames);
+    else if (_shared->partial)
+      printf("The last frame of the Y4M input is incomplete, and was ignored\n");
+    _shared->badHeader = _shared->partial = false;
+    return NVCV_ERR_READ;
+  }
+  _held = _shared->full.front();
+  _shared->full.pop_front();
+  ++_frames;
+  return _fmt.wrap(_shared->bufs[_held].data(), frame);
+}
+
+void Y4mReader::close() {
+  if (!_shared)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(_shared->mutex);
+    _shared->stop = true;
+  }
+  _shared->cond.notify_all();
+  _shared.reset();
+}
+
+void Y4mReader::printStats(FILE *fp) {
+  fprintf(fp, "Y4M frames read: %llu, of which %llu had not yet arrived when they were needed\n", _frames, _waits);
+}
+
+
+NvCV_Status Y4mWriter::open(const char *path, unsigned width, unsigned height, double frameRate,
+                            NvCVImage_PixelFormat format, unsigned char colorspace) {
+  const char  *chroma;
+  unsigned    fpsNum, fpsDen;
+  int         fd;
+  NvCV_Status vfxErr;
+
+  close();
+  if (!path || !path[0])
+    return NVCV_ERR_PARAMETER;
+  if      (NVCV_YUV444 == format)                       chroma = "444";
+  else if (NVCV_YUV420 != format)                       return NVCV_ERR_PIXELFORMAT;
+  else if (colorspace & NVCV_CHROMA_TOPLEFT)            chroma = "420paldv";
+  else if (colorspace & NVCV_CHROMA_INTSTITIAL)         chroma = "420jpeg";
+  else                                                  chroma = "420mpeg2";
+  if (NVCV_SUCCESS != (vfxErr = _fmt.init((NVCV_YUV420 == format ? "yuv420p" : "yuv444p"), width, height, colorspace)))
+    return vfxErr;
+  _buf.resize(_fmt.frameBytes);
+  if (NVCV_SUCCESS != (vfxErr = _fmt.wrap(_buf.data(), &_frame)))
+    return vfxErr;
+  FrameRateRatio(frameRate, &fpsNum, &fpsDen);
+
+  if (!strcmp(path, "-")) {
+    if ((fd = RawFrameWriter::DetachStdout()) < 0)
+      return NVCV_ERR_WRITE;
+    _fp = fdopen(fd, "wb");
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);   // If the reader goes away, fail the write rather than the process
+#endif // _WIN32
+  } else {
+    _fp = fopen(path, "wb");
+  }
+  if (!_fp)
+    return NVCV_ERR_WRITE;
+  setvbuf(_fp, nullptr, _IOFBF, kStdioBytes);
+  fprintf(_fp, "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C%s XCOLORRANGE=%s\n", width, height, fpsNum, fpsDen, chroma,
+          ((colorspace & NVCV_FULL_RANGE) ? "FULL" : "LIMITED"));
+  _frames = 0;
+  return NVCV_SUCCESS;
+}
+
+NvCV_Status Y4mWriter::write(const NvCVImage *src) {
+  NvCV_Status vfxErr;
+  const void  *pixels = _buf.data();
+
+  if (!_fp)
+    return NVCV_ERR_INITIALIZATION;
+  if (src->width != _fmt.width || src->height != _fmt.height)
+    return NVCV_ERR_MISMATCH;
+  if (src->pixelFormat == _fmt.format && NVCV_U8 == src->componentType && src->planar == _fmt.layout &&
+      src->colorspace == _fmt.colorspace && src->pitch == _fmt.pitch &&
+      (NVCV_CPU == src->gpuMem || NVCV_CPU_PINNED == src->gpuMem)) {
+    pixels = src->pixels;             // Already in the output format; write it as it is
+  } else if (NVCV_SUCCESS != (vfxErr = NvCVImage_Transfer(src, &_frame, 1.f, 0, nullptr))) {
+    return vfxErr;
+  }
+  if (kFrameTagLen != fwrite(kFrameTag, 1, kFrameTagLen, _fp) ||
+      _fmt.frameBytes != fwrite(pixels, 1, _fmt.frameBytes, _fp))
+    return NVCV_ERR_WRITE;
+  ++_frames;
+  return NVCV_SUCCESS;
+}
+
+NvCV_Status Y4mWriter::close() {
+  bool ok;
+  if (!_fp)
+    return NVCV_SUCCESS;
+  ok = (0 == fflush(_fp)) && !ferror(_fp);
+  ok = (0 == fclose(_fp)) && ok;
+  _fp = nullptr;
+  return ok ? NVCV_SUCCESS : NVCV_ERR_WRITE;
+}
@@ -0,0 +1,133 @@
+/*###############################################################################
+#
+# Copyright (c) 2022 NVIDIA Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+# the Software, and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+###############################################################################*/
+
+#ifndef __Y4M_IO_H__
+#define __Y4M_IO_H__
+
+#include <stdio.h>
+
+#include <memory>
+#include <vector>
+
+#include "RawFrameIO.h"
+
+//! Read a YUV4MPEG2 (.y4m) stream, without a decoder.
+//! 8-bit 4:2:0 and 4:4:4 streams are accommodated, and frames are delivered as I420, NV12 or I444 images whose
+//! colorspace is set from the stream's chroma siting and XCOLORRANGE tag. Y4M does not record the YUV matrix, so
+//! that is supplied by the caller. Frames are read into a ring of reusable buffers by a thread that keeps reading
+//! ahead of the caller.
+class Y4mReader {
+public:
+  Y4mReader() : _fpsNum(0), _fpsDen(1), _frameCount(0), _frames(0), _waits(0), _held(-1) {}
+  ~Y4mReader() { close(); }
+
+  //! Open a stream and start reading frames.
+  //! \param[in]  path      the file to read, or "-" for stdin.
+  //! \param[in]  layout    NVCV_I420 or NVCV_NV12, for a 4:2:0 stream; a 4:4:4 stream is always delivered as I444.
+  //! \param[in]  standard  NVCV_601, NVCV_709 or NVCV_2020.
+  //! \param[in]  depth     the number of frames that can be read ahead.
+  //! \return     NVCV_SUCCESS, NVCV_ERR_FILE if the file cannot be opened, NVCV_ERR_PARSE if it is not YUV4MPEG2, or
+  //!             NVCV_ERR_PIXELFORMAT if its chroma subsampling or bit depth is not accommodated.
+  NvCV_Status open(const char *path, unsigned layout = NVCV_I420, unsigned char standard = NVCV_709,
+                   unsigned depth = 3);
+
+  //! Query whether frames are being read.
+  bool isOpen() const { return (bool)_shared; }
+
+  //! Get the format of the frames.
+  const RawFrameFormat& format() const { return _fmt; }
+
+  //! Get the frame rate.
+  double frameRate() const { return _fpsDen ? (double)_fpsNum / _fpsDen : 0.; }
+
+  //! Get the number of frames in the file, assuming that no frame header carries parameters; 0 for a pipe.
+  long long frameCount() const { return _frameCount; }
+
+  //! Get the next frame, waiting for it to be read if necessary.
+  //! \param[out] frame an image that wraps the frame, which is valid until the next call. It should not own a buffer.
+  //! \return     NVCV_SUCCESS, or NVCV_ERR_READ at the end of the stream.
+  NvCV_Status read(NvCVImage *frame);
+
+  //! Stop reading. A read that is blocked on a pipe is abandoned to its thread, which exits once it returns.
+  //! This is called by the destructor.
+  void close();
+
+  //! Print the number of frames read, and how often the caller had to wait for one.
+  void printStats(FILE *fp);
+
+private:
+  struct Shared;
+  static void ReadLoop(std::shared_ptr<Shared> shared);
+
+  RawFrameFormat            _fmt;
+  unsigned                  _fpsNum, _fpsDen;
+  long long                 _frameCount;
+  std::shared_ptr<Shared>   _shared;    // Shared with the read thread, which may outlive us
+  unsigned long long        _frames, _waits;
+  int                       _held;      // The buffer of the frame from the last read(), or -1
+};
+
+//! Write a YUV4MPEG2 (.y4m) stream, without an encoder.
+//! Frames in any format that NvCVImage_Transfer() can convert to 8-bit I420 or I444 are accepted.
+class Y4mWriter {
+public:
+  Y4mWriter() : _fp(nullptr), _frames(0) {}
+  ~Y4mWriter() { close(); }
+
+  //! Open a stream and write its header.
+  //! \param[in]  path        the file to write, or "-" for stdout, which is detached with RawFrameWriter::DetachStdout().
+  //! \param[in]  width       the width of the frames.
+  //! \param[in]  height      the height of the frames; both should be even for 4:2:0.
+  //! \param[in]  frameRate   the frame rate; 0 is written as 30.
+  //! \param[in]  format      NVCV_YUV420 or NVCV_YUV444.
+  //! \param[in]  colorspace  the colorspace of the frames. The range and chroma siting are recorded in the header.
+  //! \return     NVCV_SUCCESS, NVCV_ERR_PIXELFORMAT, NVCV_ERR_RESOLUTION, or NVCV_ERR_WRITE if the file could not be
+  //!             created.
+  NvCV_Status open(const char *path, unsigned width, unsigned height, double frameRate,
+                   NvCVImage_PixelFormat format = NVCV_YUV420,
+                   unsigned char colorspace = NVCV_709 | NVCV_VIDEO_RANGE | NVCV_CHROMA_JPEG);
+
+  //! Query whether frames are being written.
+  bool isOpen() const { return nullptr != _fp; }
+
+  //! Write a frame, converting it if necessary.
+  //! \param[in]  src   the frame, on the CPU, of the size of the output.
+  //! \return     NVCV_SUCCESS, NVCV_ERR_MISMATCH if the size is wrong, or NVCV_ERR_WRITE.
+  NvCV_Status write(const NvCVImage *src);
+
+  //! Flush and close the stream. This is called by the destructor.
+  //! \return     NVCV_SUCCESS, or NVCV_ERR_WRITE if the buffered frames could not be written.
+  NvCV_Status close();
+
+  //! Get the number of frames written.
+  unsigned long long frames() const { return _frames; }
+
+private:
+  RawFrameFormat              _fmt;
+  FILE                        *_fp;
+  std::vector<unsigned char>  _buf;
+  NvCVImage                   _frame;   // Wraps _buf
+  unsigned long long          _frames;
+};
+
+#endif // __Y4M_IO_H__